@@ -51,6 +51,7 @@ static GDebugKey keys[] = {
   { "Smclient", NAUTILUS_DEBUG_SMCLIENT },
   { "Window", NAUTILUS_DEBUG_WINDOW },
   { "Undo", NAUTILUS_DEBUG_UNDO },
+  { "Statistics", NAUTILUS_DEBUG_STATISTICS },
   { 0, }
 };
 
@@ -80,6 +81,9 @@ nautilus_debug_set_flags (DebugFlags new_flags)
 gboolean
 nautilus_debug_flag_is_set (DebugFlags flag)
 {
+  if (G_UNLIKELY (!initialized))
+    nautilus_debug_set_flags_from_env ();
+
   return flag & flags;
 }
 
@@ -0,0 +1,763 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-deep-count-cache.c: persistent cache of directory contents
+ * for deep counts
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* A deep count that finds a directory unchanged since it was last
+ * counted takes its files from here and only has to look at its
+ * subdirectories, instead of enumerating it again.
+ *
+ * The cache file in the user's cache directory is mapped into memory.
+ * It holds the entries sorted by device, inode and flags, the hard
+ * links of all entries, and the subdirectory names. Entries added
+ * since it was written are kept in a hash table on top of it until the
+ * next write, which merges the two. Entries that were not used for a
+ * month are dropped then. Writes are done by GIO in a thread, except
+ * at quit.
+ *
+ * A file that is rewritten in place doesn't change the modification
+ * time of its directory, so its new size goes unnoticed until
+ * something else in the directory changes.
+ */
+
+#include <config.h>
+#include "nautilus-deep-count-cache.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+#define CACHE_MAGIC "NAUTDCC"
+#define CACHE_VERSION 1
+#define CACHE_BYTE_ORDER 0x01020304
+
+#define CACHE_SHOW_HIDDEN 1
+
+/* Days an entry is kept without being used. */
+#define CACHE_MAX_AGE 30
+
+/* Seconds after an insert before the cache is written. */
+#define CACHE_SAVE_DELAY 60
+
+typedef struct {
+	char magic[8];
+	guint32 version;
+	guint32 byte_order;
+	guint32 n_entries;
+	guint32 n_links;
+	guint32 strings_size;
+	guint32 padding;
+} CacheHeader;
+
+typedef struct {
+	guint64 device;
+	guint64 inode;
+	guint64 mtime;
+	guint64 size;
+	guint32 file_count;
+	guint32 flags;
+	guint32 last_used; /* days since the epoch */
+	guint32 first_link;
+	guint32 n_links;
+	guint32 subdirectories; /* offset of the first name */
+	guint32 n_subdirectories;
+	guint32 padding;
+} CacheEntry;
+
+typedef struct {
+	GMappedFile *mapped;
+	const CacheHeader *header;
+	const CacheEntry *entries;
+	const NautilusDeepCountCacheLink *links;
+	const char *strings;
+	/* One bit per entry, set when it was used. */
+	guint32 *used;
+} Cache;
+
+/* A directory is counted apart with and without hidden files. */
+typedef struct {
+	guint64 device;
+	guint64 inode;
+	guint32 flags;
+} CacheKey;
+
+typedef struct {
+	CacheKey key;
+	guint64 mtime;
+	NautilusDeepCountCacheEntry *entry;
+} AddedEntry;
+
+static char *cache_path;
+static Cache *current_cache;
+static GHashTable *added_entries;
+/* The added entries being written, or NULL. */
+static GHashTable *saving_entries;
+static gboolean dirty;
+static guint save_timeout_id;
+
+static guint cache_hits;
+static guint cache_misses;
+
+NautilusDeepCountCacheEntry *
+nautilus_deep_count_cache_entry_new (void)
+{
+	NautilusDeepCountCacheEntry *entry;
+
+	entry = g_new0 (NautilusDeepCountCacheEntry, 1);
+	entry->subdirectories = g_ptr_array_new_with_free_func (g_free);
+	entry->links = g_array_new (FALSE, FALSE, sizeof (NautilusDeepCountCacheLink));
+
+	return entry;
+}
+
+void
+nautilus_deep_count_cache_entry_free (NautilusDeepCountCacheEntry *entry)
+{
+	if (entry == NULL) {
+		return;
+	}
+
+	g_ptr_array_free (entry->subdirectories, TRUE);
+	g_array_free (entry->links, TRUE);
+	g_free (entry);
+}
+
+static guint32
+get_today (void)
+{
+	return (guint32) (g_get_real_time () / G_USEC_PER_SEC / (24 * 60 * 60));
+}
+
+static guint
+cache_key_hash (gconstpointer p)
+{
+	const CacheKey *key;
+
+	key = p;
+	return (guint) (key->inode ^ (key->inode >> 32) ^ (key->device * 31) ^
+			(key->flags << 16));
+}
+
+static gboolean
+cache_key_equal (gconstpointer a, gconstpointer b)
+{
+	const CacheKey *key_a, *key_b;
+
+	key_a = a;
+	key_b = b;
+	return key_a->inode == key_b->inode &&
+		key_a->device == key_b->device &&
+		key_a->flags == key_b->flags;
+}
+
+static void
+added_entry_free (AddedEntry *added)
+{
+	nautilus_deep_count_cache_entry_free (added->entry);
+	g_free (added);
+}
+
+static void
+cache_free (Cache *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	g_mapped_file_unref (cache->mapped);
+	g_free (cache->used);
+	g_free (cache);
+}
+
+static gboolean
+cache_is_valid (Cache *cache)
+{
+	const CacheHeader *header;
+	const CacheEntry *entry, *previous;
+	guint32 i;
+
+	header = cache->header;
+
+	if (header->n_entries > 0 &&
+	    (header->strings_size == 0 ||
+	     cache->strings[header->strings_size - 1] != '\0')) {
+		return FALSE;
+	}
+
+	previous = NULL;
+	for (i = 0; i < header->n_entries; i++) {
+		entry = &cache->entries[i];
+		if (entry->first_link > header->n_links ||
+		    entry->n_links > header->n_links - entry->first_link ||
+		    (entry->n_subdirectories > 0 &&
+		     entry->subdirectories >= header->strings_size)) {
+			return FALSE;
+		}
+		if (previous != NULL &&
+		    (previous->device > entry->device ||
+		     (previous->device == entry->device &&
+		      previous->inode >= entry->inode))) {
+			return FALSE;
+		}
+		previous = entry;
+	}
+
+	return TRUE;
+}
+
+static Cache *
+cache_load (const char *path)
+{
+	Cache *cache;
+	GMappedFile *mapped;
+	const CacheHeader *header;
+	const char *contents;
+	gsize size;
+
+	mapped = g_mapped_file_new (path, FALSE, NULL);
+	if (mapped == NULL) {
+		return NULL;
+	}
+
+	size = g_mapped_file_get_length (mapped);
+	contents = g_mapped_file_get_contents (mapped);
+	header = (const CacheHeader *) contents;
+
+	if (size < sizeof (CacheHeader) ||
+	    memcmp (header->magic, CACHE_MAGIC, sizeof (CACHE_MAGIC)) != 0 ||
+	    header->version != CACHE_VERSION ||
+	    header->byte_order != CACHE_BYTE_ORDER ||
+	    size != sizeof (CacheHeader) +
+	    (gsize) header->n_entries * sizeof (CacheEntry) +
+	    (gsize) header->n_links * sizeof (NautilusDeepCountCacheLink) +
+	    header->strings_size) {
+		g_mapped_file_unref (mapped);
+		return NULL;
+	}
+
+	cache = g_new0 (Cache, 1);
+	cache->mapped = mapped;
+	cache->header = header;
+	cache->entries = (const CacheEntry *) (contents + sizeof (CacheHeader));
+	cache->links = (const NautilusDeepCountCacheLink *) (cache->entries + header->n_entries);
+	cache->strings = (const char *) (cache->links + header->n_links);
+
+	if (!cache_is_valid (cache)) {
+		g_mapped_file_unref (mapped);
+		g_free (cache);
+		return NULL;
+	}
+
+	cache->used = g_new0 (guint32, header->n_entries / 32 + 1);
+
+	return cache;
+}
+
+static void
+ensure_loaded (void)
+{
+	if (cache_path != NULL) {
+		return;
+	}
+
+	cache_path = g_build_filename (g_get_user_cache_dir (), "nautilus", "deep-counts", NULL);
+	current_cache = cache_load (cache_path);
+	added_entries = g_hash_table_new_full (cache_key_hash, cache_key_equal,
+					       NULL, (GDestroyNotify) added_entry_free);
+}
+
+static int
+find_entry (guint64 device, guint64 inode, guint32 flags)
+{
+	const CacheEntry *entry;
+	guint32 low, high, middle;
+
+	if (current_cache == NULL) {
+		return -1;
+	}
+
+	low = 0;
+	high = current_cache->header->n_entries;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		entry = &current_cache->entries[middle];
+		if (entry->device < device ||
+		    (entry->device == device && entry->inode < inode) ||
+		    (entry->device == device && entry->inode == inode && entry->flags < flags)) {
+			low = middle + 1;
+		} else if (entry->device == device && entry->inode == inode &&
+			   entry->flags == flags) {
+			return middle;
+		} else {
+			high = middle;
+		}
+	}
+
+	return -1;
+}
+
+/* Copies a mapped entry, or returns NULL if its names run off the end
+ * of the file.
+ */
+static NautilusDeepCountCacheEntry *
+copy_cache_entry (const CacheEntry *cache_entry)
+{
+	NautilusDeepCountCacheEntry *entry;
+	guint32 offset, i;
+
+	entry = nautilus_deep_count_cache_entry_new ();
+	entry->file_count = cache_entry->file_count;
+	entry->size = cache_entry->size;
+	g_array_append_vals (entry->links,
+			     current_cache->links + cache_entry->first_link,
+			     cache_entry->n_links);
+
+	offset = cache_entry->subdirectories;
+	for (i = 0; i < cache_entry->n_subdirectories; i++) {
+		if (offset >= current_cache->header->strings_size) {
+			nautilus_deep_count_cache_entry_free (entry);
+			return NULL;
+		}
+		g_ptr_array_add (entry->subdirectories, g_strdup (current_cache->strings + offset));
+		offset += strlen (current_cache->strings + offset) + 1;
+	}
+
+	return entry;
+}
+
+static NautilusDeepCountCacheEntry *
+copy_entry (const NautilusDeepCountCacheEntry *source)
+{
+	NautilusDeepCountCacheEntry *entry;
+	guint i;
+
+	entry = nautilus_deep_count_cache_entry_new ();
+	entry->file_count = source->file_count;
+	entry->size = source->size;
+	g_array_append_vals (entry->links, source->links->data, source->links->len);
+	for (i = 0; i < source->subdirectories->len; i++) {
+		g_ptr_array_add (entry->subdirectories,
+				 g_strdup (g_ptr_array_index (source->subdirectories, i)));
+	}
+
+	return entry;
+}
+
+NautilusDeepCountCacheEntry *
+nautilus_deep_count_cache_lookup (guint64 device,
+				  guint64 inode,
+				  guint64 mtime,
+				  gboolean show_hidden)
+{
+	NautilusDeepCountCacheEntry *entry;
+	const CacheEntry *cache_entry;
+	AddedEntry *added;
+	CacheKey key;
+	guint32 flags;
+	int i;
+
+	ensure_loaded ();
+
+	flags = show_hidden ? CACHE_SHOW_HIDDEN : 0;
+	entry = NULL;
+
+	key.device = device;
+	key.inode = inode;
+	key.flags = flags;
+	added = g_hash_table_lookup (added_entries, &key);
+	if (added == NULL && saving_entries != NULL) {
+		added = g_hash_table_lookup (saving_entries, &key);
+	}
+	if (added != NULL) {
+		/* This replaces what's in the file. */
+		if (added->mtime == mtime) {
+			entry = copy_entry (added->entry);
+		}
+	} else {
+		i = find_entry (device, inode, flags);
+		if (i >= 0) {
+			cache_entry = &current_cache->entries[i];
+			if (cache_entry->mtime == mtime) {
+				entry = copy_cache_entry (cache_entry);
+			}
+			if (entry != NULL && !(current_cache->used[i / 32] & (1U << (i % 32)))) {
+				current_cache->used[i / 32] |= 1U << (i % 32);
+				if (cache_entry->last_used != get_today ()) {
+					dirty = TRUE;
+				}
+			}
+		}
+	}
+
+	if (entry != NULL) {
+		cache_hits++;
+	} else {
+		cache_misses++;
+	}
+
+	return entry;
+}
+
+static void save_async (void);
+
+static gboolean
+save_timeout_callback (gpointer data)
+{
+	save_timeout_id = 0;
+	save_async ();
+
+	return FALSE;
+}
+
+static void
+schedule_save (void)
+{
+	if (save_timeout_id == 0) {
+		save_timeout_id = g_timeout_add_seconds (CACHE_SAVE_DELAY,
+							 save_timeout_callback, NULL);
+	}
+}
+
+void
+nautilus_deep_count_cache_insert (guint64 device,
+				  guint64 inode,
+				  guint64 mtime,
+				  gboolean show_hidden,
+				  NautilusDeepCountCacheEntry *entry)
+{
+	AddedEntry *added;
+
+	ensure_loaded ();
+
+	added = g_new0 (AddedEntry, 1);
+	added->key.device = device;
+	added->key.inode = inode;
+	added->key.flags = show_hidden ? CACHE_SHOW_HIDDEN : 0;
+	added->mtime = mtime;
+	added->entry = entry;
+	g_hash_table_replace (added_entries, &added->key, added);
+
+	dirty = TRUE;
+	schedule_save ();
+}
+
+/* Writing */
+
+typedef struct {
+	GArray *entries;
+	GArray *links;
+	GString *strings;
+} CacheWriter;
+
+static void
+writer_add (CacheWriter *writer,
+	    CacheEntry *cache_entry,
+	    const NautilusDeepCountCacheLink *links,
+	    const char * const *subdirectories)
+{
+	guint32 i;
+
+	cache_entry->first_link = writer->links->len;
+	g_array_append_vals (writer->links, links, cache_entry->n_links);
+
+	cache_entry->subdirectories = writer->strings->len;
+	for (i = 0; i < cache_entry->n_subdirectories; i++) {
+		g_string_append_len (writer->strings, subdirectories[i],
+				     strlen (subdirectories[i]) + 1);
+	}
+
+	g_array_append_vals (writer->entries, cache_entry, 1);
+}
+
+static void
+writer_add_cache_entries (CacheWriter *writer, guint32 today)
+{
+	const CacheEntry *source;
+	CacheEntry cache_entry;
+	CacheKey key;
+	const char **subdirectories;
+	const char *name;
+	guint32 i, j;
+
+	if (current_cache == NULL) {
+		return;
+	}
+
+	for (i = 0; i < current_cache->header->n_entries; i++) {
+		source = &current_cache->entries[i];
+
+		key.device = source->device;
+		key.inode = source->inode;
+		key.flags = source->flags;
+		if (g_hash_table_lookup (added_entries, &key) != NULL ||
+		    (saving_entries != NULL &&
+		     g_hash_table_lookup (saving_entries, &key) != NULL)) {
+			continue;
+		}
+
+		cache_entry = *source;
+		if (current_cache->used[i / 32] & (1U << (i % 32))) {
+			cache_entry.last_used = today;
+		} else if (today - cache_entry.last_used > CACHE_MAX_AGE) {
+			continue;
+		}
+
+		subdirectories = g_new (const char *, source->n_subdirectories);
+		name = current_cache->strings + source->subdirectories;
+		for (j = 0; j < source->n_subdirectories; j++) {
+			if (name >= current_cache->strings + current_cache->header->strings_size) {
+				break;
+			}
+			subdirectories[j] = name;
+			name += strlen (name) + 1;
+		}
+		if (j == source->n_subdirectories) {
+			writer_add (writer, &cache_entry,
+				    current_cache->links + source->first_link,
+				    subdirectories);
+		}
+		g_free (subdirectories);
+	}
+}
+
+/* Adds the entries of table that aren't replaced by those of newer. */
+static void
+writer_add_added_entries (CacheWriter *writer,
+			  GHashTable *table,
+			  GHashTable *newer,
+			  guint32 today)
+{
+	GHashTableIter iter;
+	AddedEntry *added;
+	CacheEntry cache_entry;
+
+	if (table == NULL) {
+		return;
+	}
+
+	g_hash_table_iter_init (&iter, table);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &added)) {
+		if (newer != NULL &&
+		    g_hash_table_lookup (newer, &added->key) != NULL) {
+			continue;
+		}
+
+		memset (&cache_entry, 0, sizeof (cache_entry));
+		cache_entry.device = added->key.device;
+		cache_entry.inode = added->key.inode;
+		cache_entry.mtime = added->mtime;
+		cache_entry.size = added->entry->size;
+		cache_entry.file_count = added->entry->file_count;
+		cache_entry.flags = added->key.flags;
+		cache_entry.last_used = today;
+		cache_entry.n_links = added->entry->links->len;
+		cache_entry.n_subdirectories = added->entry->subdirectories->len;
+
+		writer_add (writer, &cache_entry,
+			    (const NautilusDeepCountCacheLink *) added->entry->links->data,
+			    (const char * const *) added->entry->subdirectories->pdata);
+	}
+}
+
+static int
+cache_entry_compare (gconstpointer a, gconstpointer b)
+{
+	const CacheEntry *entry_a, *entry_b;
+
+	entry_a = a;
+	entry_b = b;
+
+	if (entry_a->device != entry_b->device) {
+		return entry_a->device < entry_b->device ? -1 : 1;
+	}
+	if (entry_a->inode != entry_b->inode) {
+		return entry_a->inode < entry_b->inode ? -1 : 1;
+	}
+	if (entry_a->flags != entry_b->flags) {
+		return entry_a->flags < entry_b->flags ? -1 : 1;
+	}
+	return 0;
+}
+
+/* Returns the contents of the cache file with the entries added so
+ * far, for the path it goes to.
+ */
+static char *
+serialize (gsize *size)
+{
+	CacheWriter writer;
+	CacheHeader header;
+	char *buffer, *p, *dirname;
+	guint32 today;
+
+	today = get_today ();
+	writer.entries = g_array_new (FALSE, FALSE, sizeof (CacheEntry));
+	writer.links = g_array_new (FALSE, FALSE, sizeof (NautilusDeepCountCacheLink));
+	writer.strings = g_string_new (NULL);
+
+	writer_add_cache_entries (&writer, today);
+	writer_add_added_entries (&writer, saving_entries, added_entries, today);
+	writer_add_added_entries (&writer, added_entries, NULL, today);
+	g_array_sort (writer.entries, cache_entry_compare);
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, CACHE_MAGIC, sizeof (CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.byte_order = CACHE_BYTE_ORDER;
+	header.n_entries = writer.entries->len;
+	header.n_links = writer.links->len;
+	header.strings_size = writer.strings->len;
+
+	*size = sizeof (CacheHeader) +
+		writer.entries->len * sizeof (CacheEntry) +
+		writer.links->len * sizeof (NautilusDeepCountCacheLink) +
+		writer.strings->len;
+	buffer = p = g_malloc (*size);
+
+	memcpy (p, &header, sizeof (CacheHeader));
+	p += sizeof (CacheHeader);
+	memcpy (p, writer.entries->data, writer.entries->len * sizeof (CacheEntry));
+	p += writer.entries->len * sizeof (CacheEntry);
+	memcpy (p, writer.links->data, writer.links->len * sizeof (NautilusDeepCountCacheLink));
+	p += writer.links->len * sizeof (NautilusDeepCountCacheLink);
+	memcpy (p, writer.strings->str, writer.strings->len);
+
+	g_array_free (writer.entries, TRUE);
+	g_array_free (writer.links, TRUE);
+	g_string_free (writer.strings, TRUE);
+
+	dirname = g_path_get_dirname (cache_path);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	return buffer;
+}
+
+static void
+save_async_callback (GObject *source_object,
+		     GAsyncResult *res,
+		     gpointer user_data)
+{
+	GHashTableIter iter;
+	AddedEntry *added;
+	gboolean written;
+
+	written = g_file_replace_contents_finish (G_FILE (source_object), res, NULL, NULL);
+	g_free (user_data);
+
+	if (written) {
+		cache_free (current_cache);
+		current_cache = cache_load (cache_path);
+		g_hash_table_destroy (saving_entries);
+	} else {
+		/* Keep them for the next try, unless they were replaced
+		 * in the meantime.
+		 */
+		g_hash_table_iter_init (&iter, saving_entries);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &added)) {
+			g_hash_table_iter_steal (&iter);
+			if (g_hash_table_lookup (added_entries, &added->key) == NULL) {
+				g_hash_table_insert (added_entries, &added->key, added);
+			} else {
+				added_entry_free (added);
+			}
+		}
+		g_hash_table_destroy (saving_entries);
+		dirty = TRUE;
+	}
+	saving_entries = NULL;
+
+	if (dirty) {
+		schedule_save ();
+	}
+}
+
+static void
+save_async (void)
+{
+	GFile *file;
+	char *buffer;
+	gsize size;
+
+	/* Try again when the write in progress is done. */
+	if (!dirty || saving_entries != NULL) {
+		return;
+	}
+
+	buffer = serialize (&size);
+
+	saving_entries = added_entries;
+	added_entries = g_hash_table_new_full (cache_key_hash, cache_key_equal,
+					       NULL, (GDestroyNotify) added_entry_free);
+	dirty = FALSE;
+
+	file = g_file_new_for_path (cache_path);
+	g_file_replace_contents_async (file, buffer, size, NULL, FALSE,
+				       G_FILE_CREATE_NONE, NULL,
+				       save_async_callback, buffer);
+	g_object_unref (file);
+}
+
+void
+nautilus_deep_count_cache_save (void)
+{
+	char *buffer;
+	gsize size;
+	gboolean written;
+
+	/* Let a write in progress finish first, so that it can't
+	 * replace this one.
+	 */
+	while (saving_entries != NULL) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	if (save_timeout_id != 0) {
+		g_source_remove (save_timeout_id);
+		save_timeout_id = 0;
+	}
+
+	if (!dirty) {
+		return;
+	}
+
+	buffer = serialize (&size);
+	written = g_file_set_contents (cache_path, buffer, size, NULL);
+	g_free (buffer);
+
+	/* If writing failed, keep what's in memory and try again later. */
+	if (written) {
+		cache_free (current_cache);
+		current_cache = cache_load (cache_path);
+		g_hash_table_remove_all (added_entries);
+		dirty = FALSE;
+	}
+}
+
+void
+nautilus_deep_count_cache_get_statistics (guint *hits,
+					  guint *misses)
+{
+	if (hits != NULL) {
+		*hits = cache_hits;
+	}
+	if (misses != NULL) {
+		*misses = cache_misses;
+	}
+}
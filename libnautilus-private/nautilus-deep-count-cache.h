@@ -0,0 +1,71 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-deep-count-cache.h: persistent cache of directory contents
+ * for deep counts
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef NAUTILUS_DEEP_COUNT_CACHE_H
+#define NAUTILUS_DEEP_COUNT_CACHE_H
+
+#include <glib.h>
+
+typedef struct {
+	guint64 device;
+	guint64 inode;
+	guint64 size;
+} NautilusDeepCountCacheLink;
+
+/* What a deep count found in one directory, not counting what is in
+ * its subdirectories.
+ */
+typedef struct {
+	guint file_count;
+	/* Size of the children, except for the hard linked files. */
+	guint64 size;
+	/* Names of the subdirectories. */
+	GPtrArray *subdirectories;
+	/* Children with more than one link, NautilusDeepCountCacheLink. */
+	GArray *links;
+} NautilusDeepCountCacheEntry;
+
+NautilusDeepCountCacheEntry *nautilus_deep_count_cache_entry_new     (void);
+void                         nautilus_deep_count_cache_entry_free    (NautilusDeepCountCacheEntry *entry);
+
+/* Entries are keyed by the device and inode of the directory and only
+ * returned if its modification time, in microseconds, is unchanged.
+ * Counts with and without hidden files are kept apart.
+ */
+NautilusDeepCountCacheEntry *nautilus_deep_count_cache_lookup        (guint64                      device,
+								      guint64                      inode,
+								      guint64                      mtime,
+								      gboolean                     show_hidden);
+/* Takes over the entry. */
+void                         nautilus_deep_count_cache_insert        (guint64                      device,
+								      guint64                      inode,
+								      guint64                      mtime,
+								      gboolean                     show_hidden,
+								      NautilusDeepCountCacheEntry *entry);
+/* Writes new entries to disk before returning. This also happens on
+ * its own, in the background, a while after an insert.
+ */
+void                         nautilus_deep_count_cache_save          (void);
+void                         nautilus_deep_count_cache_get_statistics (guint                       *hits,
+								       guint                       *misses);
+
+#endif /* NAUTILUS_DEEP_COUNT_CACHE_H */
@@ -383,7 +383,7 @@ desktop_directory_file_get_item_count (NautilusFile *file,
 							    count_unreadable);
 
 	if (count) {
-		*count += g_list_length (file->details->directory->details->file_list);
+		*count += file->details->directory->details->files->len;
 	}
 	
 	return got_count;
@@ -409,7 +409,7 @@ desktop_directory_file_get_deep_counts (NautilusFile *file,
 						TRUE);
 
 	if (file_count) {
-		*file_count += g_list_length (file->details->directory->details->file_list);
+		*file_count += file->details->directory->details->files->len;
 	}
 	
 	return status;
@@ -198,8 +198,7 @@ desktop_call_when_ready (NautilusDirectory *directory,
 			(merged_callback->non_ready_directories, desktop->details->real_directory);
 
 
-	merged_callback->merged_file_list = g_list_concat (NULL,
-							   nautilus_file_list_copy (directory->details->file_list));
+	merged_callback->merged_file_list = nautilus_directory_copy_files_internal (directory);
 
 	/* Put it in the hash table. */
 	g_hash_table_insert (desktop->details->callbacks,
@@ -321,7 +320,7 @@ desktop_monitor_add (NautilusDirectory *directory,
 	
 	/* Handle the desktop part */
 	merged_callback_list = g_list_concat (merged_callback_list,
-					      nautilus_file_list_copy (directory->details->file_list));
+					      nautilus_directory_copy_files_internal (directory));
 
 	
 	if (callback != NULL) {
@@ -385,7 +384,7 @@ desktop_is_not_empty (NautilusDirectory *directory)
 		return TRUE;
 	}
 
-	return directory->details->file_list != NULL;
+	return directory->details->files->len > 0;
 }
 
 static GList *
@@ -24,6 +24,7 @@
 
 #include <config.h>
 
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-directory-notify.h"
 #include "nautilus-directory-private.h"
 #include "nautilus-file-attributes.h"
@@ -31,12 +32,16 @@
 #include "nautilus-file-utilities.h"
 #include "nautilus-signaller.h"
 #include "nautilus-global-preferences.h"
+#include "nautilus-inode-set.h"
 #include "nautilus-link.h"
+#include "nautilus-thumbnails.h"
+#include <eel/eel-debug.h>
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
 #include <libxml/parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* turn this on to see messages about each load_directory call: */
 #if 0
@@ -55,8 +60,55 @@
 
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
 
-/* Keep async. jobs down to this number for all directories. */
-#define MAX_ASYNC_JOBS 10
+/* The I/O thread of a directory load stops to wait for the main loop
+ * when it is this many files ahead of it. The main loop takes at most
+ * DIRECTORY_LOAD_ITEMS_PER_DISPATCH of them at a time.
+ */
+#define DIRECTORY_LOAD_MAX_LOADED_FILES 2000
+#define DIRECTORY_LOAD_ITEMS_PER_DISPATCH 500
+
+/* Keep async. jobs down to these numbers per backend. The limit of
+ * each backend starts out at LOCAL_ASYNC_JOBS or REMOTE_ASYNC_JOBS and
+ * moves between MIN_ASYNC_JOBS and the maximum depending on how long
+ * jobs take to complete.
+ */
+#define MIN_ASYNC_JOBS 2
+#define LOCAL_ASYNC_JOBS 10
+#define LOCAL_MAX_ASYNC_JOBS 32
+#define REMOTE_ASYNC_JOBS 4
+#define REMOTE_MAX_ASYNC_JOBS 10
+
+/* Job latencies in ms below and above which a backend is considered
+ * fast or slow.
+ */
+#define ASYNC_JOB_FAST_LATENCY 50
+#define ASYNC_JOB_SLOW_LATENCY 1000
+
+/* Largest number of files for which one attribute is fetched at once,
+ * as parallel requests that together count as a single async. job.
+ */
+#define ATTRIBUTE_BATCH_SIZE 32
+
+/* Number of directories a deep count enumerates at once. Remote
+ * backends get more, to hide the round trips.
+ */
+#define LOCAL_DEEP_COUNT_ENUMERATIONS 4
+#define REMOTE_DEEP_COUNT_ENUMERATIONS 16
+
+/* Interval in ms at which clients hear about a deep count in progress. */
+#define DEEP_COUNT_UPDATE_INTERVAL 200
+
+#define DEEP_COUNT_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN "," \
+	G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+	G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," \
+	G_FILE_ATTRIBUTE_UNIX_DEVICE "," \
+	G_FILE_ATTRIBUTE_UNIX_INODE "," \
+	G_FILE_ATTRIBUTE_UNIX_NLINK
 
 struct TopLeftTextReadState {
 	NautilusDirectory *directory;
@@ -65,12 +117,6 @@ struct TopLeftTextReadState {
 	GCancellable *cancellable;
 };
 
-struct LinkInfoReadState {
-	NautilusDirectory *directory;
-	GCancellable *cancellable;
-	NautilusFile *file;
-};
-
 struct ThumbnailState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
@@ -79,27 +125,38 @@ struct ThumbnailState {
 	gboolean tried_original;
 };
 
-struct MountState {
-	NautilusDirectory *directory;
-	GCancellable *cancellable;
-	NautilusFile *file;
-};
-
-struct FilesystemInfoState {
-	NautilusDirectory *directory;
-	GCancellable *cancellable;
-	NautilusFile *file;
-};
-
+/* The directory is enumerated in an I/O thread, which hands over
+ * the files in batches to be added from the main loop.
+ */
 struct DirectoryLoadState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
-	GFileEnumerator *enumerator;
-	GHashTable *load_mime_list_hash;
 	NautilusFile *load_directory_file;
+
+	/* Only used by the I/O thread until it is finished. */
+	GFile *location;
+	gboolean show_hidden_files;
+	GHashTable *hidden_file_hash;
+	GHashTable *load_mime_list_hash;
 	int load_file_count;
+
+	/* Protected by lock. */
+	GMutex lock;
+	GCond loaded_files_taken;
+	GQueue loaded_files; /* of PendingFileInfo * */
+	gboolean dispatch_scheduled;
+	gboolean finished;
+	GError *error;
 };
 
+/* A GFileInfo waiting to be added to the directory, along with what
+ * could be worked out for it before getting to the main loop.
+ */
+typedef struct {
+	GFileInfo *info;
+	char *collation_key; /* Of the display name in info, or NULL. */
+} PendingFileInfo;
+
 struct MimeListState {
 	NautilusDirectory *directory;
 	NautilusFile *mime_list_file;
@@ -108,11 +165,6 @@ struct MimeListState {
 	GHashTable *mime_list_hash;
 };
 
-struct GetInfoState {
-	NautilusDirectory *directory;
-	GCancellable *cancellable;
-};
-
 struct NewFilesState {
 	NautilusDirectory *directory;
 	GCancellable *cancellable;
@@ -127,13 +179,95 @@ struct DirectoryCountState {
 	int file_count;
 };
 
+/* A deep count enumerates up to max_enumerations subdirectories at
+ * once, which together count as a single async. job. The state is
+ * freed once the last of them has returned.
+ */
 struct DeepCountState {
-	NautilusDirectory *directory;
+	NautilusDirectory *directory; /* NULL if cancelled. */
 	GCancellable *cancellable;
+	gboolean show_hidden_files;
+	/* Subdirectories still to count, DeepCountEnumeration. */
+	GQueue deep_count_subdirectories;
+	guint n_enumerations;
+	guint max_enumerations;
+	guint last_update_time;
+	NautilusInodeSet *seen_deep_count_inodes;
+};
+
+typedef struct {
+	DeepCountState *state;
+	GFile *location;
+	/* Info of the directory itself, NULL until queried. */
+	GFileInfo *info;
 	GFileEnumerator *enumerator;
-	GFile *deep_count_location;
-	GList *deep_count_subdirectories;
-	GArray *seen_deep_count_inodes;
+	/* What is found, for the deep count cache. NULL if the
+	 * directory can't be cached.
+	 */
+	NautilusDeepCountCacheEntry *cache_entry;
+} DeepCountEnumeration;
+
+/* The kinds of async. jobs. */
+typedef enum {
+	ASYNC_JOB_FILE_LIST,
+	ASYNC_JOB_DIRECTORY_COUNT,
+	ASYNC_JOB_DEEP_COUNT,
+	ASYNC_JOB_MIME_LIST,
+	ASYNC_JOB_TOP_LEFT,
+	ASYNC_JOB_THUMBNAIL,
+	ASYNC_JOB_EXTENSION_INFO,
+	ASYNC_JOB_FILE_INFO,
+	ASYNC_JOB_LINK_INFO,
+	ASYNC_JOB_MOUNT,
+	ASYNC_JOB_FILESYSTEM_INFO,
+	ASYNC_JOB_N
+} AsyncJob;
+
+typedef struct {
+	const char *name;
+	/* Enumerations last as long as the directory is big, so their
+	 * duration says nothing about how responsive the backend is.
+	 */
+	gboolean measures_latency;
+} AsyncJobInfo;
+
+static const AsyncJobInfo async_job_info[ASYNC_JOB_N] = {
+	{ "file list", FALSE },
+	{ "directory count", FALSE },
+	{ "deep count", FALSE },
+	{ "MIME list", FALSE },
+	{ "top left", TRUE },
+	{ "thumbnail", TRUE },
+	{ "extension info", FALSE },
+	{ "file info", TRUE },
+	{ "link info", TRUE },
+	{ "mount", TRUE },
+	{ "filesystem info", TRUE },
+};
+
+/* Async. jobs are accounted per backend: every filesystem (or, for
+ * non-native locations, every scheme and host) gets its own pool with
+ * its own job limit, so a slow mount can't use up the job slots of the
+ * local disks. The limit of each pool adapts to the latency of the
+ * jobs it runs.
+ */
+struct AsyncJobPool {
+	char *backend;
+	gboolean keyed_by_filesystem;
+
+	int job_count;
+	int job_limit;
+	int job_limit_max;
+
+	/* Exponentially weighted average of job latency in ms. */
+	guint average_latency;
+	guint64 jobs_started;
+
+	/* Directories waiting for a job slot. Directories whose file
+	 * list is being shown are woken up first, in FIFO order.
+	 */
+	GQueue waiting_visible;
+	GQueue waiting_background;
 };
 
 
@@ -170,9 +304,44 @@ typedef struct {
 typedef gboolean (* RequestCheck) (Request);
 typedef gboolean (* FileCheck) (NautilusFile *);
 
-/* Current number of async. jobs. */
-static int async_job_count;
-static GHashTable *waiting_directories;
+typedef struct AttributeBatchItem AttributeBatchItem;
+
+/* What differs between the attributes that are fetched in batches. */
+typedef struct {
+	AsyncJob job;
+	RequestType request_type;
+	FileCheck lacks;
+	/* Where the AttributeBatch in progress is kept. */
+	glong details_offset;
+	/* Starts the I/O for one file, which must end with a call to
+	 * attribute_batch_item_done, possibly before this returns.
+	 */
+	void (* start_item) (AttributeBatchItem *item);
+} AttributeBatchClass;
+
+struct AttributeBatchItem {
+	AttributeBatch *batch;
+	NautilusFile *file; /* NULL if cancelled for this file. */
+};
+
+/* One attribute being fetched for up to ATTRIBUTE_BATCH_SIZE files
+ * at once. Each file is ref'd and kept off the work queue until the
+ * whole batch is done.
+ */
+struct AttributeBatch {
+	const AttributeBatchClass *klass;
+	NautilusDirectory *directory; /* NULL if cancelled. */
+	GCancellable *cancellable;
+	guint n_items;
+	guint n_pending;
+	AttributeBatchItem items[ATTRIBUTE_BATCH_SIZE];
+};
+
+#define ATTRIBUTE_BATCH_SLOT(directory, klass) \
+	G_STRUCT_MEMBER (AttributeBatch *, (directory)->details, (klass)->details_offset)
+
+/* All job pools, see struct AsyncJobPool. */
+static GList *job_pools;
 #ifdef DEBUG_ASYNC_JOBS
 static GHashTable *async_jobs;
 #endif
@@ -181,8 +350,11 @@ static GHashTable *async_jobs;
 static char *kde_trash_dir_name = NULL;
 
 /* Forward declarations for functions that need them. */
-static void     deep_count_load                               (DeepCountState         *state,
-							       GFile                  *location);
+static void     deep_count_load                               (DeepCountEnumeration   *enumeration);
+static void     deep_count_more_files_callback                (GObject                *source_object,
+							       GAsyncResult           *res,
+							       gpointer                user_data);
+static void     deep_count_enumeration_done                   (DeepCountEnumeration   *enumeration);
 static gboolean request_is_satisfied                          (NautilusDirectory      *directory,
 							       NautilusFile           *file,
 							       Request                 request);
@@ -342,34 +514,234 @@ nautilus_directory_verify_request_counts (NautilusDirectory *directory)
 }
 #endif
 
+static void
+async_job_pool_remove_waiting (NautilusDirectory *directory)
+{
+	AsyncJobPool *pool;
+
+	pool = directory->details->waiting_job_pool;
+	if (pool == NULL) {
+		return;
+	}
+
+	if (!g_queue_remove (&pool->waiting_visible, directory)) {
+		g_queue_remove (&pool->waiting_background, directory);
+	}
+	directory->details->waiting_job_pool = NULL;
+}
+
+static void
+async_job_pool_add_waiting (AsyncJobPool *pool,
+			    NautilusDirectory *directory)
+{
+	if (directory->details->waiting_job_pool == pool) {
+		return;
+	}
+	async_job_pool_remove_waiting (directory);
+
+	if (nautilus_directory_is_anyone_monitoring_file_list (directory)) {
+		g_queue_push_tail (&pool->waiting_visible, directory);
+	} else {
+		g_queue_push_tail (&pool->waiting_background, directory);
+	}
+	directory->details->waiting_job_pool = pool;
+}
+
+static NautilusDirectory *
+async_job_pool_pop_waiting (AsyncJobPool *pool)
+{
+	NautilusDirectory *directory;
+
+	directory = g_queue_pop_head (&pool->waiting_visible);
+	if (directory == NULL) {
+		directory = g_queue_pop_head (&pool->waiting_background);
+	}
+	if (directory != NULL) {
+		directory->details->waiting_job_pool = NULL;
+	}
+
+	return directory;
+}
+
+static void
+free_job_pools (void)
+{
+	AsyncJobPool *pool;
+	GList *node;
+
+	for (node = job_pools; node != NULL; node = node->next) {
+		pool = node->data;
+		while (async_job_pool_pop_waiting (pool) != NULL) {
+		}
+		g_free (pool->backend);
+		g_free (pool);
+	}
+	g_list_free (job_pools);
+	job_pools = NULL;
+}
+
+void
+nautilus_directory_foreach_job_pool (NautilusDirectoryJobPoolFunc callback,
+				     gpointer callback_data)
+{
+	AsyncJobPool *pool;
+	GList *node;
+
+	for (node = job_pools; node != NULL; node = node->next) {
+		pool = node->data;
+		(* callback) (pool->backend,
+			      pool->job_count,
+			      pool->job_limit,
+			      pool->waiting_visible.length + pool->waiting_background.length,
+			      pool->average_latency,
+			      pool->jobs_started,
+			      callback_data);
+	}
+}
+
+/* Returns the filesystem id of the directory if it is known, otherwise
+ * the scheme and host part of its uri.
+ */
+static char *
+get_job_pool_backend (NautilusDirectory *directory,
+		      gboolean *keyed_by_filesystem)
+{
+	NautilusFile *file;
+	char *backend, *p;
+
+	backend = NULL;
+	*keyed_by_filesystem = FALSE;
+
+	file = nautilus_directory_get_existing_corresponding_file (directory);
+	if (file != NULL) {
+		if (file->details->filesystem_id != NULL) {
+			backend = g_strdup (eel_ref_str_peek (file->details->filesystem_id));
+			*keyed_by_filesystem = TRUE;
+		}
+		nautilus_file_unref (file);
+	}
+
+	if (backend == NULL) {
+		backend = g_file_get_uri (directory->details->location);
+		p = strstr (backend, "://");
+		if (p != NULL) {
+			p = strchr (p + 3, '/');
+			if (p != NULL) {
+				*p = '\0';
+			}
+		}
+	}
+
+	return backend;
+}
+
+static AsyncJobPool *
+async_job_pool_get (NautilusDirectory *directory)
+{
+	AsyncJobPool *pool;
+	GList *node;
+	char *backend;
+	gboolean keyed_by_filesystem;
+
+	/* Keep all running jobs of a directory in the same pool, and
+	 * only look again when we may learn the filesystem id.
+	 */
+	pool = directory->details->job_pool;
+	if (pool != NULL &&
+	    (pool->keyed_by_filesystem || directory->details->job_count > 0)) {
+		return pool;
+	}
+
+	backend = get_job_pool_backend (directory, &keyed_by_filesystem);
+
+	pool = NULL;
+	for (node = job_pools; node != NULL; node = node->next) {
+		if (strcmp (((AsyncJobPool *) node->data)->backend, backend) == 0) {
+			pool = node->data;
+			break;
+		}
+	}
+
+	if (pool == NULL) {
+		pool = g_new0 (AsyncJobPool, 1);
+		pool->backend = backend;
+		pool->keyed_by_filesystem = keyed_by_filesystem;
+		if (g_file_is_native (directory->details->location)) {
+			pool->job_limit = LOCAL_ASYNC_JOBS;
+			pool->job_limit_max = LOCAL_MAX_ASYNC_JOBS;
+		} else {
+			pool->job_limit = REMOTE_ASYNC_JOBS;
+			pool->job_limit_max = REMOTE_MAX_ASYNC_JOBS;
+		}
+		if (job_pools == NULL) {
+			eel_debug_call_at_shutdown (free_job_pools);
+		}
+		job_pools = g_list_prepend (job_pools, pool);
+	} else {
+		g_free (backend);
+	}
+
+	directory->details->job_pool = pool;
+
+	return pool;
+}
+
+static guint
+get_job_time (void)
+{
+	return (guint) (g_get_monotonic_time () / 1000);
+}
+
+static void
+async_job_pool_update_limit (AsyncJobPool *pool,
+			     guint latency)
+{
+	latency = MIN (latency, 10 * ASYNC_JOB_SLOW_LATENCY);
+	pool->average_latency = (pool->average_latency * 7 + latency) / 8;
+
+	if (pool->average_latency > ASYNC_JOB_SLOW_LATENCY) {
+		if (pool->job_limit > MIN_ASYNC_JOBS) {
+			pool->job_limit -= 1;
+		}
+	} else if (pool->average_latency < ASYNC_JOB_FAST_LATENCY) {
+		if (pool->job_limit < pool->job_limit_max &&
+		    pool->job_count + 1 >= pool->job_limit &&
+		    (pool->waiting_visible.length > 0 ||
+		     pool->waiting_background.length > 0)) {
+			pool->job_limit += 1;
+		}
+	}
+
+#ifdef DEBUG_ASYNC_JOBS
+	g_message ("job pool %s: %d of %d jobs, %u ms average latency",
+		   pool->backend, pool->job_count, pool->job_limit,
+		   pool->average_latency);
+#endif
+}
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
  * number of requests is unbounded.
  */
 static gboolean
 async_job_start (NautilusDirectory *directory,
-		 const char *job)
+		 AsyncJob job)
 {
+	AsyncJobPool *pool;
 #ifdef DEBUG_ASYNC_JOBS
 	char *key;
 #endif
 
 #ifdef DEBUG_START_STOP
-	g_message ("starting %s in %p", job, directory->details->location);
+	g_message ("starting %s in %p", async_job_info[job].name, directory->details->location);
 #endif
 
-	g_assert (async_job_count >= 0);
-	g_assert (async_job_count <= MAX_ASYNC_JOBS);
+	pool = async_job_pool_get (directory);
 
-	if (async_job_count >= MAX_ASYNC_JOBS) {
-		if (waiting_directories == NULL) {
-			waiting_directories = g_hash_table_new (NULL, NULL);
-		}
+	g_assert (pool->job_count >= 0);
 
-		g_hash_table_insert (waiting_directories,
-				     directory,
-				     directory);
-		
+	if (pool->job_count >= pool->job_limit) {
+		async_job_pool_add_waiting (pool, directory);
 		return FALSE;
 	}
 
@@ -380,45 +752,63 @@ async_job_start (NautilusDirectory *directory,
 			async_jobs = g_hash_table_new (g_str_hash, g_str_equal);
 		}
 		uri = nautilus_directory_get_uri (directory);
-		key = g_strconcat (uri, ": ", job, NULL);
+		key = g_strconcat (uri, ": ", async_job_info[job].name, NULL);
 		if (g_hash_table_lookup (async_jobs, key) != NULL) {
 			g_warning ("same job twice: %s in %s",
-				   job, uri);
+				   async_job_info[job].name, uri);
 		}
 		g_free (uri);
 		g_hash_table_insert (async_jobs, key, directory);
 	}
 #endif	
 
-	async_job_count += 1;
+	if (async_job_info[job].measures_latency) {
+		if (directory->details->job_start_times == NULL) {
+			directory->details->job_start_times =
+				g_hash_table_new (g_direct_hash, g_direct_equal);
+		}
+		g_hash_table_insert (directory->details->job_start_times,
+				     GINT_TO_POINTER (job),
+				     GUINT_TO_POINTER (get_job_time ()));
+	}
+
+	pool->job_count += 1;
+	pool->jobs_started += 1;
+	directory->details->job_count += 1;
 	return TRUE;
 }
 
 /* End a job. */
 static void
 async_job_end (NautilusDirectory *directory,
-	       const char *job)
+	       AsyncJob job)
 {
+	AsyncJobPool *pool;
+	gpointer start_time;
 #ifdef DEBUG_ASYNC_JOBS
 	char *key;
 	gpointer table_key, value;
 #endif
 
 #ifdef DEBUG_START_STOP
-	g_message ("stopping %s in %p", job, directory->details->location);
+	g_message ("stopping %s in %p", async_job_info[job].name, directory->details->location);
 #endif
 
-	g_assert (async_job_count > 0);
+	pool = directory->details->job_pool;
+
+	g_assert (pool != NULL);
+	g_assert (pool->job_count > 0);
+	g_assert (directory->details->job_count > 0);
 
 #ifdef DEBUG_ASYNC_JOBS
 	{
 		char *uri;
 		uri = nautilus_directory_get_uri (directory);
 		g_assert (async_jobs != NULL);
-		key = g_strconcat (uri, ": ", job, NULL);
+		key = g_strconcat (uri, ": ", async_job_info[job].name, NULL);
 		if (!g_hash_table_lookup_extended (async_jobs, key, &table_key, &value)) {
 			g_warning ("ending job we didn't start: %s in %s",
-				   job, uri);
+				   async_job_info[job].name, uri);
 		} else {
 			g_hash_table_remove (async_jobs, key);
 			g_free (table_key);
@@ -428,57 +818,45 @@ async_job_end (NautilusDirectory *directory,
 	}
 #endif
 
-	async_job_count -= 1;
-}
-
-/* Helper to get one value from a hash table. */
-static void
-get_one_value_callback (gpointer key, gpointer value, gpointer callback_data)
-{
-	gpointer *returned_value;
-
-	returned_value = callback_data;
-	*returned_value = value;
-}
-
-/* return a single value from a hash table. */
-static gpointer
-get_one_value (GHashTable *table)
-{
-	gpointer value;
+	pool->job_count -= 1;
+	directory->details->job_count -= 1;
 
-	value = NULL;
-	if (table != NULL) {
-		g_hash_table_foreach (table, get_one_value_callback, &value);
+	if (directory->details->job_start_times != NULL &&
+	    g_hash_table_lookup_extended (directory->details->job_start_times,
+					  GINT_TO_POINTER (job), NULL, &start_time)) {
+		g_hash_table_remove (directory->details->job_start_times, GINT_TO_POINTER (job));
+		async_job_pool_update_limit (pool,
+					     get_job_time () - GPOINTER_TO_UINT (start_time));
 	}
-	return value;
 }
 
 /* Wake up directories that are "blocked" as long as there are job
- * slots available.
+ * slots available in their pool.
  */
 static void
 async_job_wake_up (void)
 {
 	static gboolean already_waking_up = FALSE;
-	gpointer value;
-
-	g_assert (async_job_count >= 0);
-	g_assert (async_job_count <= MAX_ASYNC_JOBS);
+	AsyncJobPool *pool;
+	NautilusDirectory *directory;
+	GList *node;
 
 	if (already_waking_up) {
 		return;
 	}
 	
 	already_waking_up = TRUE;
-	while (async_job_count < MAX_ASYNC_JOBS) {
-		value = get_one_value (waiting_directories);
-		if (value == NULL) {
-			break;
+	/* New pools are prepended, so they can't break this walk. */
+	for (node = job_pools; node != NULL; node = node->next) {
+		pool = node->data;
+
+		while (pool->job_count < pool->job_limit) {
+			directory = async_job_pool_pop_waiting (pool);
+			if (directory == NULL) {
+				break;
+			}
+			nautilus_directory_async_state_changed (directory);
 		}
-		g_hash_table_remove (waiting_directories, value);
-		nautilus_directory_async_state_changed
-			(NAUTILUS_DIRECTORY (value));
 	}
 	already_waking_up = FALSE;
 }
@@ -497,6 +875,7 @@ deep_count_cancel (NautilusDirectory *directory)
 	if (directory->details->deep_count_in_progress != NULL) {
 		g_assert (NAUTILUS_IS_FILE (directory->details->deep_count_file));
 		
+		/* The state is freed when its enumerations return. */
 		g_cancellable_cancel (directory->details->deep_count_in_progress->cancellable);
 
 		directory->details->deep_count_file->details->deep_counts_status = NAUTILUS_REQUEST_NOT_STARTED;
@@ -505,7 +884,7 @@ deep_count_cancel (NautilusDirectory *directory)
 		directory->details->deep_count_in_progress = NULL;
 		directory->details->deep_count_file = NULL;
 
-		async_job_end (directory, "deep count");
+		async_job_end (directory, ASYNC_JOB_DEEP_COUNT);
 	}
 }
 
@@ -525,18 +904,7 @@ top_left_cancel (NautilusDirectory *directory)
 		directory->details->top_left_read_state->directory = NULL;
 		directory->details->top_left_read_state = NULL;
 		
-		async_job_end (directory, "top left");
-	}
-}
-
-static void
-link_info_cancel (NautilusDirectory *directory)
-{
-	if (directory->details->link_info_read_state != NULL) {
-		g_cancellable_cancel (directory->details->link_info_read_state->cancellable);
-		directory->details->link_info_read_state->directory = NULL;
-		directory->details->link_info_read_state = NULL;
-		async_job_end (directory, "link info");
+		async_job_end (directory, ASYNC_JOB_TOP_LEFT);
 	}
 }
 
@@ -547,31 +915,7 @@ thumbnail_cancel (NautilusDirectory *directory)
 		g_cancellable_cancel (directory->details->thumbnail_state->cancellable);
 		directory->details->thumbnail_state->directory = NULL;
 		directory->details->thumbnail_state = NULL;
-		async_job_end (directory, "thumbnail");
-	}
-}
-
-static void
-mount_cancel (NautilusDirectory *directory)
-{
-	if (directory->details->mount_state != NULL) {
-		g_cancellable_cancel (directory->details->mount_state->cancellable);
-		directory->details->mount_state->directory = NULL;
-		directory->details->mount_state = NULL;
-		async_job_end (directory, "mount");
-	}
-}
-
-static void
-file_info_cancel (NautilusDirectory *directory)
-{
-	if (directory->details->get_info_in_progress != NULL) {
-		g_cancellable_cancel (directory->details->get_info_in_progress->cancellable);
-		directory->details->get_info_in_progress->directory = NULL;
-		directory->details->get_info_in_progress = NULL;
-		directory->details->get_info_file = NULL;
-
-		async_job_end (directory, "file info");
+		async_job_end (directory, ASYNC_JOB_THUMBNAIL);
 	}
 }
 
@@ -799,27 +1143,6 @@ nautilus_directory_monitor_add_internal (NautilusDirectory *directory,
 	nautilus_directory_async_state_changed (directory);
 }
 
-static void
-set_file_unconfirmed (NautilusFile *file, gboolean unconfirmed)
-{
-	NautilusDirectory *directory;
-
-	g_assert (NAUTILUS_IS_FILE (file));
-	g_assert (unconfirmed == FALSE || unconfirmed == TRUE);
-
-	if (file->details->unconfirmed == unconfirmed) {
-		return;
-	}
-	file->details->unconfirmed = unconfirmed;
-
-	directory = file->details->directory;
-	if (unconfirmed) {
-		directory->details->confirmed_file_count--;
-	} else {
-		directory->details->confirmed_file_count++;
-	}
-}
-
 static gboolean show_hidden_files = TRUE;
 
 static void
@@ -829,7 +1152,7 @@ show_hidden_files_changed_callback (gpointer callback_data)
 }
 
 static gboolean
-should_skip_file (NautilusDirectory *directory, GFileInfo *info)
+get_show_hidden_files (void)
 {
 	static gboolean show_hidden_files_changed_callback_installed = FALSE;
 
@@ -846,16 +1169,63 @@ should_skip_file (NautilusDirectory *directory, GFileInfo *info)
 		show_hidden_files_changed_callback (NULL);
 	}
 
-	if (!show_hidden_files &&
-	    (g_file_info_get_is_hidden (info) ||
-	     g_file_info_get_is_backup (info) ||
-	     (directory != NULL && directory->details->hidden_file_hash != NULL &&
-	      g_hash_table_lookup (directory->details->hidden_file_hash,
-				   g_file_info_get_name (info)) != NULL))) {
-		return TRUE;
-	}
+	return show_hidden_files;
+}
 
-	return FALSE;
+static gboolean
+is_hidden_file (GFileInfo *info, GHashTable *hidden_file_hash)
+{
+	return g_file_info_get_is_hidden (info) ||
+		g_file_info_get_is_backup (info) ||
+		(hidden_file_hash != NULL &&
+		 g_hash_table_lookup (hidden_file_hash,
+				      g_file_info_get_name (info)) != NULL);
+}
+
+static gboolean
+should_skip_file (NautilusDirectory *directory, GFileInfo *info)
+{
+	return !get_show_hidden_files () &&
+		is_hidden_file (info,
+				directory != NULL ? directory->details->hidden_file_hash : NULL);
+}
+
+static PendingFileInfo *
+pending_file_info_new (GFileInfo *info, char *collation_key)
+{
+	PendingFileInfo *pending;
+
+	pending = g_slice_new (PendingFileInfo);
+	pending->info = g_object_ref (info);
+	pending->collation_key = collation_key;
+
+	return pending;
+}
+
+static void
+pending_file_info_free (PendingFileInfo *pending)
+{
+	g_object_unref (pending->info);
+	g_free (pending->collation_key);
+	g_slice_free (PendingFileInfo, pending);
+}
+
+static void
+pending_file_info_list_free (GList *list)
+{
+	g_list_free_full (list, (GDestroyNotify) pending_file_info_free);
+}
+
+/* Hands a collation key made in the I/O thread over to the file. */
+static void
+take_pending_collation_key (NautilusFile *file, PendingFileInfo *pending)
+{
+	if (pending->collation_key != NULL) {
+		nautilus_file_set_display_name_collation_key
+			(file, g_file_info_get_display_name (pending->info),
+			 pending->collation_key);
+		pending->collation_key = NULL;
+	}
 }
 
 static gboolean
@@ -863,11 +1233,13 @@ dequeue_pending_idle_callback (gpointer callback_data)
 {
 	NautilusDirectory *directory;
 	GList *pending_file_info;
-	GList *node, *next;
+	GList *node;
 	NautilusFile *file;
 	GList *changed_files, *added_files;
+	PendingFileInfo *pending;
+	guint i;
 	GFileInfo *file_info;
-	const char *mimetype, *name;
+	const char *name;
 	DirectoryLoadState *dir_load_state;
 
 	directory = NAUTILUS_DIRECTORY (callback_data);
@@ -893,35 +1265,21 @@ dequeue_pending_idle_callback (gpointer callback_data)
 	
 	/* Build a list of NautilusFile objects. */
 	for (node = pending_file_info; node != NULL; node = node->next) {
-		file_info = node->data;
+		pending = node->data;
+		file_info = pending->info;
 
 		name = g_file_info_get_name (file_info);
-		
-		/* Update the file count. */
-		/* FIXME bugzilla.gnome.org 45063: This could count a
-		 * file twice if we get it from both load_directory
-		 * and from new_files_callback. Not too hard to fix by
-		 * moving this into the actual callback instead of
-		 * waiting for the idle function.
+
+		/* The file count and MIME types of a directory load are
+		 * collected in the I/O thread, see directory_load_prepare_file.
 		 */
-		if (dir_load_state &&
-		    !should_skip_file (directory, file_info)) {
-			dir_load_state->load_file_count += 1;
-
-			/* Add the MIME type to the set. */
-			mimetype = g_file_info_get_content_type (file_info);
-			if (mimetype != NULL) {
-				istr_set_insert (dir_load_state->load_mime_list_hash,
-						 mimetype);
-			}
-		}
-		
+
 		/* check if the file already exists */
 		file = nautilus_directory_find_file_by_name (directory, name);
 		if (file != NULL) {
 			/* file already exists in dir, check if we still need to
 			 *  emit file_added or if it changed */
-			set_file_unconfirmed (file, FALSE);
+			nautilus_directory_confirm_file (directory, file);
 			if (!file->details->is_added) {
 				/* We consider this newly added even if its in the list.
 				 * This can happen if someone called nautilus_file_get_by_uri()
@@ -935,9 +1293,11 @@ dequeue_pending_idle_callback (gpointer callback_data)
 				nautilus_file_ref (file);
 				changed_files = g_list_prepend (changed_files, file);
 			}
+			take_pending_collation_key (file, pending);
 		} else {
 			/* new file, create a nautilus file object and add it to the list */
 			file = nautilus_file_new_from_info (directory, file_info);
+			take_pending_collation_key (file, pending);
 			nautilus_directory_add_file (directory, file);			
 			file->details->is_added = TRUE;
 			added_files = g_list_prepend (added_files, file);
@@ -948,17 +1308,21 @@ dequeue_pending_idle_callback (gpointer callback_data)
          * files are gone.
 	 */
 	if (directory->details->directory_loaded) {
-		for (node = directory->details->file_list;
-		     node != NULL; node = next) {
-			file = NAUTILUS_FILE (node->data);
-			next = node->next;
-
-			if (file->details->unconfirmed) {
-				nautilus_file_ref (file);
-				changed_files = g_list_prepend (changed_files, file);
-				
-				nautilus_file_mark_gone (file);
+		/* They are all at the end of the array, and each one
+		 * marked gone is taken off the end.
+		 */
+		i = directory->details->files->len;
+		while (i > directory->details->confirmed_file_count) {
+			i--;
+			if (i >= directory->details->files->len) {
+				continue;
 			}
+			file = g_ptr_array_index (directory->details->files, i);
+
+			nautilus_file_ref (file);
+			changed_files = g_list_prepend (changed_files, file);
+
+			nautilus_file_mark_gone (file);
 		}
 	}
 
@@ -995,7 +1359,7 @@ dequeue_pending_idle_callback (gpointer callback_data)
 	}
 
  drain:
-	g_list_free_full (pending_file_info, g_object_unref);
+	pending_file_info_list_free (pending_file_info);
 
 	/* Get the state machine running again. */
 	nautilus_directory_async_state_changed (directory);
@@ -1013,6 +1377,16 @@ nautilus_directory_schedule_dequeue_pending (NautilusDirectory *directory)
 	}
 }
 
+static void
+add_pending_file_info (NautilusDirectory *directory,
+		       PendingFileInfo *pending)
+{
+	/* Arrange for the "loading" part of the work. */
+	directory->details->pending_file_info
+		= g_list_prepend (directory->details->pending_file_info, pending);
+	nautilus_directory_schedule_dequeue_pending (directory);
+}
+
 static void
 directory_load_one (NautilusDirectory *directory,
 		    GFileInfo *info)
@@ -1031,11 +1405,8 @@ directory_load_one (NautilusDirectory *directory,
 		return;
 	}
 	
-	/* Arrange for the "loading" part of the work. */
-	g_object_ref (info);
-	directory->details->pending_file_info
-		= g_list_prepend (directory->details->pending_file_info, info);
-	nautilus_directory_schedule_dequeue_pending (directory);
+	add_pending_file_info (directory,
+			       pending_file_info_new (info, NULL));
 }
 
 static void
@@ -1055,7 +1426,12 @@ directory_load_cancel (NautilusDirectory *directory)
 		g_cancellable_cancel (state->cancellable);
 		state->directory = NULL;
 		directory->details->directory_load_in_progress = NULL;
-		async_job_end (directory, "file list");
+		async_job_end (directory, ASYNC_JOB_FILE_LIST);
+
+		/* Wake up the I/O thread if it is waiting for us. */
+		g_mutex_lock (&state->lock);
+		g_cond_signal (&state->loaded_files_taken);
+		g_mutex_unlock (&state->lock);
 	}
 }
 
@@ -1076,7 +1452,7 @@ file_list_cancel (NautilusDirectory *directory)
 	}
 
 	if (directory->details->pending_file_info != NULL) {
-		g_list_free_full (directory->details->pending_file_info, g_object_unref);
+		pending_file_info_list_free (directory->details->pending_file_info);
 		directory->details->pending_file_info = NULL;
 	}
 
@@ -1089,22 +1465,17 @@ static void
 directory_load_done (NautilusDirectory *directory,
 		     GError *error)
 {
-	GList *node;
-
 	directory->details->directory_loaded = TRUE;
 	directory->details->directory_loaded_sent_notification = FALSE;
 
 	if (error != NULL) {
 		/* The load did not complete successfully. This means
 		 * we don't know the status of the files in this directory.
-		 * We clear the unconfirmed bit on each file here so that
-		 * they won't be marked "gone" later -- we don't know enough
-		 * about them to know whether they are really gone.
+		 * We confirm all the files here so that they won't be
+		 * marked "gone" later -- we don't know enough about them
+		 * to know whether they are really gone.
 		 */
-		for (node = directory->details->file_list;
-		     node != NULL; node = node->next) {
-			set_file_unconfirmed (NAUTILUS_FILE (node->data), FALSE);
-		}
+		nautilus_directory_confirm_all_files (directory);
 
 		nautilus_directory_emit_load_error (directory, error);
 	}
@@ -1576,20 +1947,11 @@ nautilus_async_destroying_file (NautilusFile *file)
 		directory->details->mime_list_in_progress->mime_list_file = NULL;
 		changed = TRUE;
 	}
-	if (directory->details->get_info_file == file) {
-		directory->details->get_info_file = NULL;
-		changed = TRUE;
-	}
 	if (directory->details->top_left_read_state != NULL
 	    && directory->details->top_left_read_state->file == file) {
 		directory->details->top_left_read_state->file = NULL;
 		changed = TRUE;
 	}
-	if (directory->details->link_info_read_state != NULL &&
-	    directory->details->link_info_read_state->file == file) {
-		directory->details->link_info_read_state->file = NULL;
-		changed = TRUE;
-	}
 	if (directory->details->extension_info_file == file) {
 		directory->details->extension_info_file = NULL;
 		changed = TRUE;
@@ -1601,18 +1963,6 @@ nautilus_async_destroying_file (NautilusFile *file)
 		changed = TRUE;
 	}
 	
-	if (directory->details->mount_state != NULL &&
-	    directory->details->mount_state->file ==  file) {
-		directory->details->mount_state->file = NULL;
-		changed = TRUE;
-	}
-
-	if (directory->details->filesystem_info_state != NULL &&
-	    directory->details->filesystem_info_state->file == file) {
-		directory->details->filesystem_info_state->file = NULL;
-		changed = TRUE;
-	}
-	
 	/* Let the directory take care of the rest. */
 	if (changed) {
 		nautilus_directory_async_state_changed (directory);
@@ -1733,14 +2083,14 @@ lacks_mount (NautilusFile *file)
 static gboolean
 has_problem (NautilusDirectory *directory, NautilusFile *file, FileCheck problem)
 {
-	GList *node;
+	guint i;
 
 	if (file != NULL) {
 		return (* problem) (file);
 	}
 
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		if ((* problem) (node->data)) {
+	for (i = 0; i < directory->details->files->len; i++) {
+		if ((* problem) (g_ptr_array_index (directory->details->files, i))) {
 			return TRUE;
 		}
 	}
@@ -1957,18 +2307,6 @@ nautilus_directory_is_file_list_monitored (NautilusDirectory *directory)
 	return directory->details->file_list_monitored;
 }
 
-static void
-mark_all_files_unconfirmed (NautilusDirectory *directory)
-{
-	GList *node;
-	NautilusFile *file;
-
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		file = node->data;
-		set_file_unconfirmed (file, TRUE);
-	}
-}
-
 static void
 read_dot_hidden_file (NautilusDirectory *directory)
 {
@@ -2044,125 +2382,251 @@ read_dot_hidden_file (NautilusDirectory *directory)
 static void
 directory_load_state_free (DirectoryLoadState *state)
 {
-	if (state->enumerator) {
-		if (!g_file_enumerator_is_closed (state->enumerator)) {
-			g_file_enumerator_close_async (state->enumerator,
-						       0, NULL, NULL, NULL);
-		}
-		g_object_unref (state->enumerator);
-	}
+	g_queue_foreach (&state->loaded_files, (GFunc) pending_file_info_free, NULL);
+	g_queue_clear (&state->loaded_files);
+	g_mutex_clear (&state->lock);
+	g_cond_clear (&state->loaded_files_taken);
 
+	if (state->error != NULL) {
+		g_error_free (state->error);
+	}
+	if (state->hidden_file_hash != NULL) {
+		g_hash_table_destroy (state->hidden_file_hash);
+	}
 	if (state->load_mime_list_hash != NULL) {
 		istr_set_destroy (state->load_mime_list_hash);
 	}
+	g_object_unref (state->location);
 	nautilus_file_unref (state->load_directory_file);
 	g_object_unref (state->cancellable);
 	g_free (state);
 }
 
-static void
-more_files_callback (GObject *source_object,
-		     GAsyncResult *res,
-		     gpointer user_data)
+static GHashTable *
+copy_hidden_file_hash (GHashTable *hidden_file_hash)
+{
+	GHashTable *copy;
+	GHashTableIter iter;
+	gpointer key;
+	char *name;
+
+	copy = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_hash_table_iter_init (&iter, hidden_file_hash);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		name = g_strdup (key);
+		g_hash_table_insert (copy, name, name);
+	}
+
+	return copy;
+}
+
+/* Called in the main loop with files the I/O thread has loaded. */
+static gboolean
+directory_load_dispatch (gpointer callback_data)
 {
 	DirectoryLoadState *state;
 	NautilusDirectory *directory;
-	GError *error;
-	GList *files, *l;
-	GFileInfo *info;
+	GList *loaded_files, *node;
+	gboolean more, finished;
+	guint i;
 
-	state = user_data;
+	state = callback_data;
+
+	g_mutex_lock (&state->lock);
+	loaded_files = NULL;
+	for (i = 0;
+	     i < DIRECTORY_LOAD_ITEMS_PER_DISPATCH &&
+		     !g_queue_is_empty (&state->loaded_files);
+	     i++) {
+		loaded_files = g_list_prepend (loaded_files,
+					       g_queue_pop_head (&state->loaded_files));
+	}
+	more = !g_queue_is_empty (&state->loaded_files);
+	finished = state->finished && !more;
+	state->dispatch_scheduled = more;
+	g_cond_signal (&state->loaded_files_taken);
+	g_mutex_unlock (&state->lock);
+
+	/* Nothing touches the state from the I/O thread once it is
+	 * finished, so it can be used without the lock from here on.
+	 */
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
-		directory_load_state_free (state);
-		return;
+		pending_file_info_list_free (loaded_files);
+		if (finished) {
+			directory_load_state_free (state);
+		}
+		return more;
 	}
 
 	directory = nautilus_directory_ref (state->directory);
 
-	g_assert (directory->details->directory_load_in_progress != NULL);
 	g_assert (directory->details->directory_load_in_progress == state);
 
-	error = NULL;
-	files = g_file_enumerator_next_files_finish (state->enumerator,
-						     res, &error);
-
-	for (l = files; l != NULL; l = l->next) {
-		info = l->data;
-		directory_load_one (directory, info);
-		g_object_unref (info);
+	/* Back in the order they were loaded. */
+	loaded_files = g_list_reverse (loaded_files);
+	for (node = loaded_files; node != NULL; node = node->next) {
+		add_pending_file_info (directory, node->data);
 	}
+	g_list_free (loaded_files);
 
-	if (files == NULL) {
-		directory_load_done (directory, error);
+	if (finished) {
+		directory_load_done (directory, state->error);
 		directory_load_state_free (state);
-	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_DEFAULT,
-						    state->cancellable,
-						    more_files_callback,
-						    state);
 	}
 
 	nautilus_directory_unref (directory);
 
-	if (error) {
-		g_error_free (error);
+	return more;
+}
+
+/* Hands files over to the main loop. Called in the I/O thread. */
+static void
+directory_load_hand_over (DirectoryLoadState *state,
+			  GList *loaded_files,
+			  gboolean finished,
+			  GError *error)
+{
+	GList *node;
+
+	g_mutex_lock (&state->lock);
+
+	for (node = loaded_files; node != NULL; node = node->next) {
+		g_queue_push_tail (&state->loaded_files, node->data);
 	}
+	g_list_free (loaded_files);
 
-	g_list_free (files);
+	if (finished) {
+		state->finished = TRUE;
+		state->error = error;
+	}
+
+	if (!state->dispatch_scheduled) {
+		state->dispatch_scheduled = TRUE;
+		g_idle_add (directory_load_dispatch, state);
+	}
+
+	/* Don't get too far ahead of the main loop. */
+	while (!finished &&
+	       g_queue_get_length (&state->loaded_files) >= DIRECTORY_LOAD_MAX_LOADED_FILES &&
+	       !g_cancellable_is_cancelled (state->cancellable)) {
+		g_cond_wait (&state->loaded_files_taken, &state->lock);
+	}
+
+	g_mutex_unlock (&state->lock);
 }
 
-static void
-enumerate_children_callback (GObject *source_object,
-			     GAsyncResult *res,
-			     gpointer user_data)
+/* Works out what it can about a loaded file without the main
+ * loop. Called in the I/O thread.
+ */
+static PendingFileInfo *
+directory_load_prepare_file (DirectoryLoadState *state,
+			     GFileInfo *info)
+{
+	const char *mimetype, *display_name;
+	char *uri, *collation_key;
+
+	if (g_file_info_get_name (info) == NULL) {
+		uri = g_file_get_uri (state->location);
+		g_warning ("Got GFileInfo with NULL name in %s, ignoring. This shouldn't happen unless the gvfs backend is broken.\n", uri);
+		g_free (uri);
+
+		return NULL;
+	}
+
+	if (state->show_hidden_files ||
+	    !is_hidden_file (info, state->hidden_file_hash)) {
+		state->load_file_count += 1;
+
+		/* Add the MIME type to the set. */
+		mimetype = g_file_info_get_content_type (info);
+		if (mimetype != NULL) {
+			istr_set_insert (state->load_mime_list_hash,
+					 mimetype);
+		}
+	}
+
+	/* Sorting by name needs this for every file, and it is
+	 * the most expensive part of adding one.
+	 */
+	collation_key = NULL;
+	display_name = g_file_info_get_display_name (info);
+	if (display_name != NULL) {
+		collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+	}
+
+	return pending_file_info_new (info, collation_key);
+}
+
+static gboolean
+directory_load_job (GIOSchedulerJob *io_job,
+		    GCancellable *cancellable,
+		    gpointer user_data)
 {
 	DirectoryLoadState *state;
 	GFileEnumerator *enumerator;
+	GList *files, *loaded_files, *l;
+	PendingFileInfo *pending;
 	GError *error;
 
 	state = user_data;
 
-	if (state->directory == NULL) {
-		/* Operation was cancelled. Bail out */
-		directory_load_state_free (state);
-		return;
-	}
-	
 	error = NULL;
-	enumerator = g_file_enumerate_children_finish  (G_FILE (source_object),
-							res, &error);
+	enumerator = g_file_enumerate_children (state->location,
+						NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
+						0, /* flags */
+						cancellable,
+						&error);
+
+	while (enumerator != NULL) {
+		files = g_file_enumerator_next_files (enumerator,
+						      DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+						      cancellable,
+						      &error);
+		if (files == NULL) {
+			break;
+		}
 
-	if (enumerator == NULL) {
-		directory_load_done (state->directory, error);
-		g_error_free (error);
-		directory_load_state_free (state);
-		return;
-	} else {
-		state->enumerator = enumerator;
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_DEFAULT,
-						    state->cancellable,
-						    more_files_callback,
-						    state);
+		loaded_files = NULL;
+		for (l = files; l != NULL; l = l->next) {
+			pending = directory_load_prepare_file (state, l->data);
+			if (pending != NULL) {
+				loaded_files = g_list_prepend (loaded_files, pending);
+			}
+			g_object_unref (l->data);
+		}
+		g_list_free (files);
+
+		directory_load_hand_over (state, g_list_reverse (loaded_files),
+					  FALSE, NULL);
+	}
+
+	if (enumerator != NULL) {
+		g_file_enumerator_close (enumerator, NULL, NULL);
+		g_object_unref (enumerator);
 	}
-}
 
+	/* The state may be freed as soon as this returns. */
+	directory_load_hand_over (state, NULL, TRUE, error);
+
+	return FALSE;
+}
 
 /* Start monitoring the file list if it isn't already. */
 static void
 start_monitoring_file_list (NautilusDirectory *directory)
 {
 	DirectoryLoadState *state;
+	guint i;
 	
 	if (!directory->details->file_list_monitored) {
 		g_assert (!directory->details->directory_load_in_progress);
 		directory->details->file_list_monitored = TRUE;
-		nautilus_file_list_ref (directory->details->file_list);
+		for (i = 0; i < directory->details->files->len; i++) {
+			nautilus_file_ref (g_ptr_array_index (directory->details->files, i));
+		}
 	}
 
 	if (directory->details->directory_loaded  ||
@@ -2170,17 +2634,20 @@ start_monitoring_file_list (NautilusDirectory *directory)
 		return;
 	}
 
-	if (!async_job_start (directory, "file list")) {
+	if (!async_job_start (directory, ASYNC_JOB_FILE_LIST)) {
 		return;
 	}
 
-	mark_all_files_unconfirmed (directory);
+	nautilus_directory_unconfirm_all_files (directory);
 
 	state = g_new0 (DirectoryLoadState, 1);
 	state->directory = directory;
 	state->cancellable = g_cancellable_new ();
 	state->load_mime_list_hash = istr_set_new ();
 	state->load_file_count = 0;
+	g_mutex_init (&state->lock);
+	g_cond_init (&state->loaded_files_taken);
+	g_queue_init (&state->loaded_files);
 	
 	g_assert (directory->details->location != NULL);
         state->load_directory_file =
@@ -2208,21 +2675,31 @@ start_monitoring_file_list (NautilusDirectory *directory)
 	g_message ("load_directory called to monitor file list of %p", directory->details->location);
 #endif
 	
+	/* The I/O thread gets its own copy of what it needs to count
+	 * the files that are shown.
+	 */
+	state->location = g_object_ref (directory->details->location);
+	state->show_hidden_files = get_show_hidden_files ();
+	if (directory->details->hidden_file_hash != NULL) {
+		state->hidden_file_hash = copy_hidden_file_hash
+			(directory->details->hidden_file_hash);
+	}
+
 	directory->details->directory_load_in_progress = state;
-	
-	g_file_enumerate_children_async (directory->details->location,
-					 NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
-					 0, /* flags */
-					 G_PRIORITY_DEFAULT, /* prio */
-					 state->cancellable,
-					 enumerate_children_callback,
-					 state);
+
+	g_io_scheduler_push_job (directory_load_job,
+				 state,
+				 NULL,
+				 G_PRIORITY_DEFAULT,
+				 state->cancellable);
 }
 
 /* Stop monitoring the file list if it is being monitored. */
 void
 nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
 {
+	guint i;
+
 	if (!directory->details->file_list_monitored) {
 		g_assert (directory->details->directory_load_in_progress == NULL);
 		return;
@@ -2230,7 +2707,12 @@ nautilus_directory_stop_monitoring_file_list (NautilusDirectory *directory)
 
 	directory->details->file_list_monitored = FALSE;
 	file_list_cancel (directory);
-	nautilus_file_list_unref (directory->details->file_list);
+	/* Unreffing may remove the file from the array. */
+	for (i = directory->details->files->len; i > 0; i--) {
+		if (i <= directory->details->files->len) {
+			nautilus_file_unref (g_ptr_array_index (directory->details->files, i - 1));
+		}
+	}
 	directory->details->directory_loaded = FALSE;
 }
 
@@ -2279,12 +2761,12 @@ static void
 nautilus_directory_invalidate_file_attributes (NautilusDirectory      *directory,
 					       NautilusFileAttributes  file_attributes)
 {
-	GList *node;
+	guint i;
 
 	cancel_loading_attributes (directory, file_attributes);
 
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		nautilus_file_invalidate_attributes_internal (NAUTILUS_FILE (node->data),
+	for (i = 0; i < directory->details->files->len; i++) {
+		nautilus_file_invalidate_attributes_internal (g_ptr_array_index (directory->details->files, i),
 							      file_attributes);
 	}
 
@@ -2443,7 +2925,7 @@ count_children_done (NautilusDirectory *directory,
 	nautilus_file_changed (count_file);
 
 	/* Start up the next one. */
-	async_job_end (directory, "directory count");
+	async_job_end (directory, ASYNC_JOB_DIRECTORY_COUNT);
 	nautilus_directory_async_state_changed (directory);
 }
 
@@ -2479,7 +2961,7 @@ count_more_files_callback (GObject *source_object,
 		/* Operation was cancelled. Bail out */
 		directory->details->count_in_progress = NULL;
 
-		async_job_end (directory, "directory count");
+		async_job_end (directory, ASYNC_JOB_DIRECTORY_COUNT);
 		nautilus_directory_async_state_changed (directory);
 		
 		directory_count_state_free (state);
@@ -2533,7 +3015,7 @@ count_children_callback (GObject *source_object,
 		directory = state->directory;
 		directory->details->count_in_progress = NULL;
 
-		async_job_end (directory, "directory count");
+		async_job_end (directory, ASYNC_JOB_DIRECTORY_COUNT);
 		nautilus_directory_async_state_changed (directory);
 		
 		directory_count_state_free (state);
@@ -2592,7 +3074,7 @@ directory_count_start (NautilusDirectory *directory,
 		return;
 	}
 
-	if (!async_job_start (directory, "directory count")) {
+	if (!async_job_start (directory, ASYNC_JOB_DIRECTORY_COUNT)) {
 		return;
 	}
 
@@ -2626,55 +3108,92 @@ directory_count_start (NautilusDirectory *directory,
 	g_object_unref (location);
 }
 
+static inline gboolean
+is_hard_link (GFileInfo *info)
+{
+	/* Directories can't be hard linked, their link count is
+	 * something else.
+	 */
+	return g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_NLINK) > 1 &&
+		g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY;
+}
+
+/* Returns TRUE if info is a hard link to a file counted already,
+ * and remembers it otherwise.
+ */
 static inline gboolean
 seen_inode (DeepCountState *state,
 	    GFileInfo *info)
 {
-	guint64 inode, inode2;
-	guint i;
+	guint64 device, inode;
+
+	/* Only files with other links can be seen again. */
+	if (!is_hard_link (info)) {
+		return FALSE;
+	}
 
+	device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
 	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
 
-	if (inode != 0) {
-		for (i = 0; i < state->seen_deep_count_inodes->len; i++) {
-			inode2 = g_array_index (state->seen_deep_count_inodes, guint64, i);
-			if (inode == inode2) {
-				return TRUE;
-			}
-		}
+	return !nautilus_inode_set_add (state->seen_deep_count_inodes, device, inode);
+}
+
+static DeepCountEnumeration *
+deep_count_enumeration_new (DeepCountState *state,
+			    GFile *location,
+			    GFileInfo *info)
+{
+	DeepCountEnumeration *enumeration;
+
+	enumeration = g_new0 (DeepCountEnumeration, 1);
+	enumeration->state = state;
+	enumeration->location = location;
+	if (info != NULL) {
+		enumeration->info = g_object_ref (info);
 	}
 
-	return FALSE;
+	return enumeration;
 }
 
-static inline void
-mark_inode_as_seen (DeepCountState *state,
-		    GFileInfo *info)
+static void
+deep_count_enumeration_free (DeepCountEnumeration *enumeration)
 {
-	guint64 inode;
-
-	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
-	if (inode != 0) {
-		g_array_append_val (state->seen_deep_count_inodes, inode);
+	if (enumeration->enumerator != NULL) {
+		if (!g_file_enumerator_is_closed (enumeration->enumerator)) {
+			g_file_enumerator_close_async (enumeration->enumerator,
+						       0, NULL, NULL, NULL);
+		}
+		g_object_unref (enumeration->enumerator);
+	}
+	if (enumeration->info != NULL) {
+		g_object_unref (enumeration->info);
 	}
+	g_object_unref (enumeration->location);
+	nautilus_deep_count_cache_entry_free (enumeration->cache_entry);
+	g_free (enumeration);
 }
 
 static void
-deep_count_one (DeepCountState *state,
+deep_count_one (DeepCountEnumeration *enumeration,
 		GFileInfo *info)
 {
+	DeepCountState *state;
+	NautilusDeepCountCacheEntry *cache_entry;
+	NautilusDeepCountCacheLink link;
 	NautilusFile *file;
 	GFile *subdir;
 	gboolean is_seen_inode;
+	goffset size;
 
 	if (should_skip_file (NULL, info)) {
 		return;
 	}
 
+	state = enumeration->state;
+	cache_entry = enumeration->cache_entry;
 	is_seen_inode = seen_inode (state, info);
-	if (!is_seen_inode) {
-		mark_inode_as_seen (state, info);
-	}
+	size = g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE) ?
+		g_file_info_get_size (info) : 0;
 
 	file = state->directory->details->deep_count_file;
 
@@ -2682,96 +3201,167 @@ deep_count_one (DeepCountState *state,
 		/* Count the directory. */
 		file->details->deep_directory_count += 1;
 
-		/* Record the fact that we have to descend into this directory. */
+		/* Record the fact that we have to descend into this directory.
+		 * Going depth first keeps the queue short.
+		 */
+		subdir = g_file_get_child (enumeration->location, g_file_info_get_name (info));
+		g_queue_push_head (&state->deep_count_subdirectories,
+				   deep_count_enumeration_new (state, subdir, info));
 
-		subdir = g_file_get_child (state->deep_count_location, g_file_info_get_name (info));
-		state->deep_count_subdirectories = g_list_prepend
-			(state->deep_count_subdirectories, subdir);
+		if (cache_entry != NULL) {
+			g_ptr_array_add (cache_entry->subdirectories,
+					 g_strdup (g_file_info_get_name (info)));
+		}
 	} else {
 		/* Even non-regular files count as files. */
 		file->details->deep_file_count += 1;
+
+		if (cache_entry != NULL) {
+			cache_entry->file_count += 1;
+		}
 	}
 
 	/* Count the size. */
-	if (!is_seen_inode && g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
-		file->details->deep_size += g_file_info_get_size (info);
+	if (!is_seen_inode) {
+		file->details->deep_size += size;
+	}
+
+	if (cache_entry != NULL) {
+		if (is_hard_link (info)) {
+			link.device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+			link.inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+			link.size = size;
+			g_array_append_val (cache_entry->links, link);
+		} else {
+			cache_entry->size += size;
+		}
 	}
 }
 
-static void
-deep_count_state_free (DeepCountState *state)
+/* Counts the directory of the enumeration from the deep count cache,
+ * if it has an entry for it, and queues its subdirectories. Otherwise
+ * prepares the enumeration to fill in a new entry.
+ */
+static gboolean
+deep_count_use_cache (DeepCountEnumeration *enumeration)
 {
-	if (state->enumerator) {
-		if (!g_file_enumerator_is_closed (state->enumerator)) {
-			g_file_enumerator_close_async (state->enumerator,
-						       0, NULL, NULL, NULL);
+	DeepCountState *state;
+	NautilusDeepCountCacheEntry *cache_entry;
+	NautilusDeepCountCacheLink *link;
+	NautilusFile *file;
+	GFileInfo *info;
+	GFile *subdir;
+	guint64 device, inode, mtime;
+	guint i;
+
+	state = enumeration->state;
+	info = enumeration->info;
+
+	inode = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE);
+	if (inode == 0 ||
+	    !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+		return FALSE;
+	}
+	device = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE);
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+	cache_entry = nautilus_deep_count_cache_lookup (device, inode, mtime,
+							state->show_hidden_files);
+	if (cache_entry == NULL) {
+		enumeration->cache_entry = nautilus_deep_count_cache_entry_new ();
+		return FALSE;
+	}
+
+	file = state->directory->details->deep_count_file;
+	file->details->deep_file_count += cache_entry->file_count;
+	file->details->deep_directory_count += cache_entry->subdirectories->len;
+	file->details->deep_size += cache_entry->size;
+
+	for (i = 0; i < cache_entry->links->len; i++) {
+		link = &g_array_index (cache_entry->links, NautilusDeepCountCacheLink, i);
+		if (nautilus_inode_set_add (state->seen_deep_count_inodes,
+					    link->device, link->inode)) {
+			file->details->deep_size += link->size;
 		}
-		g_object_unref (state->enumerator);
 	}
-	g_object_unref (state->cancellable);
-	if (state->deep_count_location) {
-		g_object_unref (state->deep_count_location);
+
+	for (i = 0; i < cache_entry->subdirectories->len; i++) {
+		subdir = g_file_get_child (enumeration->location,
+					   g_ptr_array_index (cache_entry->subdirectories, i));
+		g_queue_push_head (&state->deep_count_subdirectories,
+				   deep_count_enumeration_new (state, subdir, NULL));
 	}
-	g_list_free_full (state->deep_count_subdirectories, g_object_unref);
-	g_array_free (state->seen_deep_count_inodes, TRUE);
-	g_free (state);
+
+	nautilus_deep_count_cache_entry_free (cache_entry);
+
+	return TRUE;
 }
 
 static void
-deep_count_next_dir (DeepCountState *state)
+deep_count_state_free (DeepCountState *state)
 {
-	GFile *location;
-	NautilusFile *file;
-	NautilusDirectory *directory;
-	gboolean done;
+	g_assert (state->n_enumerations == 0);
 
-	directory = state->directory;
-	
-	g_object_unref (state->deep_count_location);
-	state->deep_count_location = NULL;
+	g_object_unref (state->cancellable);
+	g_queue_foreach (&state->deep_count_subdirectories,
+			 (GFunc) deep_count_enumeration_free, NULL);
+	g_queue_clear (&state->deep_count_subdirectories);
+	nautilus_inode_set_free (state->seen_deep_count_inodes);
+	g_free (state);
+}
 
-	done = FALSE;
-	file = directory->details->deep_count_file;
-	
-	if (state->deep_count_subdirectories != NULL) {
-		/* Work on a new directory. */
-		location = state->deep_count_subdirectories->data;
-		state->deep_count_subdirectories = g_list_remove
-			(state->deep_count_subdirectories, location);
-		deep_count_load (state, location);
-		g_object_unref (location);
-	} else {
-		file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
-		directory->details->deep_count_file = NULL;
-		directory->details->deep_count_in_progress = NULL;
-		deep_count_state_free (state);
-		done = TRUE;
+static void
+deep_count_update (DeepCountState *state)
+{
+	guint now;
+
+	now = get_job_time ();
+	if (now - state->last_update_time >= DEEP_COUNT_UPDATE_INTERVAL) {
+		state->last_update_time = now;
+		nautilus_file_updated_deep_count_in_progress (state->directory->details->deep_count_file);
 	}
-	
-	nautilus_file_updated_deep_count_in_progress (file);
+}
 
-	if (done) {
-		nautilus_file_changed (file);
-		async_job_end (directory, "deep count");
-		nautilus_directory_async_state_changed (directory);
+/* Starts on queued subdirectories, up to the limit. */
+static void
+deep_count_fill (DeepCountState *state)
+{
+	while (state->n_enumerations < state->max_enumerations &&
+	       !g_queue_is_empty (&state->deep_count_subdirectories)) {
+		deep_count_load (g_queue_pop_head (&state->deep_count_subdirectories));
 	}
 }
 
+static void
+deep_count_next_files (DeepCountEnumeration *enumeration)
+{
+	g_file_enumerator_next_files_async (enumeration->enumerator,
+					    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+					    G_PRIORITY_LOW,
+					    enumeration->state->cancellable,
+					    deep_count_more_files_callback,
+					    enumeration);
+}
+
 static void
 deep_count_more_files_callback (GObject *source_object,
 				GAsyncResult *res,
 				gpointer user_data)
 {
+	DeepCountEnumeration *enumeration;
 	DeepCountState *state;
 	NautilusDirectory *directory;
 	GList *files, *l;
 	GFileInfo *info;
+	GError *error;
 
-	state = user_data;
+	enumeration = user_data;
+	state = enumeration->state;
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
-		deep_count_state_free (state);
+		deep_count_enumeration_done (enumeration);
 		return;
 	}
 
@@ -2780,28 +3370,35 @@ deep_count_more_files_callback (GObject *source_object,
 	g_assert (directory->details->deep_count_in_progress != NULL);
 	g_assert (directory->details->deep_count_in_progress == state);
 
-	files = g_file_enumerator_next_files_finish (state->enumerator,
-						     res, NULL);
+	error = NULL;
+	files = g_file_enumerator_next_files_finish (enumeration->enumerator,
+						     res, &error);
 
 	for (l = files; l != NULL; l = l->next)	{
 		info = l->data;
-		deep_count_one (state, info);
+		deep_count_one (enumeration, info);
 		g_object_unref (info);
 	}
 	
 	if (files == NULL) {
-		g_file_enumerator_close_async (state->enumerator, 0, NULL, NULL, NULL);
-		g_object_unref (state->enumerator);
-		state->enumerator = NULL;
-		
-		deep_count_next_dir (state);
+		/* Only a directory that was read to the end is cached. */
+		if (error == NULL && enumeration->cache_entry != NULL) {
+			nautilus_deep_count_cache_insert
+				(g_file_info_get_attribute_uint32 (enumeration->info, G_FILE_ATTRIBUTE_UNIX_DEVICE),
+				 g_file_info_get_attribute_uint64 (enumeration->info, G_FILE_ATTRIBUTE_UNIX_INODE),
+				 g_file_info_get_attribute_uint64 (enumeration->info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+				 g_file_info_get_attribute_uint32 (enumeration->info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+				 state->show_hidden_files,
+				 enumeration->cache_entry);
+			enumeration->cache_entry = NULL;
+		}
+		g_clear_error (&error);
+
+		deep_count_enumeration_done (enumeration);
 	} else {
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_LOW,
-						    state->cancellable,
-						    deep_count_more_files_callback,
-						    state);
+		deep_count_next_files (enumeration);
+		deep_count_fill (state);
+		deep_count_update (state);
 	}
 
 	g_list_free (files);
@@ -2814,15 +3411,17 @@ deep_count_callback (GObject *source_object,
 		     GAsyncResult *res,
 		     gpointer user_data)
 {
+	DeepCountEnumeration *enumeration;
 	DeepCountState *state;
 	GFileEnumerator *enumerator;
 	NautilusFile *file;
 
-	state = user_data;
+	enumeration = user_data;
+	state = enumeration->state;
 
 	if (state->directory == NULL) {
 		/* Operation was cancelled. Bail out */
-		deep_count_state_free (state);
+		deep_count_enumeration_done (enumeration);
 		return;
 	}
 
@@ -2833,39 +3432,131 @@ deep_count_callback (GObject *source_object,
 	if (enumerator == NULL) {
 		file->details->deep_unreadable_count += 1;
 		
-		deep_count_next_dir (state);
+		deep_count_enumeration_done (enumeration);
 	} else {
-		state->enumerator = enumerator;
-		g_file_enumerator_next_files_async (state->enumerator,
-						    DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
-						    G_PRIORITY_LOW,
-						    state->cancellable,
-						    deep_count_more_files_callback,
-						    state);
+		enumeration->enumerator = enumerator;
+		deep_count_next_files (enumeration);
 	}
 }
 
-
 static void
-deep_count_load (DeepCountState *state, GFile *location)
+deep_count_enumerate (DeepCountEnumeration *enumeration)
 {
-	state->deep_count_location = g_object_ref (location);
-
 #ifdef DEBUG_LOAD_DIRECTORY		
-	g_message ("load_directory called to get deep file count for %p", location);
+	g_message ("load_directory called to get deep file count for %p", enumeration->location);
 #endif	
-	g_file_enumerate_children_async (state->deep_count_location,
-					 G_FILE_ATTRIBUTE_STANDARD_NAME ","
-					 G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-					 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-					 G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
-					 G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP ","
-					 G_FILE_ATTRIBUTE_UNIX_INODE,
+	g_file_enumerate_children_async (enumeration->location,
+					 DEEP_COUNT_ATTRIBUTES,
 					 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, /* flags */
 					 G_PRIORITY_LOW, /* prio */
-					 state->cancellable,
+					 enumeration->state->cancellable,
 					 deep_count_callback,
-					 state);
+					 enumeration);
+}
+
+static void
+deep_count_query_info_callback (GObject *source_object,
+				GAsyncResult *res,
+				gpointer user_data)
+{
+	DeepCountEnumeration *enumeration;
+	DeepCountState *state;
+	GFileInfo *info;
+
+	enumeration = user_data;
+	state = enumeration->state;
+
+	if (state->directory == NULL) {
+		/* Operation was cancelled. Bail out */
+		deep_count_enumeration_done (enumeration);
+		return;
+	}
+
+	info = g_file_query_info_finish (G_FILE (source_object), res, NULL);
+	if (info == NULL) {
+		state->directory->details->deep_count_file->details->deep_unreadable_count += 1;
+		deep_count_enumeration_done (enumeration);
+		return;
+	}
+
+	enumeration->info = info;
+	if (deep_count_use_cache (enumeration)) {
+		deep_count_enumeration_done (enumeration);
+	} else {
+		deep_count_enumerate (enumeration);
+	}
+}
+
+/* Called when an enumeration has returned for the last time, also
+ * after the count was cancelled.
+ */
+static void
+deep_count_enumeration_done (DeepCountEnumeration *enumeration)
+{
+	DeepCountState *state;
+	NautilusDirectory *directory;
+	NautilusFile *file;
+
+	state = enumeration->state;
+	deep_count_enumeration_free (enumeration);
+
+	state->n_enumerations -= 1;
+
+	directory = state->directory;
+	if (directory == NULL) {
+		if (state->n_enumerations == 0) {
+			deep_count_state_free (state);
+		}
+		return;
+	}
+
+	deep_count_fill (state);
+	if (state->n_enumerations > 0) {
+		deep_count_update (state);
+		return;
+	}
+
+	/* That was the last directory. */
+	file = directory->details->deep_count_file;
+	file->details->deep_counts_status = NAUTILUS_REQUEST_DONE;
+	directory->details->deep_count_file = NULL;
+	directory->details->deep_count_in_progress = NULL;
+	deep_count_state_free (state);
+
+	nautilus_directory_ref (directory);
+	nautilus_file_updated_deep_count_in_progress (file);
+	nautilus_file_changed (file);
+	async_job_end (directory, ASYNC_JOB_DEEP_COUNT);
+	nautilus_directory_async_state_changed (directory);
+	nautilus_directory_unref (directory);
+}
+
+/* Starts counting a directory. Directories found in the cache are
+ * counted right away, the others are enumerated. Without their info,
+ * that is for the top and cached directories, it is queried first.
+ */
+static void
+deep_count_load (DeepCountEnumeration *enumeration)
+{
+	if (enumeration->info != NULL &&
+	    deep_count_use_cache (enumeration)) {
+		deep_count_enumeration_free (enumeration);
+		return;
+	}
+
+	enumeration->state->n_enumerations += 1;
+
+	if (enumeration->info == NULL) {
+		g_file_query_info_async (enumeration->location,
+					 DEEP_COUNT_ATTRIBUTES,
+					 0, /* flags */
+					 G_PRIORITY_LOW, /* prio */
+					 enumeration->state->cancellable,
+					 deep_count_query_info_callback,
+					 enumeration);
+	} else {
+		deep_count_enumerate (enumeration);
+	}
 }
 
 static void
@@ -2917,7 +3608,7 @@ deep_count_start (NautilusDirectory *directory,
 		return;
 	}
 
-	if (!async_job_start (directory, "deep count")) {
+	if (!async_job_start (directory, ASYNC_JOB_DEEP_COUNT)) {
 		return;
 	}
 
@@ -2932,13 +3623,20 @@ deep_count_start (NautilusDirectory *directory,
 	state = g_new0 (DeepCountState, 1);
 	state->directory = directory;
 	state->cancellable = g_cancellable_new ();
-	state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
+	state->show_hidden_files = get_show_hidden_files ();
+	g_queue_init (&state->deep_count_subdirectories);
+	state->last_update_time = get_job_time ();
+	state->seen_deep_count_inodes = nautilus_inode_set_new ();
 
 	directory->details->deep_count_in_progress = state;
 	
 	location = nautilus_file_get_location (file);
-	deep_count_load (state, location);
-	g_object_unref (location);
+	if (g_file_is_native (location)) {
+		state->max_enumerations = LOCAL_DEEP_COUNT_ENUMERATIONS;
+	} else {
+		state->max_enumerations = REMOTE_DEEP_COUNT_ENUMERATIONS;
+	}
+	deep_count_load (deep_count_enumeration_new (state, location, NULL));
 }
 
 static void
@@ -3009,7 +3707,7 @@ mime_list_done (MimeListState *state, gboolean success)
 	nautilus_file_changed (file);
 
 	/* Start up the next one. */
-	async_job_end (directory, "MIME list");
+	async_job_end (directory, ASYNC_JOB_MIME_LIST);
 	nautilus_directory_async_state_changed (directory);
 }
 
@@ -3048,7 +3746,7 @@ mime_list_callback (GObject *source_object,
 		/* Operation was cancelled. Bail out */
 		directory->details->mime_list_in_progress = NULL;
 
-		async_job_end (directory, "MIME list");
+		async_job_end (directory, ASYNC_JOB_MIME_LIST);
 		nautilus_directory_async_state_changed (directory);
 		
 		mime_list_state_free (state);
@@ -3105,7 +3803,7 @@ list_mime_enum_callback (GObject *source_object,
 		directory = state->directory;
 		directory->details->mime_list_in_progress = NULL;
 
-		async_job_end (directory, "MIME list");
+		async_job_end (directory, ASYNC_JOB_MIME_LIST);
 		nautilus_directory_async_state_changed (directory);
 		
 		mime_list_state_free (state);
@@ -3166,7 +3864,7 @@ mime_list_start (NautilusDirectory *directory,
 		return;
 	}
 
-	if (!async_job_start (directory, "MIME list")) {
+	if (!async_job_start (directory, ASYNC_JOB_MIME_LIST)) {
 		return;
 	}
 
@@ -3274,7 +3972,7 @@ top_left_read_callback (GObject *source_object,
 	nautilus_file_changed (state->file);
 
 	directory->details->top_left_read_state = NULL;
-	async_job_end (directory, "top left");
+	async_job_end (directory, ASYNC_JOB_TOP_LEFT);
 
 	top_left_read_state_free (state);
 	
@@ -3356,7 +4054,7 @@ top_left_start (NautilusDirectory *directory,
 		return;
 	}
 
-	if (!async_job_start (directory, "top left")) {
+	if (!async_job_start (directory, ASYNC_JOB_TOP_LEFT)) {
 		return;
 	}
 
@@ -3378,140 +4076,371 @@ top_left_start (NautilusDirectory *directory,
 	g_object_unref (location);
 }
 
+/* Like calling nautilus_file_changed on each of the files, except
+ * that the ones in directory are reported with a single signal.
+ */
 static void
-get_info_state_free (GetInfoState *state)
+emit_files_changed (NautilusDirectory *directory,
+		    GList *files)
 {
-	g_object_unref (state->cancellable);
-	g_free (state);
+	GList *node, *changed_files;
+	NautilusFile *file;
+
+	changed_files = NULL;
+	for (node = files; node != NULL; node = node->next) {
+		file = node->data;
+		if (file->details->directory == directory &&
+		    !nautilus_file_is_self_owned (file)) {
+			changed_files = g_list_prepend (changed_files, file);
+		} else {
+			nautilus_file_changed (file);
+		}
+	}
+
+	if (changed_files != NULL) {
+		changed_files = g_list_reverse (changed_files);
+		nautilus_directory_emit_change_signals (directory, changed_files);
+		g_list_free (changed_files);
+	}
 }
 
 static void
-query_info_callback (GObject *source_object,
-		     GAsyncResult *res,
-		     gpointer user_data)
+attribute_batch_free (AttributeBatch *batch)
+{
+	guint i;
+
+	for (i = 0; i < batch->n_items; i++) {
+		nautilus_file_unref (batch->items[i].file);
+	}
+	g_object_unref (batch->cancellable);
+	g_free (batch);
+}
+
+static void
+attribute_batch_done (AttributeBatch *batch)
 {
 	NautilusDirectory *directory;
-	NautilusFile *get_info_file;
-	GFileInfo *info;
-	GetInfoState *state;
-	GError *error;
+	NautilusFile *file;
+	GList *files;
+	guint i;
 
-	state = user_data;
+	directory = nautilus_directory_ref (batch->directory);
 
-	if (state->directory == NULL) {
-		/* Operation was cancelled. Bail out */
-		get_info_state_free (state);
+	ATTRIBUTE_BATCH_SLOT (directory, batch->klass) = NULL;
+	async_job_end (directory, batch->klass->job);
+
+	/* Take over the refs so the files are alive while we
+	 * send the change notification, even the ones that were
+	 * marked gone.
+	 */
+	files = NULL;
+	for (i = batch->n_items; i > 0; i--) {
+		file = batch->items[i - 1].file;
+		if (file == NULL) {
+			continue;
+		}
+		batch->items[i - 1].file = NULL;
+
+		/* Files leave the work queue while they are in a batch,
+		 * put them back so their other attributes get loaded.
+		 */
+		if (file->details->directory == directory &&
+		    !file->details->is_gone) {
+			nautilus_directory_add_file_to_work_queue (directory, file);
+		}
+		files = g_list_prepend (files, file);
+	}
+	attribute_batch_free (batch);
+
+	emit_files_changed (directory, files);
+	nautilus_file_list_free (files);
+
+	nautilus_directory_async_state_changed (directory);
+	nautilus_directory_unref (directory);
+}
+
+static void
+attribute_batch_release (AttributeBatch *batch)
+{
+	g_assert (batch->n_pending > 0);
+	batch->n_pending--;
+	if (batch->n_pending > 0) {
 		return;
 	}
-	
-	directory = nautilus_directory_ref (state->directory);
 
-	get_info_file = directory->details->get_info_file;
-	g_assert (NAUTILUS_IS_FILE (get_info_file));
+	if (batch->directory == NULL) {
+		/* Batch was cancelled, the last callback cleans up. */
+		attribute_batch_free (batch);
+	} else {
+		attribute_batch_done (batch);
+	}
+}
 
-	directory->details->get_info_file = NULL;
-	directory->details->get_info_in_progress = NULL;
-	
-	/* ref here because we might be removing the last ref when we
-	 * mark the file gone below, but we need to keep a ref at
-	 * least long enough to send the change notification. 
+static void
+attribute_batch_item_done (AttributeBatchItem *item)
+{
+	attribute_batch_release (item->batch);
+}
+
+static gboolean
+attribute_batch_item_is_cancelled (AttributeBatchItem *item)
+{
+	return item->batch->directory == NULL || item->file == NULL;
+}
+
+static void
+attribute_batch_cancel (NautilusDirectory *directory,
+			const AttributeBatchClass *klass)
+{
+	AttributeBatch *batch;
+	NautilusFile *file;
+	guint i;
+
+	batch = ATTRIBUTE_BATCH_SLOT (directory, klass);
+	if (batch == NULL) {
+		return;
+	}
+
+	g_cancellable_cancel (batch->cancellable);
+	batch->directory = NULL;
+	ATTRIBUTE_BATCH_SLOT (directory, klass) = NULL;
+
+	/* The callbacks still arrive and free the batch, but the
+	 * files are let go right away.
 	 */
-	nautilus_file_ref (get_info_file);
+	for (i = 0; i < batch->n_items; i++) {
+		file = batch->items[i].file;
+		if (file == NULL) {
+			continue;
+		}
+		batch->items[i].file = NULL;
 
-	error = NULL;
-	info = g_file_query_info_finish (G_FILE (source_object), res, &error);
-	
-	if (info == NULL) {
-		if (error->domain == G_IO_ERROR && error->code == G_IO_ERROR_NOT_FOUND) {
-			/* mark file as gone */
-			nautilus_file_mark_gone (get_info_file);
+		if (file->details->directory == directory &&
+		    !file->details->is_gone) {
+			nautilus_directory_add_file_to_work_queue (directory, file);
 		}
-		get_info_file->details->file_info_is_up_to_date = TRUE;
-		nautilus_file_clear_info (get_info_file);
-		get_info_file->details->get_info_failed = TRUE;
-		get_info_file->details->get_info_error = error;
-	} else {
-		nautilus_file_update_info (get_info_file, info);
-		g_object_unref (info);
+		nautilus_file_unref (file);
 	}
 
-	nautilus_file_changed (get_info_file);
-	nautilus_file_unref (get_info_file);
+	async_job_end (directory, klass->job);
+}
 
-	async_job_end (directory, "file info");
-	nautilus_directory_async_state_changed (directory);
+static void
+attribute_batch_cancel_file (NautilusDirectory *directory,
+			     const AttributeBatchClass *klass,
+			     NautilusFile *file)
+{
+	AttributeBatch *batch;
+	guint i;
 
-	nautilus_directory_unref (directory);
+	batch = ATTRIBUTE_BATCH_SLOT (directory, klass);
+	if (batch == NULL) {
+		return;
+	}
 
-	get_info_state_free (state);
+	/* Only this file is dropped, the rest of the batch goes on. */
+	for (i = 0; i < batch->n_items; i++) {
+		if (batch->items[i].file == file) {
+			batch->items[i].file = NULL;
+			nautilus_file_unref (file);
+		}
+	}
 }
 
 static void
-file_info_stop (NautilusDirectory *directory)
+attribute_batch_stop (NautilusDirectory *directory,
+		      const AttributeBatchClass *klass)
 {
+	AttributeBatch *batch;
 	NautilusFile *file;
+	guint i;
 
-	if (directory->details->get_info_in_progress != NULL) {
-		file = directory->details->get_info_file;
-		if (file != NULL) {
-			g_assert (NAUTILUS_IS_FILE (file));
-			g_assert (file->details->directory == directory);
-			if (is_needy (file, lacks_info, REQUEST_FILE_INFO)) {
-				return;
-			}
-		}
+	batch = ATTRIBUTE_BATCH_SLOT (directory, klass);
+	if (batch == NULL) {
+		return;
+	}
 
-		/* The info is not wanted, so stop it. */
-		file_info_cancel (directory);
+	for (i = 0; i < batch->n_items; i++) {
+		file = batch->items[i].file;
+		if (file != NULL &&
+		    file->details->directory == directory &&
+		    is_needy (file, klass->lacks, klass->request_type)) {
+			return;
+		}
 	}
+
+	/* None of the files want it any more, so stop. */
+	attribute_batch_cancel (directory, klass);
+}
+
+static gboolean
+attribute_batch_wants_file (NautilusFile *file,
+			    gpointer callback_data)
+{
+	const AttributeBatchClass *klass;
+
+	klass = callback_data;
+	return is_needy (file, klass->lacks, klass->request_type);
 }
 
+/* Starts getting an attribute for file and for as many of the needy
+ * files behind it in queue as fit in a batch. They are taken off the
+ * queue until the batch is done.
+ */
 static void
-file_info_start (NautilusDirectory *directory,
-		 NautilusFile *file,
-		 gboolean *doing_io)
+attribute_batch_start (NautilusDirectory *directory,
+		       NautilusFileQueue *queue,
+		       NautilusFile *file,
+		       const AttributeBatchClass *klass,
+		       gboolean *doing_io)
 {
-	GFile *location;
-	GetInfoState *state;
-	
-	file_info_stop (directory);
+	AttributeBatch *batch;
+	NautilusFile *files[ATTRIBUTE_BATCH_SIZE];
+	guint i, n_files;
 
-	if (directory->details->get_info_in_progress != NULL) {
+	if (ATTRIBUTE_BATCH_SLOT (directory, klass) != NULL) {
 		*doing_io = TRUE;
 		return;
 	}
 
-	if (!is_needy (file, lacks_info, REQUEST_FILE_INFO)) {
+	if (!is_needy (file, klass->lacks, klass->request_type)) {
 		return;
 	}
 	*doing_io = TRUE;
 
-	if (!async_job_start (directory, "file info")) {
+	if (!async_job_start (directory, klass->job)) {
+		return;
+	}
+
+	/* Another batch may already have taken file off the queue,
+	 * so it is added by hand.
+	 */
+	files[0] = nautilus_file_ref (file);
+	nautilus_file_queue_remove (queue, file);
+	n_files = 1 + nautilus_file_queue_dequeue_batch (queue,
+							 attribute_batch_wants_file,
+							 (gpointer) klass,
+							 files + 1,
+							 ATTRIBUTE_BATCH_SIZE - 1);
+
+	batch = g_new0 (AttributeBatch, 1);
+	batch->klass = klass;
+	batch->directory = directory;
+	batch->cancellable = g_cancellable_new ();
+	batch->n_items = n_files;
+	/* One extra so items finishing right away can't end the
+	 * batch before all of them are started.
+	 */
+	batch->n_pending = n_files + 1;
+
+	ATTRIBUTE_BATCH_SLOT (directory, klass) = batch;
+
+	for (i = 0; i < n_files; i++) {
+		batch->items[i].batch = batch;
+		batch->items[i].file = files[i];
+	}
+	for (i = 0; i < n_files; i++) {
+		(* klass->start_item) (&batch->items[i]);
+	}
+
+	attribute_batch_release (batch);
+}
+
+static void
+query_info_callback (GObject *source_object,
+		     GAsyncResult *res,
+		     gpointer user_data)
+{
+	AttributeBatchItem *item;
+	NautilusFile *get_info_file;
+	GFileInfo *info;
+	GError *error;
+
+	item = user_data;
+
+	if (attribute_batch_item_is_cancelled (item)) {
+		/* Operation was cancelled. Bail out */
+		attribute_batch_item_done (item);
 		return;
 	}
 
-	directory->details->get_info_file = file;
+	get_info_file = item->file;
+	g_assert (NAUTILUS_IS_FILE (get_info_file));
+
+	error = NULL;
+	info = g_file_query_info_finish (G_FILE (source_object), res, &error);
+	
+	if (info == NULL) {
+		if (error->domain == G_IO_ERROR && error->code == G_IO_ERROR_NOT_FOUND) {
+			/* mark file as gone */
+			nautilus_file_mark_gone (get_info_file);
+		}
+		get_info_file->details->file_info_is_up_to_date = TRUE;
+		nautilus_file_clear_info (get_info_file);
+		get_info_file->details->get_info_failed = TRUE;
+		get_info_file->details->get_info_error = error;
+	} else {
+		nautilus_file_update_info (get_info_file, info);
+		g_object_unref (info);
+	}
+
+	attribute_batch_item_done (item);
+}
+
+static void
+file_info_start_item (AttributeBatchItem *item)
+{
+	NautilusFile *file;
+	GFile *location;
+
+	file = item->file;
 	file->details->get_info_failed = FALSE;
 	if (file->details->get_info_error) {
 		g_error_free (file->details->get_info_error);
 		file->details->get_info_error = NULL;
 	}
 
-	state = g_new (GetInfoState, 1);
-	state->directory = directory;
-	state->cancellable = g_cancellable_new ();
-
-	directory->details->get_info_in_progress = state;
-	
 	location = nautilus_file_get_location (file);
 	g_file_query_info_async (location,
 				 NAUTILUS_FILE_DEFAULT_ATTRIBUTES,
 				 0,
 				 G_PRIORITY_DEFAULT,
-				 state->cancellable, query_info_callback, state);
+				 item->batch->cancellable, query_info_callback, item);
 	g_object_unref (location);
 }
 
+static const AttributeBatchClass file_info_batch_class = {
+	ASYNC_JOB_FILE_INFO,
+	REQUEST_FILE_INFO,
+	lacks_info,
+	G_STRUCT_OFFSET (NautilusDirectoryDetails, get_info_in_progress),
+	file_info_start_item
+};
+
+static void
+file_info_cancel (NautilusDirectory *directory)
+{
+	attribute_batch_cancel (directory, &file_info_batch_class);
+}
+
+static void
+file_info_stop (NautilusDirectory *directory)
+{
+	attribute_batch_stop (directory, &file_info_batch_class);
+}
+
+static void
+file_info_start (NautilusDirectory *directory,
+		 NautilusFile *file,
+		 gboolean *doing_io)
+{
+	file_info_stop (directory);
+
+	attribute_batch_start (directory,
+			       directory->details->high_priority_queue,
+			       file, &file_info_batch_class, doing_io);
+}
+
 static gboolean
 is_link_trusted (NautilusFile *file,
 		 gboolean is_launcher)
@@ -3578,29 +4507,6 @@ link_info_done (NautilusDirectory *directory,
 	nautilus_directory_async_state_changed (directory);
 }
 
-static void
-link_info_stop (NautilusDirectory *directory)
-{
-	NautilusFile *file;
-
-	if (directory->details->link_info_read_state != NULL) {
-		file = directory->details->link_info_read_state->file;
-
-		if (file != NULL) {
-			g_assert (NAUTILUS_IS_FILE (file));
-			g_assert (file->details->directory == directory);
-			if (is_needy (file,
-				      lacks_link_info,
-				      REQUEST_LINK_INFO)) {
-				return;
-			}
-		}
-
-		/* The link info is not wanted, so stop it. */
-		link_info_cancel (directory);
-	}
-}
-
 static void
 link_info_got_data (NautilusDirectory *directory,
 		    NautilusFile *file,
@@ -3631,10 +4537,7 @@ link_info_got_data (NautilusDirectory *directory,
 		/* FIXME bugzilla.gnome.org 42433: We should report this error to the user. */
 	}
 
-	nautilus_file_ref (file);
 	link_info_done (directory, file, uri, name, icon, is_launcher, is_foreign);
-	nautilus_file_changed (file);
-	nautilus_file_unref (file);
 	
 	g_free (uri);
 	g_free (name);
@@ -3646,51 +4549,72 @@ link_info_got_data (NautilusDirectory *directory,
 	nautilus_directory_unref (directory);
 }
 
-static void
-link_info_read_state_free (LinkInfoReadState *state)
-{
-	g_object_unref (state->cancellable);
-	g_free (state);
-}
-
 static void
 link_info_nautilus_link_read_callback (GObject *source_object,
 				       GAsyncResult *res,
 				       gpointer user_data)
 {
-	LinkInfoReadState *state;
+	AttributeBatchItem *item;
 	gsize file_size;
 	char *file_contents;
 	gboolean result;
-	NautilusDirectory *directory;
 
-	state = user_data;
+	item = user_data;
 
-	if (state->directory == NULL) {
+	if (attribute_batch_item_is_cancelled (item)) {
 		/* Operation was cancelled. Bail out */
-		link_info_read_state_free (state);
+		attribute_batch_item_done (item);
 		return;
 	}
 
-	directory = nautilus_directory_ref (state->directory);
-
 	result = g_file_load_contents_finish (G_FILE (source_object),
 					      res,
 					      &file_contents, &file_size,
 					      NULL, NULL);
 
-	state->directory->details->link_info_read_state = NULL;
-	async_job_end (state->directory, "link info");
-	
-	link_info_got_data (state->directory, state->file, result, file_size, file_contents);
+	link_info_got_data (item->batch->directory, item->file, result, file_size, file_contents);
 
 	if (result) {
 		g_free (file_contents);
 	}
-	
-	link_info_read_state_free (state);
-	
-	nautilus_directory_unref (directory);
+
+	attribute_batch_item_done (item);
+}
+
+static void
+link_info_start_item (AttributeBatchItem *item)
+{
+	GFile *location;
+
+	/* lacks_link_info takes care of files that are not links,
+	 * so only the Nautilus links get here and need to be read.
+	 */
+	location = nautilus_file_get_location (item->file);
+	g_file_load_contents_async (location,
+				    item->batch->cancellable,
+				    link_info_nautilus_link_read_callback,
+				    item);
+	g_object_unref (location);
+}
+
+static const AttributeBatchClass link_info_batch_class = {
+	ASYNC_JOB_LINK_INFO,
+	REQUEST_LINK_INFO,
+	lacks_link_info,
+	G_STRUCT_OFFSET (NautilusDirectoryDetails, link_info_in_progress),
+	link_info_start_item
+};
+
+static void
+link_info_cancel (NautilusDirectory *directory)
+{
+	attribute_batch_cancel (directory, &link_info_batch_class);
+}
+
+static void
+link_info_stop (NautilusDirectory *directory)
+{
+	attribute_batch_stop (directory, &link_info_batch_class);
 }
 
 static void
@@ -3698,48 +4622,35 @@ link_info_start (NautilusDirectory *directory,
 		 NautilusFile *file,
 		 gboolean *doing_io)
 {
-	GFile *location;
-	gboolean nautilus_style_link;
-	LinkInfoReadState *state;
-	
-	if (directory->details->link_info_read_state != NULL) {
-		*doing_io = TRUE;
-		return;
-	}
-
-	if (!is_needy (file,
-		       lacks_link_info,
-		       REQUEST_LINK_INFO)) {
-		return;
-	}
-	*doing_io = TRUE;
+	attribute_batch_start (directory,
+			       directory->details->high_priority_queue,
+			       file, &link_info_batch_class, doing_io);
+}
 
-	/* Figure out if it is a link. */
-	nautilus_style_link = nautilus_file_is_nautilus_link (file);
-	location = nautilus_file_get_location (file);
-	
-	/* If it's not a link we are done. If it is, we need to read it. */
-	if (!nautilus_style_link) {
-		link_info_done (directory, file, NULL, NULL, NULL, FALSE, FALSE);
-	} else {
-		if (!async_job_start (directory, "link info")) {
-			g_object_unref (location);
-			return;
-		}
+/* Whether pixbuf, read from the original or from the thumbnail, is
+ * for the file as it is now. A thumbnail made for an older version of
+ * the file is rejected, and must not be cached either, or the cache
+ * would hand it back before every attempt to make a new one.
+ */
+static gboolean
+thumbnail_pixbuf_is_current (NautilusFile *file,
+			     GdkPixbuf *pixbuf,
+			     gboolean original)
+{
+	const char *thumb_mtime_str;
+	time_t thumb_mtime;
 
-		state = g_new0 (LinkInfoReadState, 1);
-		state->directory = directory;
-		state->file = file;
-		state->cancellable = g_cancellable_new ();
-		
-		directory->details->link_info_read_state = state;
+	if (original) {
+		return TRUE;
+	}
 
-		g_file_load_contents_async (location,
-					    state->cancellable,
-					    link_info_nautilus_link_read_callback,
-					    state);
+	thumb_mtime = 0;
+	thumb_mtime_str = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime");
+	if (thumb_mtime_str) {
+		thumb_mtime = atol (thumb_mtime_str);
 	}
-	g_object_unref (location);
+
+	return thumb_mtime == 0 || thumb_mtime == file->details->mtime;
 }
 
 static void
@@ -3823,6 +4734,18 @@ thumbnail_got_pixbuf (NautilusDirectory *directory,
 	nautilus_directory_unref (directory);
 }
 
+static gboolean
+thumbnail_changed_idle (gpointer user_data)
+{
+	NautilusFile *file;
+
+	file = user_data;
+	nautilus_file_changed (file);
+	nautilus_file_unref (file);
+
+	return FALSE;
+}
+
 static void
 thumbnail_state_free (ThumbnailState *state)
 {
@@ -3832,6 +4755,41 @@ thumbnail_state_free (ThumbnailState *state)
 
 extern int cached_thumbnail_size;
 
+static int
+get_max_thumbnail_size (void)
+{
+	/* cf. nautilus_file_get_icon() */
+	return NAUTILUS_ICON_SIZE_LARGEST * cached_thumbnail_size / NAUTILUS_ICON_SIZE_STANDARD;
+}
+
+/* The key of the pixbuf read for file, from the original or from
+ * the thumbnail.
+ */
+static char *
+get_thumbnail_cache_key (NautilusFile *file,
+			 gboolean original)
+{
+	GFile *location;
+	char *uri, *key;
+	int max_thumbnail_size;
+
+	if (original) {
+		location = nautilus_file_get_location (file);
+	} else {
+		location = g_file_new_for_path (file->details->thumbnail_path);
+	}
+	uri = g_file_get_uri (location);
+	g_object_unref (location);
+
+	max_thumbnail_size = get_max_thumbnail_size ();
+	key = nautilus_thumbnail_cache_key (uri, file->details->mtime, 0, 0,
+					    max_thumbnail_size, max_thumbnail_size,
+					    FALSE);
+	g_free (uri);
+
+	return key;
+}
+
 /* scale very large images down to the max. size we need */
 static void
 thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
@@ -3844,8 +4802,7 @@ thumbnail_loader_size_prepared (GdkPixbufLoader *loader,
 
 	aspect_ratio = ((double) width) / height;
 
-	/* cf. nautilus_file_get_icon() */
-	max_thumbnail_size = NAUTILUS_ICON_SIZE_LARGEST * cached_thumbnail_size / NAUTILUS_ICON_SIZE_STANDARD;
+	max_thumbnail_size = get_max_thumbnail_size ();
 	if (MAX (width, height) > max_thumbnail_size) {
 		if (width > height) {
 			width = max_thumbnail_size;
@@ -3911,6 +4868,7 @@ thumbnail_read_callback (GObject *source_object,
 	NautilusDirectory *directory;
 	GdkPixbuf *pixbuf;
 	GFile *location;
+	char *key;
 
 	state = user_data;
 
@@ -3943,8 +4901,15 @@ thumbnail_read_callback (GObject *source_object,
 					    state);
 		g_object_unref (location);
 	} else {
+		if (pixbuf != NULL &&
+		    thumbnail_pixbuf_is_current (state->file, pixbuf, state->trying_original)) {
+			key = get_thumbnail_cache_key (state->file, state->trying_original);
+			nautilus_thumbnail_cache_insert (key, pixbuf);
+			g_free (key);
+		}
+
 		state->directory->details->thumbnail_state = NULL;
-		async_job_end (state->directory, "thumbnail");
+		async_job_end (state->directory, ASYNC_JOB_THUMBNAIL);
 		
 		thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
 	
@@ -3961,6 +4926,8 @@ thumbnail_start (NautilusDirectory *directory,
 {
 	GFile *location;
 	ThumbnailState *state;
+	GdkPixbuf *pixbuf;
+	char *key;
 
 	if (directory->details->thumbnail_state != NULL) {
 		*doing_io = TRUE;
@@ -3972,9 +4939,26 @@ thumbnail_start (NautilusDirectory *directory,
 		       REQUEST_THUMBNAIL)) {
 		return;
 	}
+
+	/* Some other view may have read it recently. */
+	key = get_thumbnail_cache_key (file, file->details->thumbnail_wants_original);
+	pixbuf = nautilus_thumbnail_cache_lookup (key);
+	g_free (key);
+	if (pixbuf != NULL) {
+		thumbnail_done (directory, file, pixbuf,
+				file->details->thumbnail_wants_original);
+		g_object_unref (pixbuf);
+
+		/* We are in the middle of starting I/O, tell the views
+		 * from the main loop.
+		 */
+		g_idle_add (thumbnail_changed_idle, nautilus_file_ref (file));
+		return;
+	}
+
 	*doing_io = TRUE;
 
-	if (!async_job_start (directory, "thumbnail")) {
+	if (!async_job_start (directory, ASYNC_JOB_THUMBNAIL)) {
 		return;
 	}
 	
@@ -4001,60 +4985,16 @@ thumbnail_start (NautilusDirectory *directory,
 }
 
 static void
-mount_stop (NautilusDirectory *directory)
-{
-	NautilusFile *file;
-
-	if (directory->details->mount_state != NULL) {
-		file = directory->details->mount_state->file;
-
-		if (file != NULL) {
-			g_assert (NAUTILUS_IS_FILE (file));
-			g_assert (file->details->directory == directory);
-			if (is_needy (file,
-				      lacks_mount,
-				      REQUEST_MOUNT)) {
-				return;
-			}
-		}
-
-		/* The link info is not wanted, so stop it. */
-		mount_cancel (directory);
-	}
-}
-
-static void
-mount_state_free (MountState *state)
-{
-	g_object_unref (state->cancellable);
-	g_free (state);
-}
-
-static void
-got_mount (MountState *state, GMount *mount)
+got_mount (AttributeBatchItem *item, GMount *mount)
 {
-	NautilusDirectory *directory;
 	NautilusFile *file;
-	
-	directory = nautilus_directory_ref (state->directory);
 
-	state->directory->details->mount_state = NULL;
-	async_job_end (state->directory, "mount");
-	
-	file = nautilus_file_ref (state->file);
+	file = item->file;
 
 	file->details->mount_is_up_to_date = TRUE;
 	nautilus_file_set_mount (file, mount);
 
-	nautilus_directory_async_state_changed (directory);
-	nautilus_file_changed (file);
-	
-	nautilus_file_unref (file);
-	
-	nautilus_directory_unref (directory);
-	
-	mount_state_free (state);
-
+	attribute_batch_item_done (item);
 }
 
 static void
@@ -4063,13 +5003,13 @@ find_enclosing_mount_callback (GObject *source_object,
 			       gpointer user_data)
 {
 	GMount *mount;
-	MountState *state;
+	AttributeBatchItem *item;
 	GFile *location, *root;
 
-	state = user_data;
-	if (state->directory == NULL) {
+	item = user_data;
+	if (attribute_batch_item_is_cancelled (item)) {
 		/* Operation was cancelled. Bail out */
-		mount_state_free (state);
+		attribute_batch_item_done (item);
 		return;
 	}
 
@@ -4078,7 +5018,7 @@ find_enclosing_mount_callback (GObject *source_object,
 
 	if (mount) {
 		root = g_mount_get_root (mount);
-		location = nautilus_file_get_location (state->file);
+		location = nautilus_file_get_location (item->file);
 		if (!g_file_equal (location, root)) {
 			g_object_unref (mount);
 			mount = NULL;
@@ -4087,7 +5027,7 @@ find_enclosing_mount_callback (GObject *source_object,
 		g_object_unref (location);
 	}
 
-	got_mount (state, mount);
+	got_mount (item, mount);
 
 	if (mount) {
 		g_object_unref (mount);
@@ -4130,37 +5070,12 @@ get_mount_at (GFile *target)
 }
 
 static void
-mount_start (NautilusDirectory *directory,
-	     NautilusFile *file,
-	     gboolean *doing_io)
+mount_start_item (AttributeBatchItem *item)
 {
+	NautilusFile *file;
 	GFile *location;
-	MountState *state;
-	
-	if (directory->details->mount_state != NULL) {
-		*doing_io = TRUE;
-		return;
-	}
-
-	if (!is_needy (file,
-		       lacks_mount,
-		       REQUEST_MOUNT)) {
-		return;
-	}
-	*doing_io = TRUE;
-
-	if (!async_job_start (directory, "mount")) {
-		return;
-	}
-	
-	state = g_new0 (MountState, 1);
-	state->directory = directory;
-	state->file = file;
-	state->cancellable = g_cancellable_new ();
 
-	location = nautilus_file_get_location (file);
-	
-	directory->details->mount_state = state;
+	file = item->file;
 
 	if (file->details->type == G_FILE_TYPE_MOUNTABLE) {
 		GFile *target;
@@ -4173,93 +5088,50 @@ mount_start (NautilusDirectory *directory,
 			g_object_unref (target);
 		}
 
-		got_mount (state, mount);
+		got_mount (item, mount);
 
 		if (mount) {
 			g_object_unref (mount);
 		}
 	} else {
+		location = nautilus_file_get_location (file);
 		g_file_find_enclosing_mount_async (location,
 						   G_PRIORITY_DEFAULT,
-						   state->cancellable,
+						   item->batch->cancellable,
 						   find_enclosing_mount_callback,
-						   state);
+						   item);
+		g_object_unref (location);
 	}
-	g_object_unref (location);
 }
 
-static void
-filesystem_info_cancel (NautilusDirectory *directory)
-{
-	if (directory->details->filesystem_info_state != NULL) {
-		g_cancellable_cancel (directory->details->filesystem_info_state->cancellable);
-		directory->details->filesystem_info_state->directory = NULL;
-		directory->details->filesystem_info_state = NULL;
-		async_job_end (directory, "filesystem info");
-	}
-}
+static const AttributeBatchClass mount_batch_class = {
+	ASYNC_JOB_MOUNT,
+	REQUEST_MOUNT,
+	lacks_mount,
+	G_STRUCT_OFFSET (NautilusDirectoryDetails, mount_in_progress),
+	mount_start_item
+};
 
 static void
-filesystem_info_stop (NautilusDirectory *directory)
+mount_cancel (NautilusDirectory *directory)
 {
-	NautilusFile *file;
-
-	if (directory->details->filesystem_info_state != NULL) {
-		file = directory->details->filesystem_info_state->file;
-
-		if (file != NULL) {
-			g_assert (NAUTILUS_IS_FILE (file));
-			g_assert (file->details->directory == directory);
-			if (is_needy (file,
-				      lacks_filesystem_info,
-				      REQUEST_FILESYSTEM_INFO)) {
-				return;
-			}
-		}
-
-		/* The filesystem info is not wanted, so stop it. */
-		filesystem_info_cancel (directory);
-	}
+	attribute_batch_cancel (directory, &mount_batch_class);
 }
 
 static void
-filesystem_info_state_free (FilesystemInfoState *state)
+mount_stop (NautilusDirectory *directory)
 {
-	g_object_unref (state->cancellable);
-	g_free (state);
+	attribute_batch_stop (directory, &mount_batch_class);
 }
 
 static void
-got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
+mount_start (NautilusDirectory *directory,
+	     NautilusFile *file,
+	     gboolean *doing_io)
 {
-	NautilusDirectory *directory;
-	NautilusFile *file;
-
-	/* careful here, info may be NULL */
-
-	directory = nautilus_directory_ref (state->directory);
-
-	state->directory->details->filesystem_info_state = NULL;
-	async_job_end (state->directory, "filesystem info");
-	
-	file = nautilus_file_ref (state->file);
-
-	file->details->filesystem_info_is_up_to_date = TRUE;
-	if (info != NULL) {
-		file->details->filesystem_use_preview = 
-			g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW);
-		file->details->filesystem_readonly = 
-			g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY);
-	}
-	
-	nautilus_directory_async_state_changed (directory);
-	nautilus_file_changed (file);
-	
-	nautilus_file_unref (file);
-	
-	nautilus_directory_unref (directory);
-	
-	filesystem_info_state_free (state);
+	attribute_batch_start (directory,
+			       directory->details->low_priority_queue,
+			       file, &mount_batch_class, doing_io);
 }
 
 static void
@@ -4268,67 +5140,77 @@ query_filesystem_info_callback (GObject *source_object,
 				gpointer user_data)
 {
 	GFileInfo *info;
-	FilesystemInfoState *state;
+	AttributeBatchItem *item;
+	NautilusFile *file;
 
-	state = user_data;
-	if (state->directory == NULL) {
+	item = user_data;
+	if (attribute_batch_item_is_cancelled (item)) {
 		/* Operation was cancelled. Bail out */
-		filesystem_info_state_free (state);
+		attribute_batch_item_done (item);
 		return;
 	}
 
 	info = g_file_query_filesystem_info_finish (G_FILE (source_object), res, NULL);
 
-	got_filesystem_info (state, info);
-
+	file = item->file;
+	file->details->filesystem_info_is_up_to_date = TRUE;
 	if (info != NULL) {
+		file->details->filesystem_use_preview = 
+			g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW);
+		file->details->filesystem_readonly = 
+			g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY);
 		g_object_unref (info);
 	}
+
+	attribute_batch_item_done (item);
 }
 
 static void
-filesystem_info_start (NautilusDirectory *directory,
-		       NautilusFile *file,
-		       gboolean *doing_io)
+filesystem_info_start_item (AttributeBatchItem *item)
 {
 	GFile *location;
-	FilesystemInfoState *state;
-
-	if (directory->details->filesystem_info_state != NULL) {
-		*doing_io = TRUE;
-		return;
-	}
-
-	if (!is_needy (file,
-		       lacks_filesystem_info,
-		       REQUEST_FILESYSTEM_INFO)) {
-		return;
-	}
-	*doing_io = TRUE;
-
-	if (!async_job_start (directory, "filesystem info")) {
-		return;
-	}
-	
-	state = g_new0 (FilesystemInfoState, 1);
-	state->directory = directory;
-	state->file = file;
-	state->cancellable = g_cancellable_new ();
-
-	location = nautilus_file_get_location (file);
-	
-	directory->details->filesystem_info_state = state;
 
+	location = nautilus_file_get_location (item->file);
 	g_file_query_filesystem_info_async (location,
 					    G_FILE_ATTRIBUTE_FILESYSTEM_READONLY ","
 					    G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW,
 					    G_PRIORITY_DEFAULT,
-					    state->cancellable, 
+					    item->batch->cancellable, 
 					    query_filesystem_info_callback, 
-					    state);
+					    item);
 	g_object_unref (location);
 }
 
+static const AttributeBatchClass filesystem_info_batch_class = {
+	ASYNC_JOB_FILESYSTEM_INFO,
+	REQUEST_FILESYSTEM_INFO,
+	lacks_filesystem_info,
+	G_STRUCT_OFFSET (NautilusDirectoryDetails, filesystem_info_in_progress),
+	filesystem_info_start_item
+};
+
+static void
+filesystem_info_cancel (NautilusDirectory *directory)
+{
+	attribute_batch_cancel (directory, &filesystem_info_batch_class);
+}
+
+static void
+filesystem_info_stop (NautilusDirectory *directory)
+{
+	attribute_batch_stop (directory, &filesystem_info_batch_class);
+}
+
+static void
+filesystem_info_start (NautilusDirectory *directory,
+		       NautilusFile *file,
+		       gboolean *doing_io)
+{
+	attribute_batch_start (directory,
+			       directory->details->low_priority_queue,
+			       file, &filesystem_info_batch_class, doing_io);
+}
+
 static void
 extension_info_cancel (NautilusDirectory *directory)
 {
@@ -4346,7 +5228,7 @@ extension_info_cancel (NautilusDirectory *directory)
 		directory->details->extension_info_provider = NULL;
 		directory->details->extension_info_idle = 0;
 
-		async_job_end (directory, "extension info");
+		async_job_end (directory, ASYNC_JOB_EXTENSION_INFO);
 	}
 }
 	
@@ -4402,7 +5284,7 @@ info_provider_idle_callback (gpointer user_data)
 		g_warning ("Unexpected plugin response.  This probably indicates a bug in a Nautilus extension: handle=%p", response->handle);
 	} else {
 		NautilusFile *file;
-		async_job_end (directory, "extension info");
+		async_job_end (directory, ASYNC_JOB_EXTENSION_INFO);
 
 		file = directory->details->extension_info_file;
 
@@ -4457,7 +5339,7 @@ extension_info_start (NautilusDirectory *directory,
 	}
 	*doing_io = TRUE;
 
-	if (!async_job_start (directory, "extension info")) {
+	if (!async_job_start (directory, ASYNC_JOB_EXTENSION_INFO)) {
 		return;
 	}
 
@@ -4480,7 +5362,7 @@ extension_info_start (NautilusDirectory *directory,
 	if (result == NAUTILUS_OPERATION_COMPLETE ||
 	    result == NAUTILUS_OPERATION_FAILED) {
 		finish_info_provider (directory, file, provider);
-		async_job_end (directory, "extension info");
+		async_job_end (directory, ASYNC_JOB_EXTENSION_INFO);
 	} else {
 		directory->details->extension_info_in_progress = handle;
 		directory->details->extension_info_provider = provider;
@@ -4611,9 +5493,7 @@ nautilus_directory_cancel (NautilusDirectory *directory)
 	filesystem_info_cancel (directory);
 
 	/* We aren't waiting for anything any more. */
-	if (waiting_directories != NULL) {
-		g_hash_table_remove (waiting_directories, directory);
-	}
+	async_job_pool_remove_waiting (directory);
 
 	/* Check if any directories should wake up. */
 	async_job_wake_up ();
@@ -4662,9 +5542,7 @@ static void
 cancel_file_info_for_file (NautilusDirectory *directory,
 			   NautilusFile      *file)
 {
-	if (directory->details->get_info_file == file) {
-		file_info_cancel (directory);
-	}
+	attribute_batch_cancel_file (directory, &file_info_batch_class, file);
 }
 
 static void
@@ -4681,30 +5559,21 @@ static void
 cancel_mount_for_file (NautilusDirectory *directory,
 			   NautilusFile      *file)
 {
-	if (directory->details->mount_state != NULL &&
-	    directory->details->mount_state->file == file) {
-		mount_cancel (directory);
-	}
+	attribute_batch_cancel_file (directory, &mount_batch_class, file);
 }
 
 static void
 cancel_filesystem_info_for_file (NautilusDirectory *directory,
 				 NautilusFile      *file)
 {
-	if (directory->details->filesystem_info_state != NULL &&
-	    directory->details->filesystem_info_state->file == file) {
-		filesystem_info_cancel (directory);
-	}
+	attribute_batch_cancel_file (directory, &filesystem_info_batch_class, file);
 }
 
 static void
 cancel_link_info_for_file (NautilusDirectory *directory,
 			   NautilusFile      *file)
 {
-	if (directory->details->link_info_read_state != NULL &&
-	    directory->details->link_info_read_state->file == file) {
-		link_info_cancel (directory);
-	}
+	attribute_batch_cancel_file (directory, &link_info_batch_class, file);
 }
 
 
@@ -4809,11 +5678,11 @@ nautilus_directory_add_file_to_work_queue (NautilusDirectory *directory,
 static void
 add_all_files_to_work_queue (NautilusDirectory *directory)
 {
-	GList *node;
 	NautilusFile *file;
+	guint i;
 	
-	for (node = directory->details->file_list; node != NULL; node = node->next) {
-		file = NAUTILUS_FILE (node->data);
+	for (i = 0; i < directory->details->files->len; i++) {
+		file = g_ptr_array_index (directory->details->files, i);
 
 		nautilus_directory_add_file_to_work_queue (directory, file);
 	}
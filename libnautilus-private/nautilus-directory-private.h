@@ -31,18 +31,16 @@
 #include <libnautilus-extension/nautilus-info-provider.h>
 #include <libxml/tree.h>
 
-typedef struct LinkInfoReadState LinkInfoReadState;
 typedef struct TopLeftTextReadState TopLeftTextReadState;
 typedef struct FileMonitors FileMonitors;
 typedef struct DirectoryLoadState DirectoryLoadState;
 typedef struct DirectoryCountState DirectoryCountState;
 typedef struct DeepCountState DeepCountState;
-typedef struct GetInfoState GetInfoState;
 typedef struct NewFilesState NewFilesState;
 typedef struct MimeListState MimeListState;
 typedef struct ThumbnailState ThumbnailState;
-typedef struct MountState MountState;
-typedef struct FilesystemInfoState FilesystemInfoState;
+typedef struct AsyncJobPool AsyncJobPool;
+typedef struct AttributeBatch AttributeBatch;
 
 typedef enum {
 	REQUEST_LINK_INFO,
@@ -74,8 +72,11 @@ struct NautilusDirectoryDetails
 
 	/* The file objects. */
 	NautilusFile *as_file;
-	GList *file_list;
-	GHashTable *file_hash;
+	/* The confirmed files come first, followed by the ones a reload
+	 * has not seen yet, see nautilus_directory_confirm_file.
+	 */
+	GPtrArray *files;
+	GHashTable *file_hash; /* name -> NautilusFile */
 
 	/* Queues of files needing some I/O done. */
 	NautilusFileQueue *high_priority_queue;
@@ -102,8 +103,8 @@ struct NautilusDirectoryDetails
 	gboolean directory_loaded_sent_notification;
 	DirectoryLoadState *directory_load_in_progress;
 
-	GList *pending_file_info; /* list of GnomeVFSFileInfo's that are pending */
-	int confirmed_file_count;
+	GList *pending_file_info; /* list of PendingFileInfo * that are pending */
+	guint confirmed_file_count;
         guint dequeue_pending_idle_id;
 
 	GList *new_files_in_progress; /* list of NewFilesState * */
@@ -115,8 +116,11 @@ struct NautilusDirectoryDetails
 
 	MimeListState *mime_list_in_progress;
 
-	NautilusFile *get_info_file;
-	GetInfoState *get_info_in_progress;
+	/* Attributes fetched for many files at once, see AttributeBatch. */
+	AttributeBatch *get_info_in_progress;
+	AttributeBatch *link_info_in_progress;
+	AttributeBatch *mount_in_progress;
+	AttributeBatch *filesystem_info_in_progress;
 
 	NautilusFile *extension_info_file;
 	NautilusInfoProvider *extension_info_provider;
@@ -125,16 +129,16 @@ struct NautilusDirectoryDetails
 
 	ThumbnailState *thumbnail_state;
 
-	MountState *mount_state;
-
-	FilesystemInfoState *filesystem_info_state;
-	
 	TopLeftTextReadState *top_left_read_state;
 
-	LinkInfoReadState *link_info_read_state;
-
 	GList *file_operations_in_progress; /* list of FileOperation * */
 
+	/* Async. job accounting, see nautilus-directory-async.c. */
+	AsyncJobPool *job_pool;
+	AsyncJobPool *waiting_job_pool;
+	int job_count;
+	GHashTable *job_start_times;
+
 	GHashTable *hidden_file_hash;
 };
 
@@ -221,11 +225,16 @@ void               nautilus_directory_add_file_monitors               (NautilusD
 								       FileMonitors              *monitors);
 void               nautilus_directory_add_file                        (NautilusDirectory         *directory,
 								       NautilusFile              *file);
-GList *            nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
+gboolean           nautilus_directory_begin_file_name_change          (NautilusDirectory         *directory,
 								       NautilusFile              *file);
 void               nautilus_directory_end_file_name_change            (NautilusDirectory         *directory,
 								       NautilusFile              *file,
-								       GList                     *node);
+								       gboolean                   in_file_hash);
+GList *            nautilus_directory_copy_files_internal             (NautilusDirectory         *directory);
+void               nautilus_directory_confirm_file                    (NautilusDirectory         *directory,
+								       NautilusFile              *file);
+void               nautilus_directory_unconfirm_all_files             (NautilusDirectory         *directory);
+void               nautilus_directory_confirm_all_files               (NautilusDirectory         *directory);
 void               nautilus_directory_moved                           (const char                *from_uri,
 								       const char                *to_uri);
 /* Interface to the work queue. */
@@ -241,3 +250,25 @@ void               nautilus_set_kde_trash_name                        (const cha
 
 /* debugging functions */
 int                nautilus_directory_number_outstanding              (void);
+
+/* Called with the counters of each async. job pool, see
+ * nautilus-directory-async.c.
+ */
+typedef void (* NautilusDirectoryJobPoolFunc) (const char *backend,
+					       int         jobs_running,
+					       int         job_limit,
+					       int         directories_waiting,
+					       guint       average_latency,
+					       guint64     jobs_started,
+					       gpointer    callback_data);
+
+void               nautilus_directory_foreach_job_pool                (NautilusDirectoryJobPoolFunc callback,
+								       gpointer                     callback_data);
+
+#ifdef ENABLE_DEBUG
+/* Logs the job pools, the monitors and the caches, for
+ * NAUTILUS_DEBUG=Statistics.
+ */
+void               nautilus_directory_log_statistics                  (void);
+#endif
+
@@ -26,9 +26,14 @@
 #include "nautilus-directory-private.h"
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-deep-count-cache.h"
 #include "nautilus-file-attributes.h"
+#include "nautilus-file-changes-queue.h"
 #include "nautilus-file-private.h"
 #include "nautilus-file-utilities.h"
+#include "nautilus-icon-info.h"
+#include "nautilus-monitor.h"
+#include "nautilus-thumbnails.h"
 #include "nautilus-search-directory.h"
 #include "nautilus-global-preferences.h"
 #include "nautilus-lib-self-check-functions.h"
@@ -39,6 +44,9 @@
 #include <eel/eel-string.h>
 #include <gtk/gtk.h>
 
+#define DEBUG_FLAG NAUTILUS_DEBUG_STATISTICS
+#include "nautilus-debug.h"
+
 enum {
 	FILES_ADDED,
 	FILES_CHANGED,
@@ -51,6 +59,23 @@ static guint signals[LAST_SIGNAL];
 
 static GHashTable *directories;
 
+/* The directories are also kept in a tree of their locations, so that
+ * those inside a given location can be found without looking at all
+ * of them. Locations between two directories get nodes too, without
+ * a directory.
+ */
+typedef struct DirectoryTreeNode DirectoryTreeNode;
+
+struct DirectoryTreeNode {
+	GFile *location;
+	NautilusDirectory *directory;
+	DirectoryTreeNode *parent;
+	GQueue children;
+	GList sibling_link;
+};
+
+static GHashTable *directory_tree;
+
 static void               nautilus_directory_finalize         (GObject                *object);
 static NautilusDirectory *nautilus_directory_new              (GFile                  *location);
 static GList *            real_get_file_list                  (NautilusDirectory      *directory);
@@ -112,10 +137,11 @@ static void
 nautilus_directory_init (NautilusDirectory *directory)
 {
 	directory->details = G_TYPE_INSTANCE_GET_PRIVATE ((directory), NAUTILUS_TYPE_DIRECTORY, NautilusDirectoryDetails);
+	directory->details->files = g_ptr_array_new ();
 	directory->details->file_hash = g_hash_table_new (g_str_hash, g_str_equal);
-	directory->details->high_priority_queue = nautilus_file_queue_new ();
-	directory->details->low_priority_queue = nautilus_file_queue_new ();
-	directory->details->extension_queue = nautilus_file_queue_new ();
+	directory->details->high_priority_queue = nautilus_file_queue_new (0);
+	directory->details->low_priority_queue = nautilus_file_queue_new (1);
+	directory->details->extension_queue = nautilus_file_queue_new (2);
 }
 
 NautilusDirectory *
@@ -143,6 +169,100 @@ nautilus_directory_unref (NautilusDirectory *directory)
 	g_object_unref (directory);
 }
 
+static DirectoryTreeNode *
+directory_tree_get_node (GFile *location)
+{
+	DirectoryTreeNode *node;
+	GFile *parent;
+
+	node = g_hash_table_lookup (directory_tree, location);
+	if (node != NULL) {
+		return node;
+	}
+
+	node = g_slice_new0 (DirectoryTreeNode);
+	node->location = g_object_ref (location);
+	g_queue_init (&node->children);
+	node->sibling_link.data = node;
+	g_hash_table_insert (directory_tree, node->location, node);
+
+	parent = g_file_get_parent (location);
+	if (parent != NULL) {
+		node->parent = directory_tree_get_node (parent);
+		g_queue_push_tail_link (&node->parent->children, &node->sibling_link);
+		g_object_unref (parent);
+	}
+
+	return node;
+}
+
+static void
+directory_tree_add (NautilusDirectory *directory)
+{
+	if (directory_tree == NULL) {
+		directory_tree = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+	}
+
+	directory_tree_get_node (directory->details->location)->directory = directory;
+}
+
+static void
+directory_tree_remove (NautilusDirectory *directory)
+{
+	DirectoryTreeNode *node, *parent;
+
+	if (directory_tree == NULL || directory->details->location == NULL) {
+		return;
+	}
+
+	node = g_hash_table_lookup (directory_tree, directory->details->location);
+	if (node == NULL || node->directory != directory) {
+		return;
+	}
+	node->directory = NULL;
+
+	/* Prune the nodes that are no longer needed. */
+	while (node != NULL &&
+	       node->directory == NULL &&
+	       g_queue_is_empty (&node->children)) {
+		parent = node->parent;
+		if (parent != NULL) {
+			g_queue_unlink (&parent->children, &node->sibling_link);
+		}
+		g_hash_table_remove (directory_tree, node->location);
+		g_object_unref (node->location);
+		g_slice_free (DirectoryTreeNode, node);
+		node = parent;
+	}
+}
+
+/* Returns the directories at or inside container, ref'd. */
+static GList *
+directory_tree_collect (GFile *container)
+{
+	DirectoryTreeNode *node;
+	GQueue pending = G_QUEUE_INIT;
+	GList *result, *l;
+
+	result = NULL;
+
+	node = directory_tree != NULL ? g_hash_table_lookup (directory_tree, container) : NULL;
+	if (node != NULL) {
+		g_queue_push_tail (&pending, node);
+	}
+
+	while ((node = g_queue_pop_head (&pending)) != NULL) {
+		if (node->directory != NULL) {
+			result = g_list_prepend (result, nautilus_directory_ref (node->directory));
+		}
+		for (l = node->children.head; l != NULL; l = l->next) {
+			g_queue_push_tail (&pending, l->data);
+		}
+	}
+
+	return result;
+}
+
 static void
 nautilus_directory_finalize (GObject *object)
 {
@@ -151,6 +271,7 @@ nautilus_directory_finalize (GObject *object)
 	directory = NAUTILUS_DIRECTORY (object);
 
 	g_hash_table_remove (directories, directory->details->location);
+	directory_tree_remove (directory);
 
 	nautilus_directory_cancel (directory);
 	g_assert (directory->details->count_in_progress == NULL);
@@ -177,12 +298,17 @@ nautilus_directory_finalize (GObject *object)
 		g_object_unref (directory->details->location);
 	}
 
-	g_assert (directory->details->file_list == NULL);
+	g_assert (directory->details->files->len == 0);
+	g_ptr_array_free (directory->details->files, TRUE);
 	g_hash_table_destroy (directory->details->file_hash);
 
 	if (directory->details->hidden_file_hash) {
 		g_hash_table_destroy (directory->details->hidden_file_hash);
 	}
+
+	if (directory->details->job_start_times != NULL) {
+		g_hash_table_destroy (directory->details->job_start_times);
+	}
 	
 	nautilus_file_queue_destroy (directory->details->high_priority_queue);
 	nautilus_file_queue_destroy (directory->details->low_priority_queue);
@@ -190,7 +316,7 @@ nautilus_directory_finalize (GObject *object)
 	g_assert (directory->details->directory_load_in_progress == NULL);
 	g_assert (directory->details->count_in_progress == NULL);
 	g_assert (directory->details->dequeue_pending_idle_id == 0);
-	g_list_free_full (directory->details->pending_file_info, g_object_unref);
+	g_assert (directory->details->pending_file_info == NULL);
 
 	G_OBJECT_CLASS (nautilus_directory_parent_class)->finalize (object);
 }
@@ -225,12 +351,12 @@ emit_change_signals_for_all_files (NautilusDirectory *directory)
 {
 	GList *files;
 
-	files = g_list_copy (directory->details->file_list);
+	files = nautilus_directory_copy_files_internal (directory);
 	if (directory->details->as_file != NULL) {
-		files = g_list_prepend (files, directory->details->as_file);
+		files = g_list_prepend (files,
+					nautilus_file_ref (directory->details->as_file));
 	}
 
-	nautilus_file_list_ref (files);
 	nautilus_directory_emit_change_signals (directory, files);
 
 	nautilus_file_list_free (files);
@@ -355,6 +481,7 @@ nautilus_directory_get_internal (GFile *location, gboolean create)
 		g_hash_table_insert (directories,
 				     directory->details->location,
 				     directory);
+		directory_tree_add (directory);
 	}
 
 	return directory;
@@ -551,54 +678,116 @@ nautilus_directory_are_all_files_seen (NautilusDirectory *directory)
 }
 
 static void
-add_to_hash_table (NautilusDirectory *directory, NautilusFile *file, GList *node)
+add_to_hash_table (NautilusDirectory *directory, NautilusFile *file)
 {
 	const char *name;
 
 	name = eel_ref_str_peek (file->details->name);
 
-	g_assert (node != NULL);
 	g_assert (g_hash_table_lookup (directory->details->file_hash,
 				       name) == NULL);
-	g_hash_table_insert (directory->details->file_hash, (char *) name, node);
+	g_hash_table_insert (directory->details->file_hash, (char *) name, file);
 }
 
-static GList *
+static gboolean
 extract_from_hash_table (NautilusDirectory *directory, NautilusFile *file)
 {
 	const char *name;
-	GList *node;
 
 	name = eel_ref_str_peek (file->details->name);
 	if (name == NULL) {
-		return NULL;
+		return FALSE;
 	}
 
-	/* Find the list node in the hash table. */
-	node = g_hash_table_lookup (directory->details->file_hash, name);
+	if (g_hash_table_lookup (directory->details->file_hash, name) != file) {
+		return FALSE;
+	}
 	g_hash_table_remove (directory->details->file_hash, name);
 
-	return node;
+	return TRUE;
+}
+
+static void
+set_file_index (NautilusDirectory *directory, guint index, NautilusFile *file)
+{
+	g_ptr_array_index (directory->details->files, index) = file;
+	file->details->directory_index = index;
+}
+
+static void
+swap_files (NautilusDirectory *directory, guint index_1, guint index_2)
+{
+	NautilusFile *file_1, *file_2;
+
+	if (index_1 == index_2) {
+		return;
+	}
+
+	file_1 = g_ptr_array_index (directory->details->files, index_1);
+	file_2 = g_ptr_array_index (directory->details->files, index_2);
+	set_file_index (directory, index_1, file_2);
+	set_file_index (directory, index_2, file_1);
+}
+
+static guint
+get_file_index (NautilusDirectory *directory, NautilusFile *file)
+{
+	guint index;
+
+	index = file->details->directory_index;
+	g_assert (index < directory->details->files->len);
+	g_assert (g_ptr_array_index (directory->details->files, index) == file);
+
+	return index;
+}
+
+/* Marks a file as seen by the current reload, by moving it into
+ * the confirmed part of the files array.
+ */
+void
+nautilus_directory_confirm_file (NautilusDirectory *directory,
+				 NautilusFile *file)
+{
+	guint index;
+
+	index = get_file_index (directory, file);
+	if (index >= directory->details->confirmed_file_count) {
+		swap_files (directory, index, directory->details->confirmed_file_count);
+		directory->details->confirmed_file_count++;
+	}
+}
+
+/* Called when a reload starts. The files that are still past
+ * confirmed_file_count once it is done are the ones that are gone.
+ */
+void
+nautilus_directory_unconfirm_all_files (NautilusDirectory *directory)
+{
+	directory->details->confirmed_file_count = 0;
+}
+
+void
+nautilus_directory_confirm_all_files (NautilusDirectory *directory)
+{
+	directory->details->confirmed_file_count = directory->details->files->len;
 }
 
 void
 nautilus_directory_add_file (NautilusDirectory *directory, NautilusFile *file)
 {
-	GList *node;
 	gboolean add_to_work_queue;
 
 	g_assert (NAUTILUS_IS_DIRECTORY (directory));
 	g_assert (NAUTILUS_IS_FILE (file));
 	g_assert (file->details->name != NULL);
 
-	/* Add to list. */
-	node = g_list_prepend (directory->details->file_list, file);
-	directory->details->file_list = node;
+	/* Add to the array, new files count as confirmed. */
+	g_ptr_array_add (directory->details->files, file);
+	file->details->directory_index = directory->details->files->len - 1;
+	nautilus_directory_confirm_file (directory, file);
 
 	/* Add to hash table. */
-	add_to_hash_table (directory, file, node);
-
-	directory->details->confirmed_file_count++;
+	add_to_hash_table (directory, file);
 
 	add_to_work_queue = FALSE;
 	if (nautilus_directory_is_file_list_monitored (directory)) {
@@ -620,27 +809,30 @@ nautilus_directory_add_file (NautilusDirectory *directory, NautilusFile *file)
 void
 nautilus_directory_remove_file (NautilusDirectory *directory, NautilusFile *file)
 {
-	GList *node;
+	guint index, last;
+	gboolean in_file_hash;
 
 	g_assert (NAUTILUS_IS_DIRECTORY (directory));
 	g_assert (NAUTILUS_IS_FILE (file));
 	g_assert (file->details->name != NULL);
 
-	/* Find the list node in the hash table. */
-	node = extract_from_hash_table (directory, file);
-	g_assert (node != NULL);
-	g_assert (node->data == file);
-
-	/* Remove the item from the list. */
-	directory->details->file_list = g_list_remove_link
-		(directory->details->file_list, node);
-	g_list_free_1 (node);
+	in_file_hash = extract_from_hash_table (directory, file);
+	g_assert (in_file_hash);
 
-	nautilus_directory_remove_file_from_work_queue (directory, file);
-
-	if (!file->details->unconfirmed) {
+	/* Move the file to the end of the array, past the confirmed
+	 * files if it is one of them, and drop it from there.
+	 */
+	index = get_file_index (directory, file);
+	if (index < directory->details->confirmed_file_count) {
 		directory->details->confirmed_file_count--;
+		swap_files (directory, index, directory->details->confirmed_file_count);
+		index = directory->details->confirmed_file_count;
 	}
+	last = directory->details->files->len - 1;
+	swap_files (directory, index, last);
+	g_ptr_array_remove_index (directory->details->files, last);
+
+	nautilus_directory_remove_file_from_work_queue (directory, file);
 
 	/* Unref if we are monitoring. */
 	if (nautilus_directory_is_file_list_monitored (directory)) {
@@ -648,37 +840,49 @@ nautilus_directory_remove_file (NautilusDirectory *directory, NautilusFile *file
 	}
 }
 
-GList *
+gboolean
 nautilus_directory_begin_file_name_change (NautilusDirectory *directory,
 					   NautilusFile *file)
 {
-	/* Find the list node in the hash table. */
+	/* Take the file out of the hash table while the name is changed. */
 	return extract_from_hash_table (directory, file);
 }
 
 void
 nautilus_directory_end_file_name_change (NautilusDirectory *directory,
 					 NautilusFile *file,
-					 GList *node)
+					 gboolean in_file_hash)
 {
-	/* Add the list node to the hash table. */
-	if (node != NULL) {
-		add_to_hash_table (directory, file, node);
+	/* Put the file back in the hash table under its new name. */
+	if (in_file_hash) {
+		add_to_hash_table (directory, file);
 	}
 }
 
+/* All the files, including the ones not yet announced with files_added. */
+GList *
+nautilus_directory_copy_files_internal (NautilusDirectory *directory)
+{
+	GList *files;
+	guint i;
+
+	files = NULL;
+	for (i = directory->details->files->len; i > 0; i--) {
+		files = g_list_prepend (files,
+					nautilus_file_ref (g_ptr_array_index (directory->details->files, i - 1)));
+	}
+
+	return files;
+}
+
 NautilusFile *
 nautilus_directory_find_file_by_name (NautilusDirectory *directory,
 				      const char *name)
 {
-	GList *node;
-
 	g_return_val_if_fail (NAUTILUS_IS_DIRECTORY (directory), NULL);
 	g_return_val_if_fail (name != NULL, NULL);
 
-	node = g_hash_table_lookup (directory->details->file_hash,
-				    name);
-	return node == NULL ? NULL : NAUTILUS_FILE (node->data);
+	return g_hash_table_lookup (directory->details->file_hash, name);
 }
 
 /* "." for the directory-as-file, otherwise the filename */
@@ -1132,59 +1336,30 @@ change_directory_location (NautilusDirectory *directory,
 
 	g_hash_table_remove (directories,
 			     directory->details->location);
+	directory_tree_remove (directory);
 
 	set_directory_location (directory, new_location);
 
 	g_hash_table_insert (directories,
 			     directory->details->location,
 			     directory);
-}
-
-typedef struct {
-	GFile *container;
-	GList *directories;
-} CollectData;
-
-static void
-collect_directories_by_container (gpointer key, gpointer value, gpointer callback_data)
-{
-	NautilusDirectory *directory;
-	CollectData *collect_data;
-	GFile *location;
-
-	location = (GFile *) key;
-	directory = NAUTILUS_DIRECTORY (value);
-	collect_data = (CollectData *) callback_data;
-
-	if (g_file_has_prefix (location, collect_data->container) ||
-	    g_file_equal (collect_data->container, location)) {
-		nautilus_directory_ref (directory);
-		collect_data->directories =
-			g_list_prepend (collect_data->directories,
-					directory);
-	}
+	directory_tree_add (directory);
 }
 
 static GList *
 nautilus_directory_moved_internal (GFile *old_location,
 				   GFile *new_location)
 {
-	CollectData collection;
 	NautilusDirectory *directory;
-	GList *node, *affected_files;
+	GList *moved_directories, *node, *affected_files;
 	GFile *new_directory_location;
 	char *relative_path;
 
-	collection.container = old_location;
-	collection.directories = NULL;
-
-	g_hash_table_foreach (directories,
-			      collect_directories_by_container,
-			      &collection);
+	moved_directories = directory_tree_collect (old_location);
 
 	affected_files = NULL;
 
-	for (node = collection.directories; node != NULL; node = node->next) {
+	for (node = moved_directories; node != NULL; node = node->next) {
 		directory = NAUTILUS_DIRECTORY (node->data);
 		new_directory_location = NULL;
 
@@ -1212,13 +1387,13 @@ nautilus_directory_moved_internal (GFile *old_location,
 			}
 			affected_files = g_list_concat
 				(affected_files,
-				 nautilus_file_list_copy (directory->details->file_list));
+				 nautilus_directory_copy_files_internal (directory));
 		}
 		
 		nautilus_directory_unref (directory);
 	}
 
-	g_list_free (collection.directories);
+	g_list_free (moved_directories);
 
 	return affected_files;
 }
@@ -1568,12 +1743,17 @@ nautilus_directory_get_file_list (NautilusDirectory *directory)
 static GList *
 real_get_file_list (NautilusDirectory *directory)
 {
-	GList *tentative_files, *non_tentative_files;
+	GList *non_tentative_files;
+	NautilusFile *file;
+	guint i;
 
-	tentative_files = eel_g_list_partition
-		(g_list_copy (directory->details->file_list),
-		 is_tentative, NULL, &non_tentative_files);
-	g_list_free (tentative_files);
+	non_tentative_files = NULL;
+	for (i = directory->details->files->len; i > 0; i--) {
+		file = g_ptr_array_index (directory->details->files, i - 1);
+		if (!is_tentative (file, NULL)) {
+			non_tentative_files = g_list_prepend (non_tentative_files, file);
+		}
+	}
 
 	nautilus_file_list_ref (non_tentative_files);
 	return non_tentative_files;
@@ -1717,6 +1897,80 @@ nautilus_directory_is_desktop_directory (NautilusDirectory   *directory)
 	return nautilus_is_desktop_directory (directory->details->location);
 }
 
+#ifdef ENABLE_DEBUG
+
+static void
+log_job_pool (const char *backend,
+	      int jobs_running,
+	      int job_limit,
+	      int directories_waiting,
+	      guint average_latency,
+	      guint64 jobs_started,
+	      gpointer callback_data)
+{
+	DEBUG ("Jobs for %s: %d of %d running, %d directories waiting, "
+	       "%u ms latency, %" G_GUINT64_FORMAT " started",
+	       backend, jobs_running, job_limit, directories_waiting,
+	       average_latency, jobs_started);
+}
+
+static void
+log_monitor (gpointer key, gpointer value, gpointer callback_data)
+{
+	NautilusDirectory *directory;
+	double event_rate;
+	guint64 n_events;
+	guint n_overflows;
+	char *uri;
+
+	directory = value;
+	if (directory->details->monitor == NULL) {
+		return;
+	}
+
+	nautilus_monitor_get_statistics (directory->details->monitor,
+					 &event_rate, &n_events, &n_overflows);
+	if (n_events == 0) {
+		return;
+	}
+
+	uri = nautilus_directory_get_uri (directory);
+	DEBUG ("Monitor for %s: %.1f events a second, %" G_GUINT64_FORMAT
+	       " events, %u overflows", uri, event_rate, n_events, n_overflows);
+	g_free (uri);
+}
+
+void
+nautilus_directory_log_statistics (void)
+{
+	guint hits, misses, evictions;
+	guint n_queued, n_coalesced, n_batches;
+	gsize bytes;
+
+	nautilus_directory_foreach_job_pool (log_job_pool, NULL);
+
+	if (directories != NULL) {
+		g_hash_table_foreach (directories, log_monitor, NULL);
+	}
+
+	nautilus_file_changes_queue_get_statistics (&n_queued, &n_coalesced, &n_batches);
+	DEBUG ("File changes: %u queued, %u coalesced, %u batches",
+	       n_queued, n_coalesced, n_batches);
+
+	nautilus_icon_info_get_cache_statistics (&hits, &misses, &evictions, &bytes);
+	DEBUG ("Icon cache: %u hits, %u misses, %u evictions, %" G_GSIZE_FORMAT " bytes",
+	       hits, misses, evictions, bytes);
+
+	nautilus_thumbnail_cache_get_statistics (&hits, &misses, &bytes);
+	DEBUG ("Thumbnail cache: %u hits, %u misses, %" G_GSIZE_FORMAT " bytes",
+	       hits, misses, bytes);
+
+	nautilus_deep_count_cache_get_statistics (&hits, &misses);
+	DEBUG ("Deep count cache: %u hits, %u misses", hits, misses);
+}
+
+#endif /* ENABLE_DEBUG */
+
 #if !defined (NAUTILUS_OMIT_SELF_CHECK)
 
 #include <eel/eel-debug.h>
@@ -1747,12 +2001,23 @@ nautilus_self_check_directory (void)
 {
 	NautilusDirectory *directory;
 	NautilusFile *file;
+	GFile *root;
+	GList *moved;
 
 	directory = nautilus_directory_get_by_uri ("file:///etc");
 	file = nautilus_file_get_by_uri ("file:///etc/passwd");
 
 	EEL_CHECK_INTEGER_RESULT (g_hash_table_size (directories), 1);
 
+	/* Nodes for / and /etc. */
+	EEL_CHECK_INTEGER_RESULT (g_hash_table_size (directory_tree), 2);
+	root = g_file_new_for_uri ("file:///");
+	moved = directory_tree_collect (root);
+	EEL_CHECK_INTEGER_RESULT (g_list_length (moved), 1);
+	EEL_CHECK_BOOLEAN_RESULT (moved->data == directory, TRUE);
+	nautilus_directory_list_free (moved);
+	g_object_unref (root);
+
 	nautilus_directory_file_monitor_add
 		(directory, &data_dummy,
 		 TRUE, 0, NULL, NULL);
@@ -1798,6 +2063,7 @@ nautilus_self_check_directory (void)
 	}
 
 	EEL_CHECK_INTEGER_RESULT (g_hash_table_size (directories), 0);
+	EEL_CHECK_INTEGER_RESULT (g_hash_table_size (directory_tree), 0);
 
 	directory = nautilus_directory_get_by_uri ("file:///etc");
 
@@ -1813,7 +2079,7 @@ nautilus_self_check_directory (void)
 		gtk_main_iteration ();
 	}
 
-	EEL_CHECK_BOOLEAN_RESULT (directory->details->file_list == NULL, TRUE);
+	EEL_CHECK_INTEGER_RESULT (directory->details->files->len, 0);
 
 	EEL_CHECK_INTEGER_RESULT (g_hash_table_size (directories), 1);
 
@@ -24,29 +24,62 @@
 #include "nautilus-file-changes-queue.h"
 
 #include "nautilus-directory-notify.h"
+#include "nautilus-search-index.h"
+
+/* Changes are kept in a journal of segments. A segment of file changes
+ * holds at most one change per location: a file that is added and then
+ * changed, or changed and then added, is only added, and repeated
+ * changes are sent once. One that is added and then removed is still
+ * removed, as overwriting a file that is already shown adds it too.
+ * Moves can't be merged like that, so they go in segments of their
+ * own, which keep the changes before and after them apart. Position
+ * requests ride along with whatever segment they are queued into, and
+ * are sent after it.
+ *
+ * A segment is sent off with removals first, then additions, then
+ * changes. Each kind is grouped by parent directory and handed to the
+ * nautilus_directory_notify calls in batches of at most
+ * JOURNAL_BATCH_SIZE files. Unless all changes are asked for, at most
+ * CONSUME_CHANGES_MAX_CHUNK of them are sent off at a time.
+ */
+
+#define JOURNAL_BATCH_SIZE 500
+#define CONSUME_CHANGES_MAX_CHUNK 20
 
 typedef enum {
-	CHANGE_FILE_INITIAL,
 	CHANGE_FILE_ADDED,
 	CHANGE_FILE_CHANGED,
 	CHANGE_FILE_REMOVED,
-	CHANGE_FILE_MOVED,
-	CHANGE_POSITION_SET,
-	CHANGE_POSITION_REMOVE
+	/* Removed, then added again. */
+	CHANGE_FILE_REPLACED
 } NautilusFileChangeKind;
 
 typedef struct {
 	NautilusFileChangeKind kind;
-	GFile *from;
-	GFile *to;
-	GdkPoint point;
-	int screen;
+	GFile *location;
+	GList link;
 } NautilusFileChange;
 
 typedef struct {
-	GList *head;
-	GList *tail;
+	gboolean is_moves;
+	/* For file changes, NautilusFileChange, in the order the
+	 * locations were first seen, and indexed by location.
+	 */
+	GQueue changes;
+	GHashTable *changes_by_location;
+	/* For moves, GFilePair. */
+	GQueue moves;
+	/* NautilusFileChangesQueuePosition, in reverse order. */
+	GList *position_set_requests;
+} NautilusFileChangesSegment;
+
+typedef struct {
+	GQueue segments;
 	GMutex mutex;
+
+	guint n_queued;
+	guint n_coalesced;
+	guint n_batches;
 } NautilusFileChangesQueue;
 
 static NautilusFileChangesQueue *
@@ -55,6 +88,7 @@ nautilus_file_changes_queue_new (void)
 	NautilusFileChangesQueue *result;
 
 	result = g_new0 (NautilusFileChangesQueue, 1);
+	g_queue_init (&result->segments);
 	g_mutex_init (&result->mutex);
 
 	return result;
@@ -73,75 +107,201 @@ nautilus_file_changes_queue_get (void)
 }
 
 static void
-nautilus_file_changes_queue_add_common (NautilusFileChangesQueue *queue, 
-	NautilusFileChange *new_item)
+change_free (NautilusFileChange *change)
 {
-	/* enqueue the new queue item while locking down the list */
-	g_mutex_lock (&queue->mutex);
+	g_object_unref (change->location);
+	g_free (change);
+}
 
-	queue->head = g_list_prepend (queue->head, new_item);
-	if (queue->tail == NULL)
-		queue->tail = queue->head;
+static NautilusFileChangesSegment *
+segment_new (gboolean is_moves)
+{
+	NautilusFileChangesSegment *segment;
+
+	segment = g_new0 (NautilusFileChangesSegment, 1);
+	segment->is_moves = is_moves;
+	g_queue_init (&segment->changes);
+	g_queue_init (&segment->moves);
+	if (!is_moves) {
+		segment->changes_by_location = g_hash_table_new (g_file_hash,
+								 (GEqualFunc) g_file_equal);
+	}
 
-	g_mutex_unlock (&queue->mutex);
+	return segment;
 }
 
-void
-nautilus_file_changes_queue_file_added (GFile *location)
+static void
+pair_free (GFilePair *pair)
 {
-	NautilusFileChange *new_item;
-	NautilusFileChangesQueue *queue;
+	g_object_unref (pair->from);
+	g_object_unref (pair->to);
+	g_free (pair);
+}
 
-	queue = nautilus_file_changes_queue_get();
+static void
+position_set_list_free (GList *list)
+{
+	GList *p;
+	NautilusFileChangesQueuePosition *item;
 
-	new_item = g_new0 (NautilusFileChange, 1);
-	new_item->kind = CHANGE_FILE_ADDED;
-	new_item->from = g_object_ref (location);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+	for (p = list; p != NULL; p = p->next) {
+		item = p->data;
+		g_object_unref (item->location);
+	}
+	/* delete the list and the now empty structs */
+	g_list_free_full (list, g_free);
 }
 
-void
-nautilus_file_changes_queue_file_changed (GFile *location)
+static void
+segment_free (NautilusFileChangesSegment *segment)
+{
+	GList *link;
+
+	/* The links are part of the changes. */
+	while ((link = g_queue_pop_head_link (&segment->changes)) != NULL) {
+		change_free (link->data);
+	}
+	if (segment->changes_by_location != NULL) {
+		g_hash_table_destroy (segment->changes_by_location);
+	}
+	g_queue_foreach (&segment->moves, (GFunc) pair_free, NULL);
+	g_queue_clear (&segment->moves);
+	position_set_list_free (segment->position_set_requests);
+	g_free (segment);
+}
+
+/* Called with the queue locked. */
+static NautilusFileChangesSegment *
+get_last_segment (NautilusFileChangesQueue *queue, gboolean is_moves)
+{
+	NautilusFileChangesSegment *segment;
+
+	segment = g_queue_peek_tail (&queue->segments);
+	if (segment == NULL || segment->is_moves != is_moves) {
+		segment = segment_new (is_moves);
+		g_queue_push_tail (&queue->segments, segment);
+	}
+
+	return segment;
+}
+
+/* Returns the kind a change of the given kind turns into when
+ * it follows one of kind old_kind.
+ */
+static NautilusFileChangeKind
+merge_kinds (NautilusFileChangeKind old_kind,
+	     NautilusFileChangeKind kind)
+{
+	switch (kind) {
+	case CHANGE_FILE_ADDED:
+		if (old_kind == CHANGE_FILE_REMOVED) {
+			return CHANGE_FILE_REPLACED;
+		}
+		if (old_kind == CHANGE_FILE_CHANGED) {
+			return CHANGE_FILE_ADDED;
+		}
+		return old_kind;
+
+	case CHANGE_FILE_CHANGED:
+		return old_kind;
+
+	case CHANGE_FILE_REMOVED:
+		return CHANGE_FILE_REMOVED;
+
+	default:
+		g_assert_not_reached ();
+		return old_kind;
+	}
+}
+
+static void
+nautilus_file_changes_queue_add_common (GFile *location,
+					NautilusFileChangeKind kind)
 {
-	NautilusFileChange *new_item;
 	NautilusFileChangesQueue *queue;
+	NautilusFileChangesSegment *segment;
+	NautilusFileChange *change;
 
-	queue = nautilus_file_changes_queue_get();
+	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new0 (NautilusFileChange, 1);
-	new_item->kind = CHANGE_FILE_CHANGED;
-	new_item->from = g_object_ref (location);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+	g_mutex_lock (&queue->mutex);
+
+	queue->n_queued++;
+
+	segment = get_last_segment (queue, FALSE);
+	change = g_hash_table_lookup (segment->changes_by_location, location);
+
+	if (change == NULL) {
+		change = g_new0 (NautilusFileChange, 1);
+		change->kind = kind;
+		change->location = g_object_ref (location);
+		change->link.data = change;
+		g_queue_push_tail_link (&segment->changes, &change->link);
+		g_hash_table_insert (segment->changes_by_location, change->location, change);
+	} else {
+		queue->n_coalesced++;
+		change->kind = merge_kinds (change->kind, kind);
+	}
+
+	g_mutex_unlock (&queue->mutex);
 }
 
 void
-nautilus_file_changes_queue_file_removed (GFile *location)
+nautilus_file_changes_queue_file_added (GFile *location)
 {
-	NautilusFileChange *new_item;
-	NautilusFileChangesQueue *queue;
+	nautilus_file_changes_queue_add_common (location, CHANGE_FILE_ADDED);
+}
 
-	queue = nautilus_file_changes_queue_get();
+void
+nautilus_file_changes_queue_file_changed (GFile *location)
+{
+	nautilus_file_changes_queue_add_common (location, CHANGE_FILE_CHANGED);
+}
 
-	new_item = g_new0 (NautilusFileChange, 1);
-	new_item->kind = CHANGE_FILE_REMOVED;
-	new_item->from = g_object_ref (location);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+void
+nautilus_file_changes_queue_file_removed (GFile *location)
+{
+	nautilus_file_changes_queue_add_common (location, CHANGE_FILE_REMOVED);
 }
 
 void
 nautilus_file_changes_queue_file_moved (GFile *from,
 					GFile *to)
 {
-	NautilusFileChange *new_item;
 	NautilusFileChangesQueue *queue;
+	NautilusFileChangesSegment *segment;
+	GFilePair *pair;
+
+	queue = nautilus_file_changes_queue_get ();
+
+	pair = g_new (GFilePair, 1);
+	pair->from = g_object_ref (from);
+	pair->to = g_object_ref (to);
+
+	g_mutex_lock (&queue->mutex);
+	queue->n_queued++;
+	segment = get_last_segment (queue, TRUE);
+	g_queue_push_tail (&segment->moves, pair);
+	g_mutex_unlock (&queue->mutex);
+}
+
+static void
+nautilus_file_changes_queue_add_position (NautilusFileChangesQueuePosition *position)
+{
+	NautilusFileChangesQueue *queue;
+	NautilusFileChangesSegment *segment;
 
 	queue = nautilus_file_changes_queue_get ();
 
-	new_item = g_new (NautilusFileChange, 1);
-	new_item->kind = CHANGE_FILE_MOVED;
-	new_item->from = g_object_ref (from);
-	new_item->to = g_object_ref (to);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+	g_mutex_lock (&queue->mutex);
+	queue->n_queued++;
+	segment = g_queue_peek_tail (&queue->segments);
+	if (segment == NULL) {
+		segment = get_last_segment (queue, FALSE);
+	}
+	segment->position_set_requests = g_list_prepend (segment->position_set_requests,
+							 position);
+	g_mutex_unlock (&queue->mutex);
 }
 
 void
@@ -149,248 +309,292 @@ nautilus_file_changes_queue_schedule_position_set (GFile *location,
 						   GdkPoint point,
 						   int screen)
 {
-	NautilusFileChange *new_item;
-	NautilusFileChangesQueue *queue;
-
-	queue = nautilus_file_changes_queue_get ();
+	NautilusFileChangesQueuePosition *position_set;
 
-	new_item = g_new (NautilusFileChange, 1);
-	new_item->kind = CHANGE_POSITION_SET;
-	new_item->from = g_object_ref (location);
-	new_item->point = point;
-	new_item->screen = screen;
-	nautilus_file_changes_queue_add_common (queue, new_item);
+	position_set = g_new (NautilusFileChangesQueuePosition, 1);
+	position_set->location = g_object_ref (location);
+	position_set->set = TRUE;
+	position_set->point = point;
+	position_set->screen = screen;
+	nautilus_file_changes_queue_add_position (position_set);
 }
 
 void
 nautilus_file_changes_queue_schedule_position_remove (GFile *location)
 {
-	NautilusFileChange *new_item;
-	NautilusFileChangesQueue *queue;
-
-	queue = nautilus_file_changes_queue_get ();
+	NautilusFileChangesQueuePosition *position_set;
 
-	new_item = g_new (NautilusFileChange, 1);
-	new_item->kind = CHANGE_POSITION_REMOVE;
-	new_item->from = g_object_ref (location);
-	nautilus_file_changes_queue_add_common (queue, new_item);
+	position_set = g_new0 (NautilusFileChangesQueuePosition, 1);
+	position_set->location = g_object_ref (location);
+	position_set->set = FALSE;
+	nautilus_file_changes_queue_add_position (position_set);
 }
 
-static NautilusFileChange *
-nautilus_file_changes_queue_get_change (NautilusFileChangesQueue *queue)
+void
+nautilus_file_changes_queue_get_statistics (guint *n_queued,
+					    guint *n_coalesced,
+					    guint *n_batches)
 {
-	GList *new_tail;
-	NautilusFileChange *result;
+	NautilusFileChangesQueue *queue;
 
-	g_assert (queue != NULL);
-	
-	/* dequeue the tail item while locking down the list */
-	g_mutex_lock (&queue->mutex);
+	queue = nautilus_file_changes_queue_get ();
 
-	if (queue->tail == NULL) {
-		result = NULL;
-	} else {
-		new_tail = queue->tail->prev;
-		result = queue->tail->data;
-		queue->head = g_list_remove_link (queue->head,
-						  queue->tail);
-		g_list_free_1 (queue->tail);
-		queue->tail = new_tail;
+	g_mutex_lock (&queue->mutex);
+	if (n_queued != NULL) {
+		*n_queued = queue->n_queued;
+	}
+	if (n_coalesced != NULL) {
+		*n_coalesced = queue->n_coalesced;
+	}
+	if (n_batches != NULL) {
+		*n_batches = queue->n_batches;
 	}
-
 	g_mutex_unlock (&queue->mutex);
-
-	return result;
 }
 
-enum {
-	CONSUME_CHANGES_MAX_CHUNK = 20
-};
+typedef void (* NotifyFunction) (GList *files);
 
 static void
-pairs_list_free (GList *pairs)
+count_batch (void)
 {
-	GList *p;
-	GFilePair *pair;
-
-	/* deep delete the list of pairs */
+	NautilusFileChangesQueue *queue;
 
-	for (p = pairs; p != NULL; p = p->next) {
-		/* delete the strings in each pair */
-		pair = p->data;
-		g_object_unref (pair->from);
-		g_object_unref (pair->to);
-	}
+	queue = nautilus_file_changes_queue_get ();
 
-	/* delete the list and the now empty pair structs */
-	g_list_free_full (pairs, g_free);
+	g_mutex_lock (&queue->mutex);
+	queue->n_batches++;
+	g_mutex_unlock (&queue->mutex);
 }
 
+/* Sends the locations off in batches, grouped by parent directory and
+ * otherwise in order. Takes over the list and the references.
+ */
 static void
-position_set_list_free (GList *list)
+notify_in_batches (GList *locations,
+		   NotifyFunction notify,
+		   NotifyFunction notify_search_index)
 {
-	GList *p;
-	NautilusFileChangesQueuePosition *item;
+	GHashTable *groups;
+	GQueue order = G_QUEUE_INIT;
+	GList *l, *group, *batch;
+	GFile *location, *parent;
+	guint n;
+
+	groups = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+					g_object_unref, NULL);
+	for (l = locations; l != NULL; l = l->next) {
+		location = l->data;
+		parent = g_file_get_parent (location);
+		if (parent == NULL) {
+			parent = g_object_ref (location);
+		}
 
-	for (p = list; p != NULL; p = p->next) {
-		item = p->data;
-		g_object_unref (item->location);
+		group = g_hash_table_lookup (groups, parent);
+		if (group == NULL) {
+			g_queue_push_tail (&order, g_object_ref (parent));
+		}
+		/* Lists are built backwards and reversed below. */
+		g_hash_table_insert (groups, parent, g_list_prepend (group, location));
 	}
-	/* delete the list and the now empty structs */
-	g_list_free_full (list, g_free);
+	g_list_free (locations);
+
+	batch = NULL;
+	n = 0;
+	while ((parent = g_queue_pop_head (&order)) != NULL) {
+		group = g_hash_table_lookup (groups, parent);
+		g_object_unref (parent);
+
+		for (l = g_list_reverse (group); l != NULL; l = l->next) {
+			batch = g_list_prepend (batch, l->data);
+			if (++n == JOURNAL_BATCH_SIZE) {
+				batch = g_list_reverse (batch);
+				notify (batch);
+				if (notify_search_index != NULL) {
+					notify_search_index (batch);
+				}
+				count_batch ();
+				g_list_free_full (batch, g_object_unref);
+				batch = NULL;
+				n = 0;
+			}
+		}
+		g_list_free (group);
+	}
+
+	if (batch != NULL) {
+		batch = g_list_reverse (batch);
+		notify (batch);
+		if (notify_search_index != NULL) {
+			notify_search_index (batch);
+		}
+		count_batch ();
+		g_list_free_full (batch, g_object_unref);
+	}
+
+	/* The keys still hold the parents. */
+	g_hash_table_destroy (groups);
 }
 
-/* go through changes in the change queue, send ones with the same kind
- * in a list to the different nautilus_directory_notify calls
- */ 
-void
-nautilus_file_changes_consume_changes (gboolean consume_all)
+static void
+consume_file_changes (NautilusFileChangesSegment *segment)
 {
 	NautilusFileChange *change;
-	GList *additions, *changes, *deletions, *moves;
-	GList *position_set_requests;
-	GFilePair *pair;
-	NautilusFileChangesQueuePosition *position_set;
-	guint chunk_count;
-	NautilusFileChangesQueue *queue;
-	gboolean flush_needed;
-	
+	GList *additions, *changes, *deletions;
+	GList *l;
 
 	additions = NULL;
 	changes = NULL;
 	deletions = NULL;
-	moves = NULL;
-	position_set_requests = NULL;
-
-	queue = nautilus_file_changes_queue_get();
-		
-	/* Consume changes from the queue, stuffing them into one of three lists,
-	 * keep doing it while the changes are of the same kind, then send them off.
-	 * This is to ensure that the changes get sent off in the same order that they 
-	 * arrived.
-	 */
-	for (chunk_count = 0; ; chunk_count++) {
-		change = nautilus_file_changes_queue_get_change (queue);
-
-		/* figure out if we need to flush the pending changes that we collected sofar */
-
-		if (change == NULL) {
-			flush_needed = TRUE;
-			/* no changes left, flush everything */
-		} else {
-			flush_needed = additions != NULL
-				&& change->kind != CHANGE_FILE_ADDED
-				&& change->kind != CHANGE_POSITION_SET
-				&& change->kind != CHANGE_POSITION_REMOVE;
-			
-			flush_needed |= changes != NULL
-				&& change->kind != CHANGE_FILE_CHANGED;
-			
-			flush_needed |= moves != NULL
-				&& change->kind != CHANGE_FILE_MOVED
-				&& change->kind != CHANGE_POSITION_SET
-				&& change->kind != CHANGE_POSITION_REMOVE;
-			
-			flush_needed |= deletions != NULL
-				&& change->kind != CHANGE_FILE_REMOVED;
-			
-			flush_needed |= position_set_requests != NULL
-				&& change->kind != CHANGE_POSITION_SET
-				&& change->kind != CHANGE_POSITION_REMOVE
-				&& change->kind != CHANGE_FILE_ADDED
-				&& change->kind != CHANGE_FILE_MOVED;
-			
-			flush_needed |= !consume_all && chunk_count >= CONSUME_CHANGES_MAX_CHUNK;
-				/* we have reached the chunk maximum */
-		}
-		
-		if (flush_needed) {
-			/* Send changes we collected off. 
-			 * At one time we may only have one of the lists
-			 * contain changes.
-			 */
-			
-			if (deletions != NULL) {
-				deletions = g_list_reverse (deletions);
-				nautilus_directory_notify_files_removed (deletions);
-				g_list_free_full (deletions, g_object_unref);
-				deletions = NULL;
-			}
-			if (moves != NULL) {
-				moves = g_list_reverse (moves);
-				nautilus_directory_notify_files_moved (moves);
-				pairs_list_free (moves);
-				moves = NULL;
-			}
-			if (additions != NULL) {
-				additions = g_list_reverse (additions);
-				nautilus_directory_notify_files_added (additions);
-				g_list_free_full (additions, g_object_unref);
-				additions = NULL;
-			}
-			if (changes != NULL) {
-				changes = g_list_reverse (changes);
-				nautilus_directory_notify_files_changed (changes);
-				g_list_free_full (changes, g_object_unref);
-				changes = NULL;
-			}
-			if (position_set_requests != NULL) {
-				position_set_requests = g_list_reverse (position_set_requests);
-				nautilus_directory_schedule_position_set (position_set_requests);
-				position_set_list_free (position_set_requests);
-				position_set_requests = NULL;
-			}
-		}
 
-		if (change == NULL) {
-			/* we are done */
-			return;
-		}
-		
-		/* add the new change to the list */
+	for (l = segment->changes.tail; l != NULL; l = l->prev) {
+		change = l->data;
 		switch (change->kind) {
 		case CHANGE_FILE_ADDED:
-			additions = g_list_prepend (additions, change->from);
+			additions = g_list_prepend (additions, g_object_ref (change->location));
 			break;
-
 		case CHANGE_FILE_CHANGED:
-			changes = g_list_prepend (changes, change->from);
+			changes = g_list_prepend (changes, g_object_ref (change->location));
 			break;
-
 		case CHANGE_FILE_REMOVED:
-			deletions = g_list_prepend (deletions, change->from);
+			deletions = g_list_prepend (deletions, g_object_ref (change->location));
 			break;
+		case CHANGE_FILE_REPLACED:
+			deletions = g_list_prepend (deletions, g_object_ref (change->location));
+			additions = g_list_prepend (additions, g_object_ref (change->location));
+			break;
+		default:
+			g_assert_not_reached ();
+			break;
+		}
+	}
 
-		case CHANGE_FILE_MOVED:
-			pair = g_new (GFilePair, 1);
-			pair->from = change->from;
-			pair->to = change->to;
+	if (deletions != NULL) {
+		notify_in_batches (deletions,
+				   nautilus_directory_notify_files_removed,
+				   nautilus_search_index_notify_files_removed);
+	}
+	if (additions != NULL) {
+		notify_in_batches (additions,
+				   nautilus_directory_notify_files_added,
+				   nautilus_search_index_notify_files_added);
+	}
+	if (changes != NULL) {
+		notify_in_batches (changes,
+				   nautilus_directory_notify_files_changed,
+				   NULL);
+	}
+}
+
+static void
+consume_moves (NautilusFileChangesSegment *segment)
+{
+	GList *moves;
+	GFilePair *pair;
+	guint n;
+
+	while (!g_queue_is_empty (&segment->moves)) {
+		moves = NULL;
+		for (n = 0; n < JOURNAL_BATCH_SIZE; n++) {
+			pair = g_queue_pop_head (&segment->moves);
+			if (pair == NULL) {
+				break;
+			}
 			moves = g_list_prepend (moves, pair);
-			break;
+		}
+		moves = g_list_reverse (moves);
 
-		case CHANGE_POSITION_SET:
-			position_set = g_new (NautilusFileChangesQueuePosition, 1);
-			position_set->location = change->from;
-			position_set->set = TRUE;
-			position_set->point = change->point;
-			position_set->screen = change->screen;
-			position_set_requests = g_list_prepend (position_set_requests,
-								position_set);
-			break;
+		nautilus_directory_notify_files_moved (moves);
+		nautilus_search_index_notify_files_moved (moves);
+		count_batch ();
+		g_list_free_full (moves, (GDestroyNotify) pair_free);
+	}
+}
 
-		case CHANGE_POSITION_REMOVE:
-			position_set = g_new (NautilusFileChangesQueuePosition, 1);
-			position_set->location = change->from;
-			position_set->set = FALSE;
-			position_set_requests = g_list_prepend (position_set_requests,
-								position_set);
-			break;
+static void
+consume_segment (NautilusFileChangesSegment *segment)
+{
+	if (segment->is_moves) {
+		consume_moves (segment);
+	} else {
+		consume_file_changes (segment);
+	}
 
-		default:
-			g_assert_not_reached ();
-			break;
+	if (segment->position_set_requests != NULL) {
+		segment->position_set_requests = g_list_reverse (segment->position_set_requests);
+		nautilus_directory_schedule_position_set (segment->position_set_requests);
+	}
+
+	segment_free (segment);
+}
+
+/* Called with the queue locked. Takes the oldest segment out of the
+ * journal, or only its first max changes if it has more. Position
+ * requests stay with the rest of the segment.
+ */
+static NautilusFileChangesSegment *
+take_oldest_changes (NautilusFileChangesQueue *queue,
+		     guint max)
+{
+	NautilusFileChangesSegment *segment, *head;
+	NautilusFileChange *change;
+	GList *link;
+	guint n;
+
+	segment = g_queue_peek_head (&queue->segments);
+	if (segment == NULL) {
+		return NULL;
+	}
+
+	if (g_queue_get_length (&segment->changes) +
+	    g_queue_get_length (&segment->moves) <= max) {
+		return g_queue_pop_head (&queue->segments);
+	}
+
+	head = segment_new (segment->is_moves);
+	for (n = 0; n < max; n++) {
+		if (segment->is_moves) {
+			g_queue_push_tail (&head->moves, g_queue_pop_head (&segment->moves));
+		} else {
+			link = g_queue_pop_head_link (&segment->changes);
+			change = link->data;
+			g_hash_table_remove (segment->changes_by_location, change->location);
+			g_queue_push_tail_link (&head->changes, link);
+			g_hash_table_insert (head->changes_by_location, change->location, change);
+		}
+	}
+
+	return head;
+}
+
+/* Sends off the changes in the journal, or only up to
+ * CONSUME_CHANGES_MAX_CHUNK of the oldest ones unless consume_all
+ * is set.
+ */
+void
+nautilus_file_changes_consume_changes (gboolean consume_all)
+{
+	NautilusFileChangesQueue *queue;
+	NautilusFileChangesSegment *segment;
+	GQueue segments = G_QUEUE_INIT;
+
+	queue = nautilus_file_changes_queue_get ();
+
+	/* Take the segments out while locked, later changes go into
+	 * new ones.
+	 */
+	g_mutex_lock (&queue->mutex);
+	if (consume_all) {
+		segments = queue->segments;
+		g_queue_init (&queue->segments);
+	} else {
+		segment = take_oldest_changes (queue, CONSUME_CHANGES_MAX_CHUNK);
+		if (segment != NULL) {
+			g_queue_push_tail (&segments, segment);
 		}
+	}
+	g_mutex_unlock (&queue->mutex);
 
-		g_free (change);
-	}	
+	while ((segment = g_queue_pop_head (&segments)) != NULL) {
+		consume_segment (segment);
+	}
 }
@@ -38,5 +38,12 @@ void nautilus_file_changes_queue_schedule_position_remove        (GFile      *lo
 
 void nautilus_file_changes_consume_changes                       (gboolean    consume_all);
 
+/* Changes queued, changes merged into an earlier one for the same
+ * location, and batches sent off, since startup.
+ */
+void nautilus_file_changes_queue_get_statistics                  (guint      *n_queued,
+								  guint      *n_coalesced,
+								  guint      *n_batches);
+
 
 #endif /* NAUTILUS_FILE_CHANGES_QUEUE_H */
@@ -27,6 +27,7 @@
 
 #include <libnautilus-private/nautilus-directory.h>
 #include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-queue.h>
 #include <libnautilus-private/nautilus-monitor.h>
 #include <libnautilus-private/nautilus-file-undo-operations.h>
 #include <eel/eel-glib-extensions.h>
@@ -52,6 +53,22 @@ typedef enum {
 	UNKNOWN
 } Knowledge;
 
+/* String attributes whose display strings are kept with the file. */
+typedef enum {
+	NAUTILUS_FILE_FORMATTED_TYPE,
+	NAUTILUS_FILE_FORMATTED_SIZE,
+	NAUTILUS_FILE_FORMATTED_SIZE_DETAIL,
+	NAUTILUS_FILE_FORMATTED_DATE_MODIFIED,
+	NAUTILUS_FILE_FORMATTED_DATE_CHANGED,
+	NAUTILUS_FILE_FORMATTED_DATE_ACCESSED,
+	NAUTILUS_FILE_FORMATTED_DATE_PERMISSIONS,
+	NAUTILUS_FILE_FORMATTED_TRASHED_ON,
+	NAUTILUS_FILE_FORMATTED_PERMISSIONS,
+	NAUTILUS_FILE_FORMATTED_OCTAL_PERMISSIONS,
+	NAUTILUS_FILE_FORMATTED_OWNER,
+	NAUTILUS_FILE_N_FORMATTED_ATTRIBUTES
+} NautilusFileFormattedAttribute;
+
 struct NautilusFileDetails
 {
 	NautilusDirectory *directory;
@@ -76,6 +93,14 @@ struct NautilusFileDetails
 	eel_ref_str owner;
 	eel_ref_str owner_real;
 	eel_ref_str group;
+
+	/* Display strings of the attributes listed in
+	 * NautilusFileFormattedAttribute, shared between files. A string
+	 * is only valid while its bit is set in formatted_attributes_valid.
+	 */
+	eel_ref_str formatted_attributes[NAUTILUS_FILE_N_FORMATTED_ATTRIBUTES];
+	guint formatted_attributes_valid;
+	guint formatted_attributes_generation;
 	
 	time_t atime; /* 0 is unknown */
 	time_t mtime; /* 0 is unknown */
@@ -139,11 +164,20 @@ struct NautilusFileDetails
 
 	/* Mount for mountpoint or the references GMount for a "mountable" */
 	GMount *mount;
+
+	/* Position + 1 of the file in each of its directory's work
+	 * queues, 0 if not queued. Owned by nautilus-file-queue.c.
+	 */
+	guint work_queue_position[NAUTILUS_FILE_QUEUE_N_SLOTS];
+
+	/* Position in the files array of the directory. Owned by
+	 * nautilus-directory.c.
+	 */
+	guint directory_index;
 	
 	/* boolean fields: bitfield to save space, since there can be
            many NautilusFile objects. */
 
-	eel_boolean_bit unconfirmed                   : 1;
 	eel_boolean_bit is_gone                       : 1;
 	/* Set when emitting files_added on the directory to make sure we
 	   add a file, and only once */
@@ -271,6 +305,12 @@ gboolean      nautilus_file_set_display_name               (NautilusFile
 							    const char             *display_name,
 							    const char             *edit_name,
 							    gboolean                custom);
+/* Takes a collation key computed elsewhere for display_name, which is
+ * dropped unless display_name is still the file's display name.
+ */
+void          nautilus_file_set_display_name_collation_key (NautilusFile           *file,
+							    const char             *display_name,
+							    char                   *collation_key);
 void          nautilus_file_set_mount                      (NautilusFile           *file,
 							    GMount                 *mount);
 
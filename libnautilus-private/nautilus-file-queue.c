@@ -22,22 +22,39 @@
 
 #include <config.h>
 #include "nautilus-file-queue.h"
+#include "nautilus-file-private.h"
 
 #include <glib.h>
 
+#define MIN_QUEUE_SIZE 32
+
+/* The queue is an array of files in queue order. Removing a file from
+ * the middle leaves a hole, which is squeezed out the next time the
+ * array runs out of room. Each file stores its index + 1 in the slot
+ * of the queue, or 0 if it isn't queued, so lookups and removals don't
+ * need a hash table and enqueueing doesn't allocate.
+ */
 struct NautilusFileQueue {
-	GList *head;
-	GList *tail;
-	GHashTable *item_to_link_map;
+	NautilusFile **files;
+	guint head;   /* index of the first queued file */
+	guint tail;   /* index after the last queued file */
+	guint size;   /* allocated length of files */
+	guint length; /* number of queued files, not counting holes */
+	guint slot;
 };
 
+#define FILE_POSITION(queue, file) \
+	((file)->details->work_queue_position[(queue)->slot])
+
 NautilusFileQueue *
-nautilus_file_queue_new (void)
+nautilus_file_queue_new (guint slot)
 {
 	NautilusFileQueue *queue;
+
+	g_return_val_if_fail (slot < NAUTILUS_FILE_QUEUE_N_SLOTS, NULL);
 	
 	queue = g_new0 (NautilusFileQueue, 1);
-	queue->item_to_link_map = g_hash_table_new (g_direct_hash, g_direct_equal);
+	queue->slot = slot;
 
 	return queue;
 }
@@ -45,30 +62,95 @@ nautilus_file_queue_new (void)
 void
 nautilus_file_queue_destroy (NautilusFileQueue *queue)
 {
-	g_hash_table_destroy (queue->item_to_link_map);
-	nautilus_file_list_free (queue->head);
+	NautilusFile *file;
+	guint i;
+
+	for (i = queue->head; i < queue->tail; i++) {
+		file = queue->files[i];
+		if (file != NULL) {
+			FILE_POSITION (queue, file) = 0;
+			nautilus_file_unref (file);
+		}
+	}
+
+	g_free (queue->files);
 	g_free (queue);
 }
 
+static void
+compact (NautilusFileQueue *queue)
+{
+	NautilusFile *file;
+	guint i, j;
+
+	j = 0;
+	for (i = queue->head; i < queue->tail; i++) {
+		file = queue->files[i];
+		if (file != NULL) {
+			queue->files[j] = file;
+			j++;
+			FILE_POSITION (queue, file) = j;
+		}
+	}
+
+	g_assert (j == queue->length);
+
+	queue->head = 0;
+	queue->tail = j;
+}
+
+/* Called when the tail reaches the end of the array. Only grows the
+ * array if squeezing out the holes leaves it more than half full, so
+ * compacting stays amortized constant time per enqueue.
+ */
+static void
+make_room (NautilusFileQueue *queue)
+{
+	compact (queue);
+
+	if (queue->length >= queue->size / 2) {
+		queue->size = MAX (queue->size * 2, MIN_QUEUE_SIZE);
+		queue->files = g_renew (NautilusFile *, queue->files, queue->size);
+	}
+}
+
+/* Move head and tail past holes at either end after files were
+ * taken out of the queue.
+ */
+static void
+trim (NautilusFileQueue *queue)
+{
+	if (queue->length == 0) {
+		queue->head = 0;
+		queue->tail = 0;
+		return;
+	}
+
+	while (queue->files[queue->head] == NULL) {
+		queue->head++;
+	}
+	while (queue->files[queue->tail - 1] == NULL) {
+		queue->tail--;
+	}
+}
+
 void
 nautilus_file_queue_enqueue (NautilusFileQueue *queue,
 			     NautilusFile      *file)
 {
-	if (g_hash_table_lookup (queue->item_to_link_map, file) != NULL) {
+	if (FILE_POSITION (queue, file) != 0) {
 		/* It's already on the queue. */
 		return;
 	}
 
-	if (queue->tail == NULL) {
-		queue->head = g_list_append (NULL, file);
-		queue->tail = queue->head;
-	} else {
-		queue->tail = g_list_append (queue->tail, file);
-		queue->tail = queue->tail->next;
+	if (queue->tail == queue->size) {
+		make_room (queue);
 	}
 
-	nautilus_file_ref (file);
-	g_hash_table_insert (queue->item_to_link_map, file, queue->tail);
+	queue->files[queue->tail] = nautilus_file_ref (file);
+	queue->tail++;
+	queue->length++;
+	FILE_POSITION (queue, file) = queue->tail;
 }
 
 NautilusFile *
@@ -87,23 +169,24 @@ void
 nautilus_file_queue_remove (NautilusFileQueue *queue,
 			    NautilusFile *file)
 {
-	GList *link;
+	guint position;
 
-	link = g_hash_table_lookup (queue->item_to_link_map, file);
+	if (file == NULL) {
+		return;
+	}
 
-	if (link == NULL) {
+	position = FILE_POSITION (queue, file);
+	if (position == 0) {
 		/* It's not on the queue */
 		return;
 	}
 
-	if (link == queue->tail) {
-		/* Need to special-case removing the tail. */
-		queue->tail = queue->tail->prev;
-	}
+	g_assert (queue->files[position - 1] == file);
 
-	queue->head =  g_list_remove_link (queue->head, link);
-	g_list_free (link);
-	g_hash_table_remove (queue->item_to_link_map, file);
+	queue->files[position - 1] = NULL;
+	queue->length--;
+	FILE_POSITION (queue, file) = 0;
+	trim (queue);
 
 	nautilus_file_unref (file);
 }
@@ -111,15 +194,41 @@ nautilus_file_queue_remove (NautilusFileQueue *queue,
 NautilusFile *
 nautilus_file_queue_head (NautilusFileQueue *queue)
 {
-	if (queue->head == NULL) {
+	if (queue->length == 0) {
 		return NULL;
 	}
 
-	return NAUTILUS_FILE (queue->head->data);
+	return queue->files[queue->head];
 }
 
 gboolean
 nautilus_file_queue_is_empty (NautilusFileQueue *queue)
 {
-	return (queue->head == NULL);
+	return (queue->length == 0);
+}
+
+guint
+nautilus_file_queue_dequeue_batch (NautilusFileQueue     *queue,
+				   NautilusFileQueueFunc  func,
+				   gpointer               callback_data,
+				   NautilusFile         **files,
+				   guint                  max_files)
+{
+	NautilusFile *file;
+	guint i, n_files;
+
+	n_files = 0;
+	for (i = queue->head; i < queue->tail && n_files < max_files; i++) {
+		file = queue->files[i];
+		if (file != NULL && (* func) (file, callback_data)) {
+			queue->files[i] = NULL;
+			queue->length--;
+			FILE_POSITION (queue, file) = 0;
+			files[n_files++] = file;
+		}
+	}
+
+	trim (queue);
+
+	return n_files;
 }
@@ -27,7 +27,16 @@
 
 typedef struct NautilusFileQueue NautilusFileQueue;
 
-NautilusFileQueue *nautilus_file_queue_new      (void);
+/* A queue keeps the position of each of its files in the file itself,
+ * in one of these slots. Queues that use different slots can hold the
+ * same file at the same time.
+ */
+#define NAUTILUS_FILE_QUEUE_N_SLOTS 3
+
+typedef gboolean (* NautilusFileQueueFunc) (NautilusFile *file,
+					    gpointer      callback_data);
+
+NautilusFileQueue *nautilus_file_queue_new      (guint              slot);
 void               nautilus_file_queue_destroy  (NautilusFileQueue *queue);
 
 /* Add a file to the tail of the queue, unless it's already in the queue */
@@ -49,4 +58,15 @@ NautilusFile *     nautilus_file_queue_head     (NautilusFileQueue *queue);
 
 gboolean           nautilus_file_queue_is_empty (NautilusFileQueue *queue);
 
+/* Remove up to max_files files for which func returns TRUE, starting
+ * at the head of the queue, and store them in files. The references
+ * the queue held are handed over to the caller. func must not change
+ * the queue. Returns the number of files stored.
+ */
+guint              nautilus_file_queue_dequeue_batch (NautilusFileQueue     *queue,
+						      NautilusFileQueueFunc  func,
+						      gpointer               callback_data,
+						      NautilusFile         **files,
+						      guint                  max_files);
+
 #endif /* NAUTILUS_FILE_CHANGES_QUEUE_H */
@@ -123,7 +123,6 @@ static GQuark attribute_name_q,
 	attribute_accessed_date_q,
 	attribute_date_accessed_q,
 	attribute_mime_type_q,
-	attribute_size_detail_q,
 	attribute_deep_size_q,
 	attribute_deep_file_count_q,
 	attribute_deep_directory_count_q,
@@ -131,17 +130,7 @@ static GQuark attribute_name_q,
 	attribute_date_changed_q,
 	attribute_trashed_on_q,
 	attribute_trash_orig_path_q,
-	attribute_date_permissions_q,
-	attribute_permissions_q,
-	attribute_selinux_context_q,
-	attribute_octal_permissions_q,
-	attribute_owner_q,
-	attribute_group_q,
-	attribute_uri_q,
-	attribute_where_q,
-	attribute_link_target_q,
-	attribute_volume_q,
-	attribute_free_space_q;
+	attribute_date_permissions_q;
 
 static void     nautilus_file_info_iface_init                (NautilusFileInfoIface *iface);
 static char *   nautilus_file_get_owner_as_string            (NautilusFile          *file,
@@ -235,8 +224,11 @@ nautilus_file_set_display_name (NautilusFile *file,
 			file->details->display_name = eel_ref_str_new (display_name);
 		}
 		
+		/* Made when first needed, see
+		 * nautilus_file_peek_display_name_collation_key.
+		 */
 		g_free (file->details->display_name_collation_key);
-		file->details->display_name_collation_key = g_utf8_collate_key_for_filename (display_name, -1);
+		file->details->display_name_collation_key = NULL;
 	}
 
 	if (g_strcmp0 (eel_ref_str_peek (file->details->edit_name), edit_name) != 0) {
@@ -254,6 +246,19 @@ nautilus_file_set_display_name (NautilusFile *file,
 	return changed;
 }
 
+void
+nautilus_file_set_display_name_collation_key (NautilusFile *file,
+					      const char *display_name,
+					      char *collation_key)
+{
+	if (file->details->display_name_collation_key == NULL &&
+	    g_strcmp0 (eel_ref_str_peek (file->details->display_name), display_name) == 0) {
+		file->details->display_name_collation_key = collation_key;
+	} else {
+		g_free (collation_key);
+	}
+}
+
 static void
 nautilus_file_clear_display_name (NautilusFile *file)
 {
@@ -408,9 +413,22 @@ nautilus_file_update_metadata_from_info (NautilusFile *file,
 	return changed;
 }
 
+static void
+invalidate_formatted_attributes (NautilusFile *file)
+{
+	int i;
+
+	for (i = 0; i < NAUTILUS_FILE_N_FORMATTED_ATTRIBUTES; i++) {
+		eel_ref_str_unref (file->details->formatted_attributes[i]);
+		file->details->formatted_attributes[i] = NULL;
+	}
+	file->details->formatted_attributes_valid = 0;
+}
+
 void
 nautilus_file_clear_info (NautilusFile *file)
 {
+	invalidate_formatted_attributes (file);
 	file->details->got_file_info = FALSE;
 	if (file->details->get_info_error) {
 		g_error_free (file->details->get_info_error);
@@ -798,6 +816,7 @@ finalize (GObject *object)
 	eel_ref_str_unref (file->details->owner);
 	eel_ref_str_unref (file->details->owner_real);
 	eel_ref_str_unref (file->details->group);
+	invalidate_formatted_attributes (file);
 	g_free (file->details->selinux_context);
 	g_free (file->details->description);
 	g_free (file->details->top_left_text);
@@ -2079,7 +2098,7 @@ update_info_internal (NautilusFile *file,
 		      GFileInfo *info,
 		      gboolean update_name)
 {
-	GList *node;
+	gboolean in_file_hash;
 	gboolean changed;
 	gboolean is_symlink, is_hidden, is_mountpoint;
 	gboolean has_permissions;
@@ -2479,7 +2498,7 @@ update_info_internal (NautilusFile *file,
 		    strcmp (eel_ref_str_peek (file->details->name), name) != 0) {
 			changed = TRUE;
 
-			node = nautilus_directory_begin_file_name_change
+			in_file_hash = nautilus_directory_begin_file_name_change
 				(file->details->directory, file);
 			
 			eel_ref_str_unref (file->details->name);
@@ -2500,11 +2519,13 @@ update_info_internal (NautilusFile *file,
 			}
 
 			nautilus_directory_end_file_name_change
-				(file->details->directory, file, node);
+				(file->details->directory, file, in_file_hash);
 		}
 	}
 
 	if (changed) {
+		invalidate_formatted_attributes (file);
+
 		add_to_link_hash_table (file);
 		
 		update_links_if_target (file);
@@ -2532,7 +2553,7 @@ update_name_internal (NautilusFile *file,
 		      const char *name,
 		      gboolean in_directory)
 {
-	GList *node;
+	gboolean in_file_hash;
 
 	g_assert (name != NULL);
 
@@ -2544,9 +2565,9 @@ update_name_internal (NautilusFile *file,
 		return FALSE;
 	}
 	
-	node = NULL;
+	in_file_hash = FALSE;
 	if (in_directory) {
-		node = nautilus_directory_begin_file_name_change
+		in_file_hash = nautilus_directory_begin_file_name_change
 			(file->details->directory, file);
 	}
 	
@@ -2559,7 +2580,7 @@ update_name_internal (NautilusFile *file,
 
 	if (in_directory) {
 		nautilus_directory_end_file_name_change
-			(file->details->directory, file, node);
+			(file->details->directory, file, in_file_hash);
 	}
 
 	return TRUE;
@@ -3646,6 +3667,12 @@ nautilus_file_peek_display_name_collation_key (NautilusFile *file)
 {
 	const char *res;
 
+	if (file->details->display_name_collation_key == NULL &&
+	    file->details->display_name != NULL) {
+		file->details->display_name_collation_key =
+			g_utf8_collate_key_for_filename (eel_ref_str_peek (file->details->display_name), -1);
+	}
+
 	res = file->details->display_name_collation_key;
 	if (res == NULL)
 		res = "";
@@ -4182,8 +4209,10 @@ nautilus_file_get_icon (NautilusFile *file,
 	if (flags & NAUTILUS_FILE_ICON_FLAGS_USE_THUMBNAILS &&
 	    nautilus_file_should_show_thumbnail (file)) {
 		if (file->details->thumbnail) {
-			int w, h, s;
+			int w, h, s, scaled_w, scaled_h;
 			double scale;
+			gboolean framed;
+			char *uri, *key;
 
 			raw_pixbuf = g_object_ref (file->details->thumbnail);
 
@@ -4203,15 +4232,29 @@ nautilus_file_get_icon (NautilusFile *file,
 				scale = (double) NAUTILUS_ICON_SIZE_SMALLEST / s;
 			}
 
-			scaled_pixbuf = gdk_pixbuf_scale_simple (raw_pixbuf,
-								 MAX (w * scale, 1),
-								 MAX (h * scale, 1),
-								 GDK_INTERP_BILINEAR);
+			scaled_w = MAX (w * scale, 1);
+			scaled_h = MAX (h * scale, 1);
 
 			/* We don't want frames around small icons */
-			if (!gdk_pixbuf_get_has_alpha(raw_pixbuf) || s >= 128) {
-				nautilus_thumbnail_frame_image (&scaled_pixbuf);
+			framed = !gdk_pixbuf_get_has_alpha (raw_pixbuf) || s >= 128;
+
+			/* Other views may have made this one already */
+			uri = nautilus_file_get_uri (file);
+			key = nautilus_thumbnail_cache_key (uri, file->details->mtime,
+							    w, h, scaled_w, scaled_h, framed);
+			scaled_pixbuf = nautilus_thumbnail_cache_lookup (key);
+			if (scaled_pixbuf == NULL) {
+				scaled_pixbuf = gdk_pixbuf_scale_simple (raw_pixbuf,
+									 scaled_w,
+									 scaled_h,
+									 GDK_INTERP_BILINEAR);
+				if (framed) {
+					nautilus_thumbnail_frame_image (&scaled_pixbuf);
+				}
+				nautilus_thumbnail_cache_insert (key, scaled_pixbuf);
 			}
+			g_free (key);
+			g_free (uri);
 			g_object_unref (raw_pixbuf);
 
 			/* Don't scale up if more than 25%, then read the original
@@ -4397,6 +4440,42 @@ static const char *CURRENT_WEEK_TIME_FORMATS [] = {
 	NULL
 };
 
+/* Bumped whenever a preference changes how attributes are displayed,
+ * which makes the display strings kept with all files invalid.
+ */
+static guint formatted_attributes_generation;
+static int date_format;
+static guint formatted_attribute_hits;
+static guint formatted_attribute_misses;
+
+static void
+date_format_changed_callback (gpointer callback_data)
+{
+	date_format = g_settings_get_enum (nautilus_preferences,
+					   NAUTILUS_PREFERENCES_DATE_FORMAT);
+	formatted_attributes_generation++;
+}
+
+static int
+get_date_format (void)
+{
+	static gboolean date_format_callback_added = FALSE;
+
+	/* Add the callback once for the life of our process */
+	if (!date_format_callback_added) {
+		g_signal_connect_swapped (nautilus_preferences,
+					  "changed::" NAUTILUS_PREFERENCES_DATE_FORMAT,
+					  G_CALLBACK (date_format_changed_callback),
+					  NULL);
+		date_format_callback_added = TRUE;
+
+		/* Peek for the first time */
+		date_format_changed_callback (NULL);
+	}
+
+	return date_format;
+}
+
 static char *
 nautilus_file_fit_date_as_string (NautilusFile *file,
 				  NautilusDateType date_type,
@@ -4420,8 +4499,7 @@ nautilus_file_fit_date_as_string (NautilusFile *file,
 	}
 
 	date_time = g_date_time_new_from_unix_local (file_time_raw);
-	date_format_pref = g_settings_get_enum (nautilus_preferences,
-						NAUTILUS_PREFERENCES_DATE_FORMAT);
+	date_format_pref = get_date_format ();
 
 	if (date_format_pref == NAUTILUS_DATE_FORMAT_LOCALE) {
 		result = g_date_time_format (date_time, "%c");
@@ -5995,6 +6073,160 @@ nautilus_file_get_deep_directory_count_as_string (NautilusFile *file)
 	return nautilus_file_get_deep_count_as_string_internal (file, FALSE, TRUE, FALSE);
 }
 
+static char *
+get_date_modified_as_string (NautilusFile *file)
+{
+	return nautilus_file_get_date_as_string (file, NAUTILUS_DATE_TYPE_MODIFIED);
+}
+
+static char *
+get_date_changed_as_string (NautilusFile *file)
+{
+	return nautilus_file_get_date_as_string (file, NAUTILUS_DATE_TYPE_CHANGED);
+}
+
+static char *
+get_date_accessed_as_string (NautilusFile *file)
+{
+	return nautilus_file_get_date_as_string (file, NAUTILUS_DATE_TYPE_ACCESSED);
+}
+
+static char *
+get_date_permissions_as_string (NautilusFile *file)
+{
+	return nautilus_file_get_date_as_string (file, NAUTILUS_DATE_TYPE_PERMISSIONS_CHANGED);
+}
+
+static char *
+get_trashed_on_as_string (NautilusFile *file)
+{
+	return nautilus_file_get_date_as_string (file, NAUTILUS_DATE_TYPE_TRASHED);
+}
+
+static char *
+get_owner_as_string (NautilusFile *file)
+{
+	return nautilus_file_get_owner_as_string (file, TRUE);
+}
+
+typedef struct {
+	const char *name;
+	char * (* get) (NautilusFile *file);
+	/* Where the display string is kept with the file, or -1 */
+	int formatted_attribute;
+	/* The date shown, for dates, or -1 */
+	int date_type;
+} StringAttribute;
+
+static const StringAttribute string_attributes[] = {
+	{ "name", nautilus_file_get_display_name, -1, -1 },
+	{ "type", nautilus_file_get_type_as_string, NAUTILUS_FILE_FORMATTED_TYPE, -1 },
+	{ "mime_type", nautilus_file_get_mime_type, -1, -1 },
+	{ "size", nautilus_file_get_size_as_string, NAUTILUS_FILE_FORMATTED_SIZE, -1 },
+	{ "size_detail", nautilus_file_get_size_as_string_with_real_size,
+	  NAUTILUS_FILE_FORMATTED_SIZE_DETAIL, -1 },
+	{ "deep_size", nautilus_file_get_deep_size_as_string, -1, -1 },
+	{ "deep_file_count", nautilus_file_get_deep_file_count_as_string, -1, -1 },
+	{ "deep_directory_count", nautilus_file_get_deep_directory_count_as_string, -1, -1 },
+	{ "deep_total_count", nautilus_file_get_deep_total_count_as_string, -1, -1 },
+	{ "trash_orig_path", nautilus_file_get_trash_original_file_parent_as_string, -1, -1 },
+	{ "date_modified", get_date_modified_as_string,
+	  NAUTILUS_FILE_FORMATTED_DATE_MODIFIED, NAUTILUS_DATE_TYPE_MODIFIED },
+	{ "date_changed", get_date_changed_as_string,
+	  NAUTILUS_FILE_FORMATTED_DATE_CHANGED, NAUTILUS_DATE_TYPE_CHANGED },
+	{ "date_accessed", get_date_accessed_as_string,
+	  NAUTILUS_FILE_FORMATTED_DATE_ACCESSED, NAUTILUS_DATE_TYPE_ACCESSED },
+	{ "trashed_on", get_trashed_on_as_string,
+	  NAUTILUS_FILE_FORMATTED_TRASHED_ON, NAUTILUS_DATE_TYPE_TRASHED },
+	{ "date_permissions", get_date_permissions_as_string,
+	  NAUTILUS_FILE_FORMATTED_DATE_PERMISSIONS, NAUTILUS_DATE_TYPE_PERMISSIONS_CHANGED },
+	{ "permissions", nautilus_file_get_permissions_as_string,
+	  NAUTILUS_FILE_FORMATTED_PERMISSIONS, -1 },
+	{ "selinux_context", nautilus_file_get_selinux_context, -1, -1 },
+	{ "octal_permissions", nautilus_file_get_octal_permissions_as_string,
+	  NAUTILUS_FILE_FORMATTED_OCTAL_PERMISSIONS, -1 },
+	{ "owner", get_owner_as_string, NAUTILUS_FILE_FORMATTED_OWNER, -1 },
+	{ "group", nautilus_file_get_group_name, -1, -1 },
+	{ "uri", nautilus_file_get_uri, -1, -1 },
+	{ "where", nautilus_file_get_where_string, -1, -1 },
+	{ "link_target", nautilus_file_get_symbolic_link_target_path, -1, -1 },
+	{ "volume", nautilus_file_get_volume_name, -1, -1 },
+	{ "free_space", nautilus_file_get_volume_free_space, -1, -1 },
+};
+
+/* Maps attribute quarks to one more than their index in string_attributes. */
+static GHashTable *string_attribute_table;
+
+static void
+init_string_attribute_table (void)
+{
+	guint i;
+
+	string_attribute_table = g_hash_table_new (NULL, NULL);
+	for (i = 0; i < G_N_ELEMENTS (string_attributes); i++) {
+		g_hash_table_insert (string_attribute_table,
+				     GUINT_TO_POINTER (g_quark_from_static_string (string_attributes[i].name)),
+				     GUINT_TO_POINTER (i + 1));
+	}
+}
+
+/* Dates are shown relative to today for two days, after that the
+ * string does not change anymore.
+ */
+static gboolean
+date_string_is_stable (NautilusFile *file, NautilusDateType date_type)
+{
+	time_t date;
+
+	if (get_date_format () != NAUTILUS_DATE_FORMAT_INFORMAL) {
+		return TRUE;
+	}
+
+	if (!nautilus_file_get_date (file, date_type, &date)) {
+		return TRUE;
+	}
+
+	return time (NULL) - date >= 2 * 24 * 60 * 60;
+}
+
+static char *
+get_formatted_attribute (NautilusFile *file,
+			 const StringAttribute *attribute)
+{
+	int slot;
+	char *string;
+
+	slot = attribute->formatted_attribute;
+
+	if (file->details->formatted_attributes_generation != formatted_attributes_generation) {
+		invalidate_formatted_attributes (file);
+		file->details->formatted_attributes_generation = formatted_attributes_generation;
+	}
+
+	if (file->details->formatted_attributes_valid & (1 << slot)) {
+		formatted_attribute_hits++;
+		return g_strdup (eel_ref_str_peek (file->details->formatted_attributes[slot]));
+	}
+	formatted_attribute_misses++;
+
+	string = attribute->get (file);
+
+	if (attribute->date_type >= 0 &&
+	    !date_string_is_stable (file, attribute->date_type)) {
+		return string;
+	}
+
+	/* Many files share their type, owner, permissions, and dates
+	 * down to the minute, so the strings are shared too.
+	 */
+	if (string != NULL) {
+		file->details->formatted_attributes[slot] = eel_ref_str_get_unique (string);
+	}
+	file->details->formatted_attributes_valid |= 1 << slot;
+
+	return string;
+}
+
 /**
  * nautilus_file_get_string_attribute:
  * 
@@ -6017,87 +6249,18 @@ nautilus_file_get_deep_directory_count_as_string (NautilusFile *file)
 char *
 nautilus_file_get_string_attribute_q (NautilusFile *file, GQuark attribute_q)
 {
+	const StringAttribute *attribute;
 	char *extension_attribute;
-
-	if (attribute_q == attribute_name_q) {
-		return nautilus_file_get_display_name (file);
-	}
-	if (attribute_q == attribute_type_q) {
-		return nautilus_file_get_type_as_string (file);
-	}
-	if (attribute_q == attribute_mime_type_q) {
-		return nautilus_file_get_mime_type (file);
-	}
-	if (attribute_q == attribute_size_q) {
-		return nautilus_file_get_size_as_string (file);
-	}
-	if (attribute_q == attribute_size_detail_q) {
-		return nautilus_file_get_size_as_string_with_real_size (file);
-	}
-	if (attribute_q == attribute_deep_size_q) {
-		return nautilus_file_get_deep_size_as_string (file);
-	}
-	if (attribute_q == attribute_deep_file_count_q) {
-		return nautilus_file_get_deep_file_count_as_string (file);
-	}
-	if (attribute_q == attribute_deep_directory_count_q) {
-		return nautilus_file_get_deep_directory_count_as_string (file);
-	}
-	if (attribute_q == attribute_deep_total_count_q) {
-		return nautilus_file_get_deep_total_count_as_string (file);
-	}
-	if (attribute_q == attribute_trash_orig_path_q) {
-		return nautilus_file_get_trash_original_file_parent_as_string (file);
-	}
-	if (attribute_q == attribute_date_modified_q) {
-		return nautilus_file_get_date_as_string (file, 
-							 NAUTILUS_DATE_TYPE_MODIFIED);
-	}
-	if (attribute_q == attribute_date_changed_q) {
-		return nautilus_file_get_date_as_string (file, 
-							 NAUTILUS_DATE_TYPE_CHANGED);
-	}
-	if (attribute_q == attribute_date_accessed_q) {
-		return nautilus_file_get_date_as_string (file,
-							 NAUTILUS_DATE_TYPE_ACCESSED);
-	}
-	if (attribute_q == attribute_trashed_on_q) {
-		return nautilus_file_get_date_as_string (file,
-							 NAUTILUS_DATE_TYPE_TRASHED);
-	}
-	if (attribute_q == attribute_date_permissions_q) {
-		return nautilus_file_get_date_as_string (file,
-							 NAUTILUS_DATE_TYPE_PERMISSIONS_CHANGED);
-	}
-	if (attribute_q == attribute_permissions_q) {
-		return nautilus_file_get_permissions_as_string (file);
-	}
-	if (attribute_q == attribute_selinux_context_q) {
-		return nautilus_file_get_selinux_context (file);
-	}
-	if (attribute_q == attribute_octal_permissions_q) {
-		return nautilus_file_get_octal_permissions_as_string (file);
-	}
-	if (attribute_q == attribute_owner_q) {
-		return nautilus_file_get_owner_as_string (file, TRUE);
-	}
-	if (attribute_q == attribute_group_q) {
-		return nautilus_file_get_group_name (file);
-	}
-	if (attribute_q == attribute_uri_q) {
-		return nautilus_file_get_uri (file);
-	}
-	if (attribute_q == attribute_where_q) {
-		return nautilus_file_get_where_string (file);
-	}
-	if (attribute_q == attribute_link_target_q) {
-		return nautilus_file_get_symbolic_link_target_path (file);
-	}
-	if (attribute_q == attribute_volume_q) {
-		return nautilus_file_get_volume_name (file);
-	}
-	if (attribute_q == attribute_free_space_q) {
-		return nautilus_file_get_volume_free_space (file);
+	guint index;
+
+	index = GPOINTER_TO_UINT (g_hash_table_lookup (string_attribute_table,
+						       GUINT_TO_POINTER (attribute_q)));
+	if (index != 0) {
+		attribute = &string_attributes[index - 1];
+		if (attribute->formatted_attribute < 0) {
+			return attribute->get (file);
+		}
+		return get_formatted_attribute (file, attribute);
 	}
 
 	extension_attribute = NULL;
@@ -6115,6 +6278,36 @@ nautilus_file_get_string_attribute_q (NautilusFile *file, GQuark attribute_q)
 	return g_strdup (extension_attribute);
 }
 
+gboolean
+nautilus_file_string_attribute_is_stable_q (NautilusFile *file,
+					    GQuark attribute_q)
+{
+	const StringAttribute *attribute;
+	guint index;
+
+	index = GPOINTER_TO_UINT (g_hash_table_lookup (string_attribute_table,
+						       GUINT_TO_POINTER (attribute_q)));
+	if (index == 0) {
+		return TRUE;
+	}
+
+	attribute = &string_attributes[index - 1];
+	return attribute->date_type < 0 ||
+		date_string_is_stable (file, attribute->date_type);
+}
+
+void
+nautilus_file_get_formatted_attribute_statistics (guint *hits,
+						  guint *misses)
+{
+	if (hits != NULL) {
+		*hits = formatted_attribute_hits;
+	}
+	if (misses != NULL) {
+		*misses = formatted_attribute_misses;
+	}
+}
+
 char *
 nautilus_file_get_string_attribute (NautilusFile *file, const char *attribute_name)
 {
@@ -6340,6 +6533,68 @@ nautilus_file_get_mime_type (NautilusFile *file)
 	return g_strdup ("application/octet-stream");
 }
 
+/**
+ * nautilus_file_has_local_path
+ * 
+ * Check whether a file can be opened through a path, natively or
+ * through the fuse mount of its backend.
+ * @file: NautilusFile representing the file in question.
+ * 
+ **/
+gboolean
+nautilus_file_has_local_path (NautilusFile *file)
+{
+	GFile *location;
+	char *path;
+	gboolean res;
+
+	location = nautilus_file_get_location (file);
+	if (g_file_is_native (location)) {
+		res = TRUE;
+	} else {
+		path = g_file_get_path (location);
+		res = path != NULL;
+		g_free (path);
+	}
+	g_object_unref (location);
+
+	return res;
+}
+
+/**
+ * nautilus_file_get_application_key
+ * 
+ * Get a string that is the same for all files that are opened by the
+ * same applications: it is made of the MIME type, the URI scheme and
+ * whether the file has a local path.
+ * @file: NautilusFile representing the file in question.
+ * 
+ * Returns: A newly allocated string, or NULL if the file info is not
+ * there yet.
+ * 
+ **/
+char *
+nautilus_file_get_application_key (NautilusFile *file)
+{
+	char *uri_scheme, *key;
+
+	if (!nautilus_file_check_if_ready (file,
+					   NAUTILUS_FILE_ATTRIBUTE_INFO |
+					   NAUTILUS_FILE_ATTRIBUTE_LINK_INFO)) {
+		return NULL;
+	}
+
+	uri_scheme = nautilus_file_get_uri_scheme (file);
+	key = g_strdup_printf ("%s %s %s",
+			       file->details->mime_type != NULL ?
+			       eel_ref_str_peek (file->details->mime_type) : "application/octet-stream",
+			       uri_scheme != NULL ? uri_scheme : "",
+			       nautilus_file_has_local_path (file) ? "local" : "remote");
+	g_free (uri_scheme);
+
+	return key;
+}
+
 /**
  * nautilus_file_is_mime_type
  * 
@@ -7119,6 +7374,8 @@ nautilus_file_emit_changed (NautilusFile *file)
 
 	g_assert (NAUTILUS_IS_FILE (file));
 
+	invalidate_formatted_attributes (file);
+
 	/* Send out a signal. */
 	g_signal_emit (file, signals[CHANGED], 0, file);
 
@@ -7989,7 +8246,6 @@ nautilus_file_class_init (NautilusFileClass *class)
 	attribute_accessed_date_q = g_quark_from_static_string ("accessed_date");
 	attribute_date_accessed_q = g_quark_from_static_string ("date_accessed");
 	attribute_mime_type_q = g_quark_from_static_string ("mime_type");
-	attribute_size_detail_q = g_quark_from_static_string ("size_detail");
 	attribute_deep_size_q = g_quark_from_static_string ("deep_size");
 	attribute_deep_file_count_q = g_quark_from_static_string ("deep_file_count");
 	attribute_deep_directory_count_q = g_quark_from_static_string ("deep_directory_count");
@@ -7998,16 +8254,8 @@ nautilus_file_class_init (NautilusFileClass *class)
 	attribute_trashed_on_q = g_quark_from_static_string ("trashed_on");
 	attribute_trash_orig_path_q = g_quark_from_static_string ("trash_orig_path");
 	attribute_date_permissions_q = g_quark_from_static_string ("date_permissions");
-	attribute_permissions_q = g_quark_from_static_string ("permissions");
-	attribute_selinux_context_q = g_quark_from_static_string ("selinux_context");
-	attribute_octal_permissions_q = g_quark_from_static_string ("octal_permissions");
-	attribute_owner_q = g_quark_from_static_string ("owner");
-	attribute_group_q = g_quark_from_static_string ("group");
-	attribute_uri_q = g_quark_from_static_string ("uri");
-	attribute_where_q = g_quark_from_static_string ("where");
-	attribute_link_target_q = g_quark_from_static_string ("link_target");
-	attribute_volume_q = g_quark_from_static_string ("volume");
-	attribute_free_space_q = g_quark_from_static_string ("free_space");
+
+	init_string_attribute_table ();
 	
 	G_OBJECT_CLASS (class)->finalize = finalize;
 	G_OBJECT_CLASS (class)->constructor = nautilus_file_constructor;
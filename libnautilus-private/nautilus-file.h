@@ -172,6 +172,8 @@ GFileType               nautilus_file_get_file_type                     (Nautilu
 char *                  nautilus_file_get_mime_type                     (NautilusFile                   *file);
 gboolean                nautilus_file_is_mime_type                      (NautilusFile                   *file,
 									 const char                     *mime_type);
+gboolean                nautilus_file_has_local_path                    (NautilusFile                   *file);
+char *                  nautilus_file_get_application_key               (NautilusFile                   *file);
 gboolean                nautilus_file_is_launchable                     (NautilusFile                   *file);
 gboolean                nautilus_file_is_symbolic_link                  (NautilusFile                   *file);
 gboolean                nautilus_file_is_mountpoint                     (NautilusFile                   *file);
@@ -366,6 +368,13 @@ char *                  nautilus_file_get_string_attribute_with_default (Nautilu
 									 const char                     *attribute_name);
 char *                  nautilus_file_get_string_attribute_with_default_q (NautilusFile                  *file,
 									 GQuark                          attribute_q);
+/* FALSE for dates shown relative to today, whose string changes
+ * without the file changing.
+ */
+gboolean                nautilus_file_string_attribute_is_stable_q      (NautilusFile                   *file,
+									 GQuark                          attribute_q);
+void                    nautilus_file_get_formatted_attribute_statistics (guint                         *hits,
+									 guint                          *misses);
 char *			nautilus_file_fit_modified_date_as_string	(NautilusFile 			*file,
 									 int				 width,
 									 NautilusWidthMeasureCallback    measure_callback,
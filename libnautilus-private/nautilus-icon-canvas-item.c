@@ -855,37 +855,246 @@ prepare_pango_layout_for_measure_entire_text (NautilusIconCanvasItem *item,
 	}
 }
 
-static void
-prepare_pango_layout_for_draw (NautilusIconCanvasItem *item,
-			       PangoLayout *layout)
+static int
+get_label_height_for_draw (NautilusIconCanvasItem *item)
 {
 	NautilusIconCanvasItemDetails *details;
 	NautilusIconContainer *container;
 	gboolean needs_highlight;
 
-	prepare_pango_layout_width (item, layout);
-
 	container = NAUTILUS_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
 	details = item->details;
 
 	needs_highlight = details->is_highlighted_for_selection || details->is_highlighted_for_drop;
 
 	if (IS_COMPACT_VIEW (container)) {
-		pango_layout_set_height (layout, -1);
+		return -1;
 	} else if (needs_highlight ||
 		   details->is_prelit ||
 		   details->is_highlighted_as_keyboard_focus ||
 		   details->entire_text ||
 		   container->details->label_position == NAUTILUS_ICON_LABEL_POSITION_BESIDE) {
 		/* VOODOO-TODO, cf. compute_text_rectangle() */
-		pango_layout_set_height (layout, G_MININT);
+		return G_MININT;
 	} else {
 		/* TODO? we might save some resources, when the re-layout is not neccessary in case
 		 * the layout height already fits into max. layout lines. But pango should figure this
 		 * out itself (which it doesn't ATM).
 		 */
-		pango_layout_set_height (layout,
-					 nautilus_icon_container_get_max_layout_lines_for_pango (container));
+		return nautilus_icon_container_get_max_layout_lines_for_pango (container);
+	}
+}
+
+static void
+prepare_pango_layout_for_draw (NautilusIconCanvasItem *item,
+			       PangoLayout *layout)
+{
+	prepare_pango_layout_width (item, layout);
+	pango_layout_set_height (layout, get_label_height_for_draw (item));
+}
+
+static PangoAlignment
+get_label_alignment (NautilusIconContainer *container)
+{
+	if (container->details->label_position == NAUTILUS_ICON_LABEL_POSITION_BESIDE) {
+		if (!nautilus_icon_container_is_layout_rtl (container)) {
+			return PANGO_ALIGN_LEFT;
+		} else {
+			return PANGO_ALIGN_RIGHT;
+		}
+	} else {
+		return PANGO_ALIGN_CENTER;
+	}
+}
+
+static PangoFontDescription *
+get_label_font_description (NautilusIconContainer *container,
+			    PangoContext *context)
+{
+	PangoFontDescription *desc;
+
+	if (container->details->font) {
+		desc = pango_font_description_from_string (container->details->font);
+	} else {
+		desc = pango_font_description_copy (pango_context_get_font_description (context));
+		pango_font_description_set_size (desc,
+						 pango_font_description_get_size (desc) +
+						 container->details->font_size_table [container->details->zoom_level]);
+	}
+
+	return desc;
+}
+
+/* The sizes of a label are kept for all items together, keyed by
+ * the text and everything that goes into laying it out. Shaping the
+ * text is most of the cost of measuring a label, and the same labels
+ * come back when zooming back and forth or when a view is reloaded.
+ */
+#define LABEL_SIZE_CACHE_MAX_ENTRIES 50000
+
+typedef struct {
+	int width;
+	int height;
+	int dx;
+	/* only measured for the editable text */
+	int height_for_entire_text;
+	int height_for_layout;
+} LabelSize;
+
+typedef struct {
+	/* data is the key */
+	GList lru_link;
+	LabelSize size;
+} LabelSizeEntry;
+
+static GHashTable *label_size_cache = NULL;
+/* most recently used first */
+static GQueue label_size_lru = G_QUEUE_INIT;
+static guint label_size_hits;
+static guint label_size_misses;
+
+static void
+label_size_entry_free (LabelSizeEntry *entry)
+{
+	g_slice_free (LabelSizeEntry, entry);
+}
+
+static char *
+get_label_size_key (NautilusIconCanvasItem *item,
+		    const char *text,
+		    gboolean editable)
+{
+	NautilusIconContainer *container;
+	PangoContext *context;
+	PangoFontDescription *desc;
+	char *font, *key;
+	int width, height_for_entire_text, max_layout_lines;
+
+	container = NAUTILUS_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+	context = gtk_widget_get_pango_context (GTK_WIDGET (container));
+
+	desc = get_label_font_description (container, context);
+	font = pango_font_description_to_string (desc);
+	pango_font_description_free (desc);
+
+	if (nautilus_icon_canvas_item_get_max_text_width (item) < 0) {
+		width = -1;
+	} else {
+		width = floor (nautilus_icon_canvas_item_get_max_text_width (item));
+	}
+
+	height_for_entire_text = 0;
+	max_layout_lines = 0;
+	if (editable) {
+		height_for_entire_text = IS_COMPACT_VIEW (container) ? -1 : G_MININT;
+		max_layout_lines = nautilus_icon_container_get_max_layout_lines (container);
+	}
+
+	key = g_strdup_printf ("%s %g %d %d %d %d %d %d\n%s",
+			       font,
+			       pango_cairo_context_get_resolution (context),
+			       pango_context_get_base_dir (context),
+			       get_label_alignment (container),
+			       width,
+			       get_label_height_for_draw (item),
+			       height_for_entire_text,
+			       max_layout_lines,
+			       text);
+	g_free (font);
+
+	return key;
+}
+
+static void
+get_label_size (NautilusIconCanvasItem *item,
+		PangoLayout **layout_cache,
+		const char *text,
+		gboolean editable,
+		LabelSize *size)
+{
+	NautilusIconContainer *container;
+	LabelSizeEntry *entry;
+	PangoLayout *layout;
+	GList *link;
+	char *key;
+
+	if (label_size_cache == NULL) {
+		label_size_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+							  g_free, (GDestroyNotify) label_size_entry_free);
+	}
+
+	key = get_label_size_key (item, text, editable);
+	entry = g_hash_table_lookup (label_size_cache, key);
+	if (entry != NULL) {
+		label_size_hits++;
+		g_free (key);
+
+		g_queue_unlink (&label_size_lru, &entry->lru_link);
+		g_queue_push_head_link (&label_size_lru, &entry->lru_link);
+
+		*size = entry->size;
+		return;
+	}
+
+	label_size_misses++;
+
+	container = NAUTILUS_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);
+	layout = get_label_layout (layout_cache, item, text);
+
+	entry = g_slice_new0 (LabelSizeEntry);
+	if (editable) {
+		/* first, measure required text height: height_for_entire_text
+		 * then, measure text height applicable for layout: height_for_layout
+		 */
+		prepare_pango_layout_for_measure_entire_text (item, layout);
+		layout_get_full_size (layout,
+				      NULL,
+				      &entry->size.height_for_entire_text,
+				      NULL);
+		layout_get_size_for_layout (layout,
+					    nautilus_icon_container_get_max_layout_lines (container),
+					    entry->size.height_for_entire_text,
+					    &entry->size.height_for_layout);
+	}
+
+	/* next, measure actually displayed size */
+	prepare_pango_layout_for_draw (item, layout);
+	layout_get_full_size (layout,
+			      &entry->size.width,
+			      &entry->size.height,
+			      &entry->size.dx);
+	g_object_unref (layout);
+
+	entry->lru_link.data = key;
+	g_hash_table_insert (label_size_cache, key, entry);
+	g_queue_push_head_link (&label_size_lru, &entry->lru_link);
+
+	while (label_size_lru.length > LABEL_SIZE_CACHE_MAX_ENTRIES) {
+		link = g_queue_pop_tail_link (&label_size_lru);
+		g_hash_table_remove (label_size_cache, link->data);
+	}
+
+	*size = entry->size;
+}
+
+void
+nautilus_icon_canvas_item_clear_label_size_cache (void)
+{
+	if (label_size_cache != NULL) {
+		g_hash_table_remove_all (label_size_cache);
+	}
+	g_queue_init (&label_size_lru);
+}
+
+void
+nautilus_icon_canvas_item_get_label_size_cache_statistics (guint *hits,
+							   guint *misses)
+{
+	if (hits != NULL) {
+		*hits = label_size_hits;
+	}
+	if (misses != NULL) {
+		*misses = label_size_misses;
 	}
 }
 
@@ -893,11 +1102,9 @@ static void
 measure_label_text (NautilusIconCanvasItem *item)
 {
 	NautilusIconCanvasItemDetails *details;
-	NautilusIconContainer *container;
 	gint editable_height, editable_height_for_layout, editable_height_for_entire_text, editable_width, editable_dx;
 	gint additional_height, additional_width, additional_dx;
-	PangoLayout *editable_layout;
-	PangoLayout *additional_layout;
+	LabelSize size;
 	gboolean have_editable, have_additional;
 
 	/* check to see if the cached values are still valid; if so, there's
@@ -940,39 +1147,22 @@ measure_label_text (NautilusIconCanvasItem *item)
 	additional_height = 0;
 	additional_dx = 0;
 
-	container = NAUTILUS_ICON_CONTAINER (EEL_CANVAS_ITEM (item)->canvas);	
-	editable_layout = NULL;
-	additional_layout = NULL;
-
 	if (have_editable) {
-		/* first, measure required text height: editable_height_for_entire_text
-		 * then, measure text height applicable for layout: editable_height_for_layout
-		 * next, measure actually displayed height: editable_height
-		 */
-		editable_layout = get_label_layout (&details->editable_text_layout, item, details->editable_text);
-
-		prepare_pango_layout_for_measure_entire_text (item, editable_layout);
-		layout_get_full_size (editable_layout,
-				      NULL,
-				      &editable_height_for_entire_text,
-				      NULL);
-		layout_get_size_for_layout (editable_layout,
-					    nautilus_icon_container_get_max_layout_lines (container),
-					    editable_height_for_entire_text,
-					    &editable_height_for_layout);
-
-		prepare_pango_layout_for_draw (item, editable_layout);
-		layout_get_full_size (editable_layout,
-				      &editable_width,
-				      &editable_height,
-				      &editable_dx);
+		get_label_size (item, &details->editable_text_layout,
+				details->editable_text, TRUE, &size);
+		editable_width = size.width;
+		editable_height = size.height;
+		editable_dx = size.dx;
+		editable_height_for_entire_text = size.height_for_entire_text;
+		editable_height_for_layout = size.height_for_layout;
 	}
 
 	if (have_additional) {
-		additional_layout = get_label_layout (&details->additional_text_layout, item, details->additional_text);
-		prepare_pango_layout_for_draw (item, additional_layout);
-		layout_get_full_size (additional_layout,
-				      &additional_width, &additional_height, &additional_dx);
+		get_label_size (item, &details->additional_text_layout,
+				details->additional_text, FALSE, &size);
+		additional_width = size.width;
+		additional_height = size.height;
+		additional_dx = size.dx;
 	}
 
 	details->editable_text_height = editable_height;
@@ -1005,14 +1195,6 @@ measure_label_text (NautilusIconCanvasItem *item)
 
 	/* extra to make it look nicer */
 	details->text_width += TEXT_BACK_PADDING_X*2;
-
-	if (editable_layout) {
-		g_object_unref (editable_layout);
-	}
-
-	if (additional_layout) {
-		g_object_unref (additional_layout);
-	}
 }
 
 static void
@@ -1187,6 +1369,25 @@ draw_label_text (NautilusIconCanvasItem *item,
 	}
 }
 
+static void
+free_label_layouts (NautilusIconCanvasItem *item)
+{
+	if (item->details->editable_text_layout) {
+		g_object_unref (item->details->editable_text_layout);
+		item->details->editable_text_layout = NULL;
+	}
+
+	if (item->details->additional_text_layout) {
+		g_object_unref (item->details->additional_text_layout);
+		item->details->additional_text_layout = NULL;
+	}
+
+	if (item->details->embedded_text_layout) {
+		g_object_unref (item->details->embedded_text_layout);
+		item->details->embedded_text_layout = NULL;
+	}
+}
+
 void
 nautilus_icon_canvas_item_set_is_visible (NautilusIconCanvasItem       *item,
 					  gboolean                      visible)
@@ -1196,8 +1397,11 @@ nautilus_icon_canvas_item_set_is_visible (NautilusIconCanvasItem       *item,
 	
 	item->details->is_visible = visible;
 
+	/* The sizes stay good, only the layouts are dropped so that
+	 * coming back into view does not measure the label again.
+	 */
 	if (!visible) {
-		nautilus_icon_canvas_item_invalidate_label (item);
+		free_label_layouts (item);
 	}
 }
 
@@ -1205,21 +1409,7 @@ void
 nautilus_icon_canvas_item_invalidate_label (NautilusIconCanvasItem     *item)
 {
 	nautilus_icon_canvas_item_invalidate_label_size (item);
-
-	if (item->details->editable_text_layout) {
-		g_object_unref (item->details->editable_text_layout);
-		item->details->editable_text_layout = NULL;
-	}
-
-	if (item->details->additional_text_layout) {
-		g_object_unref (item->details->additional_text_layout);
-		item->details->additional_text_layout = NULL;
-	}
-
-	if (item->details->embedded_text_layout) {
-		g_object_unref (item->details->embedded_text_layout);
-		item->details->embedded_text_layout = NULL;
-	}
+	free_label_layouts (item);
 }
 
 
@@ -1517,29 +1707,12 @@ create_label_layout (NautilusIconCanvasItem *item,
 
 	pango_layout_set_text (layout, zeroified_text, -1);
 	pango_layout_set_auto_dir (layout, FALSE);
-	
-	if (container->details->label_position == NAUTILUS_ICON_LABEL_POSITION_BESIDE) {
-		if (!nautilus_icon_container_is_layout_rtl (container)) {
-			pango_layout_set_alignment (layout, PANGO_ALIGN_LEFT);
-		} else {
-			pango_layout_set_alignment (layout, PANGO_ALIGN_RIGHT);
-		}
-	} else {
-		pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
-	}
+	pango_layout_set_alignment (layout, get_label_alignment (container));
 
 	pango_layout_set_spacing (layout, LABEL_LINE_SPACING);
 	pango_layout_set_wrap (layout, PANGO_WRAP_WORD_CHAR);
 
-	/* Create a font description */
-	if (container->details->font) {
-		desc = pango_font_description_from_string (container->details->font);
-	} else {
-		desc = pango_font_description_copy (pango_context_get_font_description (context));
-		pango_font_description_set_size (desc,
-						 pango_font_description_get_size (desc) +
-						 container->details->font_size_table [container->details->zoom_level]);
-	}
+	desc = get_label_font_description (container, context);
 	pango_layout_set_font_description (layout, desc);
 	pango_font_description_free (desc);
 	g_free (zeroified_text);
@@ -95,6 +95,12 @@ gboolean    nautilus_icon_canvas_item_hit_test_stretch_handles (NautilusIconCanv
 								GtkCornerType                *corner);
 void        nautilus_icon_canvas_item_invalidate_label         (NautilusIconCanvasItem       *item);
 void        nautilus_icon_canvas_item_invalidate_label_size    (NautilusIconCanvasItem       *item);
+/* Label sizes are shared by all items. The cache has to be cleared
+ * when the font settings of the screen change.
+ */
+void        nautilus_icon_canvas_item_clear_label_size_cache   (void);
+void        nautilus_icon_canvas_item_get_label_size_cache_statistics (guint *hits,
+								       guint *misses);
 EelDRect    nautilus_icon_canvas_item_get_icon_rectangle       (const NautilusIconCanvasItem *item);
 EelDRect    nautilus_icon_canvas_item_get_text_rectangle       (NautilusIconCanvasItem       *item,
 								gboolean                      for_layout);
@@ -32,6 +32,7 @@
 #include "nautilus-global-preferences.h"
 #include "nautilus-icon-private.h"
 #include "nautilus-lib-self-check-functions.h"
+#include "nautilus-search-matcher.h"
 #include "nautilus-selection-canvas-item.h"
 #include <atk/atkaction.h>
 #include <eel/eel-accessibility.h>
@@ -185,6 +186,7 @@ static void          handle_vadjustment_changed                     (GtkAdjustme
 								     NautilusIconContainer *container);
 static GList *       nautilus_icon_container_get_selected_icons (NautilusIconContainer *container);
 static void          nautilus_icon_container_update_visible_icons   (NautilusIconContainer *container);
+static void          invalidate_visibility_index                    (NautilusIconContainer *container);
 static void          reveal_icon                                    (NautilusIconContainer *container,
 								     NautilusIcon *icon);
 
@@ -272,9 +274,86 @@ icon_free (NautilusIcon *icon)
 {
 	/* Destroy this canvas item; the parent will unref it. */
 	eel_canvas_item_destroy (EEL_CANVAS_ITEM (icon->item));
+	g_free (icon->uri);
 	g_free (icon);
 }
 
+static NautilusIcon *
+find_other_icon_with_uri (NautilusIconContainer *container,
+			  NautilusIcon *icon)
+{
+	GList *p;
+	NautilusIcon *other;
+
+	for (p = container->details->icons; p != NULL; p = p->next) {
+		other = p->data;
+		if (other != icon && g_strcmp0 (other->uri, icon->uri) == 0) {
+			return other;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+icon_remove_uri (NautilusIconContainer *container,
+		 NautilusIcon *icon)
+{
+	NautilusIconContainerDetails *details;
+	NautilusIcon *other;
+
+	if (icon->uri == NULL) {
+		return;
+	}
+
+	details = container->details;
+
+	if (g_hash_table_lookup (details->icon_uris, icon->uri) != icon) {
+		/* Another icon took over the URI. */
+		details->n_duplicate_uris--;
+	} else {
+		/* Hand the URI over to another icon that has it, if any.
+		 * The key belongs to the icon, so it is replaced too.
+		 */
+		other = NULL;
+		if (details->n_duplicate_uris > 0) {
+			other = find_other_icon_with_uri (container, icon);
+		}
+		if (other != NULL) {
+			g_hash_table_replace (details->icon_uris, other->uri, other);
+			details->n_duplicate_uris--;
+		} else {
+			g_hash_table_remove (details->icon_uris, icon->uri);
+		}
+	}
+	g_free (icon->uri);
+	icon->uri = NULL;
+}
+
+/* Files can be renamed, so this is done again on every update. */
+static void
+icon_update_uri (NautilusIconContainer *container,
+		 NautilusIcon *icon)
+{
+	char *uri;
+
+	uri = nautilus_icon_container_get_icon_uri (container, icon);
+	if (g_strcmp0 (uri, icon->uri) == 0) {
+		g_free (uri);
+		return;
+	}
+
+	icon_remove_uri (container, icon);
+	icon->uri = uri;
+	if (uri != NULL) {
+		if (g_hash_table_lookup (container->details->icon_uris, uri) != NULL) {
+			container->details->n_duplicate_uris++;
+		}
+		/* The key belongs to the icon. */
+		g_hash_table_replace (container->details->icon_uris, uri, icon);
+	}
+}
+
 static gboolean
 icon_is_positioned (const NautilusIcon *icon)
 {
@@ -302,6 +381,7 @@ icon_set_position (NautilusIcon *icon,
 	}
 
 	container = NAUTILUS_ICON_CONTAINER (EEL_CANVAS_ITEM (icon->item)->canvas);
+	invalidate_visibility_index (container);
 
 	if (icon == get_icon_being_renamed (container)) {
 		end_renaming_mode (container, TRUE);
@@ -442,9 +522,28 @@ static void
 icon_toggle_selected (NautilusIconContainer *container,
 		      NautilusIcon *icon)
 {		
+	GQueue *selected_icons;
+
 	end_renaming_mode (container, TRUE);
 
+	if (!icon->selection_change_pending) {
+		icon->selection_change_pending = TRUE;
+		icon->was_selected_before_change = icon->is_selected;
+		g_ptr_array_add (container->details->selection_changes, icon);
+	}
+
 	icon->is_selected = !icon->is_selected;
+	selected_icons = &container->details->selected_icons;
+	if (icon->is_selected) {
+		if (selected_icons->tail != NULL &&
+		    ((NautilusIcon *) selected_icons->tail->data)->display_index > icon->display_index) {
+			container->details->selected_icons_unsorted = TRUE;
+		}
+		icon->selection_link.data = icon;
+		g_queue_push_tail_link (selected_icons, &icon->selection_link);
+	} else {
+		g_queue_unlink (selected_icons, &icon->selection_link);
+	}
 	eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
 			     "highlighted_for_selection", (gboolean) icon->is_selected,
 			     NULL);
@@ -1144,7 +1243,21 @@ sort_icons (NautilusIconContainer *container,
 static void
 resort (NautilusIconContainer *container)
 {
-	sort_icons (container, &container->details->icons);
+	NautilusIconContainerDetails *details;
+	GList *p;
+	int index;
+
+	details = container->details;
+	sort_icons (container, &details->icons);
+
+	index = 0;
+	for (p = details->icons; p != NULL; p = p->next) {
+		((NautilusIcon *) p->data)->display_index = index++;
+	}
+	details->next_display_index = 0;
+	if (details->selected_icons.length > 1) {
+		details->selected_icons_unsorted = TRUE;
+	}
 }
 
 #if 0
@@ -2130,6 +2243,7 @@ static void
 redo_layout_internal (NautilusIconContainer *container)
 {
 	finish_adding_new_icons (container);
+	invalidate_visibility_index (container);
 
 	/* Don't do any re-laying-out during stretching. Later we
 	 * might add smart logic that does this and leaves room for
@@ -2678,7 +2792,6 @@ stop_rubberbanding (NautilusIconContainer *container,
 		    guint32 time)
 {
 	NautilusIconRubberbandInfo *band_info;
-	GList *icons;
 	gboolean enable_animation;
 
 	band_info = &container->details->rubberband_info;
@@ -2703,11 +2816,10 @@ stop_rubberbanding (NautilusIconContainer *container,
 
 	/* if only one item has been selected, use it as range
 	 * selection base (cf. handle_icon_button_press) */
-	icons = nautilus_icon_container_get_selected_icons (container);
-	if (g_list_length (icons) == 1) {
-		container->details->range_selection_base_icon = icons->data;
+	if (container->details->selected_icons.length == 1) {
+		container->details->range_selection_base_icon =
+			g_queue_peek_head (&container->details->selected_icons);
 	}
-	g_list_free (icons);
 
 	g_signal_emit (container,
 			 signals[BAND_SELECT_ENDED], 0);
@@ -4002,6 +4114,13 @@ finalize (GObject *object)
 
 	g_hash_table_destroy (details->icon_set);
 	details->icon_set = NULL;
+	g_hash_table_destroy (details->icon_uris);
+	details->icon_uris = NULL;
+	if (details->visibility_index != NULL) {
+		g_array_free (details->visibility_index, TRUE);
+	}
+	g_ptr_array_free (details->visible_icons, TRUE);
+	g_ptr_array_free (details->selection_changes, TRUE);
 
 	g_free (details->font);
 
@@ -4206,6 +4325,7 @@ style_updated (GtkWidget *widget)
 	}
 
 	if (gtk_widget_get_realized (widget)) {
+		nautilus_icon_canvas_item_clear_label_size_cache ();
 		invalidate_labels (container);
 		nautilus_icon_container_request_update_all (container);
 	}
@@ -4965,21 +5085,12 @@ nautilus_icon_container_search_iter (NautilusIconContainer *container,
 	NautilusIcon *icon;
 	char *name;
 	int count;
-	char *normalized_key, *case_normalized_key;
-	char *normalized_name, *case_normalized_name;
+	NautilusSearchMatcher *matcher;
 	
 	g_assert (key != NULL);
 	g_assert (n >= 1);
 	
-	normalized_key = g_utf8_normalize (key, -1, G_NORMALIZE_ALL);
-	if (!normalized_key) {
-		return FALSE;
-	}
-	case_normalized_key = g_utf8_casefold (normalized_key, -1);
-	g_free (normalized_key);
-	if (!case_normalized_key) {
-		return FALSE;
-	}
+	matcher = nautilus_search_matcher_new_prefix (key);
 	
 	icon = NULL;
 	name = NULL;
@@ -4997,27 +5108,15 @@ nautilus_icon_container_search_iter (NautilusIconContainer *container,
 			continue;
 		}
 			
-		normalized_name = g_utf8_normalize (name, -1, G_NORMALIZE_ALL);
-		if (!normalized_name) {
-			continue;
-		}
-		case_normalized_name = g_utf8_casefold (normalized_name, -1);
-		g_free (normalized_name);
-		if (!case_normalized_name) {
-			continue;
-		}
-		
-		if (strncmp (case_normalized_key, case_normalized_name,
-			     strlen (case_normalized_key)) == 0) {
+		if (nautilus_search_matcher_matches (matcher, name)) {
 			count++;
 		}
 
-		g_free (case_normalized_name);
 		g_free (name);
 		name = NULL;
 	}
 
-	g_free (case_normalized_key);
+	nautilus_search_matcher_free (matcher);
 
 	if (count == n) {
 		if (select_one_unselect_others (container, icon)) {
@@ -6078,6 +6177,9 @@ nautilus_icon_container_init (NautilusIconContainer *container)
 	details = g_new0 (NautilusIconContainerDetails, 1);
 
 	details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+	details->icon_uris = g_hash_table_new (g_str_hash, g_str_equal);
+	details->visible_icons = g_ptr_array_new ();
+	details->selection_changes = g_ptr_array_new ();
 	details->layout_timestamp = UNDEFINED_TIME;
 	details->zoom_level = NAUTILUS_ZOOM_LEVEL_STANDARD;
 
@@ -6318,6 +6420,15 @@ nautilus_icon_container_clear (NautilusIconContainer *container)
 	details->stretch_icon = NULL;
 	details->drop_target = NULL;
 
+	g_hash_table_remove_all (details->icon_uris);
+	details->n_duplicate_uris = 0;
+	g_queue_init (&details->selected_icons);
+	details->selected_icons_unsorted = FALSE;
+	details->next_display_index = 0;
+	g_ptr_array_set_size (details->selection_changes, 0);
+	invalidate_visibility_index (container);
+	g_ptr_array_set_size (details->visible_icons, 0);
+
 	for (p = details->icons; p != NULL; p = p->next) {
 		icon = p->data;
 		if (icon->is_monitored) {
@@ -6532,8 +6643,20 @@ icon_destroy (NautilusIconContainer *container,
 	details->icons = g_list_remove (details->icons, icon);
 	details->new_icons = g_list_remove (details->new_icons, icon);
 	g_hash_table_remove (details->icon_set, icon->data);
+	icon_remove_uri (container, icon);
 
 	was_selected = icon->is_selected;
+	if (was_selected) {
+		g_queue_unlink (&details->selected_icons, &icon->selection_link);
+	}
+	if (icon->selection_change_pending) {
+		g_ptr_array_remove_fast (details->selection_changes, icon);
+	}
+
+	invalidate_visibility_index (container);
+	if (icon->is_visible) {
+		g_ptr_array_remove_fast (details->visible_icons, icon);
+	}
 
 	if (details->keyboard_focus == icon ||
 	    details->keyboard_focus == NULL) {
@@ -6746,17 +6869,108 @@ nautilus_icon_container_prioritize_thumbnailing (NautilusIconContainer *containe
 	klass->prioritize_thumbnailing (container, icon->data);
 }
 
+typedef struct {
+	NautilusIcon *icon;
+	double start;
+	double end;
+} VisibilityEntry;
+
+static void
+invalidate_visibility_index (NautilusIconContainer *container)
+{
+	if (container->details->visibility_index != NULL) {
+		g_array_free (container->details->visibility_index, TRUE);
+		container->details->visibility_index = NULL;
+	}
+}
+
+static int
+compare_visibility_entries (gconstpointer a, gconstpointer b)
+{
+	const VisibilityEntry *entry_a, *entry_b;
+
+	entry_a = a;
+	entry_b = b;
+
+	if (entry_a->start < entry_b->start) {
+		return -1;
+	}
+	if (entry_a->start > entry_b->start) {
+		return 1;
+	}
+	return 0;
+}
+
+static void
+make_visibility_index (NautilusIconContainer *container)
+{
+	NautilusIconContainerDetails *details;
+	VisibilityEntry entry;
+	double x0, y0, x1, y1;
+	gboolean vertical;
+	GList *node;
+	NautilusIcon *icon;
+
+	details = container->details;
+	vertical = nautilus_icon_container_is_layout_vertical (container);
+
+	details->visibility_index = g_array_new (FALSE, FALSE, sizeof (VisibilityEntry));
+	details->visibility_index_max_extent = 0;
+
+	for (node = details->icons; node != NULL; node = node->next) {
+		icon = node->data;
+
+		if (!icon_is_positioned (icon)) {
+			continue;
+		}
+
+		eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
+					    &x0,
+					    &y0,
+					    &x1,
+					    &y1);
+		eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+				     &x0,
+				     &y0);
+		eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+				     &x1,
+				     &y1);
+
+		entry.icon = icon;
+		if (vertical) {
+			entry.start = x0;
+			entry.end = x1;
+		} else {
+			entry.start = y0;
+			entry.end = y1;
+		}
+		details->visibility_index_max_extent =
+			MAX (details->visibility_index_max_extent, entry.end - entry.start);
+		g_array_append_val (details->visibility_index, entry);
+	}
+
+	g_array_sort (details->visibility_index, compare_visibility_entries);
+}
+
+/* The visible icons are found in the index of icon positions, and
+ * only the icons that come into view or go out of it are touched, so
+ * scrolling costs the same in small and large folders.
+ */
 static void
 nautilus_icon_container_update_visible_icons (NautilusIconContainer *container)
 {
+	NautilusIconContainerDetails *details;
 	GtkAdjustment *vadj, *hadj;
 	double min_y, max_y;
 	double min_x, max_x;
-	double x0, y0, x1, y1;
-	GList *node;
+	double min, max;
+	VisibilityEntry *entry;
+	GPtrArray *previously_visible;
 	NautilusIcon *icon;
-	gboolean visible;
 	GtkAllocation allocation;
+	guint low, high, middle, i;
+
+	details = container->details;
 
 	hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (container));
 	vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (container));
@@ -6772,41 +6986,73 @@ nautilus_icon_container_update_visible_icons (NautilusIconContainer *container)
 			min_x, min_y, &min_x, &min_y);
 	eel_canvas_c2w (EEL_CANVAS (container),
 			max_x, max_y, &max_x, &max_y);
-	
-	/* Do the iteration in reverse to get the render-order from top to
-	 * bottom for the prioritized thumbnails.
+
+	if (nautilus_icon_container_is_layout_vertical (container)) {
+		min = min_x;
+		max = max_x;
+	} else {
+		min = min_y;
+		max = max_y;
+	}
+
+	if (details->visibility_index == NULL) {
+		make_visibility_index (container);
+	}
+
+	/* The first icon that may reach into view: none of the icons
+	 * starting before it are long enough to get there.
 	 */
-	for (node = g_list_last (container->details->icons); node != NULL; node = node->prev) {
-		icon = node->data;
+	low = 0;
+	high = details->visibility_index->len;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		entry = &g_array_index (details->visibility_index, VisibilityEntry, middle);
+		if (entry->start < min - details->visibility_index_max_extent) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
 
-		if (icon_is_positioned (icon)) {
-			eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
-						    &x0,
-						    &y0,
-						    &x1,
-						    &y1);
-			eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-					     &x0,
-					     &y0);
-			eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-					     &x1,
-					     &y1);
+	/* Find where the view ends, to walk the icons in reverse and get
+	 * the render-order from top to bottom for the prioritized
+	 * thumbnails.
+	 */
+	for (high = low; high < details->visibility_index->len; high++) {
+		entry = &g_array_index (details->visibility_index, VisibilityEntry, high);
+		if (entry->start > max) {
+			break;
+		}
+	}
 
-			if (nautilus_icon_container_is_layout_vertical (container)) {
-				visible = x1 >= min_x && x0 <= max_x;
-			} else {
-				visible = y1 >= min_y && y0 <= max_y;
-			}
+	previously_visible = details->visible_icons;
+	for (i = 0; i < previously_visible->len; i++) {
+		icon = g_ptr_array_index (previously_visible, i);
+		icon->is_visible = FALSE;
+	}
 
-			if (visible) {
-				nautilus_icon_canvas_item_set_is_visible (icon->item, TRUE);
-				nautilus_icon_container_prioritize_thumbnailing (container,
-										 icon);
-			} else {
-				nautilus_icon_canvas_item_set_is_visible (icon->item, FALSE);
-			}
+	details->visible_icons = g_ptr_array_new ();
+	for (i = high; i > low; i--) {
+		entry = &g_array_index (details->visibility_index, VisibilityEntry, i - 1);
+		if (entry->end < min) {
+			continue;
+		}
+
+		icon = entry->icon;
+		icon->is_visible = TRUE;
+		g_ptr_array_add (details->visible_icons, icon);
+		nautilus_icon_canvas_item_set_is_visible (icon->item, TRUE);
+		nautilus_icon_container_prioritize_thumbnailing (container,
+								 icon);
+	}
+
+	for (i = 0; i < previously_visible->len; i++) {
+		icon = g_ptr_array_index (previously_visible, i);
+		if (!icon->is_visible) {
+			nautilus_icon_canvas_item_set_is_visible (icon->item, FALSE);
 		}
 	}
+	g_ptr_array_free (previously_visible, TRUE);
 }
 
 static void
@@ -7143,10 +7389,12 @@ nautilus_icon_container_add (NautilusIconContainer *container,
 	}
 	
 	/* Put it on both lists. */
+	icon->display_index = --details->next_display_index;
 	details->icons = g_list_prepend (details->icons, icon);
 	details->new_icons = g_list_prepend (details->new_icons, icon);
 
 	g_hash_table_insert (details->icon_set, data, icon);
+	icon_update_uri (container, icon);
 
 	details->needs_resort = TRUE;
 
@@ -7221,6 +7469,7 @@ nautilus_icon_container_request_update (NautilusIconContainer *container,
 	icon = g_hash_table_lookup (container->details->icon_set, data);
 
 	if (icon != NULL) {
+		icon_update_uri (container, icon);
 		nautilus_icon_container_update_icon (container, icon);
 		container->details->needs_resort = TRUE;
 		schedule_redo_layout (container);
@@ -7327,37 +7576,106 @@ nautilus_icon_container_get_selection (NautilusIconContainer *container)
 
 	g_return_val_if_fail (NAUTILUS_IS_ICON_CONTAINER (container), NULL);
 
-	list = NULL;
-	for (p = container->details->icons; p != NULL; p = p->next) {
+	list = nautilus_icon_container_get_selected_icons (container);
+	for (p = list; p != NULL; p = p->next) {
 		NautilusIcon *icon;
 
 		icon = p->data;
+		p->data = icon->data;
+	}
+
+	return list;
+}
+
+int
+nautilus_icon_container_get_selection_count (NautilusIconContainer *container)
+{
+	g_return_val_if_fail (NAUTILUS_IS_ICON_CONTAINER (container), 0);
+
+	return container->details->selected_icons.length;
+}
+
+/**
+ * nautilus_icon_container_get_selection_changes:
+ * @container: An icon container.
+ * @newly_selected: Return location for the data of the icons selected
+ * since the last call.
+ * @newly_unselected: Return location for the data of the icons
+ * unselected since the last call.
+ *
+ * Icons whose selection changed back and forth are left out, and so are
+ * icons that were removed. Free the lists with g_list_free.
+ **/
+void
+nautilus_icon_container_get_selection_changes (NautilusIconContainer *container,
+					       GList **newly_selected,
+					       GList **newly_unselected)
+{
+	GPtrArray *changes;
+	NautilusIcon *icon;
+	guint i;
+
+	g_return_if_fail (NAUTILUS_IS_ICON_CONTAINER (container));
+
+	*newly_selected = NULL;
+	*newly_unselected = NULL;
+
+	changes = container->details->selection_changes;
+	for (i = 0; i < changes->len; i++) {
+		icon = g_ptr_array_index (changes, i);
+		icon->selection_change_pending = FALSE;
+		if (icon->is_selected == icon->was_selected_before_change) {
+			continue;
+		}
 		if (icon->is_selected) {
-			list = g_list_prepend (list, icon->data);
+			*newly_selected = g_list_prepend (*newly_selected, icon->data);
+		} else {
+			*newly_unselected = g_list_prepend (*newly_unselected, icon->data);
 		}
 	}
+	g_ptr_array_set_size (changes, 0);
 
-	return g_list_reverse (list);
+	*newly_selected = g_list_reverse (*newly_selected);
+	*newly_unselected = g_list_reverse (*newly_unselected);
 }
 
+static int
+compare_display_index (gconstpointer a,
+		       gconstpointer b,
+		       gpointer user_data)
+{
+	const NautilusIcon *icon_a, *icon_b;
+
+	icon_a = a;
+	icon_b = b;
+
+	return icon_a->display_index < icon_b->display_index ? -1 :
+		icon_a->display_index > icon_b->display_index;
+}
+
+/* The queue is only sorted again when the order of the icons or the
+ * order they were selected in made it drift from display order.
+ */
 static GList *
 nautilus_icon_container_get_selected_icons (NautilusIconContainer *container)
 {
+	NautilusIconContainerDetails *details;
 	GList *list, *p;
 
 	g_return_val_if_fail (NAUTILUS_IS_ICON_CONTAINER (container), NULL);
 
-	list = NULL;
-	for (p = container->details->icons; p != NULL; p = p->next) {
-		NautilusIcon *icon;
+	details = container->details;
+	if (details->selected_icons_unsorted) {
+		g_queue_sort (&details->selected_icons, compare_display_index, NULL);
+		details->selected_icons_unsorted = FALSE;
+	}
 
-		icon = p->data;
-		if (icon->is_selected) {
-			list = g_list_prepend (list, icon);
-		}
+	list = NULL;
+	for (p = details->selected_icons.tail; p != NULL; p = p->prev) {
+		list = g_list_prepend (list, p->data);
 	}
 
-	return g_list_reverse (list);
+	return list;
 }
 
 /**
@@ -7577,34 +7895,7 @@ NautilusIcon *
 nautilus_icon_container_get_icon_by_uri (NautilusIconContainer *container,
 					 const char *uri)
 {
-	NautilusIconContainerDetails *details;
-	GList *p;
-
-	/* Eventually, we must avoid searching the entire icon list,
-	   but it's OK for now.
-	   A hash table mapping uri to icon is one possibility.
-	*/
-
-	details = container->details;
-
-	for (p = details->icons; p != NULL; p = p->next) {
-		NautilusIcon *icon;
-		char *icon_uri;
-		gboolean is_match;
-
-		icon = p->data;
-
-		icon_uri = nautilus_icon_container_get_icon_uri
-			(container, icon);
-		is_match = strcmp (uri, icon_uri) == 0;
-		g_free (icon_uri);
-
-		if (is_match) {
-			return icon;
-		}
-	}
-
-	return NULL;
+	return g_hash_table_lookup (container->details->icon_uris, uri);
 }
 
 static NautilusIcon *
@@ -294,6 +294,10 @@ void              nautilus_icon_container_select_all                    (Nautilu
 
 /* operations on the selection */
 GList     *       nautilus_icon_container_get_selection                 (NautilusIconContainer  *view);
+int               nautilus_icon_container_get_selection_count           (NautilusIconContainer  *view);
+void              nautilus_icon_container_get_selection_changes         (NautilusIconContainer  *view,
+									 GList                 **newly_selected,
+									 GList                 **newly_unselected);
 void			  nautilus_icon_container_invert_selection				(NautilusIconContainer  *view);
 void              nautilus_icon_container_set_selection                 (NautilusIconContainer  *view,
 									 GList                  *selection);
@@ -31,7 +31,6 @@ struct _NautilusIconInfo
 	GObject parent;
 
 	gboolean sole_owner;
-	gint64 last_use_time;
 	GdkPixbuf *pixbuf;
 	
 	gboolean got_embedded_rect;
@@ -40,6 +39,15 @@ struct _NautilusIconInfo
 	GdkPoint *attach_points;
 	char *display_name;
         char *icon_name;
+
+	/* Where the icon is cached. An icon can be found under its
+	 * GIcon or file name, and any number of lists of icon names.
+	 */
+	GHashTable *cache_table;
+	gpointer cache_key;
+	GSList *named_keys;
+	GList lru_link;
+	gsize cache_size;
 };
 
 struct _NautilusIconInfoClass
@@ -47,8 +55,6 @@ struct _NautilusIconInfoClass
 	GObjectClass parent_class;
 };
 
-static void schedule_reap_cache (void);
-
 G_DEFINE_TYPE (NautilusIconInfo,
 	       nautilus_icon_info,
 	       G_TYPE_OBJECT);
@@ -56,8 +62,8 @@ G_DEFINE_TYPE (NautilusIconInfo,
 static void
 nautilus_icon_info_init (NautilusIconInfo *icon)
 {
-	icon->last_use_time = g_get_monotonic_time ();
 	icon->sole_owner = TRUE;
+	icon->lru_link.data = icon;
 }
 
 gboolean
@@ -78,8 +84,6 @@ pixbuf_toggle_notify (gpointer      info,
 		g_object_remove_toggle_ref (object,
 					    pixbuf_toggle_notify,
 					    info);
-		icon->last_use_time = g_get_monotonic_time ();
-		schedule_reap_cache ();
 	}
 }
 
@@ -168,6 +172,20 @@ nautilus_icon_info_new_for_icon_info (GtkIconInfo *icon_info)
 }
 
 
+/* Icons are cached in two tiers. Themed icons are first looked up by
+ * their list of names, which avoids asking the icon theme again; on a
+ * miss, the theme picks a file, and the icon is looked up by file name
+ * and size, so that different lists of names that end up at the same
+ * file share one icon. Loadable icons are looked up by GIcon.
+ *
+ * All cached icons are kept in a list in the order they were last used,
+ * and the least recently used ones are dropped when their pixbufs take
+ * more than ICON_CACHE_MAX_BYTES. Icons whose pixbufs are still in use
+ * elsewhere are kept, since dropping them would not free anything.
+ */
+
+#define ICON_CACHE_MAX_BYTES (8 * 1024 * 1024)
+
 typedef struct  {
 	GIcon *icon;
 	int size;
@@ -178,83 +196,127 @@ typedef struct {
 	int size;
 } ThemedIconKey;
 
+typedef struct {
+	char **names;
+	int size;
+	guint hash;
+} NamedIconKey;
+
 static GHashTable *loadable_icon_cache = NULL;
 static GHashTable *themed_icon_cache = NULL;
-static guint reap_cache_timeout = 0;
+static GHashTable *named_icon_cache = NULL;
 
-#define MICROSEC_PER_SEC ((guint64)1000000L)
+static GQueue icon_lru = G_QUEUE_INIT;
+static gsize icon_cache_bytes;
 
-static guint time_now;
+static guint icon_cache_hits;
+static guint icon_cache_misses;
+static guint icon_cache_evictions;
 
-static gboolean
-reap_old_icon (gpointer  key,
-	       gpointer  value,
-	       gpointer  user_info)
+static void
+icon_cache_touch (NautilusIconInfo *icon)
 {
-	NautilusIconInfo *icon = value;
-	gboolean *reapable_icons_left = user_info;
-
-	if (icon->sole_owner) {
-		if (time_now - icon->last_use_time > 30 * MICROSEC_PER_SEC) {
-			/* This went unused 30 secs ago. reap */
-			return TRUE;
-		} else {
-			/* We can reap this soon */
-			*reapable_icons_left = TRUE;
-		}
-	}
-	
-	return FALSE;
+	g_queue_unlink (&icon_lru, &icon->lru_link);
+	g_queue_push_head_link (&icon_lru, &icon->lru_link);
 }
 
-static gboolean
-reap_cache (gpointer data)
+/* Drops the icon from all the tables it is in. */
+static void
+icon_cache_evict (NautilusIconInfo *icon)
 {
-	gboolean reapable_icons_left;
+	GSList *l;
 
-	reapable_icons_left = TRUE;
+	g_object_ref (icon);
 
-	time_now = g_get_monotonic_time ();
-	
-	if (loadable_icon_cache) {
-		g_hash_table_foreach_remove (loadable_icon_cache,
-					     reap_old_icon,
-					     &reapable_icons_left);
-	}
-	
-	if (themed_icon_cache) {
-		g_hash_table_foreach_remove (themed_icon_cache,
-					     reap_old_icon,
-					     &reapable_icons_left);
+	for (l = icon->named_keys; l != NULL; l = l->next) {
+		g_hash_table_remove (named_icon_cache, l->data);
 	}
-	
-	if (reapable_icons_left) {
-		return TRUE;
-	} else {
-		reap_cache_timeout = 0;
-		return FALSE;
+	g_slist_free (icon->named_keys);
+	icon->named_keys = NULL;
+
+	if (icon->cache_table != NULL) {
+		g_hash_table_remove (icon->cache_table, icon->cache_key);
+		icon->cache_table = NULL;
+		icon->cache_key = NULL;
 	}
+
+	g_queue_unlink (&icon_lru, &icon->lru_link);
+	icon_cache_bytes -= icon->cache_size;
+	icon_cache_evictions++;
+
+	g_object_unref (icon);
 }
 
 static void
-schedule_reap_cache (void)
+icon_cache_trim (void)
 {
-	if (reap_cache_timeout == 0) {
-		reap_cache_timeout = g_timeout_add_seconds_full (0, 5,
-								 reap_cache,
-								 NULL, NULL);
+	GList *l, *prev;
+	NautilusIconInfo *icon;
+
+	/* The most recently used icon is always kept, it was just added
+	 * or is about to be returned.
+	 */
+	for (l = icon_lru.tail;
+	     l != NULL && l != icon_lru.head && icon_cache_bytes > ICON_CACHE_MAX_BYTES;
+	     l = prev) {
+		prev = l->prev;
+		icon = l->data;
+		if (icon->sole_owner) {
+			icon_cache_evict (icon);
+		}
+	}
+}
+
+/* Adds a new icon to the list of cached icons, and to table under key
+ * unless table is NULL. The table takes over the reference.
+ */
+static void
+icon_cache_add (NautilusIconInfo *icon,
+		GHashTable *table,
+		gpointer key)
+{
+	if (table != NULL) {
+		g_hash_table_insert (table, key, icon);
+		icon->cache_table = table;
+		icon->cache_key = key;
+	}
+
+	icon->cache_size = sizeof (NautilusIconInfo);
+	if (icon->pixbuf != NULL) {
+		icon->cache_size += gdk_pixbuf_get_rowstride (icon->pixbuf) *
+			gdk_pixbuf_get_height (icon->pixbuf);
 	}
+	icon_cache_bytes += icon->cache_size;
+	g_queue_push_head_link (&icon_lru, &icon->lru_link);
+
+	icon_cache_trim ();
 }
 
 void
 nautilus_icon_info_clear_caches (void)
 {
-	if (loadable_icon_cache) {
-		g_hash_table_remove_all (loadable_icon_cache);
+	while (icon_lru.tail != NULL) {
+		icon_cache_evict (icon_lru.tail->data);
 	}
-	
-	if (themed_icon_cache) {
-		g_hash_table_remove_all (themed_icon_cache);
+}
+
+void
+nautilus_icon_info_get_cache_statistics (guint *hits,
+					 guint *misses,
+					 guint *evictions,
+					 gsize *bytes)
+{
+	if (hits != NULL) {
+		*hits = icon_cache_hits;
+	}
+	if (misses != NULL) {
+		*misses = icon_cache_misses;
+	}
+	if (evictions != NULL) {
+		*evictions = icon_cache_evictions;
+	}
+	if (bytes != NULL) {
+		*bytes = icon_cache_bytes;
 	}
 }
 
@@ -324,6 +386,138 @@ themed_icon_key_free (ThemedIconKey *key)
 	g_slice_free (ThemedIconKey, key);
 }
 
+static void
+named_icon_key_init (NamedIconKey *key, const char * const *names, int size)
+{
+	guint i;
+
+	key->names = (char **) names;
+	key->size = size;
+	key->hash = size;
+	for (i = 0; names[i] != NULL; i++) {
+		key->hash = key->hash * 31 + g_str_hash (names[i]);
+	}
+}
+
+static guint
+named_icon_key_hash (NamedIconKey *key)
+{
+	return key->hash;
+}
+
+static gboolean
+named_icon_key_equal (const NamedIconKey *a,
+		      const NamedIconKey *b)
+{
+	guint i;
+
+	if (a->hash != b->hash || a->size != b->size) {
+		return FALSE;
+	}
+
+	for (i = 0; a->names[i] != NULL && b->names[i] != NULL; i++) {
+		if (strcmp (a->names[i], b->names[i]) != 0) {
+			return FALSE;
+		}
+	}
+
+	return a->names[i] == b->names[i];
+}
+
+static void
+named_icon_key_free (NamedIconKey *key)
+{
+	g_strfreev (key->names);
+	g_slice_free (NamedIconKey, key);
+}
+
+/* Makes icon the result for the lookup key. */
+static void
+add_named_icon (const NamedIconKey *lookup_key,
+		NautilusIconInfo *icon)
+{
+	NamedIconKey *key;
+
+	key = g_slice_new (NamedIconKey);
+	key->names = g_strdupv (lookup_key->names);
+	key->size = lookup_key->size;
+	key->hash = lookup_key->hash;
+
+	g_hash_table_insert (named_icon_cache, key, g_object_ref (icon));
+	icon->named_keys = g_slist_prepend (icon->named_keys, key);
+}
+
+static NautilusIconInfo *
+lookup_themed_icon (const char * const *names,
+		    int size)
+{
+	NamedIconKey named_key;
+	ThemedIconKey lookup_key;
+	GtkIconTheme *icon_theme;
+	GtkIconInfo *gtkicon_info;
+	NautilusIconInfo *icon_info;
+	const char *filename;
+
+	if (named_icon_cache == NULL) {
+		named_icon_cache =
+			g_hash_table_new_full ((GHashFunc)named_icon_key_hash,
+					       (GEqualFunc)named_icon_key_equal,
+					       (GDestroyNotify) named_icon_key_free,
+					       (GDestroyNotify) g_object_unref);
+	}
+	if (themed_icon_cache == NULL) {
+		themed_icon_cache =
+			g_hash_table_new_full ((GHashFunc)themed_icon_key_hash,
+					       (GEqualFunc)themed_icon_key_equal,
+					       (GDestroyNotify) themed_icon_key_free,
+					       (GDestroyNotify) g_object_unref);
+	}
+
+	named_icon_key_init (&named_key, names, size);
+	icon_info = g_hash_table_lookup (named_icon_cache, &named_key);
+	if (icon_info != NULL) {
+		icon_cache_hits++;
+		icon_cache_touch (icon_info);
+		return g_object_ref (icon_info);
+	}
+	icon_cache_misses++;
+
+	icon_theme = gtk_icon_theme_get_default ();
+	gtkicon_info = gtk_icon_theme_choose_icon (icon_theme, (const char **)names, size, 0);
+
+	filename = NULL;
+	if (gtkicon_info != NULL) {
+		filename = gtk_icon_info_get_filename (gtkicon_info);
+	}
+
+	if (filename == NULL) {
+		/* Remember that there is no such icon too. */
+		icon_info = nautilus_icon_info_new_for_pixbuf (NULL);
+		icon_cache_add (icon_info, NULL, NULL);
+	} else {
+		lookup_key.filename = (char *)filename;
+		lookup_key.size = size;
+
+		icon_info = g_hash_table_lookup (themed_icon_cache, &lookup_key);
+		if (icon_info != NULL) {
+			g_object_ref (icon_info);
+			icon_cache_touch (icon_info);
+		} else {
+			icon_info = nautilus_icon_info_new_for_icon_info (gtkicon_info);
+			icon_cache_add (g_object_ref (icon_info), themed_icon_cache,
+					themed_icon_key_new (filename, size));
+		}
+	}
+
+	if (gtkicon_info != NULL) {
+		gtk_icon_info_free (gtkicon_info);
+	}
+
+	add_named_icon (&named_key, icon_info);
+
+	return icon_info;
+}
+
 NautilusIconInfo *
 nautilus_icon_info_lookup (GIcon *icon,
 			   int size)
@@ -349,8 +543,11 @@ nautilus_icon_info_lookup (GIcon *icon,
 
 		icon_info = g_hash_table_lookup (loadable_icon_cache, &lookup_key);
 		if (icon_info) {
+			icon_cache_hits++;
+			icon_cache_touch (icon_info);
 			return g_object_ref (icon_info);
 		}
+		icon_cache_misses++;
 
 		pixbuf = NULL;
 		stream = g_loadable_icon_load (G_LOADABLE_ICON (icon),
@@ -367,57 +564,12 @@ nautilus_icon_info_lookup (GIcon *icon,
 		icon_info = nautilus_icon_info_new_for_pixbuf (pixbuf);
 
 		key = loadable_icon_key_new (icon, size);
-		g_hash_table_insert (loadable_icon_cache, key, icon_info);
+		icon_cache_add (g_object_ref (icon_info), loadable_icon_cache, key);
 
-		return g_object_ref (icon_info);
+		return icon_info;
 	} else if (G_IS_THEMED_ICON (icon)) {
-		const char * const *names;
-		ThemedIconKey lookup_key;
-		ThemedIconKey *key;
-		GtkIconTheme *icon_theme;
-		GtkIconInfo *gtkicon_info;
-		const char *filename;
-
-		if (themed_icon_cache == NULL) {
-			themed_icon_cache =
-				g_hash_table_new_full ((GHashFunc)themed_icon_key_hash,
-						       (GEqualFunc)themed_icon_key_equal,
-						       (GDestroyNotify) themed_icon_key_free,
-						       (GDestroyNotify) g_object_unref);
-		}
-		
-		names = g_themed_icon_get_names (G_THEMED_ICON (icon));
-
-		icon_theme = gtk_icon_theme_get_default ();
-		gtkicon_info = gtk_icon_theme_choose_icon (icon_theme, (const char **)names, size, 0);
-
-		if (gtkicon_info == NULL) {
-			return nautilus_icon_info_new_for_pixbuf (NULL);
-		}
-
-		filename = gtk_icon_info_get_filename (gtkicon_info);
-		if (filename == NULL) {
-			gtk_icon_info_free (gtkicon_info);
-			return nautilus_icon_info_new_for_pixbuf (NULL);
-		}
-
-		lookup_key.filename = (char *)filename;
-		lookup_key.size = size;
-
-		icon_info = g_hash_table_lookup (themed_icon_cache, &lookup_key);
-		if (icon_info) {
-			gtk_icon_info_free (gtkicon_info);
-			return g_object_ref (icon_info);
-		}
-		
-		icon_info = nautilus_icon_info_new_for_icon_info (gtkicon_info);
-		
-		key = themed_icon_key_new (filename, size);
-		g_hash_table_insert (themed_icon_cache, key, icon_info);
-
-		gtk_icon_info_free (gtkicon_info);
-
-		return g_object_ref (icon_info);
+		return lookup_themed_icon (g_themed_icon_get_names (G_THEMED_ICON (icon)),
+					   size);
 	} else {
                 GdkPixbuf *pixbuf;
                 GtkIconInfo *gtk_icon_info;
@@ -447,13 +599,11 @@ NautilusIconInfo *
 nautilus_icon_info_lookup_from_name (const char *name,
 				     int size)
 {
-	GIcon *icon;
-	NautilusIconInfo *info;
+	const char *names[2];
 
-	icon = g_themed_icon_new (name);
-	info = nautilus_icon_info_lookup (icon, size);
-	g_object_unref (icon);
-	return info;
+	names[0] = name;
+	names[1] = NULL;
+	return lookup_themed_icon (names, size);
 }
 
 NautilusIconInfo *
@@ -76,6 +76,10 @@ const char *          nautilus_icon_info_get_display_name             (NautilusI
 const char *          nautilus_icon_info_get_used_name                (NautilusIconInfo  *icon);
 
 void                  nautilus_icon_info_clear_caches                 (void);
+void                  nautilus_icon_info_get_cache_statistics         (guint              *hits,
+								       guint              *misses,
+								       guint              *evictions,
+								       gsize              *bytes);
 
 /* Relationship between zoom levels and icons sizes. */
 guint nautilus_get_icon_size_for_zoom_level          (NautilusZoomLevel  zoom_level);
@@ -39,6 +39,17 @@ typedef struct {
 	/* Canvas item for the icon. */
 	NautilusIconCanvasItem *item;
 
+	/* URI the icon is found under in icon_uris. */
+	char *uri;
+
+	/* Link in selected_icons while the icon is selected. */
+	GList selection_link;
+
+	/* Where the icon is in icons, the smaller the earlier. New icons
+	 * are put in front, so they are given ever smaller ones.
+	 */
+	int display_index;
+
 	/* X/Y coordinates. */
 	double x, y;
 
@@ -66,6 +77,12 @@ typedef struct {
 	eel_boolean_bit is_monitored : 1;
 
 	eel_boolean_bit has_lazy_position : 1;
+
+	/* Whether the icon is in selection_changes, and whether it was
+	 * selected when it was put there.
+	 */
+	eel_boolean_bit selection_change_pending : 1;
+	eel_boolean_bit was_selected_before_change : 1;
 } NautilusIcon;
 
 
@@ -123,6 +140,28 @@ struct NautilusIconContainerDetails {
 	GList *icons;
 	GList *new_icons;
 	GHashTable *icon_set;
+	GHashTable *icon_uris; /* map from URIs to icons */
+	/* Icons with a URI another icon is found under. */
+	guint n_duplicate_uris;
+
+	/* Selected icons, in display order once sorted. */
+	GQueue selected_icons;
+	gboolean selected_icons_unsorted;
+	int next_display_index;
+
+	/* Icons whose selection changed since
+	 * nautilus_icon_container_get_selection_changes was last called.
+	 */
+	GPtrArray *selection_changes;
+
+	/* Positioned icons sorted by where they start along the
+	 * scrolling axis, VisibilityEntry, or NULL when positions
+	 * have changed since it was made.
+	 */
+	GArray *visibility_index;
+	double visibility_index_max_extent;
+	/* Icons marked visible, NautilusIcon. */
+	GPtrArray *visible_icons;
 
 	/* Current icon for keyboard navigation. */
 	NautilusIcon *keyboard_focus;
@@ -0,0 +1,205 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-inode-set.c: set of (device, inode) pairs
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* An open addressing hash table with linear probing, storing the
+ * pairs inline. Slots with inode 0 are free. It is kept at most half
+ * full, so probe sequences stay short.
+ */
+
+#include <config.h>
+#include "nautilus-inode-set.h"
+
+#include "nautilus-lib-self-check-functions.h"
+
+#define INITIAL_CAPACITY 64
+
+typedef struct {
+	guint64 device;
+	guint64 inode;
+} InodeSlot;
+
+struct NautilusInodeSet {
+	InodeSlot *slots;
+	guint capacity; /* a power of 2 */
+	guint size;
+};
+
+NautilusInodeSet *
+nautilus_inode_set_new (void)
+{
+	NautilusInodeSet *set;
+
+	set = g_new0 (NautilusInodeSet, 1);
+	set->capacity = INITIAL_CAPACITY;
+	set->slots = g_new0 (InodeSlot, set->capacity);
+
+	return set;
+}
+
+void
+nautilus_inode_set_free (NautilusInodeSet *set)
+{
+	if (set == NULL) {
+		return;
+	}
+
+	g_free (set->slots);
+	g_free (set);
+}
+
+static inline guint
+hash_pair (guint64 device, guint64 inode)
+{
+	guint64 h;
+
+	/* Inodes are often sequential, so mix all the bits in. */
+	h = inode ^ (device * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15));
+	h ^= h >> 33;
+	h *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+	h ^= h >> 33;
+
+	return (guint) h;
+}
+
+static InodeSlot *
+find_slot (InodeSlot *slots, guint capacity, guint64 device, guint64 inode)
+{
+	InodeSlot *slot;
+	guint i;
+
+	for (i = hash_pair (device, inode) & (capacity - 1); ; i = (i + 1) & (capacity - 1)) {
+		slot = &slots[i];
+		if (slot->inode == 0 ||
+		    (slot->inode == inode && slot->device == device)) {
+			return slot;
+		}
+	}
+}
+
+static void
+grow (NautilusInodeSet *set)
+{
+	InodeSlot *old_slots, *slot;
+	guint old_capacity, i;
+
+	old_slots = set->slots;
+	old_capacity = set->capacity;
+
+	set->capacity *= 2;
+	set->slots = g_new0 (InodeSlot, set->capacity);
+
+	for (i = 0; i < old_capacity; i++) {
+		if (old_slots[i].inode != 0) {
+			slot = find_slot (set->slots, set->capacity,
+					  old_slots[i].device, old_slots[i].inode);
+			*slot = old_slots[i];
+		}
+	}
+
+	g_free (old_slots);
+}
+
+gboolean
+nautilus_inode_set_add (NautilusInodeSet *set,
+			guint64 device,
+			guint64 inode)
+{
+	InodeSlot *slot;
+
+	if (inode == 0) {
+		return TRUE;
+	}
+
+	slot = find_slot (set->slots, set->capacity, device, inode);
+	if (slot->inode != 0) {
+		return FALSE;
+	}
+
+	slot->device = device;
+	slot->inode = inode;
+	set->size++;
+
+	if (set->size > set->capacity / 2) {
+		grow (set);
+	}
+
+	return TRUE;
+}
+
+gboolean
+nautilus_inode_set_contains (NautilusInodeSet *set,
+			     guint64 device,
+			     guint64 inode)
+{
+	if (inode == 0) {
+		return FALSE;
+	}
+
+	return find_slot (set->slots, set->capacity, device, inode)->inode != 0;
+}
+
+guint
+nautilus_inode_set_size (NautilusInodeSet *set)
+{
+	return set->size;
+}
+
+#if !defined (NAUTILUS_OMIT_SELF_CHECK)
+
+void
+nautilus_self_check_inode_set (void)
+{
+	NautilusInodeSet *set;
+	guint64 i;
+	gboolean all_added, none_added, all_found;
+
+	set = nautilus_inode_set_new ();
+
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_inode_set_add (set, 1, 42), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_inode_set_add (set, 1, 42), FALSE);
+	/* Same inode on another file system */
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_inode_set_add (set, 2, 42), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_inode_set_contains (set, 3, 42), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_inode_set_add (set, 1, 0), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_inode_set_contains (set, 1, 0), FALSE);
+	EEL_CHECK_INTEGER_RESULT (nautilus_inode_set_size (set), 2);
+
+	/* Enough to grow a few times */
+	all_added = TRUE;
+	for (i = 1; i <= 10000; i++) {
+		all_added &= nautilus_inode_set_add (set, 7, i);
+	}
+	none_added = TRUE;
+	all_found = TRUE;
+	for (i = 1; i <= 10000; i++) {
+		none_added &= !nautilus_inode_set_add (set, 7, i);
+		all_found &= nautilus_inode_set_contains (set, 7, i);
+	}
+	EEL_CHECK_BOOLEAN_RESULT (all_added, TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (none_added, TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (all_found, TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_inode_set_contains (set, 7, 10001), FALSE);
+	EEL_CHECK_INTEGER_RESULT (nautilus_inode_set_size (set), 10002);
+
+	nautilus_inode_set_free (set);
+}
+
+#endif /* !NAUTILUS_OMIT_SELF_CHECK */
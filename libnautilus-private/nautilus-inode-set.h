@@ -0,0 +1,43 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-inode-set.h: set of (device, inode) pairs
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef NAUTILUS_INODE_SET_H
+#define NAUTILUS_INODE_SET_H
+
+#include <glib.h>
+
+typedef struct NautilusInodeSet NautilusInodeSet;
+
+NautilusInodeSet *nautilus_inode_set_new      (void);
+void              nautilus_inode_set_free     (NautilusInodeSet *set);
+
+/* Returns FALSE if the pair was in the set already. Inode 0 is not
+ * a valid inode, and is never added.
+ */
+gboolean          nautilus_inode_set_add      (NautilusInodeSet *set,
+					       guint64           device,
+					       guint64           inode);
+gboolean          nautilus_inode_set_contains (NautilusInodeSet *set,
+					       guint64           device,
+					       guint64           inode);
+guint             nautilus_inode_set_size     (NautilusInodeSet *set);
+
+#endif /* NAUTILUS_INODE_SET_H */
@@ -44,6 +44,9 @@ void nautilus_run_lib_self_checks (void);
 	macro (nautilus_self_check_directory) \
 	macro (nautilus_self_check_file) \
 	macro (nautilus_self_check_icon_container) \
+	macro (nautilus_self_check_inode_set) \
+	macro (nautilus_self_check_search_matcher) \
+	macro (nautilus_self_check_selection_set) \
 /* Add new self-check functions to the list above this line. */
 
 /* Generate prototypes for all the functions. */
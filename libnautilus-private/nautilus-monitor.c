@@ -26,13 +26,51 @@
 
 #include <config.h>
 #include "nautilus-monitor.h"
+#include "nautilus-directory-private.h"
+#include "nautilus-file-attributes.h"
 #include "nautilus-file-changes-queue.h"
 #include "nautilus-file-utilities.h"
+#include "nautilus-search-index.h"
+
+#define DEBUG_FLAG NAUTILUS_DEBUG_FILE
+#include "nautilus-debug.h"
 
 #include <gio/gio.h>
 
+/* Queued changes are consumed at most this often, in ms. The first
+ * event after a quiet period is still dispatched right away.
+ */
+#define MONITOR_DISPATCH_INTERVAL 100
+
+/* Event rates are measured over windows of this length, in ms. */
+#define MONITOR_RATE_WINDOW 1000
+
+/* A directory that gets more events than this in one window is in
+ * overflow: its events are dropped, and it is rescanned once they
+ * stay below MONITOR_OVERFLOW_EVENTS for MONITOR_OVERFLOW_QUIET ms,
+ * or every MONITOR_OVERFLOW_RESCAN_INTERVAL ms while they don't. The
+ * search index doesn't hear about the dropped events either, it is
+ * told to read the directory again instead.
+ */
+#define MONITOR_OVERFLOW_EVENTS 500
+#define MONITOR_OVERFLOW_QUIET 500
+#define MONITOR_OVERFLOW_RESCAN_INTERVAL 3000
+#define MONITOR_OVERFLOW_CHECK_INTERVAL 100
+
 struct NautilusMonitor {
 	GFileMonitor *monitor;
+	GFile *location;
+
+	/* Times are in microseconds of monotonic time. */
+	gint64 window_start;
+	guint window_events;
+	double event_rate;
+	guint64 n_events;
+
+	gboolean overflowing;
+	guint n_overflows;
+	gint64 last_rescan;
+	guint overflow_timeout_id;
 };
 
 gboolean
@@ -59,16 +97,97 @@ nautilus_monitor_active (void)
 	return monitor_success;
 }
 
-static gboolean call_consume_changes_idle_id = 0;
+static guint consume_changes_id = 0;
+static gint64 last_consume_time;
 
 static gboolean
-call_consume_changes_idle_cb (gpointer not_used)
+consume_changes_cb (gpointer not_used)
 {
+	consume_changes_id = 0;
+	last_consume_time = g_get_monotonic_time ();
 	nautilus_file_changes_consume_changes (TRUE);
-	call_consume_changes_idle_id = 0;
 	return FALSE;
 }
 
+static void
+schedule_consume_changes (void)
+{
+	gint64 elapsed;
+
+	if (consume_changes_id != 0) {
+		return;
+	}
+
+	elapsed = (g_get_monotonic_time () - last_consume_time) / 1000;
+	if (elapsed >= MONITOR_DISPATCH_INTERVAL) {
+		consume_changes_id = g_idle_add (consume_changes_cb, NULL);
+	} else {
+		consume_changes_id = g_timeout_add (MONITOR_DISPATCH_INTERVAL - elapsed,
+						    consume_changes_cb, NULL);
+	}
+}
+
+static void
+update_event_rate (NautilusMonitor *monitor, gint64 now)
+{
+	gint64 elapsed;
+
+	elapsed = now - monitor->window_start;
+	if (elapsed >= MONITOR_RATE_WINDOW * 1000) {
+		monitor->event_rate = monitor->window_events * (double) G_USEC_PER_SEC / elapsed;
+		monitor->window_start = now;
+		monitor->window_events = 0;
+	}
+}
+
+static void
+rescan (NautilusMonitor *monitor)
+{
+	NautilusDirectory *directory;
+
+	monitor->last_rescan = g_get_monotonic_time ();
+
+	nautilus_search_index_notify_directory_changed (monitor->location);
+
+	directory = nautilus_directory_get_existing (monitor->location);
+	if (directory != NULL) {
+		nautilus_directory_force_reload_internal (directory,
+							  NAUTILUS_FILE_ATTRIBUTE_INFO |
+							  NAUTILUS_FILE_ATTRIBUTE_LINK_INFO);
+		nautilus_directory_unref (directory);
+	}
+}
+
+static gboolean
+overflow_timeout_cb (gpointer user_data)
+{
+	NautilusMonitor *monitor;
+	gint64 now;
+
+	monitor = user_data;
+	now = g_get_monotonic_time ();
+	update_event_rate (monitor, now);
+
+	/* The flood is over once the current window has gone on for a
+	 * while at a rate below the limit.
+	 */
+	if (monitor->window_events * MONITOR_RATE_WINDOW <
+	    MONITOR_OVERFLOW_EVENTS * (now - monitor->window_start) / 1000 &&
+	    now - monitor->window_start >= MONITOR_OVERFLOW_QUIET * 1000) {
+		DEBUG ("Monitor overflow over, rescanning");
+		monitor->overflowing = FALSE;
+		monitor->overflow_timeout_id = 0;
+		rescan (monitor);
+		return FALSE;
+	}
+
+	if (now - monitor->last_rescan >= MONITOR_OVERFLOW_RESCAN_INTERVAL * 1000) {
+		rescan (monitor);
+	}
+
+	return TRUE;
+}
+
 static void
 dir_changed (GFileMonitor* monitor,
 	     GFile *child,
@@ -76,19 +195,38 @@ dir_changed (GFileMonitor* monitor,
 	     GFileMonitorEvent event_type,
 	     gpointer user_data)
 {
-	char *uri, *to_uri;
-	
-	uri = g_file_get_uri (child);
-	to_uri = NULL;
-	if (other_file) {
-		to_uri = g_file_get_uri (other_file);
+	NautilusMonitor *nautilus_monitor;
+	gint64 now;
+
+	nautilus_monitor = user_data;
+
+	now = g_get_monotonic_time ();
+	update_event_rate (nautilus_monitor, now);
+	nautilus_monitor->window_events++;
+	nautilus_monitor->n_events++;
+
+	if (!nautilus_monitor->overflowing &&
+	    nautilus_monitor->window_events > MONITOR_OVERFLOW_EVENTS) {
+		DEBUG ("Monitor overflow, more than %d events in %d ms",
+		       MONITOR_OVERFLOW_EVENTS, MONITOR_RATE_WINDOW);
+		nautilus_monitor->overflowing = TRUE;
+		nautilus_monitor->n_overflows++;
+		nautilus_monitor->last_rescan = now;
+		nautilus_monitor->overflow_timeout_id =
+			g_timeout_add (MONITOR_OVERFLOW_CHECK_INTERVAL,
+				       overflow_timeout_cb, nautilus_monitor);
+	}
+
+	if (nautilus_monitor->overflowing) {
+		/* The rescan will pick this up. */
+		return;
 	}
 
 	switch (event_type) {
 	default:
 	case G_FILE_MONITOR_EVENT_CHANGED:
 		/* ignore */
-		break;
+		return;
 	case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
 	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
 		nautilus_file_changes_queue_file_changed (child);
@@ -102,19 +240,13 @@ dir_changed (GFileMonitor* monitor,
 		
 	case G_FILE_MONITOR_EVENT_PRE_UNMOUNT:
 		/* TODO: Do something */
-		break;
+		return;
 	case G_FILE_MONITOR_EVENT_UNMOUNTED:
 		/* TODO: Do something */
-		break;
+		return;
 	}
 
-	g_free (uri);
-	g_free (to_uri);
-
-	if (call_consume_changes_idle_id == 0) {
-		call_consume_changes_idle_id = 
-			g_idle_add (call_consume_changes_idle_cb, NULL);
-	}
+	schedule_consume_changes ();
 }
  
 NautilusMonitor *
@@ -127,6 +259,8 @@ nautilus_monitor_directory (GFile *location)
 
 	ret = g_new0 (NautilusMonitor, 1);
 	ret->monitor = dir_monitor;
+	ret->location = g_object_ref (location);
+	ret->window_start = g_get_monotonic_time ();
 
 	if (ret->monitor) {
 		g_signal_connect (ret->monitor, "changed", (GCallback)dir_changed, ret);
@@ -136,6 +270,25 @@ nautilus_monitor_directory (GFile *location)
 	return ret;
 }
 
+void
+nautilus_monitor_get_statistics (NautilusMonitor *monitor,
+				 double *event_rate,
+				 guint64 *n_events,
+				 guint *n_overflows)
+{
+	update_event_rate (monitor, g_get_monotonic_time ());
+
+	if (event_rate != NULL) {
+		*event_rate = monitor->event_rate;
+	}
+	if (n_events != NULL) {
+		*n_events = monitor->n_events;
+	}
+	if (n_overflows != NULL) {
+		*n_overflows = monitor->n_overflows;
+	}
+}
+
 void 
 nautilus_monitor_cancel (NautilusMonitor *monitor)
 {
@@ -145,5 +298,9 @@ nautilus_monitor_cancel (NautilusMonitor *monitor)
 		g_object_unref (monitor->monitor);
 	}
 
+	if (monitor->overflow_timeout_id != 0) {
+		g_source_remove (monitor->overflow_timeout_id);
+	}
+	g_object_unref (monitor->location);
 	g_free (monitor);
 }
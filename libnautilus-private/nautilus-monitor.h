@@ -35,4 +35,13 @@ gboolean         nautilus_monitor_active    (void);
 NautilusMonitor *nautilus_monitor_directory (GFile *location);
 void             nautilus_monitor_cancel    (NautilusMonitor *monitor);
 
+/* Events per second over the last second or so, all events since the
+ * monitor was set up, and the times it had so many events that it
+ * rescanned the directory instead of passing them on.
+ */
+void             nautilus_monitor_get_statistics (NautilusMonitor *monitor,
+						  double          *event_rate,
+						  guint64         *n_events,
+						  guint           *n_overflows);
+
 #endif /* NAUTILUS_MONITOR_H */
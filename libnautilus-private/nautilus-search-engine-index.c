@@ -0,0 +1,270 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-search-engine-index.c: search engine using the file name index
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <config.h>
+#include "nautilus-search-engine-index.h"
+
+#include "nautilus-search-engine-simple.h"
+#include "nautilus-search-index.h"
+
+/* Queries the index can't answer, because they are about content
+ * types or places outside of it, or because it isn't built yet, are
+ * handed over to the simple engine.
+ */
+
+struct NautilusSearchEngineIndexDetails {
+	NautilusQuery *query;
+
+	NautilusSearchEngine *fallback;
+	gboolean fallback_active;
+
+	/* The query running in the index, if any. */
+	GCancellable *cancellable;
+};
+
+G_DEFINE_TYPE (NautilusSearchEngineIndex, nautilus_search_engine_index,
+	       NAUTILUS_TYPE_SEARCH_ENGINE);
+
+static void
+finalize (GObject *object)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (object);
+
+	if (engine->details->cancellable != NULL) {
+		g_cancellable_cancel (engine->details->cancellable);
+		g_clear_object (&engine->details->cancellable);
+	}
+
+	g_clear_object (&engine->details->query);
+	g_clear_object (&engine->details->fallback);
+
+	G_OBJECT_CLASS (nautilus_search_engine_index_parent_class)->finalize (object);
+}
+
+static GFile *
+get_query_location (NautilusQuery *query)
+{
+	GFile *location;
+	char *uri;
+
+	uri = nautilus_query_get_location (query);
+	if (uri == NULL) {
+		return g_file_new_for_path ("/");
+	}
+
+	location = g_file_new_for_uri (uri);
+	g_free (uri);
+
+	return location;
+}
+
+static char **
+get_query_words (NautilusQuery *query)
+{
+	char *text, *normalized, *lower;
+	char **words;
+
+	text = nautilus_query_get_text (query);
+	normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
+	lower = g_utf8_strdown (normalized, -1);
+	words = g_strsplit (lower, " ", -1);
+	g_free (text);
+	g_free (normalized);
+	g_free (lower);
+
+	return words;
+}
+
+static void
+index_hits (GList *uris,
+	    gboolean finished,
+	    gpointer callback_data)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = callback_data;
+
+	if (uris != NULL) {
+		nautilus_search_engine_hits_added (NAUTILUS_SEARCH_ENGINE (engine), uris);
+	}
+
+	if (finished) {
+		g_clear_object (&engine->details->cancellable);
+		nautilus_search_engine_finished (NAUTILUS_SEARCH_ENGINE (engine));
+	}
+}
+
+static void
+fallback_hits_added (NautilusSearchEngine *fallback,
+		     GList *hits,
+		     NautilusSearchEngineIndex *engine)
+{
+	nautilus_search_engine_hits_added (NAUTILUS_SEARCH_ENGINE (engine), hits);
+}
+
+static void
+fallback_finished (NautilusSearchEngine *fallback,
+		   NautilusSearchEngineIndex *engine)
+{
+	engine->details->fallback_active = FALSE;
+	nautilus_search_engine_finished (NAUTILUS_SEARCH_ENGINE (engine));
+}
+
+static void
+fallback_error (NautilusSearchEngine *fallback,
+		const char *error_message,
+		NautilusSearchEngineIndex *engine)
+{
+	nautilus_search_engine_error (NAUTILUS_SEARCH_ENGINE (engine), error_message);
+}
+
+static void
+start_fallback (NautilusSearchEngineIndex *engine)
+{
+	if (engine->details->fallback == NULL) {
+		engine->details->fallback = nautilus_search_engine_simple_new ();
+		g_signal_connect (engine->details->fallback, "hits-added",
+				  G_CALLBACK (fallback_hits_added), engine);
+		g_signal_connect (engine->details->fallback, "finished",
+				  G_CALLBACK (fallback_finished), engine);
+		g_signal_connect (engine->details->fallback, "error",
+				  G_CALLBACK (fallback_error), engine);
+	}
+
+	engine->details->fallback_active = TRUE;
+	nautilus_search_engine_set_query (engine->details->fallback, engine->details->query);
+	nautilus_search_engine_start (engine->details->fallback);
+}
+
+static void
+nautilus_search_engine_index_start (NautilusSearchEngine *search_engine)
+{
+	NautilusSearchEngineIndex *engine;
+	GList *mime_types;
+	GFile *location;
+	gboolean covered;
+	char **words;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (search_engine);
+
+	if (engine->details->cancellable != NULL ||
+	    engine->details->fallback_active) {
+		return;
+	}
+
+	if (engine->details->query == NULL) {
+		return;
+	}
+
+	location = get_query_location (engine->details->query);
+	covered = nautilus_search_index_covers (location);
+
+	mime_types = nautilus_query_get_mime_types (engine->details->query);
+	if (mime_types != NULL) {
+		covered = FALSE;
+		g_list_free_full (mime_types, g_free);
+	}
+
+	if (!covered) {
+		g_object_unref (location);
+		start_fallback (engine);
+		return;
+	}
+
+	engine->details->cancellable = g_cancellable_new ();
+	words = get_query_words (engine->details->query);
+	nautilus_search_index_query_async (location, words,
+					   engine->details->cancellable,
+					   index_hits, engine);
+	g_strfreev (words);
+	g_object_unref (location);
+}
+
+static void
+nautilus_search_engine_index_stop (NautilusSearchEngine *search_engine)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (search_engine);
+
+	if (engine->details->cancellable != NULL) {
+		g_cancellable_cancel (engine->details->cancellable);
+		g_clear_object (&engine->details->cancellable);
+	}
+
+	if (engine->details->fallback_active) {
+		nautilus_search_engine_stop (engine->details->fallback);
+		engine->details->fallback_active = FALSE;
+	}
+}
+
+static void
+nautilus_search_engine_index_set_query (NautilusSearchEngine *search_engine,
+					NautilusQuery *query)
+{
+	NautilusSearchEngineIndex *engine;
+
+	engine = NAUTILUS_SEARCH_ENGINE_INDEX (search_engine);
+
+	if (query) {
+		g_object_ref (query);
+	}
+
+	if (engine->details->query) {
+		g_object_unref (engine->details->query);
+	}
+
+	engine->details->query = query;
+}
+
+static void
+nautilus_search_engine_index_class_init (NautilusSearchEngineIndexClass *class)
+{
+	GObjectClass *gobject_class;
+	NautilusSearchEngineClass *engine_class;
+
+	gobject_class = G_OBJECT_CLASS (class);
+	gobject_class->finalize = finalize;
+
+	engine_class = NAUTILUS_SEARCH_ENGINE_CLASS (class);
+	engine_class->set_query = nautilus_search_engine_index_set_query;
+	engine_class->start = nautilus_search_engine_index_start;
+	engine_class->stop = nautilus_search_engine_index_stop;
+
+	g_type_class_add_private (class, sizeof (NautilusSearchEngineIndexDetails));
+}
+
+static void
+nautilus_search_engine_index_init (NautilusSearchEngineIndex *engine)
+{
+	engine->details = G_TYPE_INSTANCE_GET_PRIVATE (engine, NAUTILUS_TYPE_SEARCH_ENGINE_INDEX,
+						       NautilusSearchEngineIndexDetails);
+
+	nautilus_search_index_ensure ();
+}
+
+NautilusSearchEngine *
+nautilus_search_engine_index_new (void)
+{
+	return g_object_new (NAUTILUS_TYPE_SEARCH_ENGINE_INDEX, NULL);
+}
@@ -23,34 +23,87 @@
 
 #include <config.h>
 #include "nautilus-search-engine-simple.h"
+#include "nautilus-search-matcher.h"
 
-#include <string.h>
+#include <unistd.h>
 #include <glib.h>
 #include <gio/gio.h>
 
 #define BATCH_SIZE 500
 
+/* Default number of crawler threads, when there are this many CPUs. */
+#define DEFAULT_MAX_THREADS 8
+#define MAX_THREADS 64
+
+/* Number of locks the visited set is split over. */
+#define VISITED_SHARDS 16
+
+typedef struct SearchThreadData SearchThreadData;
+
+/* A crawler thread. Directories found by a crawler go on its own
+ * deque, where it takes them from the tail. Idle crawlers steal from
+ * the head of the others, which gets them the biggest subtrees.
+ */
+typedef struct {
+	SearchThreadData *data;
+	guint index;
+
+	GMutex lock;
+	GQueue directories; /* GFiles, protected by lock */
+
+	gint n_processed_files;
+	GList *uri_hits;
+} SearchWorker;
+
 typedef struct {
+	GMutex lock;
+	GHashTable *ids;
+} VisitedShard;
+
+struct SearchThreadData {
 	NautilusSearchEngineSimple *engine;
 	GCancellable *cancellable;
 
 	GList *mime_types;
-	char **words;
-	GList *found_list;
+	NautilusSearchMatcher *matcher;
 
-	GQueue *directories; /* GFiles */
+	GFile *location;
 
-	GHashTable *visited;
-	
-	gint n_processed_files;
+	SearchWorker *workers;
+	guint n_workers;
+	gint n_running; /* atomic */
+
+	/* Directories queued but not yet visited, atomic. The search is
+	 * done when this drops to 0.
+	 */
+	gint n_pending;
+
+	/* Idle crawlers wait on idle_cond until a directory is queued,
+	 * the crawl is done or the search is cancelled.
+	 */
+	GMutex idle_lock;
+	GCond idle_cond;
+	gint n_idle; /* atomic */
+	gulong cancelled_id;
+
+	VisitedShard visited[VISITED_SHARDS];
+
+	/* Hits of all the crawlers waiting for the main loop,
+	 * protected by hits_lock.
+	 */
+	GMutex hits_lock;
 	GList *uri_hits;
-} SearchThreadData;
+	gboolean report_scheduled;
+	gboolean finished;
+};
 
 
 struct NautilusSearchEngineSimpleDetails {
 	NautilusQuery *query;
 
 	SearchThreadData *active_search;
+
+	guint n_threads;
 	
 	gboolean query_finished;
 };
@@ -73,19 +126,50 @@ finalize (GObject *object)
 	G_OBJECT_CLASS (nautilus_search_engine_simple_parent_class)->finalize (object);
 }
 
+static guint
+get_default_n_threads (void)
+{
+	long n_cpus;
+
+	n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	if (n_cpus < 1) {
+		return 1;
+	}
+
+	return MIN (n_cpus, DEFAULT_MAX_THREADS);
+}
+
 static SearchThreadData *
 search_thread_data_new (NautilusSearchEngineSimple *engine,
 			NautilusQuery *query)
 {
 	SearchThreadData *data;
-	char *text, *lower, *normalized, *uri;
+	char *text, *uri;
 	GFile *location;
+	guint i;
 	
 	data = g_new0 (SearchThreadData, 1);
 
 	data->engine = engine;
-	data->directories = g_queue_new ();
-	data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (i = 0; i < VISITED_SHARDS; i++) {
+		g_mutex_init (&data->visited[i].lock);
+		data->visited[i].ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	}
+
+	data->n_workers = engine->details->n_threads;
+	data->workers = g_new0 (SearchWorker, data->n_workers);
+	for (i = 0; i < data->n_workers; i++) {
+		data->workers[i].data = data;
+		data->workers[i].index = i;
+		g_mutex_init (&data->workers[i].lock);
+		g_queue_init (&data->workers[i].directories);
+	}
+
+	g_mutex_init (&data->idle_lock);
+	g_cond_init (&data->idle_cond);
+	g_mutex_init (&data->hits_lock);
+
 	uri = nautilus_query_get_location (query);
 	location = NULL;
 	if (uri != NULL) {
@@ -95,15 +179,11 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
 	if (location == NULL) {
 		location = g_file_new_for_path ("/");
 	}
-	g_queue_push_tail (data->directories, location);
+	data->location = location;
 	
 	text = nautilus_query_get_text (query);
-	normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
-	lower = g_utf8_strdown (normalized, -1);
-	data->words = g_strsplit (lower, " ", -1);
+	data->matcher = nautilus_search_matcher_new (text);
 	g_free (text);
-	g_free (lower);
-	g_free (normalized);
 
 	data->mime_types = nautilus_query_get_mime_types (query);
 
@@ -115,72 +195,274 @@ search_thread_data_new (NautilusSearchEngineSimple *engine,
 static void 
 search_thread_data_free (SearchThreadData *data)
 {
-	g_queue_foreach (data->directories,
-			 (GFunc)g_object_unref, NULL);
-	g_queue_free (data->directories);
-	g_hash_table_destroy (data->visited);
+	SearchWorker *worker;
+	guint i;
+
+	g_cancellable_disconnect (data->cancellable, data->cancelled_id);
+
+	for (i = 0; i < data->n_workers; i++) {
+		worker = &data->workers[i];
+		g_queue_foreach (&worker->directories,
+				 (GFunc)g_object_unref, NULL);
+		g_queue_clear (&worker->directories);
+		g_mutex_clear (&worker->lock);
+		g_list_free_full (worker->uri_hits, g_free);
+	}
+	g_free (data->workers);
+
+	for (i = 0; i < VISITED_SHARDS; i++) {
+		g_mutex_clear (&data->visited[i].lock);
+		g_hash_table_destroy (data->visited[i].ids);
+	}
+
+	g_mutex_clear (&data->idle_lock);
+	g_cond_clear (&data->idle_cond);
+	g_mutex_clear (&data->hits_lock);
+
+	g_object_unref (data->location);
 	g_object_unref (data->cancellable);
-	g_strfreev (data->words);	
+	nautilus_search_matcher_free (data->matcher);
 	g_list_free_full (data->mime_types, g_free);
 	g_list_free_full (data->uri_hits, g_free);
 	g_free (data);
 }
 
+/* Reports the hits collected so far, and the end of the search once
+ * all the crawlers are done. There is at most one of these pending.
+ */
 static gboolean
-search_thread_done_idle (gpointer user_data)
+search_thread_report_idle (gpointer user_data)
 {
 	SearchThreadData *data;
+	GList *uri_hits;
+	gboolean finished;
 
 	data = user_data;
 
-	if (!g_cancellable_is_cancelled (data->cancellable)) {
-		nautilus_search_engine_finished (NAUTILUS_SEARCH_ENGINE (data->engine));
-		data->engine->details->active_search = NULL;
+	g_mutex_lock (&data->hits_lock);
+	uri_hits = data->uri_hits;
+	data->uri_hits = NULL;
+	finished = data->finished;
+	data->report_scheduled = FALSE;
+	g_mutex_unlock (&data->hits_lock);
+
+	if (uri_hits != NULL &&
+	    !g_cancellable_is_cancelled (data->cancellable)) {
+		nautilus_search_engine_hits_added (NAUTILUS_SEARCH_ENGINE (data->engine),
+						   uri_hits);
+	}
+	g_list_free_full (uri_hits, g_free);
+
+	if (finished) {
+		if (!g_cancellable_is_cancelled (data->cancellable)) {
+			nautilus_search_engine_finished (NAUTILUS_SEARCH_ENGINE (data->engine));
+			data->engine->details->active_search = NULL;
+		}
+
+		search_thread_data_free (data);
 	}
 	
-	search_thread_data_free (data);
-	
 	return FALSE;
 }
 
-typedef struct {
-	GList *uris;
-	SearchThreadData *thread_data;
-} SearchHits;
+/* Hands hits over to the main loop, merged with those of the other
+ * crawlers. Once finished is passed, data may be freed at any time.
+ */
+static void
+add_hits (SearchThreadData *data,
+	  GList *uri_hits,
+	  gboolean finished)
+{
+	g_mutex_lock (&data->hits_lock);
 
+	data->uri_hits = g_list_concat (uri_hits, data->uri_hits);
+	if (finished) {
+		data->finished = TRUE;
+	}
 
+	if (!data->report_scheduled &&
+	    (data->uri_hits != NULL || data->finished)) {
+		data->report_scheduled = TRUE;
+		g_idle_add (search_thread_report_idle, data);
+	}
+
+	g_mutex_unlock (&data->hits_lock);
+}
+
+static void
+send_batch (SearchWorker *worker)
+{
+	worker->n_processed_files = 0;
+	
+	if (worker->uri_hits) {
+		add_hits (worker->data, worker->uri_hits, FALSE);
+	}
+	worker->uri_hits = NULL;
+}
+
+/* Returns TRUE if the id was not in the visited set yet. */
 static gboolean
-search_thread_add_hits_idle (gpointer user_data)
+mark_visited (SearchThreadData *data,
+	      const char *id)
 {
-	SearchHits *hits;
+	VisitedShard *shard;
+	gboolean visited;
 
-	hits = user_data;
+	shard = &data->visited[g_str_hash (id) % VISITED_SHARDS];
 
-	if (!g_cancellable_is_cancelled (hits->thread_data->cancellable)) {
-		nautilus_search_engine_hits_added (NAUTILUS_SEARCH_ENGINE (hits->thread_data->engine),
-						   hits->uris);
+	g_mutex_lock (&shard->lock);
+	visited = g_hash_table_lookup_extended (shard->ids, id, NULL, NULL);
+	if (!visited) {
+		g_hash_table_insert (shard->ids, g_strdup (id), NULL);
 	}
+	g_mutex_unlock (&shard->lock);
 
-	g_list_free_full (hits->uris, g_free);
-	g_free (hits);
-	
-	return FALSE;
+	return !visited;
 }
 
 static void
-send_batch (SearchThreadData *data)
+wake_idle_workers (SearchThreadData *data,
+		   gboolean all)
 {
-	SearchHits *hits;
-	
-	data->n_processed_files = 0;
-	
-	if (data->uri_hits) {
-		hits = g_new (SearchHits, 1);
-		hits->uris = data->uri_hits;
-		hits->thread_data = data;
-		g_idle_add (search_thread_add_hits_idle, hits);
+	g_mutex_lock (&data->idle_lock);
+	if (all) {
+		g_cond_broadcast (&data->idle_cond);
+	} else {
+		g_cond_signal (&data->idle_cond);
 	}
-	data->uri_hits = NULL;
+	g_mutex_unlock (&data->idle_lock);
+}
+
+/* Queues a directory already counted in n_pending. */
+static void
+queue_directory (SearchWorker *worker,
+		 GFile *dir)
+{
+	SearchThreadData *data;
+
+	data = worker->data;
+
+	g_mutex_lock (&worker->lock);
+	g_queue_push_tail (&worker->directories, dir);
+	g_mutex_unlock (&worker->lock);
+
+	if (g_atomic_int_get (&data->n_idle) > 0) {
+		wake_idle_workers (data, FALSE);
+	}
+}
+
+static void
+push_directory (SearchWorker *worker,
+		GFile *dir)
+{
+	g_atomic_int_inc (&worker->data->n_pending);
+	queue_directory (worker, dir);
+}
+
+static GFile *
+pop_directory (SearchWorker *worker)
+{
+	GFile *dir;
+
+	g_mutex_lock (&worker->lock);
+	dir = g_queue_pop_tail (&worker->directories);
+	g_mutex_unlock (&worker->lock);
+
+	return dir;
+}
+
+static GFile *
+steal_directory (SearchWorker *thief)
+{
+	SearchThreadData *data;
+	SearchWorker *victim;
+	GFile *dir;
+	guint i;
+
+	data = thief->data;
+
+	for (i = 1; i < data->n_workers; i++) {
+		victim = &data->workers[(thief->index + i) % data->n_workers];
+
+		g_mutex_lock (&victim->lock);
+		dir = g_queue_pop_head (&victim->directories);
+		g_mutex_unlock (&victim->lock);
+
+		if (dir != NULL) {
+			return dir;
+		}
+	}
+
+	return NULL;
+}
+
+static gboolean
+any_directory_queued (SearchThreadData *data)
+{
+	SearchWorker *worker;
+	gboolean queued;
+	guint i;
+
+	queued = FALSE;
+	for (i = 0; i < data->n_workers && !queued; i++) {
+		worker = &data->workers[i];
+
+		g_mutex_lock (&worker->lock);
+		queued = !g_queue_is_empty (&worker->directories);
+		g_mutex_unlock (&worker->lock);
+	}
+
+	return queued;
+}
+
+/* Waits until there may be work to steal, or the crawl is over. */
+static void
+wait_for_directory (SearchThreadData *data)
+{
+	g_mutex_lock (&data->idle_lock);
+	/* Once n_idle is raised, queue_directory signals us for every
+	 * directory pushed after the check below, so none is missed.
+	 */
+	g_atomic_int_inc (&data->n_idle);
+	while (g_atomic_int_get (&data->n_pending) > 0 &&
+	       !g_cancellable_is_cancelled (data->cancellable) &&
+	       !any_directory_queued (data)) {
+		g_cond_wait (&data->idle_cond, &data->idle_lock);
+	}
+	g_atomic_int_add (&data->n_idle, -1);
+	g_mutex_unlock (&data->idle_lock);
+}
+
+static void
+search_cancelled (GCancellable *cancellable,
+		  gpointer user_data)
+{
+	wake_idle_workers (user_data, TRUE);
+}
+
+static void
+visit_root (SearchWorker *worker)
+{
+	SearchThreadData *data;
+	GFileInfo *info;
+	const char *id;
+
+	data = worker->data;
+
+	/* Insert id for toplevel directory into visited */
+	info = g_file_query_info (data->location, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
+	if (info) {
+		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+		if (id) {
+			mark_visited (data, id);
+		}
+		g_object_unref (info);
+	}
+
+	/* n_pending counts the root from the start, so the other
+	 * crawlers wait for it instead of quitting.
+	 */
+	queue_directory (worker, g_object_ref (data->location));
 }
 
 #define STD_ATTRIBUTES \
@@ -191,19 +473,20 @@ send_batch (SearchThreadData *data)
 	G_FILE_ATTRIBUTE_ID_FILE
 
 static void
-visit_directory (GFile *dir, SearchThreadData *data)
+visit_directory (GFile *dir, SearchWorker *worker)
 {
+	SearchThreadData *data;
 	GFileEnumerator *enumerator;
 	GFileInfo *info;
 	GFile *child;
 	const char *mime_type, *display_name;
-	char *lower_name, *normalized;
 	gboolean hit;
-	int i;
 	GList *l;
 	const char *id;
 	gboolean visited;
 
+	data = worker->data;
+
 	enumerator = g_file_enumerate_children (dir,
 						data->mime_types != NULL ?
 						STD_ATTRIBUTES ","
@@ -227,18 +510,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
 			goto next;
 		}
 		
-		normalized = g_utf8_normalize (display_name, -1, G_NORMALIZE_NFD);
-		lower_name = g_utf8_strdown (normalized, -1);
-		g_free (normalized);
-		
-		hit = TRUE;
-		for (i = 0; data->words[i] != NULL; i++) {
-			if (strstr (lower_name, data->words[i]) == NULL) {
-				hit = FALSE;
-				break;
-			}
-		}
-		g_free (lower_name);
+		hit = nautilus_search_matcher_matches (data->matcher, display_name);
 		
 		if (hit && data->mime_types) {
 			mime_type = g_file_info_get_content_type (info);
@@ -255,28 +527,23 @@ visit_directory (GFile *dir, SearchThreadData *data)
 		child = g_file_get_child (dir, g_file_info_get_name (info));
 		
 		if (hit) {
-			data->uri_hits = g_list_prepend (data->uri_hits, g_file_get_uri (child));
+			worker->uri_hits = g_list_prepend (worker->uri_hits, g_file_get_uri (child));
 		}
 		
-		data->n_processed_files++;
-		if (data->n_processed_files > BATCH_SIZE) {
-			send_batch (data);
+		worker->n_processed_files++;
+		if (worker->n_processed_files > BATCH_SIZE) {
+			send_batch (worker);
 		}
 
 		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
 			id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
 			visited = FALSE;
 			if (id) {
-				if (g_hash_table_lookup_extended (data->visited,
-								  id, NULL, NULL)) {
-					visited = TRUE;
-				} else {
-					g_hash_table_insert (data->visited, g_strdup (id), NULL);
-				}
+				visited = !mark_visited (data, id);
 			}
 			
 			if (!visited) {
-				g_queue_push_tail (data->directories, g_object_ref (child));
+				push_directory (worker, g_object_ref (child));
 			}
 		}
 		
@@ -288,36 +555,50 @@ visit_directory (GFile *dir, SearchThreadData *data)
 	g_object_unref (enumerator);
 }
 
-
 static gpointer 
 search_thread_func (gpointer user_data)
 {
+	SearchWorker *worker;
 	SearchThreadData *data;
 	GFile *dir;
-	GFileInfo *info;
-	const char *id;
 
-	data = user_data;
+	worker = user_data;
+	data = worker->data;
 
-	/* Insert id for toplevel directory into visited */
-	dir = g_queue_peek_head (data->directories);
-	info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
-	if (info) {
-		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
-		if (id) {
-			g_hash_table_insert (data->visited, g_strdup (id), NULL);
-		}
-		g_object_unref (info);
+	if (worker->index == 0) {
+		visit_root (worker);
 	}
-	
-	while (!g_cancellable_is_cancelled (data->cancellable) &&
-	       (dir = g_queue_pop_head (data->directories)) != NULL) {
-		visit_directory (dir, data);
-		g_object_unref (dir);
+
+	while (!g_cancellable_is_cancelled (data->cancellable)) {
+		dir = pop_directory (worker);
+		if (dir == NULL) {
+			dir = steal_directory (worker);
+		}
+
+		if (dir != NULL) {
+			visit_directory (dir, worker);
+			g_object_unref (dir);
+
+			if (g_atomic_int_dec_and_test (&data->n_pending)) {
+				/* That was the last one, wake everyone up to quit. */
+				wake_idle_workers (data, TRUE);
+			}
+			continue;
+		}
+
+		if (g_atomic_int_get (&data->n_pending) == 0) {
+			break;
+		}
+
+		/* Others are still crawling and may find more directories. */
+		wait_for_directory (data);
 	}
-	send_batch (data);
+	send_batch (worker);
 
-	g_idle_add (search_thread_done_idle, data);
+	/* The last crawler out reports the end of the search. */
+	if (g_atomic_int_dec_and_test (&data->n_running)) {
+		add_hits (data, NULL, TRUE);
+	}
 	
 	return NULL;
 }
@@ -328,6 +609,7 @@ nautilus_search_engine_simple_start (NautilusSearchEngine *engine)
 	NautilusSearchEngineSimple *simple;
 	SearchThreadData *data;
 	GThread *thread;
+	guint i;
 	
 	simple = NAUTILUS_SEARCH_ENGINE_SIMPLE (engine);
 
@@ -341,10 +623,19 @@ nautilus_search_engine_simple_start (NautilusSearchEngine *engine)
 	
 	data = search_thread_data_new (simple, simple->details->query);
 
-	thread = g_thread_new ("nautilus-search-simple", search_thread_func, data);
+	data->cancelled_id = g_cancellable_connect (data->cancellable,
+						    G_CALLBACK (search_cancelled),
+						    data, NULL);
+
+	/* The first crawler queues the root. */
+	data->n_pending = 1;
+	data->n_running = data->n_workers;
+	for (i = 0; i < data->n_workers; i++) {
+		thread = g_thread_new ("nautilus-search-simple", search_thread_func,
+				       &data->workers[i]);
+		g_thread_unref (thread);
+	}
 	simple->details->active_search = data;
-
-	g_thread_unref (thread);
 }
 
 static void
@@ -400,6 +691,7 @@ nautilus_search_engine_simple_init (NautilusSearchEngineSimple *engine)
 {
 	engine->details = G_TYPE_INSTANCE_GET_PRIVATE (engine, NAUTILUS_TYPE_SEARCH_ENGINE_SIMPLE,
 						       NautilusSearchEngineSimpleDetails);
+	engine->details->n_threads = get_default_n_threads ();
 }
 
 NautilusSearchEngine *
@@ -411,3 +703,24 @@ nautilus_search_engine_simple_new (void)
 
 	return engine;
 }
+
+/**
+ * nautilus_search_engine_simple_set_n_threads:
+ * @simple: a #NautilusSearchEngineSimple
+ * @n_threads: number of crawler threads, or 0 for the default
+ *
+ * Sets how many threads crawl the file system in parallel. The default
+ * is one per CPU, up to 8. Takes effect with the next search started.
+ */
+void
+nautilus_search_engine_simple_set_n_threads (NautilusSearchEngineSimple *simple,
+					     guint n_threads)
+{
+	g_return_if_fail (NAUTILUS_IS_SEARCH_ENGINE_SIMPLE (simple));
+
+	if (n_threads == 0) {
+		n_threads = get_default_n_threads ();
+	}
+
+	simple->details->n_threads = MIN (n_threads, MAX_THREADS);
+}
@@ -47,5 +47,7 @@ typedef struct {
 GType          nautilus_search_engine_simple_get_type  (void);
 
 NautilusSearchEngine* nautilus_search_engine_simple_new       (void);
+void                  nautilus_search_engine_simple_set_n_threads (NautilusSearchEngineSimple *simple,
+								    guint                       n_threads);
 
 #endif /* NAUTILUS_SEARCH_ENGINE_SIMPLE_H */
@@ -0,0 +1,2179 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-search-index.c: persistent index of file names
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* The index covers the names of all the non-hidden files below the
+ * home directory. It is built by a crawler thread and written to a
+ * file in the user's cache directory, which is then mapped into
+ * memory. The file holds:
+ *
+ *  - one entry per file, in breadth first order, so that the children
+ *    of a directory are next to each other, sorted by name;
+ *  - a sorted table of the 3-byte sequences (trigrams) found in the
+ *    normalized names, each pointing at the list of entries that
+ *    contain it;
+ *  - the names themselves.
+ *
+ * A query looks up the trigrams of its words, takes the shortest list
+ * of entries and checks those with strstr.
+ *
+ * Changes Nautilus sees after the index was built are kept in memory
+ * on top of it: removed entries are hidden, and a tree of the paths
+ * that changed holds the new files and the entries moved there, whose
+ * descendants are then reported below the new location. The index is
+ * rebuilt from scratch every few hours, and the overlay thrown away.
+ *
+ * Other programs change files too. The index keeps the modification
+ * time of each directory, and before it looks for names a query reads
+ * those of the directories below its location. The directories that
+ * changed are read again and the difference goes into the overlay, so
+ * that only those are crawled, and only once.
+ *
+ * Queries run in a thread of their own, on a reference to the index
+ * that was current when they started.
+ */
+
+#include <config.h>
+#include "nautilus-search-index.h"
+
+#include "nautilus-directory-notify.h"
+
+#include <string.h>
+
+#define INDEX_MAGIC "NAUTIDX"
+#define INDEX_VERSION 2
+#define INDEX_BYTE_ORDER 0x01020304
+
+/* Rebuild the index when it is older than this, in seconds. */
+#define INDEX_MAX_AGE (6 * 60 * 60)
+
+/* Number of hits handed to the main loop at once. */
+#define QUERY_BATCH_SIZE 500
+
+/* Number of candidates checked between looks at the cancellable. */
+#define QUERY_CANCEL_CHECK 4096
+
+/* Changes kept while the index is being rebuilt. Past that, another
+ * rebuild is started when this one is done.
+ */
+#define JOURNAL_MAX_FILES 10000
+
+#define NO_ENTRY G_MAXUINT32
+#define ENTRY_IS_DIRECTORY (1 << 0)
+#define ENTRY_KEY(id) GUINT_TO_POINTER ((id) + 1)
+
+#define TRIGRAM(s) (((guint32) (guchar) (s)[0] << 16) | \
+		    ((guint32) (guchar) (s)[1] << 8) | \
+		    (guint32) (guchar) (s)[2])
+
+typedef struct {
+	char magic[8];
+	guint32 version;
+	guint32 byte_order;
+	guint32 n_entries;
+	guint32 n_trigrams;
+	guint32 n_postings;
+	guint32 strings_size;
+	guint32 root_uri;
+	guint32 padding;
+	guint64 build_time;
+} IndexHeader;
+
+typedef struct {
+	guint32 parent;
+	guint32 first_child;
+	guint32 n_children;
+	guint32 name; /* file system name */
+	guint32 key; /* normalized, lowercased display name */
+	guint32 flags;
+	/* of directories, as they were crawled */
+	guint32 mtime;
+	guint32 mtime_usec;
+} IndexEntry;
+
+typedef struct {
+	guint32 trigram;
+	guint32 first_posting;
+	guint32 n_postings;
+} IndexTrigram;
+
+typedef struct OverlayNode OverlayNode;
+
+/* A path below the root of the index where something changed. */
+struct OverlayNode {
+	OverlayNode *parent;
+	char *name;
+	GHashTable *children; /* name -> OverlayNode, or NULL */
+
+	char *key; /* key of the file added here, or NULL */
+	guint32 entry; /* the entry moved here, or NO_ENTRY */
+	/* of the file added here, in microseconds: 0 if not known yet,
+	 * NOT_A_DIRECTORY if it isn't one */
+	gint64 mtime;
+};
+
+#define NOT_A_DIRECTORY (-1)
+
+typedef struct {
+	int ref_count;
+
+	GMappedFile *mapped;
+	const IndexHeader *header;
+	const IndexEntry *entries;
+	const IndexTrigram *trigrams;
+	const guint32 *postings;
+	const char *strings;
+	GFile *root;
+
+	/* Changes seen since the index was built, by the main loop and
+	 * by queries. They are only read and changed under lock.
+	 */
+	GMutex lock;
+	GHashTable *removed_entries; /* entries that are gone, or moved */
+	GHashTable *moved_entries; /* entry -> OverlayNode it was moved to */
+	OverlayNode *overlay; /* the root */
+	/* entry -> modification time of the directory read by a query */
+	GHashTable *directory_mtimes;
+} Index;
+
+typedef struct {
+	Index *index;
+	char *path; /* the location, relative to the root */
+	char **words;
+	GCancellable *cancellable;
+	NautilusSearchIndexHitsFunc callback;
+	gpointer callback_data;
+
+	/* Hits waiting for the main loop, protected by hits_lock. */
+	GMutex hits_lock;
+	GList *hits;
+	gboolean report_scheduled;
+	gboolean finished;
+} IndexQuery;
+
+typedef struct {
+	GFile *root;
+	char *path;
+
+	GArray *entries;
+	GString *strings;
+	GHashTable *visited;
+
+	gboolean succeeded;
+} IndexBuilder;
+
+typedef struct {
+	GFile *location;
+	guint32 id;
+} BuildDirectory;
+
+typedef struct {
+	char *name;
+	char *key;
+	gboolean is_directory;
+	gint64 mtime; /* of directories */
+	char *id;
+} BuildChild;
+
+/* A directory a query looks at before looking for names. */
+typedef struct {
+	char *path;
+	/* the modification time seen last, 0 if not known or if the
+	 * directory is to be read again */
+	gint64 mtime;
+	/* found by the query, and read in any case */
+	gboolean is_new;
+} CheckDirectory;
+
+typedef enum {
+	JOURNAL_ADDED,
+	JOURNAL_REMOVED,
+	JOURNAL_MOVED,
+	JOURNAL_CHANGED
+} JournalKind;
+
+typedef struct {
+	JournalKind kind;
+	GList *files;
+} JournalRecord;
+
+static char *index_path;
+static Index *current_index;
+static gboolean building;
+
+/* Changes seen while a new index is being built, most recent first. */
+static GList *journal;
+static guint journal_n_files;
+static gboolean journal_overflowed;
+
+static char *
+make_key (const char *display_name)
+{
+	char *normalized, *key;
+
+	normalized = g_utf8_normalize (display_name, -1, G_NORMALIZE_NFD);
+	if (normalized == NULL) {
+		return g_strdup ("");
+	}
+	key = g_utf8_strdown (normalized, -1);
+	g_free (normalized);
+
+	return key;
+}
+
+static char *
+make_key_for_location (GFile *location)
+{
+	char *basename, *display_name, *key;
+
+	basename = g_file_get_basename (location);
+	display_name = g_filename_display_name (basename);
+	key = make_key (display_name);
+	g_free (display_name);
+	g_free (basename);
+
+	return key;
+}
+
+static gboolean
+key_matches (const char *key, char **words)
+{
+	int i;
+
+	for (i = 0; words[i] != NULL; i++) {
+		if (strstr (key, words[i]) == NULL) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+relative_path_is_hidden (const char *relative_path)
+{
+	const char *p;
+
+	for (p = relative_path; p != NULL; p = strchr (p, G_DIR_SEPARATOR)) {
+		if (*p == G_DIR_SEPARATOR) {
+			p++;
+		}
+		if (*p == '.') {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gint64
+get_info_mtime (GFileInfo *info)
+{
+	return (gint64) g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
+
+static void
+build_child_clear (BuildChild *child)
+{
+	g_free (child->name);
+	g_free (child->key);
+	g_free (child->id);
+}
+
+/* Reads the children of the directory at location that aren't
+ * hidden, or returns NULL.
+ */
+static GArray *
+read_children (GFile *location,
+	       GFileQueryInfoFlags flags,
+	       GCancellable *cancellable)
+{
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GArray *children;
+	BuildChild child;
+	const char *display_name;
+
+	enumerator = g_file_enumerate_children (location,
+						G_FILE_ATTRIBUTE_STANDARD_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME ","
+						G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN ","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+						G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+						G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+						G_FILE_ATTRIBUTE_ID_FILE,
+						flags, cancellable, NULL);
+	if (enumerator == NULL) {
+		return NULL;
+	}
+
+	children = g_array_new (FALSE, FALSE, sizeof (BuildChild));
+	while ((info = g_file_enumerator_next_file (enumerator, cancellable, NULL)) != NULL) {
+		if (!g_file_info_get_is_hidden (info)) {
+			display_name = g_file_info_get_display_name (info);
+			if (display_name == NULL) {
+				display_name = g_file_info_get_name (info);
+			}
+
+			child.name = g_strdup (g_file_info_get_name (info));
+			child.key = make_key (display_name);
+			child.is_directory = g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY;
+			child.mtime = child.is_directory ? get_info_mtime (info) : 0;
+			child.id = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE));
+			g_array_append_val (children, child);
+		}
+		g_object_unref (info);
+	}
+	g_object_unref (enumerator);
+
+	return children;
+}
+
+static char *
+get_index_path (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "nautilus", "filename-index", NULL);
+}
+
+/* Building, in a thread of its own */
+
+static guint32
+builder_add_string (IndexBuilder *builder, const char *string)
+{
+	guint32 offset;
+
+	offset = builder->strings->len;
+	g_string_append_len (builder->strings, string, strlen (string) + 1);
+
+	return offset;
+}
+
+static int
+build_child_compare (gconstpointer a, gconstpointer b)
+{
+	return strcmp (((const BuildChild *) a)->name,
+		       ((const BuildChild *) b)->name);
+}
+
+static BuildDirectory *
+build_directory_new (GFile *location, guint32 id)
+{
+	BuildDirectory *directory;
+
+	directory = g_new (BuildDirectory, 1);
+	directory->location = location;
+	directory->id = id;
+
+	return directory;
+}
+
+static void
+build_visit_directory (IndexBuilder *builder,
+		       BuildDirectory *directory,
+		       GQueue *pending)
+{
+	GArray *children;
+	BuildChild *c;
+	IndexEntry entry;
+	guint32 first_child;
+	guint i;
+
+	children = read_children (directory->location, 0, NULL);
+	if (children == NULL) {
+		return;
+	}
+
+	g_array_sort (children, build_child_compare);
+
+	first_child = builder->entries->len;
+	g_array_index (builder->entries, IndexEntry, directory->id).first_child = first_child;
+	g_array_index (builder->entries, IndexEntry, directory->id).n_children = children->len;
+
+	for (i = 0; i < children->len; i++) {
+		c = &g_array_index (children, BuildChild, i);
+
+		entry.parent = directory->id;
+		entry.first_child = 0;
+		entry.n_children = 0;
+		entry.name = builder_add_string (builder, c->name);
+		entry.key = builder_add_string (builder, c->key);
+		entry.flags = c->is_directory ? ENTRY_IS_DIRECTORY : 0;
+		entry.mtime = c->mtime / G_USEC_PER_SEC;
+		entry.mtime_usec = c->mtime % G_USEC_PER_SEC;
+		g_array_append_val (builder->entries, entry);
+
+		if (c->is_directory &&
+		    (c->id == NULL ||
+		     !g_hash_table_lookup_extended (builder->visited, c->id, NULL, NULL))) {
+			if (c->id != NULL) {
+				g_hash_table_insert (builder->visited, c->id, NULL);
+				c->id = NULL;
+			}
+			g_queue_push_tail (pending,
+					   build_directory_new (g_file_get_child (directory->location, c->name),
+								first_child + i));
+		}
+
+		build_child_clear (c);
+	}
+	g_array_free (children, TRUE);
+}
+
+static int
+compare_guint64 (gconstpointer a, gconstpointer b)
+{
+	guint64 x, y;
+
+	x = *(const guint64 *) a;
+	y = *(const guint64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+build_trigrams (IndexBuilder *builder,
+		GArray *trigrams,
+		GArray *postings)
+{
+	GArray *pairs;
+	IndexEntry *entry;
+	IndexTrigram trigram;
+	const char *key;
+	guint64 pair, previous;
+	guint32 id, value;
+	gsize len, i;
+
+	pairs = g_array_new (FALSE, FALSE, sizeof (guint64));
+	for (id = 1; id < builder->entries->len; id++) {
+		entry = &g_array_index (builder->entries, IndexEntry, id);
+		key = builder->strings->str + entry->key;
+		len = strlen (key);
+		for (i = 0; i + 2 < len; i++) {
+			pair = ((guint64) TRIGRAM (key + i) << 32) | id;
+			g_array_append_val (pairs, pair);
+		}
+	}
+	g_array_sort (pairs, compare_guint64);
+
+	previous = G_MAXUINT64;
+	for (i = 0; i < pairs->len; i++) {
+		pair = g_array_index (pairs, guint64, i);
+		if (pair == previous) {
+			continue;
+		}
+
+		value = pair >> 32;
+		if (trigrams->len == 0 ||
+		    g_array_index (trigrams, IndexTrigram, trigrams->len - 1).trigram != value) {
+			trigram.trigram = value;
+			trigram.first_posting = postings->len;
+			trigram.n_postings = 0;
+			g_array_append_val (trigrams, trigram);
+		}
+		g_array_index (trigrams, IndexTrigram, trigrams->len - 1).n_postings++;
+
+		value = pair & G_MAXUINT32;
+		g_array_append_val (postings, value);
+		previous = pair;
+	}
+	g_array_free (pairs, TRUE);
+}
+
+static gboolean
+build_write (IndexBuilder *builder)
+{
+	IndexHeader header;
+	GArray *trigrams, *postings;
+	char *buffer, *p, *uri, *dirname;
+	gsize size;
+	gboolean result;
+
+	trigrams = g_array_new (FALSE, FALSE, sizeof (IndexTrigram));
+	postings = g_array_new (FALSE, FALSE, sizeof (guint32));
+	build_trigrams (builder, trigrams, postings);
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, INDEX_MAGIC, sizeof (INDEX_MAGIC));
+	header.version = INDEX_VERSION;
+	header.byte_order = INDEX_BYTE_ORDER;
+	uri = g_file_get_uri (builder->root);
+	header.root_uri = builder_add_string (builder, uri);
+	g_free (uri);
+	header.n_entries = builder->entries->len;
+	header.n_trigrams = trigrams->len;
+	header.n_postings = postings->len;
+	header.strings_size = builder->strings->len;
+	header.build_time = g_get_real_time () / G_USEC_PER_SEC;
+
+	size = sizeof (IndexHeader) +
+		builder->entries->len * sizeof (IndexEntry) +
+		trigrams->len * sizeof (IndexTrigram) +
+		postings->len * sizeof (guint32) +
+		builder->strings->len;
+	buffer = p = g_malloc (size);
+
+	memcpy (p, &header, sizeof (IndexHeader));
+	p += sizeof (IndexHeader);
+	memcpy (p, builder->entries->data, builder->entries->len * sizeof (IndexEntry));
+	p += builder->entries->len * sizeof (IndexEntry);
+	memcpy (p, trigrams->data, trigrams->len * sizeof (IndexTrigram));
+	p += trigrams->len * sizeof (IndexTrigram);
+	memcpy (p, postings->data, postings->len * sizeof (guint32));
+	p += postings->len * sizeof (guint32);
+	memcpy (p, builder->strings->str, builder->strings->len);
+
+	g_array_free (trigrams, TRUE);
+	g_array_free (postings, TRUE);
+
+	dirname = g_path_get_dirname (builder->path);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	result = g_file_set_contents (builder->path, buffer, size, NULL);
+	g_free (buffer);
+
+	return result;
+}
+
+static gboolean build_done_idle (gpointer user_data);
+
+static gpointer
+build_thread_func (gpointer user_data)
+{
+	IndexBuilder *builder;
+	BuildDirectory *directory;
+	IndexEntry root;
+	GFileInfo *info;
+	gint64 mtime;
+	GQueue pending = G_QUEUE_INIT;
+
+	builder = user_data;
+
+	builder->entries = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+	builder->strings = g_string_new (NULL);
+	builder->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	/* Read before the directory itself, like those of the others. */
+	mtime = 0;
+	info = g_file_query_info (builder->root,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				  0, NULL, NULL);
+	if (info != NULL) {
+		mtime = get_info_mtime (info);
+		g_object_unref (info);
+	}
+
+	memset (&root, 0, sizeof (root));
+	root.name = root.key = builder_add_string (builder, "");
+	root.flags = ENTRY_IS_DIRECTORY;
+	root.mtime = mtime / G_USEC_PER_SEC;
+	root.mtime_usec = mtime % G_USEC_PER_SEC;
+	g_array_append_val (builder->entries, root);
+
+	g_queue_push_tail (&pending, build_directory_new (g_object_ref (builder->root), 0));
+	while ((directory = g_queue_pop_head (&pending)) != NULL) {
+		/* Entries are addressed with 32 bits. */
+		if (builder->entries->len < G_MAXUINT32 / 2) {
+			build_visit_directory (builder, directory, &pending);
+		}
+		g_object_unref (directory->location);
+		g_free (directory);
+	}
+
+	builder->succeeded = build_write (builder);
+
+	g_array_free (builder->entries, TRUE);
+	builder->entries = NULL;
+	g_string_free (builder->strings, TRUE);
+	builder->strings = NULL;
+	g_hash_table_destroy (builder->visited);
+	builder->visited = NULL;
+
+	g_idle_add (build_done_idle, builder);
+
+	return NULL;
+}
+
+static void
+start_build (void)
+{
+	IndexBuilder *builder;
+	GThread *thread;
+
+	if (building) {
+		return;
+	}
+	building = TRUE;
+
+	builder = g_new0 (IndexBuilder, 1);
+	builder->root = g_file_new_for_path (g_get_home_dir ());
+	builder->path = g_strdup (index_path);
+
+	thread = g_thread_new ("nautilus-search-index", build_thread_func, builder);
+	g_thread_unref (thread);
+}
+
+/* Loading */
+
+static void
+overlay_node_free (Index *index, OverlayNode *node);
+
+static void
+overlay_node_attach (OverlayNode *node, OverlayNode *parent)
+{
+	if (parent->children == NULL) {
+		parent->children = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+	g_hash_table_insert (parent->children, node->name, node);
+	node->parent = parent;
+}
+
+static OverlayNode *
+overlay_node_new (OverlayNode *parent, const char *name)
+{
+	OverlayNode *node;
+
+	node = g_new0 (OverlayNode, 1);
+	node->name = g_strdup (name);
+	node->entry = NO_ENTRY;
+
+	if (parent != NULL) {
+		overlay_node_attach (node, parent);
+	}
+
+	return node;
+}
+
+static Index *
+index_ref (Index *index)
+{
+	g_atomic_int_inc (&index->ref_count);
+
+	return index;
+}
+
+static void
+index_unref (Index *index)
+{
+	if (index == NULL ||
+	    !g_atomic_int_dec_and_test (&index->ref_count)) {
+		return;
+	}
+
+	overlay_node_free (index, index->overlay);
+	g_hash_table_destroy (index->removed_entries);
+	g_hash_table_destroy (index->moved_entries);
+	g_hash_table_destroy (index->directory_mtimes);
+	g_mutex_clear (&index->lock);
+
+	g_mapped_file_unref (index->mapped);
+	g_object_unref (index->root);
+	g_free (index);
+}
+
+static gboolean
+index_is_valid (Index *index)
+{
+	const IndexHeader *header;
+	const IndexEntry *entry;
+	const IndexTrigram *trigram;
+	guint32 i;
+
+	header = index->header;
+
+	if (header->n_entries == 0 ||
+	    header->strings_size == 0 ||
+	    index->strings[header->strings_size - 1] != '\0' ||
+	    header->root_uri >= header->strings_size) {
+		return FALSE;
+	}
+
+	for (i = 0; i < header->n_entries; i++) {
+		entry = &index->entries[i];
+		if (entry->name >= header->strings_size ||
+		    entry->key >= header->strings_size ||
+		    (i != 0 && entry->parent >= i) ||
+		    entry->first_child > header->n_entries ||
+		    entry->n_children > header->n_entries - entry->first_child) {
+			return FALSE;
+		}
+	}
+
+	for (i = 0; i < header->n_trigrams; i++) {
+		trigram = &index->trigrams[i];
+		if (trigram->first_posting > header->n_postings ||
+		    trigram->n_postings > header->n_postings - trigram->first_posting) {
+			return FALSE;
+		}
+	}
+
+	for (i = 0; i < header->n_postings; i++) {
+		if (index->postings[i] >= header->n_entries) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static Index *
+index_load (const char *path)
+{
+	Index *index;
+	GMappedFile *mapped;
+	const IndexHeader *header;
+	const char *contents;
+	gsize size;
+
+	mapped = g_mapped_file_new (path, FALSE, NULL);
+	if (mapped == NULL) {
+		return NULL;
+	}
+
+	size = g_mapped_file_get_length (mapped);
+	contents = g_mapped_file_get_contents (mapped);
+	header = (const IndexHeader *) contents;
+
+	if (size < sizeof (IndexHeader) ||
+	    memcmp (header->magic, INDEX_MAGIC, sizeof (INDEX_MAGIC)) != 0 ||
+	    header->version != INDEX_VERSION ||
+	    header->byte_order != INDEX_BYTE_ORDER ||
+	    size != sizeof (IndexHeader) +
+	    (gsize) header->n_entries * sizeof (IndexEntry) +
+	    (gsize) header->n_trigrams * sizeof (IndexTrigram) +
+	    (gsize) header->n_postings * sizeof (guint32) +
+	    header->strings_size) {
+		g_mapped_file_unref (mapped);
+		return NULL;
+	}
+
+	index = g_new0 (Index, 1);
+	index->mapped = mapped;
+	index->header = header;
+	index->entries = (const IndexEntry *) (contents + sizeof (IndexHeader));
+	index->trigrams = (const IndexTrigram *) (index->entries + header->n_entries);
+	index->postings = (const guint32 *) (index->trigrams + header->n_trigrams);
+	index->strings = (const char *) (index->postings + header->n_postings);
+
+	if (!index_is_valid (index)) {
+		g_mapped_file_unref (mapped);
+		g_free (index);
+		return NULL;
+	}
+
+	index->ref_count = 1;
+	index->root = g_file_new_for_uri (index->strings + header->root_uri);
+
+	g_mutex_init (&index->lock);
+	index->removed_entries = g_hash_table_new (NULL, NULL);
+	index->moved_entries = g_hash_table_new (NULL, NULL);
+	index->overlay = overlay_node_new (NULL, "");
+	index->directory_mtimes = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+	return index;
+}
+
+static gboolean
+index_is_stale (Index *index)
+{
+	GFile *home;
+	gboolean stale;
+
+	if (g_get_real_time () / G_USEC_PER_SEC - (gint64) index->header->build_time > INDEX_MAX_AGE) {
+		return TRUE;
+	}
+
+	home = g_file_new_for_path (g_get_home_dir ());
+	stale = !g_file_equal (home, index->root);
+	g_object_unref (home);
+
+	return stale;
+}
+
+/* The overlay */
+
+static void
+overlay_node_free (Index *index, OverlayNode *node)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (node->children != NULL) {
+		g_hash_table_iter_init (&iter, node->children);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			overlay_node_free (index, value);
+		}
+		g_hash_table_destroy (node->children);
+	}
+
+	/* The entry stays removed. */
+	if (node->entry != NO_ENTRY) {
+		g_hash_table_remove (index->moved_entries, ENTRY_KEY (node->entry));
+	}
+
+	g_free (node->name);
+	g_free (node->key);
+	g_free (node);
+}
+
+static void
+overlay_node_detach (OverlayNode *node)
+{
+	if (node->parent != NULL) {
+		g_hash_table_remove (node->parent->children, node->name);
+		node->parent = NULL;
+	}
+}
+
+static OverlayNode *
+overlay_node_get_child (OverlayNode *node, const char *name)
+{
+	if (node->children == NULL) {
+		return NULL;
+	}
+
+	return g_hash_table_lookup (node->children, name);
+}
+
+/* Returns the node for path, a path relative to the root. */
+static OverlayNode *
+overlay_lookup (Index *index, const char *path, gboolean create)
+{
+	OverlayNode *node, *child;
+	char **components;
+	int i;
+
+	components = g_strsplit (path, G_DIR_SEPARATOR_S, -1);
+
+	node = index->overlay;
+	for (i = 0; components[i] != NULL && node != NULL; i++) {
+		if (components[i][0] == '\0') {
+			continue;
+		}
+
+		child = overlay_node_get_child (node, components[i]);
+		if (child == NULL && create) {
+			child = overlay_node_new (node, components[i]);
+		}
+		node = child;
+	}
+
+	g_strfreev (components);
+
+	return node;
+}
+
+/* Frees the nodes that no longer hold anything, from node up. */
+static void
+overlay_node_prune (Index *index, OverlayNode *node)
+{
+	OverlayNode *parent;
+
+	while (node != NULL && node != index->overlay &&
+	       node->key == NULL && node->entry == NO_ENTRY &&
+	       (node->children == NULL || g_hash_table_size (node->children) == 0)) {
+		parent = node->parent;
+		overlay_node_detach (node);
+		overlay_node_free (index, node);
+		node = parent;
+	}
+}
+
+static void
+overlay_node_append_path (OverlayNode *node, GString *path)
+{
+	if (node->parent == NULL) {
+		return;
+	}
+
+	overlay_node_append_path (node->parent, path);
+	if (path->len > 0) {
+		g_string_append_c (path, G_DIR_SEPARATOR);
+	}
+	g_string_append (path, node->name);
+}
+
+/* Lookups */
+
+static const char *
+entry_name (Index *index, guint32 id)
+{
+	return index->strings + index->entries[id].name;
+}
+
+static gboolean
+entry_is_removed (Index *index, guint32 id)
+{
+	return g_hash_table_lookup_extended (index->removed_entries, ENTRY_KEY (id), NULL, NULL);
+}
+
+static guint32
+find_child (Index *index, guint32 parent, const char *name)
+{
+	const IndexEntry *entry;
+	guint32 low, high, middle;
+	int cmp;
+
+	entry = &index->entries[parent];
+	low = entry->first_child;
+	high = entry->first_child + entry->n_children;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		cmp = strcmp (entry_name (index, middle), name);
+		if (cmp == 0) {
+			return middle;
+		}
+		if (cmp < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return NO_ENTRY;
+}
+
+/* Returns the path of location relative to the root of the index,
+ * or NULL if the index doesn't cover it.
+ */
+static char *
+get_relative_path (Index *index, GFile *location)
+{
+	char *path;
+
+	if (g_file_equal (index->root, location)) {
+		return g_strdup ("");
+	}
+
+	path = g_file_get_relative_path (index->root, location);
+	if (path != NULL && relative_path_is_hidden (path)) {
+		g_free (path);
+		return NULL;
+	}
+
+	return path;
+}
+
+/* Returns the entry that is at path now. */
+static guint32
+lookup_entry (Index *index, const char *path)
+{
+	OverlayNode *node;
+	char **components;
+	guint32 id, start_id;
+	int i, start;
+
+	components = g_strsplit (path, G_DIR_SEPARATOR_S, -1);
+
+	/* The descendants of a moved directory are found below its
+	 * new location. Take the innermost one of those if there are
+	 * many, and look up the rest in the index from there.
+	 */
+	id = 0;
+	start = 0;
+	node = index->overlay;
+	for (i = 0; components[i] != NULL && node != NULL; i++) {
+		if (components[i][0] == '\0') {
+			continue;
+		}
+		node = overlay_node_get_child (node, components[i]);
+		if (node != NULL && node->entry != NO_ENTRY) {
+			id = node->entry;
+			start = i + 1;
+		}
+	}
+
+	start_id = id;
+	for (i = start; components[i] != NULL && id != NO_ENTRY; i++) {
+		if (components[i][0] == '\0') {
+			continue;
+		}
+
+		/* Only the last component may be a removed entry, the
+		 * caller wants to know about those. Moved ones are no
+		 * longer here at all.
+		 */
+		if (id != start_id && entry_is_removed (index, id)) {
+			id = NO_ENTRY;
+			break;
+		}
+
+		id = find_child (index, id, components[i]);
+		if (id != NO_ENTRY &&
+		    g_hash_table_lookup (index->moved_entries, ENTRY_KEY (id)) != NULL) {
+			id = NO_ENTRY;
+		}
+	}
+
+	g_strfreev (components);
+
+	return id;
+}
+
+static gboolean
+append_entry_path (Index *index, guint32 id, GString *path)
+{
+	OverlayNode *node;
+
+	if (id == 0) {
+		return TRUE;
+	}
+
+	node = g_hash_table_lookup (index->moved_entries, ENTRY_KEY (id));
+	if (node != NULL) {
+		overlay_node_append_path (node, path);
+		return TRUE;
+	}
+
+	if (entry_is_removed (index, id) ||
+	    !append_entry_path (index, index->entries[id].parent, path)) {
+		return FALSE;
+	}
+
+	if (path->len > 0) {
+		g_string_append_c (path, G_DIR_SEPARATOR);
+	}
+	g_string_append (path, entry_name (index, id));
+
+	return TRUE;
+}
+
+/* Sets path to where the entry is now, relative to the root. Returns
+ * FALSE if it is gone.
+ */
+static gboolean
+get_entry_path (Index *index, guint32 id, GString *path)
+{
+	/* Moved entries are reported as new files. */
+	if (entry_is_removed (index, id)) {
+		return FALSE;
+	}
+
+	g_string_truncate (path, 0);
+
+	return append_entry_path (index, id, path);
+}
+
+static char *
+make_uri (Index *index, const char *path)
+{
+	const char *root_uri;
+	char *escaped, *uri;
+
+	root_uri = index->strings + index->header->root_uri;
+	escaped = g_uri_escape_string (path, G_URI_RESERVED_CHARS_ALLOWED_IN_PATH, FALSE);
+	if (g_str_has_suffix (root_uri, "/")) {
+		uri = g_strconcat (root_uri, escaped, NULL);
+	} else {
+		uri = g_strconcat (root_uri, "/", escaped, NULL);
+	}
+	g_free (escaped);
+
+	return uri;
+}
+
+/* TRUE if path is below the directory at prefix, both relative to the
+ * root.
+ */
+static gboolean
+path_has_prefix (const char *path, const char *prefix)
+{
+	gsize len;
+
+	if (prefix[0] == '\0') {
+		return TRUE;
+	}
+
+	len = strlen (prefix);
+	return strncmp (path, prefix, len) == 0 && path[len] == G_DIR_SEPARATOR;
+}
+
+static const IndexTrigram *
+find_trigram (Index *index, guint32 value)
+{
+	const IndexTrigram *trigram;
+	guint32 low, high, middle;
+
+	low = 0;
+	high = index->header->n_trigrams;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		trigram = &index->trigrams[middle];
+		if (trigram->trigram == value) {
+			return trigram;
+		}
+		if (trigram->trigram < value) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return NULL;
+}
+
+gboolean
+nautilus_search_index_covers (GFile *location)
+{
+	char *path;
+	gboolean covered;
+
+	if (current_index == NULL) {
+		return FALSE;
+	}
+
+	path = get_relative_path (current_index, location);
+	covered = path != NULL;
+	g_free (path);
+
+	return covered;
+}
+
+/* Queries, in a thread of their own */
+
+static void
+index_query_free (IndexQuery *query)
+{
+	index_unref (query->index);
+	g_free (query->path);
+	g_strfreev (query->words);
+	g_object_unref (query->cancellable);
+	g_mutex_clear (&query->hits_lock);
+	g_list_free_full (query->hits, g_free);
+	g_free (query);
+}
+
+/* Reports the hits found so far, and the end of the query once the
+ * thread is done. There is at most one of these pending.
+ */
+static gboolean
+index_query_report_idle (gpointer user_data)
+{
+	IndexQuery *query;
+	GList *hits;
+	gboolean finished;
+
+	query = user_data;
+
+	g_mutex_lock (&query->hits_lock);
+	hits = query->hits;
+	query->hits = NULL;
+	finished = query->finished;
+	query->report_scheduled = FALSE;
+	g_mutex_unlock (&query->hits_lock);
+
+	/* Queries are cancelled from the main loop too, so the caller
+	 * hears nothing after that.
+	 */
+	if (!g_cancellable_is_cancelled (query->cancellable) &&
+	    (hits != NULL || finished)) {
+		(* query->callback) (hits, finished, query->callback_data);
+	}
+	g_list_free_full (hits, g_free);
+
+	if (finished) {
+		index_query_free (query);
+	}
+
+	return FALSE;
+}
+
+/* Once finished is passed, query may be freed at any time. */
+static void
+index_query_add_hits (IndexQuery *query,
+		      GList *hits,
+		      gboolean finished)
+{
+	g_mutex_lock (&query->hits_lock);
+
+	query->hits = g_list_concat (hits, query->hits);
+	if (finished) {
+		query->finished = TRUE;
+	}
+
+	if (!query->report_scheduled &&
+	    (query->hits != NULL || query->finished)) {
+		query->report_scheduled = TRUE;
+		g_idle_add (index_query_report_idle, query);
+	}
+
+	g_mutex_unlock (&query->hits_lock);
+}
+
+/* Turns the matching entries into URIs of the files below the
+ * location, and hands them over.
+ */
+static void
+index_query_add_entries (IndexQuery *query,
+			 GArray *ids)
+{
+	Index *index;
+	GString *path;
+	GList *hits;
+	guint i;
+
+	index = query->index;
+	path = g_string_new (NULL);
+	hits = NULL;
+
+	g_mutex_lock (&index->lock);
+	for (i = 0; i < ids->len; i++) {
+		if (get_entry_path (index, g_array_index (ids, guint32, i), path) &&
+		    path_has_prefix (path->str, query->path)) {
+			hits = g_list_prepend (hits, make_uri (index, path->str));
+		}
+	}
+	g_mutex_unlock (&index->lock);
+
+	g_string_free (path, TRUE);
+	g_array_set_size (ids, 0);
+
+	if (hits != NULL) {
+		index_query_add_hits (query, hits, FALSE);
+	}
+}
+
+static void
+index_query_add_overlay (IndexQuery *query,
+			 OverlayNode *node,
+			 GString *path,
+			 GList **hits)
+{
+	GHashTableIter iter;
+	gpointer value;
+	OverlayNode *child;
+	gsize len;
+
+	if (node->children == NULL) {
+		return;
+	}
+
+	len = path->len;
+	g_hash_table_iter_init (&iter, node->children);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		child = value;
+
+		if (len > 0) {
+			g_string_append_c (path, G_DIR_SEPARATOR);
+		}
+		g_string_append (path, child->name);
+
+		if (child->key != NULL && key_matches (child->key, query->words)) {
+			*hits = g_list_prepend (*hits, make_uri (query->index, path->str));
+		}
+		index_query_add_overlay (query, child, path, hits);
+
+		g_string_truncate (path, len);
+	}
+}
+
+/* Hands over the new files below the location that match. */
+static void
+index_query_add_new_files (IndexQuery *query)
+{
+	Index *index;
+	OverlayNode *node;
+	GString *path;
+	GList *hits;
+
+	index = query->index;
+	path = g_string_new (query->path);
+	hits = NULL;
+
+	g_mutex_lock (&index->lock);
+	node = overlay_lookup (index, query->path, FALSE);
+	if (node != NULL) {
+		index_query_add_overlay (query, node, path, &hits);
+	}
+	g_mutex_unlock (&index->lock);
+
+	g_string_free (path, TRUE);
+
+	if (hits != NULL) {
+		index_query_add_hits (query, hits, FALSE);
+	}
+}
+
+static void index_query_check_directories (IndexQuery *query);
+
+static gpointer
+index_query_thread_func (gpointer user_data)
+{
+	IndexQuery *query;
+	Index *index;
+	const IndexTrigram *trigram;
+	const guint32 *candidates;
+	GArray *ids;
+	guint32 n_candidates, id, i;
+	gsize len, j;
+	int w;
+
+	query = user_data;
+	index = query->index;
+
+	index_query_check_directories (query);
+
+	/* Only look at the entries with the rarest trigram of the
+	 * query. Words too short to have one leave all the entries.
+	 */
+	candidates = NULL;
+	n_candidates = index->header->n_entries;
+	for (w = 0; query->words[w] != NULL && n_candidates > 0; w++) {
+		len = strlen (query->words[w]);
+		for (j = 0; j + 2 < len; j++) {
+			trigram = find_trigram (index, TRIGRAM (query->words[w] + j));
+			if (trigram == NULL) {
+				n_candidates = 0;
+				break;
+			}
+			if (trigram->n_postings < n_candidates || candidates == NULL) {
+				candidates = index->postings + trigram->first_posting;
+				n_candidates = trigram->n_postings;
+			}
+		}
+	}
+
+	/* The entries and their keys never change, only their
+	 * locations need the lock.
+	 */
+	ids = g_array_sized_new (FALSE, FALSE, sizeof (guint32), QUERY_BATCH_SIZE);
+	for (i = 0; i < n_candidates; i++) {
+		if (i % QUERY_CANCEL_CHECK == 0 &&
+		    g_cancellable_is_cancelled (query->cancellable)) {
+			break;
+		}
+
+		id = candidates != NULL ? candidates[i] : i;
+		if (id == 0 ||
+		    !key_matches (index->strings + index->entries[id].key, query->words)) {
+			continue;
+		}
+
+		g_array_append_val (ids, id);
+		if (ids->len == QUERY_BATCH_SIZE) {
+			index_query_add_entries (query, ids);
+		}
+	}
+	index_query_add_entries (query, ids);
+	g_array_free (ids, TRUE);
+
+	if (!g_cancellable_is_cancelled (query->cancellable)) {
+		index_query_add_new_files (query);
+	}
+
+	index_query_add_hits (query, NULL, TRUE);
+
+	return NULL;
+}
+
+void
+nautilus_search_index_query_async (GFile *location,
+				   char **words,
+				   GCancellable *cancellable,
+				   NautilusSearchIndexHitsFunc callback,
+				   gpointer callback_data)
+{
+	IndexQuery *query;
+	GThread *thread;
+
+	g_return_if_fail (nautilus_search_index_covers (location));
+	g_return_if_fail (G_IS_CANCELLABLE (cancellable));
+
+	query = g_new0 (IndexQuery, 1);
+	query->index = index_ref (current_index);
+	query->path = get_relative_path (current_index, location);
+	query->words = g_strdupv (words);
+	query->cancellable = g_object_ref (cancellable);
+	query->callback = callback;
+	query->callback_data = callback_data;
+	g_mutex_init (&query->hits_lock);
+
+	thread = g_thread_new ("nautilus-search-index-query", index_query_thread_func, query);
+	g_thread_unref (thread);
+}
+
+/* Changes, made under the lock of the index */
+
+/* mtime is that of the new file if it is a directory and is known,
+ * or 0.
+ */
+static void
+add_path (Index *index, const char *path, const char *key, gint64 mtime)
+{
+	OverlayNode *node;
+	guint32 id;
+
+	id = lookup_entry (index, path);
+	if (id == NO_ENTRY || entry_is_removed (index, id)) {
+		node = overlay_lookup (index, path, TRUE);
+		g_free (node->key);
+		node->key = g_strdup (key);
+		if (mtime != 0) {
+			node->mtime = mtime;
+		}
+	}
+}
+
+static void
+add_file (Index *index, GFile *location)
+{
+	char *path, *key;
+
+	path = get_relative_path (index, location);
+	if (path != NULL && path[0] != '\0') {
+		key = make_key_for_location (location);
+		add_path (index, path, key, 0);
+		g_free (key);
+	}
+	g_free (path);
+}
+
+static void
+remove_path (Index *index, const char *path)
+{
+	OverlayNode *node, *parent;
+	guint32 id;
+
+	id = lookup_entry (index, path);
+	if (id != NO_ENTRY) {
+		g_hash_table_insert (index->removed_entries, ENTRY_KEY (id), NULL);
+	}
+
+	/* Takes the new files and the entries moved below it along. */
+	node = overlay_lookup (index, path, FALSE);
+	if (node != NULL && node != index->overlay) {
+		parent = node->parent;
+		overlay_node_detach (node);
+		overlay_node_free (index, node);
+		overlay_node_prune (index, parent);
+	}
+}
+
+static void
+remove_file (Index *index, GFile *location)
+{
+	char *path;
+
+	path = get_relative_path (index, location);
+	if (path != NULL && path[0] != '\0') {
+		remove_path (index, path);
+	}
+	g_free (path);
+}
+
+static void
+move_file (Index *index, GFile *from, GFile *to)
+{
+	OverlayNode *node, *old_parent, *parent;
+	char *from_path, *to_path, *dirname;
+	guint32 id;
+
+	from_path = get_relative_path (index, from);
+	to_path = get_relative_path (index, to);
+
+	if (to_path == NULL || to_path[0] == '\0') {
+		remove_file (index, from);
+		goto out;
+	}
+	if (from_path == NULL || from_path[0] == '\0') {
+		add_file (index, to);
+		goto out;
+	}
+	if (strcmp (from_path, to_path) == 0) {
+		goto out;
+	}
+
+	/* A directory that was moved before is found at its new
+	 * location, and removed already.
+	 */
+	id = lookup_entry (index, from_path);
+	if (id != NO_ENTRY &&
+	    entry_is_removed (index, id) &&
+	    g_hash_table_lookup (index->moved_entries, ENTRY_KEY (id)) == NULL) {
+		id = NO_ENTRY;
+	}
+
+	/* Whatever was at to is replaced. */
+	remove_path (index, to_path);
+
+	/* Whatever changed below from is below to now. */
+	node = overlay_lookup (index, from_path, FALSE);
+	if (node != NULL) {
+		old_parent = node->parent;
+		overlay_node_detach (node);
+
+		dirname = g_path_get_dirname (to_path);
+		parent = overlay_lookup (index, strcmp (dirname, ".") == 0 ? "" : dirname, TRUE);
+		g_free (dirname);
+
+		g_free (node->name);
+		node->name = g_path_get_basename (to_path);
+		overlay_node_attach (node, parent);
+
+		overlay_node_prune (index, old_parent);
+	}
+
+	if (id != NO_ENTRY) {
+		if (node == NULL) {
+			node = overlay_lookup (index, to_path, TRUE);
+		}
+		g_hash_table_insert (index->removed_entries, ENTRY_KEY (id), NULL);
+		node->entry = id;
+		g_hash_table_insert (index->moved_entries, ENTRY_KEY (id), node);
+	}
+
+	/* The moved file itself is reported as a new one. */
+	add_file (index, to);
+
+ out:
+	g_free (from_path);
+	g_free (to_path);
+}
+
+/* Checking, in the query threads */
+
+static GFile *
+get_location_for_path (Index *index, const char *path)
+{
+	if (path[0] == '\0') {
+		return g_object_ref (index->root);
+	}
+
+	return g_file_resolve_relative_path (index->root, path);
+}
+
+static void
+append_path_component (GString *path, const char *name)
+{
+	if (path->len > 0) {
+		g_string_append_c (path, G_DIR_SEPARATOR);
+	}
+	g_string_append (path, name);
+}
+
+static gint64
+entry_get_mtime (Index *index, guint32 id)
+{
+	const IndexEntry *entry;
+	gint64 *mtime;
+
+	mtime = g_hash_table_lookup (index->directory_mtimes, ENTRY_KEY (id));
+	if (mtime != NULL) {
+		return *mtime;
+	}
+
+	entry = &index->entries[id];
+	return (gint64) entry->mtime * G_USEC_PER_SEC + entry->mtime_usec;
+}
+
+static void
+check_directory_push (GQueue *directories,
+		      const char *path,
+		      gint64 mtime,
+		      gboolean is_new)
+{
+	CheckDirectory *directory;
+
+	directory = g_new (CheckDirectory, 1);
+	directory->path = g_strdup (path);
+	directory->mtime = mtime;
+	directory->is_new = is_new;
+	g_queue_push_tail (directories, directory);
+}
+
+static void
+check_directory_free (CheckDirectory *directory)
+{
+	g_free (directory->path);
+	g_free (directory);
+}
+
+/* Queues the entry at path if it is a directory, and the directories
+ * below it.
+ */
+static void
+check_add_entry (Index *index,
+		 guint32 id,
+		 GString *path,
+		 GQueue *directories)
+{
+	const IndexEntry *entry;
+	guint32 child;
+	gsize len;
+
+	entry = &index->entries[id];
+	if ((entry->flags & ENTRY_IS_DIRECTORY) == 0) {
+		return;
+	}
+
+	check_directory_push (directories, path->str, entry_get_mtime (index, id), FALSE);
+
+	len = path->len;
+	for (child = entry->first_child; child < entry->first_child + entry->n_children; child++) {
+		/* Those moved elsewhere are found through the overlay. */
+		if ((index->entries[child].flags & ENTRY_IS_DIRECTORY) == 0 ||
+		    entry_is_removed (index, child)) {
+			continue;
+		}
+
+		append_path_component (path, entry_name (index, child));
+		check_add_entry (index, child, path, directories);
+		g_string_truncate (path, len);
+	}
+}
+
+/* Queues the directories below node that were moved or added there. */
+static void
+check_add_overlay (Index *index,
+		   OverlayNode *node,
+		   GString *path,
+		   GQueue *directories)
+{
+	GHashTableIter iter;
+	gpointer value;
+	OverlayNode *child;
+	gsize len;
+
+	if (node->children == NULL) {
+		return;
+	}
+
+	len = path->len;
+	g_hash_table_iter_init (&iter, node->children);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		child = value;
+		append_path_component (path, child->name);
+
+		if (child->entry != NO_ENTRY) {
+			check_add_entry (index, child->entry, path, directories);
+		} else if (child->key != NULL && child->mtime != NOT_A_DIRECTORY) {
+			check_directory_push (directories, path->str, child->mtime, FALSE);
+		}
+		check_add_overlay (index, child, path, directories);
+
+		g_string_truncate (path, len);
+	}
+}
+
+/* Brings the index in line with children, what the directory at path
+ * holds now, and remembers mtime for it. Directories that are new to
+ * the index are queued to be read as well.
+ */
+static void
+check_apply_children (Index *index,
+		      const char *path,
+		      GArray *children,
+		      gint64 mtime,
+		      GQueue *directories)
+{
+	GHashTable *known, *present;
+	GHashTableIter iter;
+	OverlayNode *node, *child_node;
+	BuildChild *c;
+	GString *child_path;
+	GList *gone, *l;
+	gpointer key, value;
+	gint64 *entry_mtime;
+	guint32 id, child;
+	gsize len;
+	guint i;
+
+	id = lookup_entry (index, path);
+	if (id != NO_ENTRY &&
+	    entry_is_removed (index, id) &&
+	    g_hash_table_lookup (index->moved_entries, ENTRY_KEY (id)) == NULL) {
+		id = NO_ENTRY;
+	}
+	node = overlay_lookup (index, path, FALSE);
+
+	/* Removed while it was being read. */
+	if (id == NO_ENTRY && (node == NULL || node->key == NULL)) {
+		return;
+	}
+
+	if (id != NO_ENTRY) {
+		entry_mtime = g_new (gint64, 1);
+		*entry_mtime = mtime;
+		g_hash_table_insert (index->directory_mtimes, ENTRY_KEY (id), entry_mtime);
+	} else {
+		node->mtime = mtime;
+	}
+
+	/* The names of the files the index has there. */
+	known = g_hash_table_new (g_str_hash, g_str_equal);
+	if (id != NO_ENTRY) {
+		for (child = index->entries[id].first_child;
+		     child < index->entries[id].first_child + index->entries[id].n_children;
+		     child++) {
+			if (!entry_is_removed (index, child)) {
+				g_hash_table_insert (known, (char *) entry_name (index, child), NULL);
+			}
+		}
+	}
+	if (node != NULL && node->children != NULL) {
+		g_hash_table_iter_init (&iter, node->children);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			child_node = value;
+			if (child_node->key != NULL) {
+				g_hash_table_insert (known, key, NULL);
+			}
+		}
+	}
+
+	child_path = g_string_new (path);
+	len = child_path->len;
+
+	present = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < children->len; i++) {
+		c = &g_array_index (children, BuildChild, i);
+		g_hash_table_insert (present, c->name, NULL);
+		if (g_hash_table_lookup_extended (known, c->name, NULL, NULL)) {
+			continue;
+		}
+
+		append_path_component (child_path, c->name);
+		add_path (index, child_path->str, c->key,
+			  c->is_directory ? c->mtime : NOT_A_DIRECTORY);
+		if (c->is_directory) {
+			check_directory_push (directories, child_path->str, c->mtime, TRUE);
+		}
+		g_string_truncate (child_path, len);
+	}
+
+	/* Removing frees the names in known. */
+	gone = NULL;
+	g_hash_table_iter_init (&iter, known);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_lookup_extended (present, key, NULL, NULL)) {
+			append_path_component (child_path, key);
+			gone = g_list_prepend (gone, g_strdup (child_path->str));
+			g_string_truncate (child_path, len);
+		}
+	}
+	for (l = gone; l != NULL; l = l->next) {
+		remove_path (index, l->data);
+	}
+
+	g_list_free_full (gone, g_free);
+	g_hash_table_destroy (present);
+	g_hash_table_destroy (known);
+	g_string_free (child_path, TRUE);
+}
+
+/* Reads the directory again if it changed since it was last seen. */
+static void
+index_query_check_directory (IndexQuery *query,
+			     CheckDirectory *directory,
+			     GQueue *directories)
+{
+	Index *index;
+	OverlayNode *node;
+	GFileInfo *info;
+	GFile *location;
+	GArray *children;
+	GError *error;
+	gboolean gone;
+	gint64 mtime;
+	guint i;
+
+	index = query->index;
+	location = get_location_for_path (index, directory->path);
+	mtime = directory->mtime;
+
+	if (!directory->is_new) {
+		error = NULL;
+		info = g_file_query_info (location,
+					  G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+					  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+					  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+					  0, query->cancellable, &error);
+		if (info == NULL) {
+			gone = g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+			g_error_free (error);
+
+			if (gone && directory->path[0] != '\0') {
+				g_mutex_lock (&index->lock);
+				remove_path (index, directory->path);
+				g_mutex_unlock (&index->lock);
+			}
+			goto out;
+		}
+
+		if (g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY) {
+			g_object_unref (info);
+
+			/* Don't look at a new file again. */
+			g_mutex_lock (&index->lock);
+			node = overlay_lookup (index, directory->path, FALSE);
+			if (node != NULL && node->entry == NO_ENTRY) {
+				node->mtime = NOT_A_DIRECTORY;
+			}
+			g_mutex_unlock (&index->lock);
+			goto out;
+		}
+
+		mtime = get_info_mtime (info);
+		g_object_unref (info);
+		if (mtime == directory->mtime) {
+			goto out;
+		}
+	}
+
+	/* Links to directories that weren't crawled aren't followed,
+	 * they may lead anywhere.
+	 */
+	children = read_children (location, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				  query->cancellable);
+	if (children != NULL) {
+		g_mutex_lock (&index->lock);
+		check_apply_children (index, directory->path, children, mtime, directories);
+		g_mutex_unlock (&index->lock);
+
+		for (i = 0; i < children->len; i++) {
+			build_child_clear (&g_array_index (children, BuildChild, i));
+		}
+		g_array_free (children, TRUE);
+	}
+
+ out:
+	g_object_unref (location);
+}
+
+/* Catches up with what other programs changed below the location of
+ * the query, before names are looked for.
+ */
+static void
+index_query_check_directories (IndexQuery *query)
+{
+	Index *index;
+	OverlayNode *node;
+	CheckDirectory *directory;
+	GString *path;
+	guint32 id;
+	gboolean found;
+	GQueue directories = G_QUEUE_INIT;
+
+	index = query->index;
+	path = g_string_new (query->path);
+
+	g_mutex_lock (&index->lock);
+	id = lookup_entry (index, query->path);
+	found = id != NO_ENTRY &&
+		(!entry_is_removed (index, id) ||
+		 g_hash_table_lookup (index->moved_entries, ENTRY_KEY (id)) != NULL);
+	if (found) {
+		check_add_entry (index, id, path, &directories);
+	}
+
+	node = overlay_lookup (index, query->path, FALSE);
+	if (node != NULL) {
+		if (!found && node->entry == NO_ENTRY &&
+		    node->key != NULL && node->mtime != NOT_A_DIRECTORY) {
+			check_directory_push (&directories, query->path, node->mtime, FALSE);
+		}
+		check_add_overlay (index, node, path, &directories);
+	}
+	g_mutex_unlock (&index->lock);
+
+	g_string_free (path, TRUE);
+
+	while ((directory = g_queue_pop_head (&directories)) != NULL) {
+		if (!g_cancellable_is_cancelled (query->cancellable)) {
+			index_query_check_directory (query, directory, &directories);
+		}
+		check_directory_free (directory);
+	}
+}
+
+static void
+journal_record_free (JournalRecord *record)
+{
+	GFilePair *pair;
+	GList *l;
+
+	if (record->kind == JOURNAL_MOVED) {
+		for (l = record->files; l != NULL; l = l->next) {
+			pair = l->data;
+			g_object_unref (pair->from);
+			g_object_unref (pair->to);
+			g_free (pair);
+		}
+		g_list_free (record->files);
+	} else {
+		g_list_free_full (record->files, g_object_unref);
+	}
+	g_free (record);
+}
+
+static void
+journal_clear (void)
+{
+	g_list_free_full (journal, (GDestroyNotify) journal_record_free);
+	journal = NULL;
+	journal_n_files = 0;
+}
+
+static void
+journal_add (JournalKind kind, GList *files)
+{
+	JournalRecord *record;
+	GFilePair *pair, *copy;
+	GList *l;
+	guint n_files;
+
+	if (journal_overflowed) {
+		return;
+	}
+
+	/* Rather than keep up with that many changes, index again. */
+	n_files = g_list_length (files);
+	if (journal_n_files + n_files > JOURNAL_MAX_FILES) {
+		journal_clear ();
+		journal_overflowed = TRUE;
+		return;
+	}
+	journal_n_files += n_files;
+
+	record = g_new0 (JournalRecord, 1);
+	record->kind = kind;
+
+	for (l = files; l != NULL; l = l->next) {
+		if (kind == JOURNAL_MOVED) {
+			pair = l->data;
+			copy = g_new (GFilePair, 1);
+			copy->from = g_object_ref (pair->from);
+			copy->to = g_object_ref (pair->to);
+			record->files = g_list_prepend (record->files, copy);
+		} else {
+			record->files = g_list_prepend (record->files,
+							g_object_ref (l->data));
+		}
+	}
+	record->files = g_list_reverse (record->files);
+
+	journal = g_list_prepend (journal, record);
+}
+
+void
+nautilus_search_index_notify_files_added (GList *files)
+{
+	GList *l;
+
+	if (building) {
+		journal_add (JOURNAL_ADDED, files);
+	}
+
+	if (current_index == NULL) {
+		return;
+	}
+
+	g_mutex_lock (&current_index->lock);
+	for (l = files; l != NULL; l = l->next) {
+		add_file (current_index, l->data);
+	}
+	g_mutex_unlock (&current_index->lock);
+}
+
+void
+nautilus_search_index_notify_files_removed (GList *files)
+{
+	GList *l;
+
+	if (building) {
+		journal_add (JOURNAL_REMOVED, files);
+	}
+
+	if (current_index == NULL) {
+		return;
+	}
+
+	g_mutex_lock (&current_index->lock);
+	for (l = files; l != NULL; l = l->next) {
+		remove_file (current_index, l->data);
+	}
+	g_mutex_unlock (&current_index->lock);
+}
+
+void
+nautilus_search_index_notify_files_moved (GList *file_pairs)
+{
+	GFilePair *pair;
+	GList *l;
+
+	if (building) {
+		journal_add (JOURNAL_MOVED, file_pairs);
+	}
+
+	if (current_index == NULL) {
+		return;
+	}
+
+	g_mutex_lock (&current_index->lock);
+	for (l = file_pairs; l != NULL; l = l->next) {
+		pair = l->data;
+		move_file (current_index, pair->from, pair->to);
+	}
+	g_mutex_unlock (&current_index->lock);
+}
+
+/* Forgets the modification time of the directory at location, so
+ * that the next query reads it.
+ */
+static void
+change_directory (Index *index, GFile *location)
+{
+	OverlayNode *node;
+	gint64 *mtime;
+	char *path;
+	guint32 id;
+
+	path = get_relative_path (index, location);
+	if (path == NULL) {
+		return;
+	}
+
+	id = lookup_entry (index, path);
+	if (id != NO_ENTRY &&
+	    (!entry_is_removed (index, id) ||
+	     g_hash_table_lookup (index->moved_entries, ENTRY_KEY (id)) != NULL)) {
+		mtime = g_new0 (gint64, 1);
+		g_hash_table_insert (index->directory_mtimes, ENTRY_KEY (id), mtime);
+	} else {
+		node = overlay_lookup (index, path, FALSE);
+		if (node != NULL && node->key != NULL) {
+			node->mtime = 0;
+		}
+	}
+
+	g_free (path);
+}
+
+void
+nautilus_search_index_notify_directory_changed (GFile *location)
+{
+	GList *files;
+
+	if (building) {
+		files = g_list_prepend (NULL, location);
+		journal_add (JOURNAL_CHANGED, files);
+		g_list_free (files);
+	}
+
+	if (current_index == NULL) {
+		return;
+	}
+
+	g_mutex_lock (&current_index->lock);
+	change_directory (current_index, location);
+	g_mutex_unlock (&current_index->lock);
+}
+
+static gboolean
+build_done_idle (gpointer user_data)
+{
+	IndexBuilder *builder;
+	JournalRecord *record;
+	Index *index;
+	gboolean overflowed;
+	GList *l;
+
+	builder = user_data;
+	building = FALSE;
+	overflowed = journal_overflowed;
+	journal_overflowed = FALSE;
+
+	index = NULL;
+	if (builder->succeeded) {
+		index = index_load (builder->path);
+	}
+
+	if (index != NULL) {
+		/* Queries still running keep the old one. */
+		index_unref (current_index);
+		current_index = index;
+
+		/* Some of these may have happened after the crawler went
+		 * by, apply them again.
+		 */
+		journal = g_list_reverse (journal);
+		for (l = journal; l != NULL; l = l->next) {
+			record = l->data;
+			switch (record->kind) {
+			case JOURNAL_ADDED:
+				nautilus_search_index_notify_files_added (record->files);
+				break;
+			case JOURNAL_REMOVED:
+				nautilus_search_index_notify_files_removed (record->files);
+				break;
+			case JOURNAL_MOVED:
+				nautilus_search_index_notify_files_moved (record->files);
+				break;
+			case JOURNAL_CHANGED:
+				nautilus_search_index_notify_directory_changed (record->files->data);
+				break;
+			}
+		}
+	}
+
+	journal_clear ();
+
+	g_object_unref (builder->root);
+	g_free (builder->path);
+	g_free (builder);
+
+	/* Too much changed while crawling for the new index to be
+	 * trusted.
+	 */
+	if (index != NULL && overflowed) {
+		start_build ();
+	}
+
+	return FALSE;
+}
+
+static gboolean
+rebuild_timeout (gpointer user_data)
+{
+	start_build ();
+
+	return TRUE;
+}
+
+void
+nautilus_search_index_ensure (void)
+{
+	static gboolean initialized = FALSE;
+
+	if (initialized) {
+		return;
+	}
+	initialized = TRUE;
+
+	index_path = get_index_path ();
+	current_index = index_load (index_path);
+	if (current_index == NULL || index_is_stale (current_index)) {
+		start_build ();
+	}
+
+	g_timeout_add_seconds (INDEX_MAX_AGE, rebuild_timeout, NULL);
+}
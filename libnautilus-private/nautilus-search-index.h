@@ -0,0 +1,60 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-search-index.h: persistent index of file names
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef NAUTILUS_SEARCH_INDEX_H
+#define NAUTILUS_SEARCH_INDEX_H
+
+#include <gio/gio.h>
+
+/* Loads the index, or starts building it in the background. */
+void     nautilus_search_index_ensure                (void);
+
+/* TRUE if the index is loaded and covers everything below location. */
+gboolean nautilus_search_index_covers                (GFile       *location);
+
+typedef void (* NautilusSearchIndexHitsFunc) (GList    *uris,
+					      gboolean  finished,
+					      gpointer  callback_data);
+
+/* Looks for the URIs below location whose names contain all the words,
+ * in a thread. The directories below location that changed since the
+ * index last saw them are read again first. The words must be
+ * normalized to NFD and lowercased.
+ * The hits are passed to callback from the main loop in batches, the
+ * last call has finished set. Once cancellable is cancelled, callback
+ * is no longer called.
+ */
+void     nautilus_search_index_query_async           (GFile                      *location,
+						      char                      **words,
+						      GCancellable               *cancellable,
+						      NautilusSearchIndexHitsFunc callback,
+						      gpointer                    callback_data);
+
+/* Keep the index in sync with the changes Nautilus sees. */
+void     nautilus_search_index_notify_files_added    (GList       *files);
+void     nautilus_search_index_notify_files_removed  (GList       *files);
+void     nautilus_search_index_notify_files_moved    (GList       *file_pairs);
+/* Something changed in the directory at location that Nautilus didn't
+ * see. The next query below it reads the directory again.
+ */
+void     nautilus_search_index_notify_directory_changed (GFile    *location);
+
+#endif /* NAUTILUS_SEARCH_INDEX_H */
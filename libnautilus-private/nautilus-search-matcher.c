@@ -0,0 +1,384 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-search-matcher.c: matching file names against search text
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* Names are compared after Unicode normalization and case folding,
+ * which costs two allocations per name. Most names are plain ASCII
+ * though, where both come down to lowercasing the letters. Those are
+ * lowercased into a buffer on the stack instead, and searched with
+ * SSE2 where available: each block of 16 positions is tested for the
+ * first and last byte of a word at once, and only the positions where
+ * both match are compared in full.
+ */
+
+#include <config.h>
+#include "nautilus-search-matcher.h"
+
+#include "nautilus-lib-self-check-functions.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Longer names take the slow path. */
+#define NAME_BUFFER_SIZE 256
+
+/* So that blocks of 16 can be read past the end of the name. */
+#define NAME_BUFFER_PADDING 32
+
+typedef struct {
+	char *text;
+	gsize len;
+} MatcherWord;
+
+struct NautilusSearchMatcher {
+	gboolean prefix;
+	gboolean valid;
+
+	/* Whether the words are ASCII, and lowercasing ASCII gives
+	 * the same as the Unicode case folding here.
+	 */
+	gboolean ascii;
+
+	MatcherWord *words;
+	guint n_words;
+};
+
+static char *
+fold_slow (NautilusSearchMatcher *matcher, const char *text)
+{
+	char *normalized, *folded;
+
+	normalized = g_utf8_normalize (text, -1,
+				       matcher->prefix ? G_NORMALIZE_ALL : G_NORMALIZE_NFD);
+	if (normalized == NULL) {
+		return NULL;
+	}
+
+	if (matcher->prefix) {
+		folded = g_utf8_casefold (normalized, -1);
+	} else {
+		folded = g_utf8_strdown (normalized, -1);
+	}
+	g_free (normalized);
+
+	return folded;
+}
+
+static gboolean
+is_ascii (const char *text)
+{
+	for (; *text != '\0'; text++) {
+		if (*text & 0x80) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+ascii_lowercase_is_plain (NautilusSearchMatcher *matcher)
+{
+	char *lower;
+	gboolean result;
+
+	/* Case folding doesn't depend on the locale, but in Turkish
+	 * g_utf8_strdown turns I into a dotless i.
+	 */
+	if (matcher->prefix) {
+		return TRUE;
+	}
+
+	lower = g_utf8_strdown ("I", -1);
+	result = strcmp (lower, "i") == 0;
+	g_free (lower);
+
+	return result;
+}
+
+static NautilusSearchMatcher *
+matcher_new (const char *text, gboolean prefix)
+{
+	NautilusSearchMatcher *matcher;
+	char *folded;
+	char **words;
+	guint i;
+
+	matcher = g_new0 (NautilusSearchMatcher, 1);
+	matcher->prefix = prefix;
+
+	folded = fold_slow (matcher, text);
+	if (folded == NULL) {
+		return matcher;
+	}
+	matcher->valid = TRUE;
+
+	if (prefix) {
+		words = g_new0 (char *, 2);
+		words[0] = folded;
+	} else {
+		words = g_strsplit (folded, " ", -1);
+		g_free (folded);
+	}
+
+	matcher->n_words = g_strv_length (words);
+	matcher->words = g_new (MatcherWord, matcher->n_words);
+	matcher->ascii = ascii_lowercase_is_plain (matcher);
+	for (i = 0; i < matcher->n_words; i++) {
+		matcher->words[i].text = words[i];
+		matcher->words[i].len = strlen (words[i]);
+		matcher->ascii &= is_ascii (words[i]);
+	}
+	/* The strings now belong to the words. */
+	g_free (words);
+
+	return matcher;
+}
+
+NautilusSearchMatcher *
+nautilus_search_matcher_new (const char *text)
+{
+	return matcher_new (text, FALSE);
+}
+
+NautilusSearchMatcher *
+nautilus_search_matcher_new_prefix (const char *text)
+{
+	return matcher_new (text, TRUE);
+}
+
+void
+nautilus_search_matcher_free (NautilusSearchMatcher *matcher)
+{
+	guint i;
+
+	if (matcher == NULL) {
+		return;
+	}
+
+	for (i = 0; i < matcher->n_words; i++) {
+		g_free (matcher->words[i].text);
+	}
+	g_free (matcher->words);
+	g_free (matcher);
+}
+
+/* Lowercases name into buffer if it is short enough and all ASCII,
+ * and pads it with zeros. Returns the length of name, or -1.
+ */
+static gssize
+fold_ascii (const char *name, char *buffer)
+{
+	gsize len, i;
+	char c;
+#ifdef __SSE2__
+	__m128i chunk, upper;
+#endif
+
+	len = strlen (name);
+	if (len > NAME_BUFFER_SIZE) {
+		return -1;
+	}
+
+	i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		chunk = _mm_loadu_si128 ((const __m128i *) (name + i));
+		if (_mm_movemask_epi8 (chunk) != 0) {
+			return -1;
+		}
+		upper = _mm_and_si128 (_mm_cmpgt_epi8 (chunk, _mm_set1_epi8 ('A' - 1)),
+				       _mm_cmplt_epi8 (chunk, _mm_set1_epi8 ('Z' + 1)));
+		chunk = _mm_add_epi8 (chunk, _mm_and_si128 (upper, _mm_set1_epi8 (0x20)));
+		_mm_storeu_si128 ((__m128i *) (buffer + i), chunk);
+	}
+#endif
+	for (; i < len; i++) {
+		c = name[i];
+		if (c & 0x80) {
+			return -1;
+		}
+		buffer[i] = g_ascii_tolower (c);
+	}
+	memset (buffer + len, 0, NAME_BUFFER_PADDING);
+
+	return len;
+}
+
+/* haystack must be padded as by fold_ascii. */
+static gboolean
+contains_word (const char *haystack, gsize len, const MatcherWord *word)
+{
+#ifdef __SSE2__
+	__m128i first, last, block_first, block_last;
+	gsize i, position;
+	int mask, bit;
+#endif
+
+	if (word->len == 0) {
+		return TRUE;
+	}
+	if (word->len > len) {
+		return FALSE;
+	}
+
+#ifdef __SSE2__
+	first = _mm_set1_epi8 (word->text[0]);
+	last = _mm_set1_epi8 (word->text[word->len - 1]);
+
+	for (i = 0; i + word->len <= len; i += 16) {
+		block_first = _mm_loadu_si128 ((const __m128i *) (haystack + i));
+		block_last = _mm_loadu_si128 ((const __m128i *) (haystack + i + word->len - 1));
+		mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (first, block_first),
+							 _mm_cmpeq_epi8 (last, block_last)));
+
+		for (bit = g_bit_nth_lsf (mask, -1); bit != -1; bit = g_bit_nth_lsf (mask, bit)) {
+			position = i + bit;
+			if (position + word->len > len) {
+				break;
+			}
+			if (word->len <= 2 ||
+			    memcmp (haystack + position + 1, word->text + 1, word->len - 2) == 0) {
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
+#else
+	return strstr (haystack, word->text) != NULL;
+#endif
+}
+
+static gboolean
+matches_folded (NautilusSearchMatcher *matcher,
+		const char *name,
+		gsize len,
+		gboolean padded)
+{
+	MatcherWord *word;
+	guint i;
+
+	for (i = 0; i < matcher->n_words; i++) {
+		word = &matcher->words[i];
+
+		if (matcher->prefix) {
+			if (len < word->len ||
+			    memcmp (name, word->text, word->len) != 0) {
+				return FALSE;
+			}
+		} else if (padded) {
+			if (!contains_word (name, len, word)) {
+				return FALSE;
+			}
+		} else {
+			if (strstr (name, word->text) == NULL) {
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+gboolean
+nautilus_search_matcher_matches (NautilusSearchMatcher *matcher,
+				 const char *name)
+{
+	char buffer[NAME_BUFFER_SIZE + NAME_BUFFER_PADDING];
+	char *folded;
+	gssize len;
+	gboolean result;
+
+	if (!matcher->valid) {
+		return FALSE;
+	}
+
+	if (matcher->ascii) {
+		len = fold_ascii (name, buffer);
+		if (len >= 0) {
+			return matches_folded (matcher, buffer, len, TRUE);
+		}
+	}
+
+	folded = fold_slow (matcher, name);
+	if (folded == NULL) {
+		return FALSE;
+	}
+	result = matches_folded (matcher, folded, strlen (folded), FALSE);
+	g_free (folded);
+
+	return result;
+}
+
+#if !defined (NAUTILUS_OMIT_SELF_CHECK)
+
+static gboolean
+matches_once (const char *text, gboolean prefix, const char *name)
+{
+	NautilusSearchMatcher *matcher;
+	gboolean result;
+
+	matcher = prefix ? nautilus_search_matcher_new_prefix (text) : nautilus_search_matcher_new (text);
+	result = nautilus_search_matcher_matches (matcher, name);
+	nautilus_search_matcher_free (matcher);
+
+	return result;
+}
+
+void
+nautilus_self_check_search_matcher (void)
+{
+	char *long_name;
+
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("foo bar", FALSE, "Bar of FOO.txt"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("foo bar", FALSE, "foobar"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("foo bar", FALSE, "foo"), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("foo bar", FALSE, "fo obar"), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("", FALSE, "anything"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("x", FALSE, "abcdefghijklmnopqrstuvwxyz"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("xyz", FALSE, "abcdefghijklmnopqrstuvwxyz"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("yz", FALSE, "abcdefghijklmnopqrstuvwxy"), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("Report 2011", FALSE, "Annual report for the year 2011 (final).odt"), TRUE);
+
+	/* Non-ASCII names and words */
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("\xc3\xa9t\xc3\xa9", FALSE, "Summer \xc3\x89T\xc3\x89"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("\xc3\xa9t\xc3\xa9", FALSE, "Summer ete"), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("e", FALSE, "\xc3\xa9"), TRUE);
+
+	/* Longer than the buffer */
+	long_name = g_strnfill (NAME_BUFFER_SIZE + 10, 'a');
+	long_name[NAME_BUFFER_SIZE + 5] = 'B';
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("ab", FALSE, long_name), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("ba", FALSE, long_name), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("bb", FALSE, long_name), FALSE);
+	g_free (long_name);
+
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("Rea", TRUE, "readme"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("rea", TRUE, "README"), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("rea", TRUE, "a readme"), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("rea", TRUE, "r\xc3\xa9" "a"), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (matches_once ("readme now", TRUE, "README"), FALSE);
+}
+
+#endif /* !NAUTILUS_OMIT_SELF_CHECK */
@@ -0,0 +1,45 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-search-matcher.h: matching file names against search text
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef NAUTILUS_SEARCH_MATCHER_H
+#define NAUTILUS_SEARCH_MATCHER_H
+
+#include <glib.h>
+
+typedef struct NautilusSearchMatcher NautilusSearchMatcher;
+
+/* Matches names that contain all the space separated words of text,
+ * ignoring case. This is what searches do.
+ */
+NautilusSearchMatcher *nautilus_search_matcher_new        (const char            *text);
+
+/* Matches names that start with text, ignoring case. This is what
+ * typing in a view does.
+ */
+NautilusSearchMatcher *nautilus_search_matcher_new_prefix (const char            *text);
+
+void                   nautilus_search_matcher_free       (NautilusSearchMatcher *matcher);
+
+/* A matcher can be used from several threads at once. */
+gboolean               nautilus_search_matcher_matches    (NautilusSearchMatcher *matcher,
+							   const char            *name);
+
+#endif /* NAUTILUS_SEARCH_MATCHER_H */
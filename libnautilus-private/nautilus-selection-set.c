@@ -0,0 +1,450 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-selection-set.c: ordered set of selected files
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+/* The files are kept in a queue, in the order they were given, and
+ * found through a hash table. What each file adds to the totals is
+ * remembered, so that the totals can be updated when a single file
+ * changes or goes away, without going over all the others.
+ *
+ * The files are also grouped by their application key, so that the
+ * Open With menu only has to look at one file of each kind.
+ *
+ * When the selection changes, the set is brought in line with the new
+ * one rather than built again: the files that stay keep their entries,
+ * so only the files that come and go are looked at.
+ */
+
+#include <config.h>
+#include "nautilus-selection-set.h"
+
+#include "nautilus-lib-self-check-functions.h"
+
+typedef struct {
+	/* data is the file */
+	GList link;
+
+	gboolean is_folder;
+	gboolean item_count_known;
+	guint item_count;
+	gboolean size_known;
+	goffset size;
+
+	/* "" until the file is ready */
+	char *type_key;
+	/* data is the entry, in the queue of its type */
+	GList type_link;
+
+	/* set while nautilus_selection_set_update goes over the files */
+	gboolean kept;
+} SelectionEntry;
+
+struct NautilusSelectionSet {
+	GHashTable *entries;
+	GQueue files;
+	/* type key -> GQueue of entries */
+	GHashTable *types;
+
+	guint folder_count;
+	guint folder_item_count;
+	guint n_unknown_item_counts;
+	guint non_folder_count;
+	goffset non_folder_size;
+	guint n_known_sizes;
+};
+
+static void
+type_queue_free (GQueue *queue)
+{
+	/* The links are part of the entries. */
+	g_queue_init (queue);
+	g_queue_free (queue);
+}
+
+NautilusSelectionSet *
+nautilus_selection_set_new (void)
+{
+	NautilusSelectionSet *set;
+
+	set = g_new0 (NautilusSelectionSet, 1);
+	set->entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_queue_init (&set->files);
+	set->types = g_hash_table_new_full (g_str_hash, g_str_equal,
+					    NULL, (GDestroyNotify) type_queue_free);
+
+	return set;
+}
+
+NautilusSelectionSet *
+nautilus_selection_set_new_from_list (GList *files)
+{
+	NautilusSelectionSet *set;
+	GList *l;
+
+	set = nautilus_selection_set_new ();
+	for (l = files; l != NULL; l = l->next) {
+		nautilus_selection_set_add (set, l->data);
+	}
+
+	return set;
+}
+
+void
+nautilus_selection_set_free (NautilusSelectionSet *set)
+{
+	GList *link;
+
+	if (set == NULL) {
+		return;
+	}
+
+	/* Drop the queues before the keys they are filed under. */
+	g_hash_table_destroy (set->types);
+
+	while ((link = g_queue_pop_head_link (&set->files)) != NULL) {
+		nautilus_file_unref (link->data);
+		g_free (((SelectionEntry *) link)->type_key);
+		g_slice_free (SelectionEntry, (SelectionEntry *) link);
+	}
+	g_hash_table_destroy (set->entries);
+	g_free (set);
+}
+
+static void
+add_to_types (NautilusSelectionSet *set,
+	      SelectionEntry *entry)
+{
+	GQueue *queue;
+
+	entry->type_key = nautilus_file_get_application_key (entry->link.data);
+	if (entry->type_key == NULL) {
+		entry->type_key = g_strdup ("");
+	}
+	entry->type_link.data = entry;
+
+	queue = g_hash_table_lookup (set->types, entry->type_key);
+	if (queue == NULL) {
+		queue = g_queue_new ();
+		g_hash_table_insert (set->types, entry->type_key, queue);
+	}
+	g_queue_push_tail_link (queue, &entry->type_link);
+}
+
+static void
+remove_from_types (NautilusSelectionSet *set,
+		   SelectionEntry *entry)
+{
+	GQueue *queue;
+	SelectionEntry *first;
+
+	queue = g_hash_table_lookup (set->types, entry->type_key);
+	g_queue_unlink (queue, &entry->type_link);
+
+	if (g_queue_is_empty (queue)) {
+		g_hash_table_remove (set->types, entry->type_key);
+	} else {
+		/* The table key belongs to the first entry. */
+		first = queue->head->data;
+		g_hash_table_steal (set->types, entry->type_key);
+		g_hash_table_insert (set->types, first->type_key, queue);
+	}
+
+	g_free (entry->type_key);
+	entry->type_key = NULL;
+}
+
+static void
+add_to_totals (NautilusSelectionSet *set,
+	       SelectionEntry *entry)
+{
+	NautilusFile *file;
+
+	file = entry->link.data;
+
+	entry->is_folder = nautilus_file_is_directory (file);
+	if (entry->is_folder) {
+		entry->item_count_known =
+			nautilus_file_get_directory_item_count (file, &entry->item_count, NULL);
+
+		set->folder_count++;
+		if (entry->item_count_known) {
+			set->folder_item_count += entry->item_count;
+		} else {
+			set->n_unknown_item_counts++;
+		}
+	} else {
+		entry->size_known = !nautilus_file_can_get_size (file);
+		if (entry->size_known) {
+			entry->size = nautilus_file_get_size (file);
+		}
+
+		set->non_folder_count++;
+		if (entry->size_known) {
+			set->non_folder_size += entry->size;
+			set->n_known_sizes++;
+		}
+	}
+}
+
+static void
+remove_from_totals (NautilusSelectionSet *set,
+		    SelectionEntry *entry)
+{
+	if (entry->is_folder) {
+		set->folder_count--;
+		if (entry->item_count_known) {
+			set->folder_item_count -= entry->item_count;
+		} else {
+			set->n_unknown_item_counts--;
+		}
+	} else {
+		set->non_folder_count--;
+		if (entry->size_known) {
+			set->non_folder_size -= entry->size;
+			set->n_known_sizes--;
+		}
+	}
+}
+
+gboolean
+nautilus_selection_set_add (NautilusSelectionSet *set,
+			    NautilusFile *file)
+{
+	SelectionEntry *entry;
+
+	if (g_hash_table_lookup (set->entries, file) != NULL) {
+		return FALSE;
+	}
+
+	entry = g_slice_new0 (SelectionEntry);
+	entry->link.data = nautilus_file_ref (file);
+	g_queue_push_tail_link (&set->files, &entry->link);
+	g_hash_table_insert (set->entries, file, entry);
+
+	add_to_totals (set, entry);
+	add_to_types (set, entry);
+
+	return TRUE;
+}
+
+gboolean
+nautilus_selection_set_remove (NautilusSelectionSet *set,
+			       NautilusFile *file)
+{
+	SelectionEntry *entry;
+
+	entry = g_hash_table_lookup (set->entries, file);
+	if (entry == NULL) {
+		return FALSE;
+	}
+
+	remove_from_totals (set, entry);
+	remove_from_types (set, entry);
+
+	g_hash_table_remove (set->entries, file);
+	g_queue_unlink (&set->files, &entry->link);
+	nautilus_file_unref (file);
+	g_slice_free (SelectionEntry, entry);
+
+	return TRUE;
+}
+
+void
+nautilus_selection_set_update (NautilusSelectionSet *set,
+			       GList *files)
+{
+	SelectionEntry *entry;
+	GList *l;
+	guint n_kept;
+
+	/* Move the files that stay to the end in their new order, and
+	 * add the new ones after them. Those left at the start are gone.
+	 */
+	n_kept = 0;
+	for (l = files; l != NULL; l = l->next) {
+		entry = g_hash_table_lookup (set->entries, l->data);
+		if (entry == NULL) {
+			nautilus_selection_set_add (set, l->data);
+			entry = (SelectionEntry *) set->files.tail;
+		} else if (entry->kept) {
+			continue;
+		} else {
+			g_queue_unlink (&set->files, &entry->link);
+			g_queue_push_tail_link (&set->files, &entry->link);
+		}
+		entry->kept = TRUE;
+		n_kept++;
+	}
+
+	while (set->files.length > n_kept) {
+		nautilus_selection_set_remove (set, set->files.head->data);
+	}
+
+	for (l = set->files.head; l != NULL; l = l->next) {
+		((SelectionEntry *) l)->kept = FALSE;
+	}
+}
+
+gboolean
+nautilus_selection_set_contains (NautilusSelectionSet *set,
+				 NautilusFile *file)
+{
+	return g_hash_table_lookup (set->entries, file) != NULL;
+}
+
+guint
+nautilus_selection_set_get_count (NautilusSelectionSet *set)
+{
+	return set->files.length;
+}
+
+GList *
+nautilus_selection_set_peek_files (NautilusSelectionSet *set)
+{
+	return set->files.head;
+}
+
+GList *
+nautilus_selection_set_get_files (NautilusSelectionSet *set)
+{
+	return nautilus_file_list_copy (set->files.head);
+}
+
+void
+nautilus_selection_set_file_changed (NautilusSelectionSet *set,
+				     NautilusFile *file)
+{
+	SelectionEntry *entry;
+
+	entry = g_hash_table_lookup (set->entries, file);
+	if (entry == NULL) {
+		return;
+	}
+
+	remove_from_totals (set, entry);
+	add_to_totals (set, entry);
+
+	remove_from_types (set, entry);
+	add_to_types (set, entry);
+}
+
+GList *
+nautilus_selection_set_get_type_files (NautilusSelectionSet *set)
+{
+	GHashTableIter iter;
+	GQueue *queue;
+	SelectionEntry *entry;
+	GList *files;
+
+	files = NULL;
+	g_hash_table_iter_init (&iter, set->types);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &queue)) {
+		entry = queue->head->data;
+		files = g_list_prepend (files, entry->link.data);
+	}
+
+	return files;
+}
+
+void
+nautilus_selection_set_get_totals (NautilusSelectionSet *set,
+				   guint *folder_count,
+				   guint *folder_item_count,
+				   gboolean *folder_item_count_known,
+				   guint *non_folder_count,
+				   goffset *non_folder_size,
+				   gboolean *non_folder_size_known)
+{
+	if (folder_count != NULL) {
+		*folder_count = set->folder_count;
+	}
+	if (folder_item_count != NULL) {
+		*folder_item_count = set->folder_item_count;
+	}
+	if (folder_item_count_known != NULL) {
+		*folder_item_count_known = set->n_unknown_item_counts == 0;
+	}
+	if (non_folder_count != NULL) {
+		*non_folder_count = set->non_folder_count;
+	}
+	if (non_folder_size != NULL) {
+		*non_folder_size = set->non_folder_size;
+	}
+	if (non_folder_size_known != NULL) {
+		*non_folder_size_known = set->n_known_sizes > 0;
+	}
+}
+
+#if !defined (NAUTILUS_OMIT_SELF_CHECK)
+
+void
+nautilus_self_check_selection_set (void)
+{
+	NautilusSelectionSet *set;
+	NautilusFile *etc, *tmp;
+	GList *files;
+
+	etc = nautilus_file_get_by_uri ("file:///etc");
+	tmp = nautilus_file_get_by_uri ("file:///tmp");
+
+	set = nautilus_selection_set_new ();
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_add (set, tmp), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_add (set, etc), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_add (set, tmp), FALSE);
+	EEL_CHECK_INTEGER_RESULT (nautilus_selection_set_get_count (set), 2);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_peek_files (set)->data == tmp, TRUE);
+
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_remove (set, tmp), TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_remove (set, tmp), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_contains (set, tmp), FALSE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_contains (set, etc), TRUE);
+	EEL_CHECK_INTEGER_RESULT (nautilus_selection_set_get_count (set), 1);
+
+	files = nautilus_selection_set_get_files (set);
+	EEL_CHECK_INTEGER_RESULT (g_list_length (files), 1);
+	EEL_CHECK_BOOLEAN_RESULT (files->data == etc, TRUE);
+	nautilus_file_list_free (files);
+
+	files = nautilus_selection_set_get_type_files (set);
+	EEL_CHECK_INTEGER_RESULT (g_list_length (files), 1);
+	EEL_CHECK_BOOLEAN_RESULT (files->data == etc, TRUE);
+	g_list_free (files);
+
+	files = g_list_prepend (NULL, etc);
+	files = g_list_prepend (files, tmp);
+	files = g_list_prepend (files, tmp);
+	nautilus_selection_set_update (set, files);
+	EEL_CHECK_INTEGER_RESULT (nautilus_selection_set_get_count (set), 2);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_peek_files (set)->data == tmp, TRUE);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_peek_files (set)->next->data == etc, TRUE);
+	nautilus_selection_set_update (set, files->next->next);
+	EEL_CHECK_INTEGER_RESULT (nautilus_selection_set_get_count (set), 1);
+	EEL_CHECK_BOOLEAN_RESULT (nautilus_selection_set_contains (set, tmp), FALSE);
+	nautilus_selection_set_update (set, NULL);
+	EEL_CHECK_INTEGER_RESULT (nautilus_selection_set_get_count (set), 0);
+	g_list_free (files);
+
+	nautilus_selection_set_free (set);
+
+	nautilus_file_unref (etc);
+	nautilus_file_unref (tmp);
+}
+
+#endif /* !NAUTILUS_OMIT_SELF_CHECK */
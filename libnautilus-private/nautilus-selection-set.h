@@ -0,0 +1,77 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * nautilus-selection-set.h: ordered set of selected files
+ *
+ * Nautilus is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Nautilus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef NAUTILUS_SELECTION_SET_H
+#define NAUTILUS_SELECTION_SET_H
+
+#include <libnautilus-private/nautilus-file.h>
+
+typedef struct NautilusSelectionSet NautilusSelectionSet;
+
+NautilusSelectionSet *nautilus_selection_set_new            (void);
+NautilusSelectionSet *nautilus_selection_set_new_from_list  (GList                *files);
+void                  nautilus_selection_set_free           (NautilusSelectionSet *set);
+
+/* Returns FALSE if the file was in the set already. */
+gboolean              nautilus_selection_set_add            (NautilusSelectionSet *set,
+							     NautilusFile         *file);
+/* Returns FALSE if the file was not in the set. */
+gboolean              nautilus_selection_set_remove         (NautilusSelectionSet *set,
+							     NautilusFile         *file);
+/* Makes the set hold the files in the list, in its order. The files
+ * already in the set keep what was worked out for them.
+ */
+void                  nautilus_selection_set_update         (NautilusSelectionSet *set,
+							     GList                *files);
+gboolean              nautilus_selection_set_contains       (NautilusSelectionSet *set,
+							     NautilusFile         *file);
+guint                 nautilus_selection_set_get_count      (NautilusSelectionSet *set);
+
+/* The files in the order they were added, or as given to
+ * nautilus_selection_set_update. The list belongs to the set and is
+ * only good until the set changes.
+ */
+GList *               nautilus_selection_set_peek_files     (NautilusSelectionSet *set);
+GList *               nautilus_selection_set_get_files      (NautilusSelectionSet *set);
+
+/* One file for each application key among the files in the set, see
+ * nautilus_file_get_application_key. The files are not reffed, free
+ * the list with g_list_free.
+ */
+GList *               nautilus_selection_set_get_type_files (NautilusSelectionSet *set);
+
+/* Updates the totals for a file in the set whose attributes changed. */
+void                  nautilus_selection_set_file_changed   (NautilusSelectionSet *set,
+							     NautilusFile         *file);
+
+/* Totals over the files in the set, as shown in the status bar. The
+ * item counts are only known if they are for all of the folders, the
+ * size is known if it is for any of the other files.
+ */
+void                  nautilus_selection_set_get_totals     (NautilusSelectionSet *set,
+							     guint                *folder_count,
+							     guint                *folder_item_count,
+							     gboolean             *folder_item_count_known,
+							     guint                *non_folder_count,
+							     goffset              *non_folder_size,
+							     gboolean             *non_folder_size_known);
+
+#endif /* NAUTILUS_SELECTION_SET_H */
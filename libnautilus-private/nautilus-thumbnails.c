@@ -64,7 +64,27 @@
 #define NAUTILUS_THUMBNAIL_FRAME_RIGHT 3
 #define NAUTILUS_THUMBNAIL_FRAME_BOTTOM 3
 
+/* Most thumbnail threads that run at once, when there are this many CPUs. */
+#define MAX_THUMBNAIL_THREADS 16
+
 static gpointer thumbnail_thread_start (gpointer data);
+static gboolean pixbuf_can_load_type (const char *mime_type);
+
+/* The thumbnails waiting for the same MIME type. A MIME type only gets
+   some of the threads if an external program makes its thumbnails, so
+   that a folder full of videos doesn't hold up the images. */
+
+typedef struct {
+	char *mime_type;
+
+	/* Thumbnails of visible icons, the most recently shown first. */
+	GQueue high_priority;
+	/* The others, the oldest request first. */
+	GQueue normal_priority;
+
+	guint n_running;
+	guint max_running;
+} NautilusThumbnailMimeQueue;
 
 /* structure used for making thumbnails, associating a uri with where the thumbnail is to be stored */
 
@@ -72,35 +92,77 @@ typedef struct {
 	char *image_uri;
 	char *mime_type;
 	time_t original_file_mtime;
+
+	NautilusThumbnailMimeQueue *mime_queue;
+	GList *link; /* in one of the mime_queue queues, NULL while running */
+	gboolean high_priority;
+	guint64 stamp;
+
+	gboolean running;
+	/* Nobody wants it any more, but it is running. */
+	gboolean cancelled;
 } NautilusThumbnailInfo;
 
 /*
  * Thumbnail thread state.
  */
 
-/* The id of the idle handler used to start the thumbnail thread, or 0 if no
+/* The id of the idle handler used to start the thumbnail threads, or 0 if no
    idle handler is currently registered. */
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
-   thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
-   thumbnails_to_make list. */
+   thumbnail threads, i.e. everything below. */
 static pthread_mutex_t thumbnails_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
-   start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
+/* How many thumbnail threads are running, and may run. Lock
+   thumbnails_mutex when accessing this. */
+static guint thumbnail_threads_running = 0;
+static guint thumbnail_threads_max = 0;
 
-/* The list of NautilusThumbnailInfo structs containing information about the
-   thumbnails we are making. Lock thumbnails_mutex when accessing this. */
-static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
-
-/* Quickly check if uri is in thumbnails_to_make list */
+/* The NautilusThumbnailInfo structs of the thumbnails we are making,
+   by uri. The running ones stay here so they aren't added again. */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static NautilusThumbnailInfo *currently_thumbnailing = NULL;
+/* mime type -> NautilusThumbnailMimeQueue */
+static GHashTable *thumbnail_mime_queues = NULL;
+
+/* Number of thumbnails waiting in the mime queues. */
+static guint thumbnails_waiting = 0;
+
+/* Orders the queues, see thumbnail_pick. */
+static guint64 thumbnail_stamp = 0;
+
+/*
+ * Pixbuf cache state. Only used from the main thread.
+ */
+
+/* Budget for the pixbuf data in the cache. */
+#define THUMBNAIL_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+/* A cache that went unused for this long shrinks to a quarter of the
+   budget, so an idle Nautilus doesn't hold on to it all. */
+#define THUMBNAIL_CACHE_TRIM_INTERVAL_SECS 60
+#define THUMBNAIL_CACHE_IDLE_MAX_BYTES (THUMBNAIL_CACHE_MAX_BYTES / 4)
+
+typedef struct {
+	char *key;
+	GdkPixbuf *pixbuf;
+	gsize bytes;
+	GList *link;
+} NautilusThumbnailCacheEntry;
+
+/* key -> NautilusThumbnailCacheEntry */
+static GHashTable *thumbnail_cache = NULL;
+
+/* The entries, the most recently used first. */
+static GQueue thumbnail_cache_lru = G_QUEUE_INIT;
+
+static gsize thumbnail_cache_bytes = 0;
+static guint thumbnail_cache_trim_id = 0;
+static gboolean thumbnail_cache_used = FALSE;
+static guint thumbnail_cache_hits = 0;
+static guint thumbnail_cache_misses = 0;
 
 static GnomeDesktopThumbnailFactory *thumbnail_factory = NULL;
 
@@ -129,6 +191,19 @@ get_file_mtime (const char *file_uri, time_t* mtime)
 	return ret;
 }
 
+static guint
+get_max_thumbnail_threads (void)
+{
+	long n_cpus;
+
+	n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	if (n_cpus < 1) {
+		return 1;
+	}
+
+	return MIN (n_cpus, MAX_THUMBNAIL_THREADS);
+}
+
 static void
 free_thumbnail_info (NautilusThumbnailInfo *info)
 {
@@ -159,37 +234,186 @@ thumbnail_thread_starter_cb (gpointer data)
 {
 	pthread_attr_t thread_attributes;
 	pthread_t thumbnail_thread;
+	guint n_threads;
 
 	/* Don't do this in thread, since g_object_ref is not threadsafe */
 	if (thumbnail_factory == NULL) {
 		thumbnail_factory = get_thumbnail_factory ();
 	}
 
-	/* We create the thread in the detached state, as we don't need/want
-	   to join with it at any point. */
+	thumbnail_thread_starter_id = 0;
+
+	/* Start as many threads as there is work for. Those that find
+	   nothing they are allowed to do exit right away. */
+	pthread_mutex_lock (&thumbnails_mutex);
+	n_threads = MIN (thumbnail_threads_max - thumbnail_threads_running,
+			 thumbnails_waiting);
+	thumbnail_threads_running += n_threads;
+	pthread_mutex_unlock (&thumbnails_mutex);
+
+	/* We create the threads in the detached state, as we don't need/want
+	   to join with them at any point. */
 	pthread_attr_init (&thread_attributes);
 	pthread_attr_setdetachstate (&thread_attributes,
 				     PTHREAD_CREATE_DETACHED);
 #ifdef _POSIX_THREAD_ATTR_STACKSIZE
 	pthread_attr_setstacksize (&thread_attributes, 128*1024);
 #endif
+	for (; n_threads > 0; n_threads--) {
 #ifdef DEBUG_THUMBNAILS
-	g_message ("(Main Thread) Creating thumbnails thread\n");
+		g_message ("(Main Thread) Creating thumbnails thread\n");
 #endif
-	/* We set a flag to indicate the thread is running, so we don't create
-	   a new one. We don't need to lock a mutex here, as the thumbnail
-	   thread isn't running yet. And we know we won't create the thread
-	   twice, as we also check thumbnail_thread_starter_id before
-	   scheduling this idle function. */
-	thumbnail_thread_is_running = TRUE;
-	pthread_create (&thumbnail_thread, &thread_attributes,
-			thumbnail_thread_start, NULL);
-
-	thumbnail_thread_starter_id = 0;
+		if (pthread_create (&thumbnail_thread, &thread_attributes,
+				    thumbnail_thread_start, NULL) != 0) {
+			pthread_mutex_lock (&thumbnails_mutex);
+			thumbnail_threads_running -= n_threads;
+			pthread_mutex_unlock (&thumbnails_mutex);
+			break;
+		}
+	}
+	pthread_attr_destroy (&thread_attributes);
 
 	return FALSE;
 }
 
+/* Call with thumbnails_mutex locked. */
+static void
+schedule_thumbnail_threads (void)
+{
+	/* We don't want to start them until all the other work is done,
+	   so the GUI will be updated as quickly as possible. */
+	if (thumbnails_waiting > 0 &&
+	    thumbnail_threads_running < thumbnail_threads_max &&
+	    thumbnail_thread_starter_id == 0) {
+		thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
+	}
+}
+
+/* Call with thumbnails_mutex locked, from the main thread. */
+static NautilusThumbnailMimeQueue *
+get_mime_queue (const char *mime_type)
+{
+	NautilusThumbnailMimeQueue *mime_queue;
+
+	if (mime_type == NULL) {
+		mime_type = "";
+	}
+
+	mime_queue = g_hash_table_lookup (thumbnail_mime_queues, mime_type);
+	if (mime_queue == NULL) {
+		mime_queue = g_new0 (NautilusThumbnailMimeQueue, 1);
+		mime_queue->mime_type = g_strdup (mime_type);
+		g_queue_init (&mime_queue->high_priority);
+		g_queue_init (&mime_queue->normal_priority);
+
+		/* Images are loaded in process and quickly, anything else
+		   is done by a thumbnailer program. */
+		if (pixbuf_can_load_type (mime_type)) {
+			mime_queue->max_running = thumbnail_threads_max;
+		} else {
+			mime_queue->max_running = MAX (1, thumbnail_threads_max / 2);
+		}
+
+		g_hash_table_insert (thumbnail_mime_queues, mime_queue->mime_type, mime_queue);
+	}
+
+	return mime_queue;
+}
+
+/* Frees the queue of a MIME type once no thumbnail of that type is
+   waiting or being made. Call with thumbnails_mutex locked. */
+static void
+release_mime_queue (NautilusThumbnailMimeQueue *mime_queue)
+{
+	if (mime_queue->n_running > 0 ||
+	    !g_queue_is_empty (&mime_queue->high_priority) ||
+	    !g_queue_is_empty (&mime_queue->normal_priority)) {
+		return;
+	}
+
+	g_hash_table_remove (thumbnail_mime_queues, mime_queue->mime_type);
+	g_free (mime_queue->mime_type);
+	g_free (mime_queue);
+}
+
+/* Call with thumbnails_mutex locked. */
+static void
+thumbnail_enqueue (NautilusThumbnailInfo *info, gboolean high_priority)
+{
+	NautilusThumbnailMimeQueue *mime_queue;
+
+	g_assert (info->link == NULL);
+	g_assert (!info->running);
+
+	mime_queue = info->mime_queue;
+	info->high_priority = high_priority;
+	info->stamp = ++thumbnail_stamp;
+	if (high_priority) {
+		g_queue_push_head (&mime_queue->high_priority, info);
+		info->link = g_queue_peek_head_link (&mime_queue->high_priority);
+	} else {
+		g_queue_push_tail (&mime_queue->normal_priority, info);
+		info->link = g_queue_peek_tail_link (&mime_queue->normal_priority);
+	}
+	thumbnails_waiting++;
+}
+
+/* Call with thumbnails_mutex locked. */
+static void
+thumbnail_dequeue (NautilusThumbnailInfo *info)
+{
+	NautilusThumbnailMimeQueue *mime_queue;
+
+	g_assert (info->link != NULL);
+
+	mime_queue = info->mime_queue;
+	g_queue_delete_link (info->high_priority ?
+			     &mime_queue->high_priority :
+			     &mime_queue->normal_priority,
+			     info->link);
+	info->link = NULL;
+	thumbnails_waiting--;
+}
+
+/* Picks the next thumbnail to make: the most recently shown visible
+   icon, or else the oldest request, among the MIME types that may
+   use another thread. Call with thumbnails_mutex locked. */
+static NautilusThumbnailInfo *
+thumbnail_pick (void)
+{
+	NautilusThumbnailMimeQueue *mime_queue;
+	NautilusThumbnailInfo *info, *best_high, *best_normal;
+	GHashTableIter iter;
+
+	if (thumbnails_waiting == 0) {
+		return NULL;
+	}
+
+	best_high = NULL;
+	best_normal = NULL;
+
+	g_hash_table_iter_init (&iter, thumbnail_mime_queues);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mime_queue)) {
+		if (mime_queue->n_running >= mime_queue->max_running) {
+			continue;
+		}
+
+		info = g_queue_peek_head (&mime_queue->high_priority);
+		if (info != NULL &&
+		    (best_high == NULL || info->stamp > best_high->stamp)) {
+			best_high = info;
+		}
+
+		info = g_queue_peek_head (&mime_queue->normal_priority);
+		if (info != NULL &&
+		    (best_normal == NULL || info->stamp < best_normal->stamp)) {
+			best_normal = info;
+		}
+	}
+
+	return best_high != NULL ? best_high : best_normal;
+}
+
 static GdkPixbuf *
 nautilus_get_thumbnail_frame (void)
 {
@@ -238,7 +462,8 @@ nautilus_thumbnail_frame_image (GdkPixbuf **pixbuf)
 void
 nautilus_thumbnail_remove_from_queue (const char *file_uri)
 {
-	GList *node;
+	NautilusThumbnailInfo *info;
+	NautilusThumbnailMimeQueue *mime_queue;
 	
 #ifdef DEBUG_THUMBNAILS
 	g_message ("(Remove from queue) Locking mutex\n");
@@ -250,12 +475,19 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
 	 *********************************/
 
 	if (thumbnails_to_make_hash) {
-		node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
-		
-		if (node && node->data != currently_thumbnailing) {
+		info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+
+		if (info == NULL) {
+			/* Not queued */
+		} else if (info->running) {
+			/* Let the thread drop it when done */
+			info->cancelled = TRUE;
+		} else {
+			mime_queue = info->mime_queue;
+			thumbnail_dequeue (info);
 			g_hash_table_remove (thumbnails_to_make_hash, file_uri);
-			free_thumbnail_info (node->data);
-			g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+			free_thumbnail_info (info);
+			release_mime_queue (mime_queue);
 		}
 	}
 	
@@ -272,7 +504,7 @@ nautilus_thumbnail_remove_from_queue (const char *file_uri)
 void
 nautilus_thumbnail_prioritize (const char *file_uri)
 {
-	GList *node;
+	NautilusThumbnailInfo *info;
 
 #ifdef DEBUG_THUMBNAILS
 	g_message ("(Prioritize) Locking mutex\n");
@@ -284,11 +516,11 @@ nautilus_thumbnail_prioritize (const char *file_uri)
 	 *********************************/
 
 	if (thumbnails_to_make_hash) {
-		node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+		info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 		
-		if (node && node->data != currently_thumbnailing) {
-			g_queue_unlink ((GQueue *)&thumbnails_to_make, node);
-			g_queue_push_head_link ((GQueue *)&thumbnails_to_make, node);
+		if (info && !info->running) {
+			thumbnail_dequeue (info);
+			thumbnail_enqueue (info, TRUE);
 		}
 	}
 	
@@ -303,6 +535,159 @@ nautilus_thumbnail_prioritize (const char *file_uri)
 }
 
 
+/***************************************************************************
+ * Pixbuf Cache Functions.
+ ***************************************************************************/
+
+/* Source size is that of the pixbuf a display pixbuf is made from, or 0
+   for pixbufs read from disk. */
+char *
+nautilus_thumbnail_cache_key (const char *uri,
+			      time_t mtime,
+			      int source_width,
+			      int source_height,
+			      int width,
+			      int height,
+			      gboolean framed)
+{
+	return g_strdup_printf ("%s %" G_GINT64_FORMAT " %dx%d %dx%d %d",
+				uri, (gint64) mtime,
+				source_width, source_height,
+				width, height,
+				framed ? 1 : 0);
+}
+
+static void
+thumbnail_cache_entry_free (NautilusThumbnailCacheEntry *entry)
+{
+	g_free (entry->key);
+	g_object_unref (entry->pixbuf);
+	g_free (entry);
+}
+
+static void
+thumbnail_cache_remove (NautilusThumbnailCacheEntry *entry)
+{
+	g_queue_delete_link (&thumbnail_cache_lru, entry->link);
+	thumbnail_cache_bytes -= entry->bytes;
+	g_hash_table_remove (thumbnail_cache, entry->key);
+	thumbnail_cache_entry_free (entry);
+}
+
+GdkPixbuf *
+nautilus_thumbnail_cache_lookup (const char *key)
+{
+	NautilusThumbnailCacheEntry *entry;
+
+	entry = NULL;
+	if (thumbnail_cache != NULL) {
+		entry = g_hash_table_lookup (thumbnail_cache, key);
+	}
+	thumbnail_cache_used = TRUE;
+
+	if (entry == NULL) {
+		thumbnail_cache_misses++;
+		return NULL;
+	}
+
+	thumbnail_cache_hits++;
+	g_queue_unlink (&thumbnail_cache_lru, entry->link);
+	g_queue_push_head_link (&thumbnail_cache_lru, entry->link);
+
+	return g_object_ref (entry->pixbuf);
+}
+
+static gboolean
+thumbnail_cache_trim_timeout (gpointer data)
+{
+	if (!thumbnail_cache_used) {
+		nautilus_thumbnail_cache_trim (THUMBNAIL_CACHE_IDLE_MAX_BYTES);
+	}
+	thumbnail_cache_used = FALSE;
+
+	if (thumbnail_cache_bytes == 0) {
+		thumbnail_cache_trim_id = 0;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void
+nautilus_thumbnail_cache_insert (const char *key,
+				 GdkPixbuf *pixbuf)
+{
+	NautilusThumbnailCacheEntry *entry;
+	gsize bytes;
+
+	bytes = (gsize) gdk_pixbuf_get_rowstride (pixbuf) * gdk_pixbuf_get_height (pixbuf);
+
+	/* Don't let one pixbuf push out lots of others. */
+	if (bytes > THUMBNAIL_CACHE_MAX_BYTES / 16) {
+		return;
+	}
+
+	if (thumbnail_cache == NULL) {
+		thumbnail_cache = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	entry = g_hash_table_lookup (thumbnail_cache, key);
+	if (entry != NULL) {
+		thumbnail_cache_remove (entry);
+	}
+
+	entry = g_new0 (NautilusThumbnailCacheEntry, 1);
+	entry->key = g_strdup (key);
+	entry->pixbuf = g_object_ref (pixbuf);
+	entry->bytes = bytes;
+	g_queue_push_head (&thumbnail_cache_lru, entry);
+	entry->link = g_queue_peek_head_link (&thumbnail_cache_lru);
+	g_hash_table_insert (thumbnail_cache, entry->key, entry);
+	thumbnail_cache_bytes += bytes;
+	thumbnail_cache_used = TRUE;
+
+	nautilus_thumbnail_cache_trim (THUMBNAIL_CACHE_MAX_BYTES);
+
+	if (thumbnail_cache_trim_id == 0) {
+		thumbnail_cache_trim_id = g_timeout_add_seconds (THUMBNAIL_CACHE_TRIM_INTERVAL_SECS,
+								 thumbnail_cache_trim_timeout,
+								 NULL);
+	}
+}
+
+void
+nautilus_thumbnail_cache_trim (gsize max_bytes)
+{
+	NautilusThumbnailCacheEntry *entry;
+
+	while (thumbnail_cache_bytes > max_bytes) {
+		entry = g_queue_peek_tail (&thumbnail_cache_lru);
+		thumbnail_cache_remove (entry);
+	}
+
+#ifdef DEBUG_THUMBNAILS
+	g_message ("(Main Thread) Thumbnail cache: %u hits, %u misses, %" G_GSIZE_FORMAT " bytes\n",
+		   thumbnail_cache_hits, thumbnail_cache_misses, thumbnail_cache_bytes);
+#endif
+}
+
+void
+nautilus_thumbnail_cache_get_statistics (guint *hits,
+					 guint *misses,
+					 gsize *bytes)
+{
+	if (hits != NULL) {
+		*hits = thumbnail_cache_hits;
+	}
+	if (misses != NULL) {
+		*misses = thumbnail_cache_misses;
+	}
+	if (bytes != NULL) {
+		*bytes = thumbnail_cache_bytes;
+	}
+}
+
+
 /***************************************************************************
  * Thumbnail Thread Functions.
  ***************************************************************************/
@@ -425,13 +810,47 @@ nautilus_can_thumbnail (NautilusFile *file)
 	return res;
 }
 
+/* The threads that are still running at shutdown keep the queues. */
+static void
+free_thumbnail_queues (void)
+{
+	NautilusThumbnailMimeQueue *mime_queue;
+	GHashTableIter iter;
+	gpointer value;
+
+	pthread_mutex_lock (&thumbnails_mutex);
+
+	if (thumbnail_threads_running == 0) {
+		g_hash_table_iter_init (&iter, thumbnails_to_make_hash);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			free_thumbnail_info (value);
+		}
+		g_hash_table_destroy (thumbnails_to_make_hash);
+		thumbnails_to_make_hash = NULL;
+
+		g_hash_table_iter_init (&iter, thumbnail_mime_queues);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			mime_queue = value;
+			g_queue_clear (&mime_queue->high_priority);
+			g_queue_clear (&mime_queue->normal_priority);
+			g_free (mime_queue->mime_type);
+			g_free (mime_queue);
+		}
+		g_hash_table_destroy (thumbnail_mime_queues);
+		thumbnail_mime_queues = NULL;
+
+		thumbnails_waiting = 0;
+	}
+
+	pthread_mutex_unlock (&thumbnails_mutex);
+}
+
 void
 nautilus_create_thumbnail (NautilusFile *file)
 {
 	time_t file_mtime = 0;
 	NautilusThumbnailInfo *info;
-	NautilusThumbnailInfo *existing_info;
-	GList *existing, *node;
+	NautilusThumbnailInfo *existing;
 
 	nautilus_file_set_is_thumbnailing (file, TRUE);
 
@@ -464,6 +883,10 @@ nautilus_create_thumbnail (NautilusFile *file)
 	if (thumbnails_to_make_hash == NULL) {
 		thumbnails_to_make_hash = g_hash_table_new (g_str_hash,
 							    g_str_equal);
+		thumbnail_mime_queues = g_hash_table_new (g_str_hash,
+							  g_str_equal);
+		thumbnail_threads_max = get_max_thumbnail_threads ();
+		eel_debug_call_at_shutdown (free_thumbnail_queues);
 	}
 
 	/* Check if it is already in the list of thumbnails to make. */
@@ -474,27 +897,23 @@ nautilus_create_thumbnail (NautilusFile *file)
 		g_message ("(Main Thread) Adding thumbnail: %s\n",
 			   info->image_uri);
 #endif
-		g_queue_push_tail ((GQueue *)&thumbnails_to_make, info);
-		node = g_queue_peek_tail_link ((GQueue *)&thumbnails_to_make);
+		info->mime_queue = get_mime_queue (info->mime_type);
+		thumbnail_enqueue (info, FALSE);
 		g_hash_table_insert (thumbnails_to_make_hash,
 				     info->image_uri,
-				     node);
-		/* If the thumbnail thread isn't running, and we haven't
-		   scheduled an idle function to start it up, do that now.
-		   We don't want to start it until all the other work is done,
-		   so the GUI will be updated as quickly as possible.*/
-		if (thumbnail_thread_is_running == FALSE &&
-		    thumbnail_thread_starter_id == 0) {
-			thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
-		}
+				     info);
+		/* If there are threads to spare, and we haven't
+		   scheduled an idle function to start them up, do that now. */
+		schedule_thumbnail_threads ();
 	} else {
 #ifdef DEBUG_THUMBNAILS
 		g_message ("(Main Thread) Updating non-current mtime: %s\n",
 			   info->image_uri);
 #endif
 		/* The file in the queue might need a new original mtime */
-		existing_info = existing->data;
-		existing_info->original_file_mtime = info->original_file_mtime;
+		existing->original_file_mtime = info->original_file_mtime;
+		/* and is wanted again if it was cancelled */
+		existing->cancelled = FALSE;
 		free_thumbnail_info (info);
 	}   
 
@@ -508,7 +927,37 @@ nautilus_create_thumbnail (NautilusFile *file)
 	pthread_mutex_unlock (&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
+/* Called by a thumbnail thread when it is done with info, with
+   thumbnails_mutex locked. Returns the uri to notify about, if any. */
+static char *
+thumbnail_finish (NautilusThumbnailInfo *info,
+		  time_t thumbnailed_mtime)
+{
+	NautilusThumbnailMimeQueue *mime_queue;
+	char *image_uri;
+
+	mime_queue = info->mime_queue;
+	info->running = FALSE;
+	mime_queue->n_running--;
+
+	/* Don't drop the thumbnail if the original file mtime of the
+	   request changed. Then we need to redo the thumbnail. */
+	if (!info->cancelled &&
+	    info->original_file_mtime != thumbnailed_mtime) {
+		thumbnail_enqueue (info, info->high_priority);
+		return NULL;
+	}
+
+	image_uri = info->cancelled ? NULL : g_strdup (info->image_uri);
+	g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+	free_thumbnail_info (info);
+	release_mime_queue (mime_queue);
+
+	return image_uri;
+}
+
+/* thumbnail_thread is invoked as a separate thread to to make thumbnails.
+   Several of them may be running. */
 static gpointer
 thumbnail_thread_start (gpointer data)
 {
@@ -516,10 +965,15 @@ thumbnail_thread_start (gpointer data)
 	GdkPixbuf *pixbuf;
 	time_t current_orig_mtime = 0;
 	time_t current_time;
-	GList *node;
+	char *image_uri, *mime_type, *notify_uri;
+	gboolean delayed;
+
+	image_uri = NULL;
+	mime_type = NULL;
+	delayed = FALSE;
 
-	/* We loop until there are no more thumbails to make, at which point
-	   we exit the thread. */
+	/* We loop until there are no more thumbails we may make, at which
+	   point we exit the thread. */
 	for (;;) {
 #ifdef DEBUG_THUMBNAILS
 		g_message ("(Thumbnail Thread) Locking mutex\n");
@@ -530,41 +984,48 @@ thumbnail_thread_start (gpointer data)
 		 * MUTEX LOCKED
 		 *********************************/
 
-		/* Pop the last thumbnail we just made off the head of the
-		   list and free it. I did this here so we only have to lock
-		   the mutex once per thumbnail, rather than once before
-		   creating it and once after.
-		   Don't pop the thumbnail off the queue if the original file
-		   mtime of the request changed. Then we need to redo the thumbnail.
-		*/
-		if (currently_thumbnailing &&
-		    currently_thumbnailing->original_file_mtime == current_orig_mtime) {
-			g_assert (info == currently_thumbnailing);
-			node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-			g_assert (node != NULL);
-			g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
-			free_thumbnail_info (info);
-			g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+		/* Drop the last thumbnail we just made. I did this here
+		   so we only have to lock the mutex once per thumbnail,
+		   rather than once before creating it and once after. */
+		if (info != NULL) {
+			notify_uri = thumbnail_finish (info, current_orig_mtime);
+			if (notify_uri != NULL) {
+				if (delayed) {
+					/* Reschedule thumbnailing via a change notification */
+					g_timeout_add_seconds (1, thumbnail_thread_notify_file_changed,
+							       notify_uri);
+				} else {
+					/* We need to call nautilus_file_changed(), but I don't think that is
+					   thread safe. So add an idle handler and do it from the main loop. */
+					g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+							 thumbnail_thread_notify_file_changed,
+							 notify_uri, NULL);
+				}
+			}
+			g_free (image_uri);
+			g_free (mime_type);
 		}
-		currently_thumbnailing = NULL;
 
-		/* If there are no more thumbnails to make, reset the
-		   thumbnail_thread_is_running flag, unlock the mutex, and
-		   exit the thread. */
-		if (g_queue_is_empty ((GQueue *)&thumbnails_to_make)) {
+		/* If there are no more thumbnails we may make, unlock the
+		   mutex, and exit the thread. */
+		info = thumbnail_pick ();
+		if (info == NULL) {
 #ifdef DEBUG_THUMBNAILS
 			g_message ("(Thumbnail Thread) Exiting\n");
 #endif
-			thumbnail_thread_is_running = FALSE;
+			thumbnail_threads_running--;
 			pthread_mutex_unlock (&thumbnails_mutex);
 			pthread_exit (NULL);
 		}
 
-		/* Get the next one to make. We leave it on the list until it
-		   is created so the main thread doesn't add it again while we
-		   are creating it. */
-		info = g_queue_peek_head ((GQueue *)&thumbnails_to_make);
-		currently_thumbnailing = info;
+		/* Get the next one to make. We leave it in the hash table
+		   until it is created so the main thread doesn't add it
+		   again while we are creating it. */
+		thumbnail_dequeue (info);
+		info->running = TRUE;
+		info->mime_queue->n_running++;
+		image_uri = g_strdup (info->image_uri);
+		mime_type = g_strdup (info->mime_type);
 		current_orig_mtime = info->original_file_mtime;
 		/*********************************
 		 * MUTEX UNLOCKED
@@ -579,43 +1040,36 @@ thumbnail_thread_start (gpointer data)
 
 		/* Don't try to create a thumbnail if the file was modified recently.
 		   This prevents constant re-thumbnailing of changing files. */ 
-		if (current_time < current_orig_mtime + THUMBNAIL_CREATION_DELAY_SECS &&
-		    current_time >= current_orig_mtime) {
+		delayed = current_time < current_orig_mtime + THUMBNAIL_CREATION_DELAY_SECS &&
+			current_time >= current_orig_mtime;
+		if (delayed) {
 #ifdef DEBUG_THUMBNAILS
 			g_message ("(Thumbnail Thread) Skipping: %s\n",
-				   info->image_uri);
+				   image_uri);
 #endif
-			/* Reschedule thumbnailing via a change notification */
-			g_timeout_add_seconds (1, thumbnail_thread_notify_file_changed,
-				       g_strdup (info->image_uri));
  			continue;
 		}
 
 		/* Create the thumbnail. */
 #ifdef DEBUG_THUMBNAILS
 		g_message ("(Thumbnail Thread) Creating thumbnail: %s\n",
-			   info->image_uri);
+			   image_uri);
 #endif
 
 		pixbuf = gnome_desktop_thumbnail_factory_generate_thumbnail (thumbnail_factory,
-									     info->image_uri,
-									     info->mime_type);
+									     image_uri,
+									     mime_type);
 
 		if (pixbuf) {
 			gnome_desktop_thumbnail_factory_save_thumbnail (thumbnail_factory,
 									pixbuf,
-									info->image_uri,
+									image_uri,
 									current_orig_mtime);
 			g_object_unref (pixbuf);
 		} else {
 			gnome_desktop_thumbnail_factory_create_failed_thumbnail (thumbnail_factory, 
-										 info->image_uri,
+										 image_uri,
 										 current_orig_mtime);
 		}
-		/* We need to call nautilus_file_changed(), but I don't think that is
-		   thread safe. So add an idle handler and do it from the main loop. */
-		g_idle_add_full (G_PRIORITY_HIGH_IDLE,
-				 thumbnail_thread_notify_file_changed,
-				 g_strdup (info->image_uri), NULL);
 	}
 }
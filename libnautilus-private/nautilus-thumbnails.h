@@ -40,5 +40,25 @@ void       nautilus_thumbnail_frame_image           (GdkPixbuf **pixbuf);
 void       nautilus_thumbnail_remove_from_queue     (const char   *file_uri);
 void       nautilus_thumbnail_prioritize            (const char   *file_uri);
 
+/* Cache of decoded and display-ready thumbnail pixbufs, shared by all
+ * views. Keys come from nautilus_thumbnail_cache_key. */
+char *     nautilus_thumbnail_cache_key             (const char   *uri,
+						     time_t        mtime,
+						     int           source_width,
+						     int           source_height,
+						     int           width,
+						     int           height,
+						     gboolean      framed);
+GdkPixbuf *nautilus_thumbnail_cache_lookup          (const char   *key);
+void       nautilus_thumbnail_cache_insert          (const char   *key,
+						     GdkPixbuf    *pixbuf);
+/* Evicts the least recently used pixbufs until the cache is no bigger
+ * than max_bytes. The cache does this itself when it is over budget,
+ * and when it goes unused for a minute. */
+void       nautilus_thumbnail_cache_trim            (gsize         max_bytes);
+void       nautilus_thumbnail_cache_get_statistics  (guint        *hits,
+						     guint        *misses,
+						     gsize        *bytes);
+
 
 #endif /* NAUTILUS_THUMBNAILS_H */
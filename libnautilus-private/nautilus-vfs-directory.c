@@ -136,7 +136,7 @@ vfs_is_not_empty (NautilusDirectory *directory)
 	g_assert (NAUTILUS_IS_VFS_DIRECTORY (directory));
 	g_assert (nautilus_directory_is_anyone_monitoring_file_list (directory));
 
-	return directory->details->file_list != NULL;
+	return directory->details->files->len > 0;
 }
 
 static void
@@ -52,6 +52,7 @@
 #include "nautilus-window-slot.h"
 
 #include <libnautilus-private/nautilus-dbus-manager.h>
+#include <libnautilus-private/nautilus-deep-count-cache.h>
 #include <libnautilus-private/nautilus-desktop-link-monitor.h>
 #include <libnautilus-private/nautilus-directory-private.h>
 #include <libnautilus-private/nautilus-file-utilities.h>
@@ -60,6 +61,7 @@
 #include <libnautilus-private/nautilus-lib-self-check-functions.h>
 #include <libnautilus-private/nautilus-module.h>
 #include <libnautilus-private/nautilus-signaller.h>
+#include <libnautilus-private/nautilus-thumbnails.h>
 #include <libnautilus-private/nautilus-ui-utilities.h>
 #include <libnautilus-extension/nautilus-menu-provider.h>
 
@@ -1253,6 +1255,21 @@ init_gtk_accels (void)
 	g_free (old_scripts_directory_path);
 }
 
+#ifdef ENABLE_DEBUG
+
+/* How often NAUTILUS_DEBUG=Statistics logs, in seconds. */
+#define STATISTICS_LOG_INTERVAL 10
+
+static gboolean
+log_statistics_callback (gpointer user_data)
+{
+	nautilus_directory_log_statistics ();
+
+	return TRUE;
+}
+
+#endif /* ENABLE_DEBUG */
+
 static void
 nautilus_application_startup (GApplication *app)
 {
@@ -1316,6 +1333,13 @@ nautilus_application_startup (GApplication *app)
 	do_upgrades_once (self);
 
 	nautilus_application_init_app_menu (self);
+
+#ifdef ENABLE_DEBUG
+	if (nautilus_debug_flag_is_set (NAUTILUS_DEBUG_STATISTICS)) {
+		g_timeout_add_seconds (STATISTICS_LOG_INTERVAL,
+				       log_statistics_callback, NULL);
+	}
+#endif
 }
 
 static void
@@ -1324,6 +1348,8 @@ nautilus_application_quit_mainloop (GApplication *app)
 	DEBUG ("Quitting mainloop");
 
 	nautilus_icon_info_clear_caches ();
+	nautilus_thumbnail_cache_trim (0);
+	nautilus_deep_count_cache_save ();
  	nautilus_application_save_accel_map (NULL);
 
 	G_APPLICATION_CLASS (nautilus_application_parent_class)->quit_mainloop (app);
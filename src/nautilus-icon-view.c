@@ -1151,6 +1151,19 @@ nautilus_icon_view_get_selection (NautilusView *view)
 	return list;
 }
 
+static gboolean
+nautilus_icon_view_get_selection_changes (NautilusView *view,
+					  GList **newly_selected,
+					  GList **newly_unselected)
+{
+	g_return_val_if_fail (NAUTILUS_IS_ICON_VIEW (view), FALSE);
+
+	nautilus_icon_container_get_selection_changes
+		(get_icon_container (NAUTILUS_ICON_VIEW (view)),
+		 newly_selected, newly_unselected);
+	return TRUE;
+}
+
 static void
 count_item (NautilusIconData *icon_data,
 	    gpointer callback_data)
@@ -1447,8 +1460,9 @@ nautilus_icon_view_update_menus (NautilusView *view)
 
 	NAUTILUS_VIEW_CLASS (nautilus_icon_view_parent_class)->update_menus(view);
 
-        selection_count = nautilus_view_get_selection_count (view);
         icon_container = get_icon_container (icon_view);
+        selection_count = icon_container != NULL ?
+		nautilus_icon_container_get_selection_count (icon_container) : 0;
 
 	action = gtk_action_group_get_action (icon_view->details->icon_action_group,
 					      NAUTILUS_ACTION_STRETCH);
@@ -2483,6 +2497,7 @@ nautilus_icon_view_class_init (NautilusIconViewClass *klass)
 	nautilus_view_class->get_selected_icon_locations = nautilus_icon_view_get_selected_icon_locations;
 	nautilus_view_class->get_selection = nautilus_icon_view_get_selection;
 	nautilus_view_class->get_selection_for_file_transfer = nautilus_icon_view_get_selection;
+	nautilus_view_class->get_selection_changes = nautilus_icon_view_get_selection_changes;
 	nautilus_view_class->get_item_count = nautilus_icon_view_get_item_count;
 	nautilus_view_class->is_empty = nautilus_icon_view_is_empty;
 	nautilus_view_class->remove_file = nautilus_icon_view_remove_file;
@@ -76,7 +76,7 @@ struct NautilusListModelDetails {
 
 	GPtrArray *columns;
 
-	GList *highlight_files;
+	GHashTable *highlight_files; /* map from locations to highlighted files */
 };
 
 typedef struct {
@@ -95,6 +95,14 @@ struct FileEntry {
 	GSequence *files;
 	GSequenceIter *ptr;
 	guint loaded : 1;
+
+	/* What get_value last returned for the row, dropped whenever
+	 * the row changes. Icons are per zoom level, strings per
+	 * extra column. Dates shown relative to today aren't kept.
+	 */
+	GdkPixbuf *icons[NAUTILUS_ZOOM_LEVEL_N_ENTRIES];
+	char **strings;
+	guint n_strings;
 };
 
 G_DEFINE_TYPE_WITH_CODE (NautilusListModel, nautilus_list_model, G_TYPE_OBJECT,
@@ -112,9 +120,27 @@ static const GtkTargetEntry drag_types [] = {
 
 static GtkTargetList *drag_target_list = NULL;
 
+static void
+file_entry_invalidate (FileEntry *file_entry)
+{
+	guint i;
+
+	for (i = 0; i < NAUTILUS_ZOOM_LEVEL_N_ENTRIES; i++) {
+		g_clear_object (&file_entry->icons[i]);
+	}
+
+	for (i = 0; i < file_entry->n_strings; i++) {
+		g_free (file_entry->strings[i]);
+	}
+	g_free (file_entry->strings);
+	file_entry->strings = NULL;
+	file_entry->n_strings = 0;
+}
+
 static void
 file_entry_free (FileEntry *file_entry)
 {
+	file_entry_invalidate (file_entry);
 	nautilus_file_unref (file_entry->file);
 	if (file_entry->reverse_map) {
 		g_hash_table_destroy (file_entry->reverse_map);
@@ -241,13 +267,30 @@ nautilus_list_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
 	return path;
 }
 
+static gboolean
+is_highlighted (NautilusListModel *model, NautilusFile *file)
+{
+	GFile *location;
+	gboolean highlighted;
+
+	if (model->details->highlight_files == NULL) {
+		return FALSE;
+	}
+
+	location = nautilus_file_get_location (file);
+	highlighted = g_hash_table_lookup (model->details->highlight_files, location) != NULL;
+	g_object_unref (location);
+
+	return highlighted;
+}
+
 static void
 nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int column, GValue *value)
 {
 	NautilusListModel *model;
 	FileEntry *file_entry;
 	NautilusFile *file;
-	char *str;
+	guint index, i;
 	GdkPixbuf *icon, *rendered_icon;
 	GIcon *gicon, *emblemed_icon, *emblem_icon;
 	NautilusIconInfo *icon_info;
@@ -256,6 +299,7 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 	int icon_size;
 	NautilusZoomLevel zoom_level;
 	NautilusFileIconFlags flags;
+	char *str;
 	
 	model = (NautilusListModel *)tree_model;
 
@@ -310,6 +354,13 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 				}
 			}
 
+			/* The drop target look is never cached. */
+			if ((flags & NAUTILUS_FILE_ICON_FLAGS_FOR_DRAG_ACCEPT) == 0 &&
+			    file_entry->icons[zoom_level] != NULL) {
+				g_value_set_object (value, file_entry->icons[zoom_level]);
+				break;
+			}
+
 			gicon = G_ICON (nautilus_file_get_icon_pixbuf (file, icon_size, TRUE, flags));
 			emblem_icons = nautilus_file_get_emblem_icons (file);
 
@@ -336,10 +387,7 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 			g_object_unref (icon_info);
 			g_object_unref (gicon);
 
-			if (model->details->highlight_files != NULL &&
-			    g_list_find_custom (model->details->highlight_files,
-			                        file, (GCompareFunc) nautilus_file_compare_location))
-			{
+			if (is_highlighted (model, file)) {
 				rendered_icon = eel_create_spotlight_pixbuf (icon);
 
 				if (rendered_icon != NULL) {
@@ -348,6 +396,10 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
 				}
 			}
 
+			if ((flags & NAUTILUS_FILE_ICON_FLAGS_FOR_DRAG_ACCEPT) == 0) {
+				file_entry->icons[zoom_level] = g_object_ref (icon);
+			}
+
 			g_value_set_object (value, icon);
 			g_object_unref (icon);
 		}
@@ -361,17 +413,40 @@ nautilus_list_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter, int
  		if (column >= NAUTILUS_LIST_MODEL_NUM_COLUMNS || column < NAUTILUS_LIST_MODEL_NUM_COLUMNS + model->details->columns->len) {
 			NautilusColumn *nautilus_column;
 			GQuark attribute;
-			nautilus_column = model->details->columns->pdata[column - NAUTILUS_LIST_MODEL_NUM_COLUMNS];
+			index = column - NAUTILUS_LIST_MODEL_NUM_COLUMNS;
+			nautilus_column = model->details->columns->pdata[index];
 			
 			g_value_init (value, G_TYPE_STRING);
+			if (file != NULL) {
+				if (index >= file_entry->n_strings) {
+					file_entry->strings = g_renew (char *, file_entry->strings,
+								       model->details->columns->len);
+					for (i = file_entry->n_strings; i < model->details->columns->len; i++) {
+						file_entry->strings[i] = NULL;
+					}
+					file_entry->n_strings = model->details->columns->len;
+				}
+
+				if (file_entry->strings[index] == NULL) {
+					g_object_get (nautilus_column, 
+						      "attribute_q", &attribute, 
+						      NULL);
+					str = nautilus_file_get_string_attribute_with_default_q (file, 
+												 attribute);
+					if (!nautilus_file_string_attribute_is_stable_q (file, attribute)) {
+						g_value_take_string (value, str);
+						break;
+					}
+					file_entry->strings[index] = str;
+				}
+				g_value_set_string (value, file_entry->strings[index]);
+				break;
+			}
+
 			g_object_get (nautilus_column, 
 				      "attribute_q", &attribute, 
 				      NULL);
-			if (file != NULL) {
-				str = nautilus_file_get_string_attribute_with_default_q (file, 
-											 attribute);
-				g_value_take_string (value, str);
-			} else if (attribute == attribute_name_q) {
+			if (attribute == attribute_name_q) {
 				if (file_entry->parent->loaded) {
 					g_value_set_string (value, _("(Empty)"));
 				} else {
@@ -1501,7 +1576,7 @@ nautilus_list_model_finalize (GObject *object)
 	model = NAUTILUS_LIST_MODEL (object);
 
 	if (model->details->highlight_files != NULL) {
-		nautilus_file_list_free (model->details->highlight_files);
+		g_hash_table_destroy (model->details->highlight_files);
 		model->details->highlight_files = NULL;
 	}
 
@@ -1510,6 +1585,15 @@ nautilus_list_model_finalize (GObject *object)
 	G_OBJECT_CLASS (nautilus_list_model_parent_class)->finalize (object);
 }
 
+static void
+row_changed_callback (GtkTreeModel *tree_model,
+		      GtkTreePath  *path,
+		      GtkTreeIter  *iter,
+		      gpointer      data)
+{
+	file_entry_invalidate (g_sequence_get (iter->user_data));
+}
+
 static void
 nautilus_list_model_init (NautilusListModel *model)
 {
@@ -1520,6 +1604,10 @@ nautilus_list_model_init (NautilusListModel *model)
 	model->details->stamp = g_random_int ();
 	model->details->sort_attribute = 0;
 	model->details->columns = g_ptr_array_new ();
+
+	/* Connected before any view, so that views see the new values. */
+	g_signal_connect (model, "row-changed",
+			  G_CALLBACK (row_changed_callback), NULL);
 }
 
 static void
@@ -1648,17 +1736,33 @@ void
 nautilus_list_model_set_highlight_for_files (NautilusListModel *model,
 					     GList *files)
 {
-	if (model->details->highlight_files != NULL) {
-		g_list_foreach (model->details->highlight_files,
-		                refresh_row, model);
-		nautilus_file_list_free (model->details->highlight_files);
-		model->details->highlight_files = NULL;
-	}
+	GHashTable *old_files;
+	GList *highlighted, *l;
+
+	old_files = model->details->highlight_files;
+	model->details->highlight_files = NULL;
 
 	if (files != NULL) {
-		model->details->highlight_files = nautilus_file_list_copy (files);
-		g_list_foreach (model->details->highlight_files,
-		                refresh_row, model);
+		model->details->highlight_files =
+			g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+					       g_object_unref, (GDestroyNotify) nautilus_file_unref);
+		for (l = files; l != NULL; l = l->next) {
+			g_hash_table_insert (model->details->highlight_files,
+					     nautilus_file_get_location (l->data),
+					     nautilus_file_ref (l->data));
+		}
+	}
 
+	if (old_files != NULL) {
+		highlighted = g_hash_table_get_values (old_files);
+		g_list_foreach (highlighted, refresh_row, model);
+		g_list_free (highlighted);
+		g_hash_table_destroy (old_files);
+	}
+
+	if (model->details->highlight_files != NULL) {
+		highlighted = g_hash_table_get_values (model->details->highlight_files);
+		g_list_foreach (highlighted, refresh_row, model);
+		g_list_free (highlighted);
 	}
 }
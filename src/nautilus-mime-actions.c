@@ -276,63 +276,138 @@ filter_non_uri_apps (GList *apps)
 }
 
 
-static gboolean
-nautilus_mime_actions_check_if_required_attributes_ready (NautilusFile *file)
+NautilusFileAttributes 
+nautilus_mime_actions_get_required_file_attributes (void)
 {
-	NautilusFileAttributes attributes;
-	gboolean ready;
+	return NAUTILUS_FILE_ATTRIBUTE_INFO |
+		NAUTILUS_FILE_ATTRIBUTE_LINK_INFO;
+}
 
-	attributes = nautilus_mime_actions_get_required_file_attributes ();
-	ready = nautilus_file_check_if_ready (file, attributes);
+/* What GIO says about the files with one application key, see
+ * nautilus_file_get_application_key. Asking GIO means reading the MIME
+ * caches and the desktop files, so the answers are kept until the MIME
+ * data changes: when Nautilus changes it, or when mimeapps.list or one
+ * of the applications directories changes on disk.
+ */
+typedef struct {
+	gboolean got_default_application;
+	GAppInfo *default_application;
+	gboolean got_applications;
+	GList *applications;
+} MimeApplications;
 
-	return ready;
+static GHashTable *mime_applications_cache = NULL;
+static GList *mime_data_monitors = NULL;
+
+static void
+mime_applications_free (MimeApplications *applications)
+{
+	if (applications->default_application != NULL) {
+		g_object_unref (applications->default_application);
+	}
+	g_list_free_full (applications->applications, g_object_unref);
+	g_slice_free (MimeApplications, applications);
 }
 
-NautilusFileAttributes 
-nautilus_mime_actions_get_required_file_attributes (void)
+static void
+mime_data_changed_callback (GObject *signaller, gpointer user_data)
 {
-	return NAUTILUS_FILE_ATTRIBUTE_INFO |
-		NAUTILUS_FILE_ATTRIBUTE_LINK_INFO;
+	g_hash_table_remove_all (mime_applications_cache);
 }
 
-static gboolean
-file_has_local_path (NautilusFile *file)
+static void
+mime_data_file_changed_callback (GFileMonitor *monitor,
+				 GFile *file,
+				 GFile *other_file,
+				 GFileMonitorEvent event_type,
+				 gpointer user_data)
 {
-	GFile *location;
-	char *path;
-	gboolean res;
+	g_hash_table_remove_all (mime_applications_cache);
+}
 
-	
-	/* Don't only check _is_native, because we want to support
-	   using the fuse path */
-	location = nautilus_file_get_location (file);
-	if (g_file_is_native (location)) {
-		res = TRUE;
+static void
+monitor_mime_data_path (const char *path,
+			gboolean is_directory)
+{
+	GFileMonitor *monitor;
+	GFile *file;
+
+	file = g_file_new_for_path (path);
+	if (is_directory) {
+		monitor = g_file_monitor_directory (file, 0, NULL, NULL);
 	} else {
-		path = g_file_get_path (location);
-		
-		res = path != NULL;
-		
+		monitor = g_file_monitor_file (file, 0, NULL, NULL);
+	}
+	g_object_unref (file);
+
+	if (monitor != NULL) {
+		g_signal_connect (monitor, "changed",
+				  G_CALLBACK (mime_data_file_changed_callback), NULL);
+		mime_data_monitors = g_list_prepend (mime_data_monitors, monitor);
+	}
+}
+
+/* Other programs install applications and change the defaults too. */
+static void
+monitor_mime_data (void)
+{
+	const char * const *dirs;
+	char *path;
+	int i;
+
+	path = g_build_filename (g_get_user_config_dir (), "mimeapps.list", NULL);
+	monitor_mime_data_path (path, FALSE);
+	g_free (path);
+
+	/* These also hold the desktop files, the older mimeapps.list
+	 * and the MIME caches.
+	 */
+	path = g_build_filename (g_get_user_data_dir (), "applications", NULL);
+	monitor_mime_data_path (path, TRUE);
+	g_free (path);
+
+	dirs = g_get_system_data_dirs ();
+	for (i = 0; dirs[i] != NULL; i++) {
+		path = g_build_filename (dirs[i], "applications", NULL);
+		monitor_mime_data_path (path, TRUE);
 		g_free (path);
 	}
-	g_object_unref (location);
-	
-	return res;
 }
 
-GAppInfo *
-nautilus_mime_get_default_application_for_file (NautilusFile *file)
+static MimeApplications *
+lookup_mime_applications (const char *key)
+{
+	MimeApplications *applications;
+
+	if (mime_applications_cache == NULL) {
+		mime_applications_cache =
+			g_hash_table_new_full (g_str_hash, g_str_equal,
+					       g_free, (GDestroyNotify) mime_applications_free);
+		g_signal_connect (nautilus_signaller_get_current (),
+				  "mime_data_changed",
+				  G_CALLBACK (mime_data_changed_callback),
+				  NULL);
+		monitor_mime_data ();
+	}
+
+	applications = g_hash_table_lookup (mime_applications_cache, key);
+	if (applications == NULL) {
+		applications = g_slice_new0 (MimeApplications);
+		g_hash_table_insert (mime_applications_cache, g_strdup (key), applications);
+	}
+
+	return applications;
+}
+
+static GAppInfo *
+get_default_application_for_file (NautilusFile *file)
 {
 	GAppInfo *app;
 	char *mime_type;
 	char *uri_scheme;
 
-	if (!nautilus_mime_actions_check_if_required_attributes_ready (file)) {
-		return NULL;
-	}
-
 	mime_type = nautilus_file_get_mime_type (file);
-	app = g_app_info_get_default_for_type (mime_type, !file_has_local_path (file));
+	app = g_app_info_get_default_for_type (mime_type, !nautilus_file_has_local_path (file));
 	g_free (mime_type);
 
 	if (app == NULL) {
@@ -346,39 +421,28 @@ nautilus_mime_get_default_application_for_file (NautilusFile *file)
 	return app;
 }
 
-static int
-file_compare_by_mime_type (NautilusFile *file_a,
-			   NautilusFile *file_b)
+GAppInfo *
+nautilus_mime_get_default_application_for_file (NautilusFile *file)
 {
-	char *mime_type_a, *mime_type_b;
-	int ret;
-	
-	mime_type_a = nautilus_file_get_mime_type (file_a);
-	mime_type_b = nautilus_file_get_mime_type (file_b);
-	
-	ret = strcmp (mime_type_a, mime_type_b);
-	
-	g_free (mime_type_a);
-	g_free (mime_type_b);
-	
-	return ret;
-}
-
-static int
-file_compare_by_parent_uri (NautilusFile *file_a,
-			    NautilusFile *file_b) {
-	char *parent_uri_a, *parent_uri_b;
-	int ret;
-
-	parent_uri_a = nautilus_file_get_parent_uri (file_a);
-	parent_uri_b = nautilus_file_get_parent_uri (file_b);
+	MimeApplications *applications;
+	char *key;
 
-	ret = strcmp (parent_uri_a, parent_uri_b);
+	key = nautilus_file_get_application_key (file);
+	if (key == NULL) {
+		return NULL;
+	}
 
-	g_free (parent_uri_a);
-	g_free (parent_uri_b);
+	applications = lookup_mime_applications (key);
+	if (!applications->got_default_application) {
+		applications->default_application = get_default_application_for_file (file);
+		applications->got_default_application = TRUE;
+	}
+	g_free (key);
 
-	return ret;
+	if (applications->default_application == NULL) {
+		return NULL;
+	}
+	return g_object_ref (applications->default_application);
 }
 
 static int
@@ -420,17 +484,14 @@ application_compare_by_id (const GAppInfo *app_a,
 	return strcmp (id_a, id_b);
 }
 
-GList *
-nautilus_mime_get_applications_for_file (NautilusFile *file)
+static GList *
+get_applications_for_file (NautilusFile *file)
 {
 	char *mime_type;
 	char *uri_scheme;
 	GList *result;
 	GAppInfo *uri_handler;
 
-	if (!nautilus_mime_actions_check_if_required_attributes_ready (file)) {
-		return NULL;
-	}
 	mime_type = nautilus_file_get_mime_type (file);
 	result = g_app_info_get_all_for_type (mime_type);
 
@@ -443,7 +504,7 @@ nautilus_mime_get_applications_for_file (NautilusFile *file)
 		g_free (uri_scheme);
 	}
 	
-	if (!file_has_local_path (file)) {
+	if (!nautilus_file_has_local_path (file)) {
 		/* Filter out non-uri supporting apps */
 		result = filter_non_uri_apps (result);
 	}
@@ -454,27 +515,87 @@ nautilus_mime_get_applications_for_file (NautilusFile *file)
 	return filter_nautilus_handler (result);
 }
 
+GList *
+nautilus_mime_get_applications_for_file (NautilusFile *file)
+{
+	MimeApplications *applications;
+	char *key;
+	GList *result;
+
+	key = nautilus_file_get_application_key (file);
+	if (key == NULL) {
+		return NULL;
+	}
+
+	applications = lookup_mime_applications (key);
+	if (!applications->got_applications) {
+		applications->applications = get_applications_for_file (file);
+		applications->got_applications = TRUE;
+	}
+	g_free (key);
+
+	result = g_list_copy (applications->applications);
+	g_list_foreach (result, (GFunc) g_object_ref, NULL);
+
+	return result;
+}
+
+/* Returns the files of files that have a key different from all the
+ * files before them, and sets unready if any file is not ready yet.
+ */
+static GList *
+get_files_with_distinct_application_keys (GList *files,
+					  gboolean *unready)
+{
+	GHashTable *keys;
+	GList *l, *result;
+	char *key;
+
+	keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	result = NULL;
+	*unready = FALSE;
+
+	for (l = files; l != NULL; l = l->next) {
+		key = nautilus_file_get_application_key (l->data);
+		if (key == NULL) {
+			*unready = TRUE;
+			break;
+		}
+
+		if (g_hash_table_lookup (keys, key) != NULL) {
+			g_free (key);
+			continue;
+		}
+
+		g_hash_table_insert (keys, key, l->data);
+		result = g_list_prepend (result, l->data);
+	}
+
+	g_hash_table_destroy (keys);
+
+	return g_list_reverse (result);
+}
+
 GAppInfo *
 nautilus_mime_get_default_application_for_files (GList *files)
 {
-	GList *l, *sorted_files;
+	GList *l, *distinct_files;
 	NautilusFile *file;
 	GAppInfo *app, *one_app;
+	gboolean unready;
 
 	g_assert (files != NULL);
 
-	sorted_files = g_list_sort (g_list_copy (files), (GCompareFunc) file_compare_by_mime_type);
+	distinct_files = get_files_with_distinct_application_keys (files, &unready);
+	if (unready) {
+		g_list_free (distinct_files);
+		return NULL;
+	}
 
 	app = NULL;
-	for (l = sorted_files; l != NULL; l = l->next) {
+	for (l = distinct_files; l != NULL; l = l->next) {
 		file = l->data;
 
-		if (l->prev &&
-		    file_compare_by_mime_type (file, l->prev->data) == 0 &&
-		    file_compare_by_parent_uri (file, l->prev->data) == 0) {
-			continue;
-		}
-
 		one_app = nautilus_mime_get_default_application_for_file (file);
 		if (one_app == NULL || (app != NULL && !g_app_info_equal (app, one_app))) {
 			if (app) {
@@ -494,7 +615,7 @@ nautilus_mime_get_default_application_for_files (GList *files)
 		}
 	}
 
-	g_list_free (sorted_files);
+	g_list_free (distinct_files);
 
 	return app;
 }
@@ -548,24 +669,23 @@ intersect_application_lists (GList *a,
 GList *
 nautilus_mime_get_applications_for_files (GList *files)
 {
-	GList *l, *sorted_files;
+	GList *l, *distinct_files;
 	NautilusFile *file;
 	GList *one_ret, *ret;
+	gboolean unready;
 
 	g_assert (files != NULL);
 
-	sorted_files = g_list_sort (g_list_copy (files), (GCompareFunc) file_compare_by_mime_type);
+	distinct_files = get_files_with_distinct_application_keys (files, &unready);
+	if (unready) {
+		g_list_free (distinct_files);
+		return NULL;
+	}
 
 	ret = NULL;
-	for (l = sorted_files; l != NULL; l = l->next) {
+	for (l = distinct_files; l != NULL; l = l->next) {
 		file = l->data;
 
-		if (l->prev &&
-		    file_compare_by_mime_type (file, l->prev->data) == 0 &&
-		    file_compare_by_parent_uri (file, l->prev->data) == 0) {
-			continue;
-		}
-
 		one_ret = nautilus_mime_get_applications_for_file (file);
 		one_ret = g_list_sort (one_ret, (GCompareFunc) application_compare_by_id);
 		if (ret != NULL) {
@@ -579,7 +699,7 @@ nautilus_mime_get_applications_for_files (GList *files)
 		}
 	}
 
-	g_list_free (sorted_files);
+	g_list_free (distinct_files);
 
 	ret = g_list_sort (ret, (GCompareFunc) application_compare_by_name);
 	
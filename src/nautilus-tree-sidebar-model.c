@@ -73,6 +73,8 @@ struct TreeNode {
 	TreeNode *parent;
 	TreeNode *next;
 	TreeNode *prev;
+	/* position in the children of the parent */
+	GSequenceIter *child_ptr;
 
 	/* part of the node used only for directories */
 	int dummy_child_ref_count;
@@ -84,6 +86,11 @@ struct TreeNode {
 	guint files_changed_id;
 
 	TreeNode *first_child;
+	/* the same nodes as the first_child list, so that the
+	 * position of a child and the nth child can be found
+	 * without walking the list.
+	 */
+	GSequence *children;
 
 	/* misc. flags */
 	guint done_loading : 1;
@@ -192,6 +199,11 @@ tree_node_unparent (FMTreeModel *model, TreeNode *node)
 		prev->next = next;
 	}
 
+	if (node->child_ptr != NULL) {
+		g_sequence_remove (node->child_ptr);
+		node->child_ptr = NULL;
+	}
+
 	node->parent = NULL;
 	node->next = NULL;
 	node->prev = NULL;
@@ -217,31 +229,59 @@ tree_node_destroy (FMTreeModel *model, TreeNode *node)
 	g_assert (node->files_changed_id == 0);
 	nautilus_directory_unref (node->directory);
 
+	if (node->children != NULL) {
+		g_sequence_free (node->children);
+	}
+
 	g_free (node);
 }
 
+static TreeNode *
+tree_node_get_last_child (TreeNode *parent)
+{
+	GSequenceIter *end;
+
+	if (parent->children == NULL) {
+		return NULL;
+	}
+
+	end = g_sequence_get_end_iter (parent->children);
+	if (g_sequence_iter_is_begin (end)) {
+		return NULL;
+	}
+	return g_sequence_get (g_sequence_iter_prev (end));
+}
+
 static void
 tree_node_parent (TreeNode *node, TreeNode *parent)
 {
-	TreeNode *first_child;
+	TreeNode *last_child;
 
 	g_assert (parent != NULL);
 	g_assert (node->parent == NULL);
 	g_assert (node->prev == NULL);
 	g_assert (node->next == NULL);
 
-	first_child = parent->first_child;
-	
+	/* New children go last, so that the rows after them, and
+	 * whatever the sort model keeps for them, stay where they are.
+	 */
+	last_child = tree_node_get_last_child (parent);
+
 	node->parent = parent;
 	node->root = parent->root;
-	node->next = first_child;
+	node->prev = last_child;
 
-	if (first_child != NULL) {
-		g_assert (first_child->prev == NULL);
-		first_child->prev = node;
+	if (last_child != NULL) {
+		g_assert (last_child->next == NULL);
+		last_child->next = node;
+	} else {
+		parent->first_child = node;
 	}
 
-	parent->first_child = node;
+	if (parent->children == NULL) {
+		parent->children = g_sequence_new (NULL);
+	}
+	node->child_ptr = g_sequence_append (parent->children, node);
 }
 
 static GdkPixbuf *
@@ -426,22 +466,16 @@ static int
 tree_node_get_child_index (TreeNode *parent, TreeNode *child)
 {
 	int i;
-	TreeNode *node;
 
 	if (child == NULL) {
 		g_assert (tree_node_has_dummy_child (parent));
 		return 0;
 	}
 
-	i = tree_node_has_dummy_child (parent) ? 1 : 0;
-	for (node = parent->first_child; node != NULL; node = node->next, i++) {
-		if (child == node) {
-			return i;
-		}
-	}
+	g_assert (child->parent == parent);
 
-	g_assert_not_reached ();
-	return 0;
+	i = tree_node_has_dummy_child (parent) ? 1 : 0;
+	return i + g_sequence_iter_get_position (child->child_ptr);
 }
 
 static gboolean
@@ -766,8 +800,11 @@ destroy_node (FMTreeModel *model, TreeNode *node)
 static void
 destroy_children (FMTreeModel *model, TreeNode *parent)
 {
-	while (parent->first_child != NULL) {
-		destroy_node (model, parent->first_child);
+	TreeNode *child;
+
+	/* From the end, so that the rows left don't move each time. */
+	while ((child = tree_node_get_last_child (parent)) != NULL) {
+		destroy_node (model, child);
 	}
 }
 
@@ -1343,7 +1380,7 @@ fm_tree_model_iter_has_child (GtkTreeModel *model, GtkTreeIter *iter)
 static int
 fm_tree_model_iter_n_children (GtkTreeModel *model, GtkTreeIter *iter)
 {
-	TreeNode *parent, *node;
+	TreeNode *parent;
 	int n;
 	
 	g_return_val_if_fail (FM_IS_TREE_MODEL (model), FALSE);
@@ -1359,8 +1396,8 @@ fm_tree_model_iter_n_children (GtkTreeModel *model, GtkTreeIter *iter)
 	}
 
 	n = tree_node_has_dummy_child (parent) ? 1 : 0;
-	for (node = parent->first_child; node != NULL; node = node->next) {
-		n++;
+	if (parent->children != NULL) {
+		n += g_sequence_get_length (parent->children);
 	}
 
 	return n;
@@ -1372,6 +1409,7 @@ fm_tree_model_iter_nth_child (GtkTreeModel *model, GtkTreeIter *iter,
 {
 	FMTreeModel *tree_model;
 	TreeNode *parent, *node;
+	GSequenceIter *ptr;
 	int i;
 	
 	g_return_val_if_fail (FM_IS_TREE_MODEL (model), FALSE);
@@ -1396,13 +1434,16 @@ fm_tree_model_iter_nth_child (GtkTreeModel *model, GtkTreeIter *iter,
 	if (n == 0 && i == 1) {
 		return make_iter_for_dummy_row (parent, iter, parent_iter->stamp);
 	}
-	for (node = parent->first_child; i != n; i++, node = node->next) {
-		if (node == NULL) {
-			return make_iter_invalid (iter);
-		}
+	if (n < i || parent->children == NULL) {
+		return make_iter_invalid (iter);
+	}
+
+	ptr = g_sequence_get_iter_at_pos (parent->children, n - i);
+	if (g_sequence_iter_is_end (ptr)) {
+		return make_iter_invalid (iter);
 	}
 
-	return make_iter_for_node (node, iter, parent_iter->stamp);	
+	return make_iter_for_node (g_sequence_get (ptr), iter, parent_iter->stamp);	
 }
 
 static void
@@ -63,6 +63,7 @@
 #include <libnautilus-private/nautilus-desktop-icon-file.h>
 #include <libnautilus-private/nautilus-desktop-directory.h>
 #include <libnautilus-private/nautilus-search-directory.h>
+#include <libnautilus-private/nautilus-selection-set.h>
 #include <libnautilus-private/nautilus-directory.h>
 #include <libnautilus-private/nautilus-dnd.h>
 #include <libnautilus-private/nautilus-file-attributes.h>
@@ -247,6 +248,12 @@ struct NautilusViewDetails
 
 	gboolean selection_was_removed;
 
+	/* The selection as of the last selection change, built when
+	 * first needed and brought up to date after that.
+	 */
+	NautilusSelectionSet *selection;
+	gboolean selection_is_stale;
+
 	gboolean metadata_for_directory_as_file_pending;
 	gboolean metadata_for_files_in_directory_pending;
 
@@ -696,6 +703,65 @@ nautilus_view_get_selection (NautilusView *view)
 	return NAUTILUS_VIEW_CLASS (G_OBJECT_GET_CLASS (view))->get_selection (view);
 }
 
+static gboolean
+get_selection_changes (NautilusView *view,
+		       GList **newly_selected,
+		       GList **newly_unselected)
+{
+	NautilusViewClass *klass;
+
+	klass = NAUTILUS_VIEW_CLASS (G_OBJECT_GET_CLASS (view));
+	if (klass->get_selection_changes == NULL) {
+		return FALSE;
+	}
+	return klass->get_selection_changes (view, newly_selected, newly_unselected);
+}
+
+/* Once made, the set follows the changes the view reports, and is only
+ * compared with the whole selection for views that can't report them.
+ */
+static NautilusSelectionSet *
+get_selection_set (NautilusView *view)
+{
+	GList *selection, *newly_selected, *newly_unselected, *l;
+
+	if (view->details->selection == NULL) {
+		/* The changes so far are part of the selection read here. */
+		if (get_selection_changes (view, &newly_selected, &newly_unselected)) {
+			g_list_free (newly_selected);
+			g_list_free (newly_unselected);
+		}
+		selection = nautilus_view_get_selection (view);
+		view->details->selection = nautilus_selection_set_new_from_list (selection);
+		nautilus_file_list_free (selection);
+	} else if (view->details->selection_is_stale) {
+		if (get_selection_changes (view, &newly_selected, &newly_unselected)) {
+			for (l = newly_unselected; l != NULL; l = l->next) {
+				nautilus_selection_set_remove (view->details->selection, l->data);
+			}
+			for (l = newly_selected; l != NULL; l = l->next) {
+				nautilus_selection_set_add (view->details->selection, l->data);
+			}
+			g_list_free (newly_selected);
+			g_list_free (newly_unselected);
+		} else {
+			selection = nautilus_view_get_selection (view);
+			nautilus_selection_set_update (view->details->selection, selection);
+			nautilus_file_list_free (selection);
+		}
+	}
+	view->details->selection_is_stale = FALSE;
+
+	return view->details->selection;
+}
+
+static void
+forget_selection_set (NautilusView *view)
+{
+	nautilus_selection_set_free (view->details->selection);
+	view->details->selection = NULL;
+}
+
 /**
  * nautilus_view_update_menus:
  * 
@@ -764,21 +830,6 @@ application_launch_parameters_free (ApplicationLaunchParameters *parameters)
 	g_free (parameters);
 }			      
 
-static GList *
-file_and_directory_list_to_files (GList *fad_list)
-{
-	GList *res, *l;
-	FileAndDirectory *fad;
-
-	res = NULL;
-	for (l = fad_list; l != NULL; l = l->next) {
-		fad = l->data;
-		res = g_list_prepend (res, nautilus_file_ref (fad->file));
-	}
-	return g_list_reverse (res);
-}
-
-
 static GList *
 file_and_directory_list_from_files (NautilusDirectory *directory, GList *files)
 {
@@ -2188,9 +2239,8 @@ all_selected_items_in_trash (NautilusView *view)
 	 * check that parent directory. Otherwise we have to inspect
 	 * each selected item.
 	 */
-	selection = nautilus_view_get_selection (view);
+	selection = nautilus_selection_set_peek_files (get_selection_set (view));
 	result = (selection == NULL) ? FALSE : all_files_in_trash (selection);
-	nautilus_file_list_free (selection);
 
 	return result;
 }
@@ -2454,15 +2504,7 @@ nautilus_view_grab_focus (NautilusView *view)
 int
 nautilus_view_get_selection_count (NautilusView *view)
 {
-	/* FIXME: This could be faster if we special cased it in subclasses */
-	GList *files;
-	int len;
-
-	files = nautilus_view_get_selection (NAUTILUS_VIEW (view));
-	len = g_list_length (files);
-	nautilus_file_list_free (files);
-	
-	return len;
+	return nautilus_selection_set_get_count (get_selection_set (view));
 }
 
 static void
@@ -2809,6 +2851,7 @@ nautilus_view_finalize (GObject *object)
 	}
 
 	g_hash_table_destroy (view->details->non_ready_files);
+	nautilus_selection_set_free (view->details->selection);
 
 	G_OBJECT_CLASS (nautilus_view_parent_class)->finalize (object);
 }
@@ -2823,13 +2866,12 @@ nautilus_view_finalize (GObject *object)
 void
 nautilus_view_display_selection_info (NautilusView *view)
 {
-	GList *selection;
+	NautilusSelectionSet *selection;
+	const GList *files;
 	goffset non_folder_size;
 	gboolean non_folder_size_known;
 	guint non_folder_count, folder_count, folder_item_count;
 	gboolean folder_item_count_known;
-	guint file_item_count;
-	GList *p;
 	char *first_item_name;
 	char *non_folder_str;
 	char *folder_count_str;
@@ -2838,19 +2880,24 @@ nautilus_view_display_selection_info (NautilusView *view)
 	char *view_status_string;
 	char *free_space_str;
 	char *obj_selected_free_space_str;
-	NautilusFile *file;
 
 	g_return_if_fail (NAUTILUS_IS_VIEW (view));
 
-	selection = nautilus_view_get_selection (view);
-	
-	folder_item_count_known = TRUE;
-	folder_count = 0;
-	folder_item_count = 0;
-	non_folder_count = 0;
-	non_folder_size_known = FALSE;
-	non_folder_size = 0;
+	selection = get_selection_set (view);
+	nautilus_selection_set_get_totals (selection,
+					   &folder_count,
+					   &folder_item_count,
+					   &folder_item_count_known,
+					   &non_folder_count,
+					   &non_folder_size,
+					   &non_folder_size_known);
+
 	first_item_name = NULL;
+	files = nautilus_selection_set_peek_files (selection);
+	if (files != NULL) {
+		first_item_name = nautilus_file_get_display_name (files->data);
+	}
+
 	folder_count_str = NULL;
 	non_folder_str = NULL;
 	folder_item_count_str = NULL;
@@ -2859,30 +2906,6 @@ nautilus_view_display_selection_info (NautilusView *view)
 	status_string = NULL;
 	view_status_string = NULL;
 	
-	for (p = selection; p != NULL; p = p->next) {
-		file = p->data;
-		if (nautilus_file_is_directory (file)) {
-			folder_count++;
-			if (nautilus_file_get_directory_item_count (file, &file_item_count, NULL)) {
-				folder_item_count += file_item_count;
-			} else {
-				folder_item_count_known = FALSE;
-			}
-		} else {
-			non_folder_count++;
-			if (!nautilus_file_can_get_size (file)) {
-				non_folder_size_known = TRUE;
-				non_folder_size += nautilus_file_get_size (file);
-			}
-		}
-
-		if (first_item_name == NULL) {
-			first_item_name = nautilus_file_get_display_name (file);
-		}
-	}
-	
-	nautilus_file_list_free (selection);
-	
 	/* Break out cases for localization's sake. But note that there are still pieces
 	 * being assembled in a particular order, which may be a problem for some localizers.
 	 */
@@ -3507,8 +3530,8 @@ process_old_files (NautilusView *view)
 {
 	GList *files_added, *files_changed, *node;
 	FileAndDirectory *pending;
-	GList *selection, *files;
-	gboolean send_selection_change;
+	NautilusSelectionSet *selection;
+	gboolean send_selection_change, still_shown;
 
 	files_added = view->details->old_added_files;
 	files_changed = view->details->old_changed_files;
@@ -3526,21 +3549,27 @@ process_old_files (NautilusView *view)
 
 		for (node = files_changed; node != NULL; node = node->next) {
 			pending = node->data;
+			still_shown = still_should_show_file (view, pending->file, pending->directory);
 			g_signal_emit (view,
-				       signals[still_should_show_file (view, pending->file, pending->directory)
-					       ? FILE_CHANGED : REMOVE_FILE], 0,
+				       signals[still_shown ? FILE_CHANGED : REMOVE_FILE], 0,
 				       pending->file, pending->directory);
+			if (!still_shown && view->details->selection != NULL) {
+				nautilus_selection_set_remove (view->details->selection,
+							       pending->file);
+			}
 		}
 
 		g_signal_emit (view, signals[END_FILE_CHANGES], 0);
 
 		if (files_changed != NULL) {
-			selection = nautilus_view_get_selection (view);
-			files = file_and_directory_list_to_files (files_changed);
-			send_selection_change = eel_g_lists_sort_and_check_for_intersection
-				(&files, &selection);
-			nautilus_file_list_free (files);
-			nautilus_file_list_free (selection);
+			selection = get_selection_set (view);
+			for (node = files_changed; node != NULL; node = node->next) {
+				pending = node->data;
+				if (nautilus_selection_set_contains (selection, pending->file)) {
+					nautilus_selection_set_file_changed (selection, pending->file);
+					send_selection_change = TRUE;
+				}
+			}
 		}
 		
 		file_and_directory_list_free (view->details->old_added_files);
@@ -4149,7 +4178,7 @@ special_link_in_selection (NautilusView *view)
 
 	saw_link = FALSE;
 
-	selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
+	selection = nautilus_selection_set_peek_files (get_selection_set (view));
 
 	for (node = selection; node != NULL; node = node->next) {
 		file = NAUTILUS_FILE (node->data);
@@ -4161,8 +4190,6 @@ special_link_in_selection (NautilusView *view)
 		}
 	}
 	
-	nautilus_file_list_free (selection);
-	
 	return saw_link;
 }
 
@@ -4182,7 +4209,7 @@ desktop_or_home_dir_in_selection (NautilusView *view)
 
 	saw_desktop_or_home_dir = FALSE;
 
-	selection = nautilus_view_get_selection (NAUTILUS_VIEW (view));
+	selection = nautilus_selection_set_peek_files (get_selection_set (view));
 
 	for (node = selection; node != NULL; node = node->next) {
 		file = NAUTILUS_FILE (node->data);
@@ -4196,8 +4223,6 @@ desktop_or_home_dir_in_selection (NautilusView *view)
 		}
 	}
 	
-	nautilus_file_list_free (selection);
-	
 	return saw_desktop_or_home_dir;
 }
 
@@ -4546,9 +4571,10 @@ add_x_content_apps (NautilusView *view, NautilusFile *file, GList **applications
 }
 
 static void
-reset_open_with_menu (NautilusView *view, GList *selection)
+reset_open_with_menu (NautilusView *view)
 {
-	GList *applications, *node;
+	NautilusSelectionSet *selection_set;
+	GList *selection, *applications, *node, *type_files;
 	NautilusFile *file;
 	gboolean submenu_visible, filter_default;
 	int num_applications;
@@ -4571,6 +4597,9 @@ reset_open_with_menu (NautilusView *view, GList *selection)
 				      &view->details->open_with_merge_id,
 				      &view->details->open_with_action_group);
 
+	selection_set = get_selection_set (view);
+	selection = nautilus_selection_set_peek_files (selection_set);
+
 	other_applications_visible = (selection != NULL);
 	filter_default = (selection != NULL);
 
@@ -4583,16 +4612,24 @@ reset_open_with_menu (NautilusView *view, GList *selection)
 					       nautilus_file_is_directory (file));
 	}
 
+	/* The applications only depend on the kind of file, so one
+	 * file of each kind will do. Every file in the set is filed
+	 * under a kind, so there is one as soon as there is a file.
+	 */
+	type_files = nautilus_selection_set_get_type_files (selection_set);
+
 	default_app = NULL;
 	if (filter_default) {
-		default_app = nautilus_mime_get_default_application_for_files (selection);
+		default_app = nautilus_mime_get_default_application_for_files (type_files);
 	}
 
 	applications = NULL;
 	if (other_applications_visible) {
-		applications = nautilus_mime_get_applications_for_files (selection);
+		applications = nautilus_mime_get_applications_for_files (type_files);
 	}
 
+	g_list_free (type_files);
+
 	if (g_list_length (selection) == 1) {
 		add_x_content_apps (view, NAUTILUS_FILE (selection->data), &applications);
 	}
@@ -7414,8 +7451,8 @@ clipboard_targets_received (GtkClipboard     *clipboard,
 	}
 	
 	
-	selection = nautilus_view_get_selection (view);
-	count = g_list_length (selection);
+	selection = nautilus_selection_set_peek_files (get_selection_set (view));
+	count = nautilus_view_get_selection_count (view);
 	
 	action = gtk_action_group_get_action (view->details->dir_action_group,
 					      NAUTILUS_ACTION_PASTE);
@@ -7439,8 +7476,6 @@ clipboard_targets_received (GtkClipboard     *clipboard,
 				  GPOINTER_TO_INT (g_object_get_data (G_OBJECT (action),
 								      "can-paste-according-to-destination")));
 
-	nautilus_file_list_free (selection);
-	
 	g_object_unref (view);
 }
 
@@ -8252,13 +8287,10 @@ clipboard_changed_callback (NautilusClipboardMonitor *monitor, NautilusView *vie
 		return;
 	}
 
-	selection = nautilus_view_get_selection (view);
-	selection_count = g_list_length (selection);
+	selection = nautilus_selection_set_peek_files (get_selection_set (view));
+	selection_count = nautilus_view_get_selection_count (view);
 
 	real_update_paste_menu (view, selection, selection_count);
-
-	nautilus_file_list_free (selection);
-	
 }
 
 static gboolean
@@ -8291,7 +8323,7 @@ has_writable_extra_pane (NautilusView *view)
 static void
 real_update_menus (NautilusView *view)
 {
-	GList *selection, *l;
+	GList *selection, *l, *type_files;
 	gint selection_count;
 	const char *tip, *label;
 	char *label_with_underscore;
@@ -8317,8 +8349,8 @@ real_update_menus (NautilusView *view)
 	gboolean next_pane_is_writable;
 	gboolean show_properties;
 
-	selection = nautilus_view_get_selection (view);
-	selection_count = g_list_length (selection);
+	selection = nautilus_selection_set_peek_files (get_selection_set (view));
+	selection_count = nautilus_view_get_selection_count (view);
 
 	selection_contains_special_link = special_link_in_selection (view);
 	selection_contains_desktop_or_home_dir = desktop_or_home_dir_in_selection (view);
@@ -8388,7 +8420,9 @@ real_update_menus (NautilusView *view)
 	app_icon = NULL;
 
 	if (can_open && show_app) {
-		app = nautilus_mime_get_default_application_for_files (selection);
+		type_files = nautilus_selection_set_get_type_files (get_selection_set (view));
+		app = nautilus_mime_get_default_application_for_files (type_files);
+		g_list_free (type_files);
 	}
 
 	if (app != NULL) {
@@ -8484,7 +8518,7 @@ real_update_menus (NautilusView *view)
 	g_free (label_with_underscore);
 
 	/* Broken into its own function just for convenience */
-	reset_open_with_menu (view, selection);
+	reset_open_with_menu (view);
 	reset_extension_actions_menu (view, selection);
 
 	if (all_selected_items_in_trash (view)) {
@@ -8615,8 +8649,6 @@ real_update_menus (NautilusView *view)
 
 	update_undo_actions (view);
 
-	nautilus_file_list_free (selection);
-
 	if (view->details->scripts_invalid) {
 		update_scripts_menu (view);
 	}
@@ -8889,10 +8921,14 @@ nautilus_view_notify_selection_changed (NautilusView *view)
 	
 	g_return_if_fail (NAUTILUS_IS_VIEW (view));
 
-	selection = nautilus_view_get_selection (view);
-	window = nautilus_view_get_containing_window (view);
-	DEBUG_FILES (selection, "Selection changed in window %p", window);
-	nautilus_file_list_free (selection);
+	view->details->selection_is_stale = TRUE;
+
+	if (DEBUGGING) {
+		selection = nautilus_view_get_selection (view);
+		window = nautilus_view_get_containing_window (view);
+		DEBUG_FILES (selection, "Selection changed in window %p", window);
+		nautilus_file_list_free (selection);
+	}
 
 	view->details->selection_was_removed = FALSE;
 
@@ -8954,6 +8990,7 @@ load_directory (NautilusView *view,
 
 	nautilus_view_stop_loading (view);
 	g_signal_emit (view, signals[CLEAR], 0);
+	forget_selection_set (view);
 
 	view->details->loading = TRUE;
 
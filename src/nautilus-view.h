@@ -165,6 +165,16 @@ struct NautilusViewClass {
 	 * in the selection is not included.
 	 */
 	GList *	(* get_selection_for_file_transfer)(NautilusView *view);
+
+	/* get_selection_changes is a function pointer that subclasses may
+	 * override to hand out the files selected and unselected since it
+	 * was last called, in lists of unreffed NautilusFile pointers to be
+	 * freed with g_list_free. It returns FALSE if the view can't tell,
+	 * in which case get_selection is used instead.
+	 */
+	gboolean (* get_selection_changes)	(NautilusView *view,
+						 GList **newly_selected,
+						 GList **newly_unselected);
 	
         /* select_all is a function pointer that subclasses must override to
          * select all of the items in the view */
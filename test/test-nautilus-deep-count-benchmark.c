@@ -0,0 +1,167 @@
+/* Times hard link dedupe in deep counts: first the inode set against
+ * a linear scan, then deep counts of a synthetic tree in which every
+ * tenth file is a hard link, without and with the deep count cache.
+ * See test-nautilus-deep-count for the check of the totals. The cache
+ * goes to a scratch directory.
+ *
+ * Usage: test-nautilus-deep-count-benchmark [files [files-per-directory]]
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-deep-count-cache.h>
+#include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-attributes.h>
+#include <libnautilus-private/nautilus-inode-set.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void
+make_tree (const char *root, int n_files, int files_per_dir)
+{
+	char *dir, *path, *target;
+	int i;
+
+	dir = NULL;
+	target = NULL;
+	for (i = 0; i < n_files; i++) {
+		if (i % files_per_dir == 0) {
+			g_free (dir);
+			dir = g_strdup_printf ("%s/dir-%d", root, i / files_per_dir);
+			g_mkdir_with_parents (dir, 0755);
+		}
+
+		path = g_strdup_printf ("%s/file-%d", dir, i);
+		if (i % 10 == 9 && target != NULL) {
+			if (link (target, path) != 0) {
+				g_error ("Could not link %s to %s", path, target);
+			}
+			g_free (path);
+		} else {
+			if (!g_file_set_contents (path, "0123456789", 10, NULL)) {
+				g_error ("Could not create %s", path);
+			}
+			g_free (target);
+			target = path;
+		}
+	}
+
+	g_free (target);
+	g_free (dir);
+}
+
+static gboolean
+linear_add (GArray *array, guint64 inode)
+{
+	guint i;
+
+	for (i = 0; i < array->len; i++) {
+		if (g_array_index (array, guint64, i) == inode) {
+			return FALSE;
+		}
+	}
+	g_array_append_val (array, inode);
+
+	return TRUE;
+}
+
+static void
+time_inode_sets (guint n)
+{
+	NautilusInodeSet *set;
+	GArray *array;
+	GTimer *timer;
+	guint i, n_seen;
+
+	timer = g_timer_new ();
+
+	set = nautilus_inode_set_new ();
+	n_seen = 0;
+	g_timer_start (timer);
+	for (i = 0; i < 2 * n; i++) {
+		n_seen += !nautilus_inode_set_add (set, 1, 1 + i % n);
+	}
+	g_print ("inode set, %u inodes: %.3f s (%u seen)\n",
+		 n, g_timer_elapsed (timer, NULL), n_seen);
+	nautilus_inode_set_free (set);
+
+	/* The scan is quadratic, keep it to something that finishes. */
+	n = MIN (n, 50000);
+	array = g_array_new (FALSE, FALSE, sizeof (guint64));
+	n_seen = 0;
+	g_timer_start (timer);
+	for (i = 0; i < 2 * n; i++) {
+		n_seen += !linear_add (array, 1 + i % n);
+	}
+	g_print ("linear scan, %u inodes: %.3f s (%u seen)\n",
+		 n, g_timer_elapsed (timer, NULL), n_seen);
+	g_array_free (array, TRUE);
+
+	g_timer_destroy (timer);
+}
+
+static void
+time_deep_count (NautilusFile *file, const char *label)
+{
+	GTimer *timer;
+	guint directory_count, file_count, unreadable_count;
+	guint hits, misses, previous_hits, previous_misses;
+	goffset total_size;
+
+	nautilus_deep_count_cache_get_statistics (&previous_hits, &previous_misses);
+
+	timer = g_timer_new ();
+	nautilus_file_recompute_deep_counts (file);
+	while (nautilus_file_get_deep_counts (file, NULL, NULL, NULL, NULL, TRUE)
+	       != NAUTILUS_REQUEST_DONE) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	nautilus_file_get_deep_counts (file, &directory_count, &file_count,
+				       &unreadable_count, &total_size, TRUE);
+	nautilus_deep_count_cache_get_statistics (&hits, &misses);
+	g_print ("%s deep count: %.3f s, %u directories, %u files, %" G_GOFFSET_FORMAT " bytes, "
+		 "%u cache hits, %u misses\n",
+		 label, g_timer_elapsed (timer, NULL),
+		 directory_count, file_count, total_size,
+		 hits - previous_hits, misses - previous_misses);
+	g_timer_destroy (timer);
+}
+
+int
+main (int argc, char* argv[])
+{
+	NautilusFile *file;
+	char *root, *tree, *cache, *uri;
+	int n_files, files_per_dir;
+
+	root = test_make_temp_directory ("nautilus-deep-count-bench");
+	tree = g_build_filename (root, "tree", NULL);
+	cache = g_build_filename (root, "cache", NULL);
+	g_setenv ("XDG_CACHE_HOME", cache, TRUE);
+
+	test_init (&argc, &argv);
+
+	n_files = argc > 1 ? atoi (argv[1]) : 1000000;
+	files_per_dir = argc > 2 ? atoi (argv[2]) : 1000;
+
+	time_inode_sets (n_files / 10);
+
+	make_tree (tree, n_files, files_per_dir);
+	uri = g_filename_to_uri (tree, NULL, NULL);
+
+	file = nautilus_file_get_by_uri (uri);
+	nautilus_file_monitor_add (file, &file, NAUTILUS_FILE_ATTRIBUTE_DEEP_COUNTS);
+	time_deep_count (file, "first");
+	time_deep_count (file, "cached");
+	nautilus_file_monitor_remove (file, &file);
+	nautilus_file_unref (file);
+
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (cache);
+	g_free (tree);
+	g_free (root);
+
+	return test_quit (0);
+}
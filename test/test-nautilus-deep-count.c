@@ -0,0 +1,163 @@
+/* Checks hard link dedupe in deep counts: the inode set on its own,
+ * then deep counts of a small tree in which some files are hard links
+ * to others, counted without the deep count cache, from the entries
+ * added to it, and from the file it is written to. The cache goes to
+ * a scratch directory.
+ *
+ * Usage: test-nautilus-deep-count
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-deep-count-cache.h>
+#include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-attributes.h>
+#include <libnautilus-private/nautilus-inode-set.h>
+#include <unistd.h>
+
+/* Every link is counted as a file, but each file's size only once. */
+#define EXPECTED_DIRECTORIES 2
+#define EXPECTED_FILES 7
+#define EXPECTED_SIZE 60
+
+static void
+make_sized_file (const char *root, const char *name, gsize size)
+{
+	char *path, *contents;
+
+	path = g_build_filename (root, name, NULL);
+	test_make_file (path);
+	contents = g_strnfill (size, 'x');
+	if (!g_file_set_contents (path, contents, size, NULL)) {
+		g_error ("Could not write %s", path);
+	}
+	g_free (contents);
+	g_free (path);
+}
+
+static void
+make_link (const char *root, const char *target, const char *name)
+{
+	char *target_path, *path;
+
+	target_path = g_build_filename (root, target, NULL);
+	path = g_build_filename (root, name, NULL);
+	if (link (target_path, path) != 0) {
+		g_error ("Could not link %s to %s", path, target_path);
+	}
+	g_free (path);
+	g_free (target_path);
+}
+
+static void
+check_inode_set (void)
+{
+	NautilusInodeSet *set;
+	guint i, n_added;
+
+	set = nautilus_inode_set_new ();
+
+	n_added = 0;
+	for (i = 0; i < 2000; i++) {
+		n_added += nautilus_inode_set_add (set, 1 + i % 2, 1 + i % 500);
+	}
+	if (n_added != 1000 || nautilus_inode_set_size (set) != 1000) {
+		g_error ("inode set: %u added, size %u, expected 1000",
+			 n_added, nautilus_inode_set_size (set));
+	}
+
+	if (!nautilus_inode_set_contains (set, 2, 500) ||
+	    nautilus_inode_set_contains (set, 3, 1)) {
+		g_error ("inode set: wrong contents");
+	}
+	if (nautilus_inode_set_add (set, 1, 0) ||
+	    nautilus_inode_set_contains (set, 1, 0)) {
+		g_error ("inode set: inode 0 added");
+	}
+
+	nautilus_inode_set_free (set);
+}
+
+/* Counts file again and checks the totals and the number of
+ * directories found in the cache.
+ */
+static void
+check_deep_count (NautilusFile *file, const char *label, guint expected_hits)
+{
+	guint directory_count, file_count, unreadable_count;
+	guint hits, misses, previous_hits, previous_misses;
+	goffset total_size;
+
+	nautilus_deep_count_cache_get_statistics (&previous_hits, &previous_misses);
+
+	nautilus_file_recompute_deep_counts (file);
+	while (nautilus_file_get_deep_counts (file, NULL, NULL, NULL, NULL, TRUE)
+	       != NAUTILUS_REQUEST_DONE) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	nautilus_file_get_deep_counts (file, &directory_count, &file_count,
+				       &unreadable_count, &total_size, TRUE);
+	if (directory_count != EXPECTED_DIRECTORIES ||
+	    file_count != EXPECTED_FILES ||
+	    unreadable_count != 0 ||
+	    total_size != EXPECTED_SIZE) {
+		g_error ("%s: %u directories, %u files, %u unreadable, %" G_GOFFSET_FORMAT " bytes, "
+			 "expected %d, %d, 0, %d",
+			 label, directory_count, file_count, unreadable_count, total_size,
+			 EXPECTED_DIRECTORIES, EXPECTED_FILES, EXPECTED_SIZE);
+	}
+
+	nautilus_deep_count_cache_get_statistics (&hits, &misses);
+	if (hits - previous_hits != expected_hits) {
+		g_error ("%s: %u cache hits, expected %u",
+			 label, hits - previous_hits, expected_hits);
+	}
+}
+
+int
+main (int argc, char* argv[])
+{
+	NautilusFile *file;
+	char *root, *tree, *cache, *uri;
+
+	root = test_make_temp_directory ("nautilus-deep-count-test");
+	tree = g_build_filename (root, "tree", NULL);
+	cache = g_build_filename (root, "cache", NULL);
+	g_setenv ("XDG_CACHE_HOME", cache, TRUE);
+
+	test_init (&argc, &argv);
+
+	check_inode_set ();
+
+	/* Links within a directory, across directories and to a file
+	 * in the directory being counted, which is never cached.
+	 */
+	make_sized_file (tree, "a/file-1", 10);
+	make_sized_file (tree, "a/file-2", 20);
+	make_link (tree, "a/file-1", "a/link-1");
+	make_sized_file (tree, "b/file-3", 30);
+	make_link (tree, "a/file-1", "b/link-1");
+	make_link (tree, "a/file-2", "b/link-2");
+	make_link (tree, "b/file-3", "link-3");
+	uri = g_filename_to_uri (tree, NULL, NULL);
+
+	file = nautilus_file_get_by_uri (uri);
+	nautilus_file_monitor_add (file, &file, NAUTILUS_FILE_ATTRIBUTE_DEEP_COUNTS);
+
+	check_deep_count (file, "fresh", 0);
+	check_deep_count (file, "cached", EXPECTED_DIRECTORIES);
+	nautilus_deep_count_cache_save ();
+	check_deep_count (file, "saved", EXPECTED_DIRECTORIES);
+
+	nautilus_file_monitor_remove (file, &file);
+	nautilus_file_unref (file);
+
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (cache);
+	g_free (tree);
+	g_free (root);
+
+	return test_quit (0);
+}
@@ -0,0 +1,126 @@
+/* Times the string attributes the list view shows for a directory of
+ * files, the first time they are formatted and then when they are
+ * asked for again, as on every redraw. See
+ * test-nautilus-file-attributes for the check of what is kept.
+ *
+ * Usage: test-nautilus-file-attributes-benchmark [files [rounds]]
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-directory.h>
+#include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-attributes.h>
+#include <stdlib.h>
+
+static const char *attribute_names[] = {
+	"name",
+	"size",
+	"type",
+	"date_modified",
+	"date_accessed",
+	"permissions",
+	"octal_permissions",
+	"owner",
+	"group",
+};
+
+static GMainLoop *loop;
+static GList *directory_files;
+
+static void
+make_files (const char *root, int n_files)
+{
+	char *path;
+	int i;
+
+	for (i = 0; i < n_files; i++) {
+		path = g_strdup_printf ("%s/file-%d.txt", root, i);
+		if (!g_file_set_contents (path, "0123456789", i % 10, NULL)) {
+			g_error ("Could not create %s", path);
+		}
+		g_free (path);
+	}
+}
+
+static void
+files_ready_cb (NautilusDirectory *directory,
+		GList *files,
+		gpointer data)
+{
+	directory_files = nautilus_file_list_copy (files);
+	g_main_loop_quit (loop);
+}
+
+static void
+time_attributes (const char *label, int rounds)
+{
+	GQuark attributes[G_N_ELEMENTS (attribute_names)];
+	GTimer *timer;
+	GList *l;
+	guint i, hits, misses, previous_hits, previous_misses, n_calls;
+	int round;
+
+	for (i = 0; i < G_N_ELEMENTS (attribute_names); i++) {
+		attributes[i] = g_quark_from_string (attribute_names[i]);
+	}
+
+	nautilus_file_get_formatted_attribute_statistics (&previous_hits, &previous_misses);
+
+	timer = g_timer_new ();
+	n_calls = 0;
+	for (round = 0; round < rounds; round++) {
+		for (l = directory_files; l != NULL; l = l->next) {
+			for (i = 0; i < G_N_ELEMENTS (attributes); i++) {
+				g_free (nautilus_file_get_string_attribute_with_default_q (l->data,
+											 attributes[i]));
+				n_calls++;
+			}
+		}
+	}
+
+	nautilus_file_get_formatted_attribute_statistics (&hits, &misses);
+	g_print ("%s: %u calls in %.3f s (%.0f ns per call), %u hits, %u misses\n",
+		 label, n_calls, g_timer_elapsed (timer, NULL),
+		 g_timer_elapsed (timer, NULL) * 1e9 / MAX (n_calls, 1),
+		 hits - previous_hits, misses - previous_misses);
+	g_timer_destroy (timer);
+}
+
+int
+main (int argc, char* argv[])
+{
+	NautilusDirectory *directory;
+	char *root, *uri;
+	int n_files, rounds;
+
+	test_init (&argc, &argv);
+
+	n_files = argc > 1 ? atoi (argv[1]) : 50000;
+	rounds = argc > 2 ? atoi (argv[2]) : 20;
+
+	root = test_make_temp_directory ("nautilus-attributes-bench");
+	make_files (root, n_files);
+	uri = g_filename_to_uri (root, NULL, NULL);
+
+	loop = g_main_loop_new (NULL, FALSE);
+	directory = nautilus_directory_get_by_uri (uri);
+	nautilus_directory_call_when_ready (directory,
+					    NAUTILUS_FILE_ATTRIBUTE_INFO,
+					    TRUE,
+					    files_ready_cb, NULL);
+	g_main_loop_run (loop);
+
+	time_attributes ("first round", 1);
+	time_attributes ("later rounds", rounds);
+
+	nautilus_file_list_free (directory_files);
+	nautilus_directory_unref (directory);
+	g_main_loop_unref (loop);
+
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (root);
+
+	return test_quit (0);
+}
@@ -0,0 +1,186 @@
+/* Checks the formatted string attributes kept with files: asking again
+ * gives the kept string, nautilus_file_changed makes it be formatted
+ * again, and so does reading new information for a file that was
+ * changed on disk.
+ *
+ * Usage: test-nautilus-file-attributes
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-directory.h>
+#include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-attributes.h>
+#include <glib/gstdio.h>
+
+#define N_FILES 10
+
+/* Attributes that are kept whatever the preferences. Dates aren't,
+ * those of new files read "today".
+ */
+static const char *attribute_names[] = {
+	"type",
+	"size",
+	"size_detail",
+	"permissions",
+	"octal_permissions",
+	"owner",
+};
+
+static GList *directory_files;
+static gboolean ready;
+
+static void
+files_ready_cb (NautilusDirectory *directory,
+		GList *files,
+		gpointer data)
+{
+	directory_files = nautilus_file_list_copy (files);
+	ready = TRUE;
+}
+
+static void
+file_ready_cb (NautilusFile *file,
+	       gpointer data)
+{
+	ready = TRUE;
+}
+
+static void
+wait_until_ready (void)
+{
+	while (!ready) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+	ready = FALSE;
+}
+
+/* Returns the attribute, checking that it was formatted again, or
+ * taken from what was kept.
+ */
+static char *
+get_attribute (NautilusFile *file,
+	       const char *name,
+	       gboolean expect_kept)
+{
+	guint hits, misses, previous_hits, previous_misses;
+	char *value;
+
+	nautilus_file_get_formatted_attribute_statistics (&previous_hits, &previous_misses);
+	value = nautilus_file_get_string_attribute (file, name);
+	nautilus_file_get_formatted_attribute_statistics (&hits, &misses);
+
+	if (expect_kept && (hits != previous_hits + 1 || misses != previous_misses)) {
+		g_error ("%s of %s was formatted again", name, nautilus_file_get_name (file));
+	}
+	if (!expect_kept && (hits != previous_hits || misses != previous_misses + 1)) {
+		g_error ("%s of %s was not formatted again", name, nautilus_file_get_name (file));
+	}
+
+	return value;
+}
+
+static void
+check_same (NautilusFile *file,
+	    const char *name,
+	    const char *value,
+	    const char *expected)
+{
+	if (g_strcmp0 (value, expected) != 0) {
+		g_error ("%s of %s is \"%s\", expected \"%s\"",
+			 name, nautilus_file_get_name (file), value, expected);
+	}
+}
+
+static void
+check_file (NautilusFile *file)
+{
+	char *fresh, *kept;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (attribute_names); i++) {
+		/* Whether the directory load formatted it already or not. */
+		g_free (nautilus_file_get_string_attribute (file, attribute_names[i]));
+
+		fresh = get_attribute (file, attribute_names[i], TRUE);
+		nautilus_file_changed (file);
+		kept = get_attribute (file, attribute_names[i], FALSE);
+		check_same (file, attribute_names[i], kept, fresh);
+		g_free (kept);
+
+		kept = get_attribute (file, attribute_names[i], TRUE);
+		check_same (file, attribute_names[i], kept, fresh);
+		g_free (kept);
+		g_free (fresh);
+	}
+}
+
+int
+main (int argc, char* argv[])
+{
+	NautilusDirectory *directory;
+	NautilusFile *file;
+	GFile *location;
+	char *root, *uri, *path, *old_size, *size, *permissions;
+	GList *l;
+	int i;
+
+	test_init (&argc, &argv);
+
+	root = test_make_temp_directory ("nautilus-attributes-test");
+	for (i = 0; i < N_FILES; i++) {
+		path = g_strdup_printf ("%s/file-%d.txt", root, i);
+		g_file_set_contents (path, "0123456789", i, NULL);
+		g_chmod (path, 0644);
+		g_free (path);
+	}
+	uri = g_filename_to_uri (root, NULL, NULL);
+
+	directory = nautilus_directory_get_by_uri (uri);
+	nautilus_directory_call_when_ready (directory,
+					    NAUTILUS_FILE_ATTRIBUTE_INFO,
+					    TRUE,
+					    files_ready_cb, NULL);
+	wait_until_ready ();
+	if (g_list_length (directory_files) != N_FILES) {
+		g_error ("%u files, expected %d", g_list_length (directory_files), N_FILES);
+	}
+
+	for (l = directory_files; l != NULL; l = l->next) {
+		check_file (l->data);
+	}
+
+	/* Change a file behind its back, then read it again. */
+	file = directory_files->data;
+	old_size = get_attribute (file, "size", TRUE);
+	location = nautilus_file_get_location (file);
+	path = g_file_get_path (location);
+	g_file_set_contents (path, "0123456789", 10, NULL);
+	g_chmod (path, 0600);
+	g_free (path);
+	g_object_unref (location);
+
+	nautilus_file_invalidate_attributes (file, NAUTILUS_FILE_ATTRIBUTE_INFO);
+	nautilus_file_call_when_ready (file, NAUTILUS_FILE_ATTRIBUTE_INFO,
+				       file_ready_cb, NULL);
+	wait_until_ready ();
+
+	size = get_attribute (file, "size", FALSE);
+	if (g_strcmp0 (size, old_size) == 0) {
+		g_error ("size is still \"%s\"", old_size);
+	}
+	permissions = get_attribute (file, "octal_permissions", FALSE);
+	check_same (file, "octal_permissions", permissions, "600");
+	g_free (permissions);
+	g_free (size);
+	g_free (old_size);
+
+	nautilus_file_list_free (directory_files);
+	nautilus_directory_unref (directory);
+
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (root);
+
+	return test_quit (0);
+}
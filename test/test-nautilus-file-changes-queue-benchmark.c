@@ -0,0 +1,110 @@
+/* Stress test for the file changes queue: lets file-torture.py churn a
+ * monitored directory without sleeping, then reports how many changes
+ * were queued and merged and how many notifications the directory
+ * sent for them. See test-nautilus-file-changes-queue for the check
+ * of the merged notifications.
+ *
+ * Usage: test-nautilus-file-changes-queue-benchmark [seconds [file-torture.py]]
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-directory.h>
+#include <libnautilus-private/nautilus-file-attributes.h>
+#include <libnautilus-private/nautilus-file-changes-queue.h>
+#include <signal.h>
+#include <stdlib.h>
+
+static GMainLoop *loop;
+static GPid torture_pid;
+static guint n_signals;
+static guint n_files;
+
+static void
+files_cb (NautilusDirectory *directory,
+	  GList *files)
+{
+	n_signals++;
+	n_files += g_list_length (files);
+}
+
+static gboolean
+quit_cb (gpointer data)
+{
+	g_main_loop_quit (loop);
+
+	return FALSE;
+}
+
+static gboolean
+stop_torture_cb (gpointer data)
+{
+	kill (torture_pid, SIGTERM);
+	g_spawn_close_pid (torture_pid);
+
+	/* Let the last events come in. */
+	g_timeout_add_seconds (2, quit_cb, NULL);
+
+	return FALSE;
+}
+
+int
+main (int argc, char* argv[])
+{
+	NautilusDirectory *directory;
+	GError *error;
+	char *root, *uri;
+	char *torture_argv[8];
+	int seconds;
+	guint n_queued, n_coalesced, n_batches;
+
+	test_init (&argc, &argv);
+
+	seconds = argc > 1 ? atoi (argv[1]) : 10;
+
+	root = test_make_temp_directory ("nautilus-changes-bench");
+	uri = g_filename_to_uri (root, NULL, NULL);
+
+	directory = nautilus_directory_get_by_uri (uri);
+	g_signal_connect (directory, "files-added", G_CALLBACK (files_cb), NULL);
+	g_signal_connect (directory, "files-changed", G_CALLBACK (files_cb), NULL);
+	nautilus_directory_file_monitor_add (directory, &loop, TRUE,
+					     NAUTILUS_FILE_ATTRIBUTE_INFO,
+					     NULL, NULL);
+
+	torture_argv[0] = "python";
+	torture_argv[1] = argc > 2 ? argv[2] : "file-torture.py";
+	torture_argv[2] = "-o";
+	torture_argv[3] = root;
+	torture_argv[4] = "--seed=1";
+	torture_argv[5] = "--no-sleep";
+	torture_argv[6] = NULL;
+
+	error = NULL;
+	if (!g_spawn_async (NULL, torture_argv, NULL,
+			    G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD |
+			    G_SPAWN_STDOUT_TO_DEV_NULL,
+			    NULL, NULL, &torture_pid, &error)) {
+		g_error ("Could not run %s: %s", torture_argv[1], error->message);
+	}
+
+	loop = g_main_loop_new (NULL, FALSE);
+	g_timeout_add_seconds (seconds, stop_torture_cb, NULL);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+
+	nautilus_file_changes_queue_get_statistics (&n_queued, &n_coalesced, &n_batches);
+	g_print ("%u changes queued, %u merged, %u batches sent\n",
+		 n_queued, n_coalesced, n_batches);
+	g_print ("%u directory signals for %u files (%.1f files per signal)\n",
+		 n_signals, n_files, n_signals > 0 ? (double) n_files / n_signals : 0.0);
+
+	nautilus_directory_file_monitor_remove (directory, &loop);
+	nautilus_directory_unref (directory);
+
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (root);
+
+	return test_quit (0);
+}
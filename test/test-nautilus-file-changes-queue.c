@@ -0,0 +1,264 @@
+/* Checks the notifications a monitored directory gets for changes
+ * merged in the file changes queue: an add then a remove removes,
+ * a change then an add adds, a remove then an add replaces, and
+ * repeated changes are sent once. Also checks that a partial consume
+ * sends off a limited number of changes. The files aren't touched
+ * after they are created, the directory only learns about the queued
+ * changes.
+ *
+ * Usage: test-nautilus-file-changes-queue
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-directory.h>
+#include <libnautilus-private/nautilus-file.h>
+#include <libnautilus-private/nautilus-file-attributes.h>
+#include <libnautilus-private/nautilus-file-changes-queue.h>
+
+#define N_FILES 25
+#define MAX_CHUNK 20
+#define WAIT_SECONDS 10
+
+static char *root;
+/* File names, each with the number of times it was added. */
+static GHashTable *added;
+static guint n_changed;
+
+static void
+files_added_cb (NautilusDirectory *directory,
+		GList *files)
+{
+	GList *l;
+	char *name;
+
+	for (l = files; l != NULL; l = l->next) {
+		name = nautilus_file_get_name (l->data);
+		g_hash_table_insert (added, name,
+				     GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (added, name)) + 1));
+	}
+}
+
+static void
+files_changed_cb (NautilusDirectory *directory,
+		  GList *files)
+{
+	n_changed += g_list_length (files);
+}
+
+static GFile *
+get_location (const char *name)
+{
+	char *path;
+	GFile *location;
+
+	path = g_build_filename (root, name, NULL);
+	location = g_file_new_for_path (path);
+	g_free (path);
+
+	return location;
+}
+
+typedef enum {
+	ADDED,
+	CHANGED,
+	REMOVED
+} Change;
+
+static void
+queue_change (Change change, const char *name)
+{
+	GFile *location;
+
+	location = get_location (name);
+	switch (change) {
+	case ADDED:
+		nautilus_file_changes_queue_file_added (location);
+		break;
+	case CHANGED:
+		nautilus_file_changes_queue_file_changed (location);
+		break;
+	case REMOVED:
+		nautilus_file_changes_queue_file_removed (location);
+		break;
+	}
+	g_object_unref (location);
+}
+
+static NautilusFile *
+get_file (const char *name)
+{
+	NautilusFile *file;
+	GFile *location;
+
+	location = get_location (name);
+	file = nautilus_file_get_existing (location);
+	g_object_unref (location);
+
+	if (file == NULL || nautilus_file_is_gone (file)) {
+		g_error ("%s is not in the directory", name);
+	}
+
+	return file;
+}
+
+/* Sends off the queued changes and checks how many files the
+ * directory reported changed, which it does right away.
+ */
+static void
+consume_changes (const char *label,
+		 gboolean consume_all,
+		 guint expected_changed)
+{
+	n_changed = 0;
+	nautilus_file_changes_consume_changes (consume_all);
+	if (n_changed != expected_changed) {
+		g_error ("%s: %u files changed, expected %u",
+			 label, n_changed, expected_changed);
+	}
+}
+
+static gboolean
+timed_out_cb (gpointer data)
+{
+	*(gboolean *) data = TRUE;
+
+	return FALSE;
+}
+
+/* Waits until there were n_added files added in all. Added files
+ * are only reported once their information is read.
+ */
+static void
+wait_for_added (const char *label, guint n_added)
+{
+	gboolean timed_out;
+	guint id, total;
+	GHashTableIter iter;
+	gpointer value;
+
+	timed_out = FALSE;
+	id = g_timeout_add_seconds (WAIT_SECONDS, timed_out_cb, &timed_out);
+
+	for (;;) {
+		total = 0;
+		g_hash_table_iter_init (&iter, added);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			total += GPOINTER_TO_UINT (value);
+		}
+		if (total >= n_added || timed_out) {
+			break;
+		}
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	if (total != n_added) {
+		g_error ("%s: %u files added, expected %u", label, total, n_added);
+	}
+
+	if (!timed_out) {
+		g_source_remove (id);
+	}
+}
+
+static void
+check_added (const char *label, const char *name, guint expected)
+{
+	guint n;
+
+	n = GPOINTER_TO_UINT (g_hash_table_lookup (added, name));
+	if (n != expected) {
+		g_error ("%s: %s added %u times, expected %u", label, name, n, expected);
+	}
+}
+
+/* Checks that file was removed, and lets go of it. */
+static void
+check_gone (const char *label, NautilusFile *file)
+{
+	if (!nautilus_file_is_gone (file)) {
+		g_error ("%s: file not removed", label);
+	}
+	nautilus_file_unref (file);
+}
+
+int
+main (int argc, char* argv[])
+{
+	NautilusDirectory *directory;
+	NautilusFile *file;
+	char *uri, *name;
+	guint n_coalesced, n_batches, previous_coalesced, previous_batches;
+	int i;
+
+	test_init (&argc, &argv);
+
+	root = test_make_temp_directory ("nautilus-changes-test");
+	test_make_tree (root, 0, 0, N_FILES);
+	uri = g_filename_to_uri (root, NULL, NULL);
+
+	added = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	directory = nautilus_directory_get_by_uri (uri);
+	g_signal_connect (directory, "files-added",
+			  G_CALLBACK (files_added_cb), NULL);
+	g_signal_connect (directory, "files-changed",
+			  G_CALLBACK (files_changed_cb), NULL);
+	nautilus_directory_file_monitor_add (directory, &directory, TRUE,
+					     NAUTILUS_FILE_ATTRIBUTE_INFO,
+					     NULL, NULL);
+	wait_for_added ("load", N_FILES);
+
+	/* As for a file overwritten by a copy, then deleted. */
+	file = get_file ("file-0");
+	queue_change (ADDED, "file-0");
+	queue_change (REMOVED, "file-0");
+	consume_changes ("added, removed", TRUE, 1);
+	check_gone ("added, removed", file);
+	check_added ("added, removed", "file-0", 1);
+
+	/* The directory thinks file-0 is gone, but it's still there. */
+	queue_change (CHANGED, "file-0");
+	queue_change (ADDED, "file-0");
+	consume_changes ("changed, added", TRUE, 0);
+	wait_for_added ("changed, added", N_FILES + 1);
+	check_added ("changed, added", "file-0", 2);
+
+	file = get_file ("file-1");
+	queue_change (REMOVED, "file-1");
+	queue_change (ADDED, "file-1");
+	consume_changes ("removed, added", TRUE, 1);
+	check_gone ("removed, added", file);
+	wait_for_added ("removed, added", N_FILES + 2);
+	check_added ("removed, added", "file-1", 2);
+
+	nautilus_file_changes_queue_get_statistics (NULL, &previous_coalesced, &previous_batches);
+	queue_change (CHANGED, "file-2");
+	queue_change (CHANGED, "file-2");
+	queue_change (CHANGED, "file-2");
+	consume_changes ("changed three times", TRUE, 1);
+	nautilus_file_changes_queue_get_statistics (NULL, &n_coalesced, &n_batches);
+	if (n_coalesced - previous_coalesced != 2 ||
+	    n_batches - previous_batches != 1) {
+		g_error ("changed three times: %u merged in %u batches, expected 2 in 1",
+			 n_coalesced - previous_coalesced, n_batches - previous_batches);
+	}
+
+	for (i = 0; i < N_FILES; i++) {
+		name = g_strdup_printf ("file-%d", i);
+		queue_change (CHANGED, name);
+		g_free (name);
+	}
+	consume_changes ("first chunk", FALSE, MAX_CHUNK);
+	consume_changes ("second chunk", FALSE, N_FILES - MAX_CHUNK);
+	consume_changes ("no chunk", FALSE, 0);
+
+	nautilus_directory_file_monitor_remove (directory, &directory);
+	nautilus_directory_unref (directory);
+	g_hash_table_destroy (added);
+
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (root);
+
+	return test_quit (0);
+}
@@ -0,0 +1,154 @@
+/* Times zooming an icon container full of icons: every zoom measures
+ * the labels of all icons again for the layout. The first round
+ * through the zoom levels shapes the labels, the later ones find
+ * them in the label size cache. See test-nautilus-icon-labels for the
+ * check of the sizes.
+ *
+ * Usage: test-nautilus-icon-labels-benchmark [icons [rounds]]
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-icon-canvas-item.h>
+#include <libnautilus-private/nautilus-icon-container.h>
+#include <libnautilus-private/nautilus-icon-info.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef NautilusIconContainer TestIconContainer;
+typedef NautilusIconContainerClass TestIconContainerClass;
+
+G_DEFINE_TYPE (TestIconContainer, test_icon_container, NAUTILUS_TYPE_ICON_CONTAINER);
+
+/* The icon data is the name of the icon. */
+
+static NautilusIconInfo *
+test_icon_container_get_icon_images (NautilusIconContainer *container,
+				     NautilusIconData *data,
+				     int size,
+				     char **embedded_text,
+				     gboolean for_drag_accept,
+				     gboolean need_large_embedded_text,
+				     gboolean *embedded_text_needs_loading,
+				     gboolean *has_window_open)
+{
+	*embedded_text_needs_loading = FALSE;
+	*has_window_open = FALSE;
+
+	return nautilus_icon_info_lookup_from_name ("text-x-generic", size);
+}
+
+static void
+test_icon_container_get_icon_text (NautilusIconContainer *container,
+				   NautilusIconData *data,
+				   char **editable_text,
+				   char **additional_text,
+				   gboolean include_invisible)
+{
+	*editable_text = g_strdup ((char *) data);
+	*additional_text = NULL;
+}
+
+static char *
+test_icon_container_get_icon_description (NautilusIconContainer *container,
+					  NautilusIconData *data)
+{
+	return NULL;
+}
+
+static int
+test_icon_container_compare_icons (NautilusIconContainer *container,
+				   NautilusIconData *icon_a,
+				   NautilusIconData *icon_b)
+{
+	return strcmp ((char *) icon_a, (char *) icon_b);
+}
+
+static char *
+test_icon_container_get_container_uri (NautilusIconContainer *container)
+{
+	return g_strdup ("file:///");
+}
+
+static void
+test_icon_container_class_init (TestIconContainerClass *class)
+{
+	class->get_icon_images = test_icon_container_get_icon_images;
+	class->get_icon_text = test_icon_container_get_icon_text;
+	class->get_icon_description = test_icon_container_get_icon_description;
+	class->compare_icons = test_icon_container_compare_icons;
+	class->compare_icons_by_name = test_icon_container_compare_icons;
+	class->get_container_uri = test_icon_container_get_container_uri;
+}
+
+static void
+test_icon_container_init (TestIconContainer *container)
+{
+}
+
+static void
+time_zoom (NautilusIconContainer *container, const char *label)
+{
+	GTimer *timer;
+	guint hits, misses, previous_hits, previous_misses;
+	int level, n_zooms;
+
+	nautilus_icon_canvas_item_get_label_size_cache_statistics (&previous_hits, &previous_misses);
+
+	timer = g_timer_new ();
+	n_zooms = 0;
+	for (level = NAUTILUS_ZOOM_LEVEL_SMALLEST; level <= NAUTILUS_ZOOM_LEVEL_LARGEST; level++) {
+		nautilus_icon_container_set_zoom_level (container, level);
+		nautilus_icon_container_layout_now (container);
+		n_zooms++;
+	}
+
+	nautilus_icon_canvas_item_get_label_size_cache_statistics (&hits, &misses);
+	g_print ("%s: %d zooms in %.3f s (%.1f ms per zoom), %u hits, %u misses\n",
+		 label, n_zooms, g_timer_elapsed (timer, NULL),
+		 g_timer_elapsed (timer, NULL) * 1000 / n_zooms,
+		 hits - previous_hits, misses - previous_misses);
+	g_timer_destroy (timer);
+}
+
+int
+main (int argc, char* argv[])
+{
+	GtkWidget *window, *scrolled_window, *container;
+	char **names;
+	int n_icons, rounds, i;
+
+	test_init (&argc, &argv);
+
+	n_icons = argc > 1 ? atoi (argv[1]) : 20000;
+	rounds = argc > 2 ? atoi (argv[2]) : 3;
+
+	window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size (GTK_WINDOW (window), 800, 600);
+	scrolled_window = gtk_scrolled_window_new (NULL, NULL);
+	gtk_container_add (GTK_CONTAINER (window), scrolled_window);
+	container = g_object_new (test_icon_container_get_type (), NULL);
+	gtk_container_add (GTK_CONTAINER (scrolled_window), container);
+	gtk_widget_show_all (window);
+
+	names = g_new (char *, n_icons);
+	for (i = 0; i < n_icons; i++) {
+		names[i] = g_strdup_printf ("Some document with a long name-%d.txt", i);
+		nautilus_icon_container_add (NAUTILUS_ICON_CONTAINER (container),
+					     NAUTILUS_ICON_CONTAINER_ICON_DATA (names[i]));
+	}
+	nautilus_icon_container_layout_now (NAUTILUS_ICON_CONTAINER (container));
+
+	time_zoom (NAUTILUS_ICON_CONTAINER (container), "first round");
+	for (i = 1; i < rounds; i++) {
+		time_zoom (NAUTILUS_ICON_CONTAINER (container), "later round");
+	}
+
+	gtk_widget_destroy (window);
+	for (i = 0; i < n_icons; i++) {
+		g_free (names[i]);
+	}
+	g_free (names);
+
+	return test_quit (0);
+}
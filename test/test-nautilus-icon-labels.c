@@ -0,0 +1,206 @@
+/* Checks that the label sizes icons share through the label size
+ * cache are those they measure on their own, at every zoom level.
+ * Many icons have the same name, so that they share entries.
+ *
+ * Usage: test-nautilus-icon-labels [icons]
+ */
+
+#include "test.h"
+
+#include <eel/eel-canvas.h>
+#include <libnautilus-private/nautilus-icon-canvas-item.h>
+#include <libnautilus-private/nautilus-icon-container.h>
+#include <libnautilus-private/nautilus-icon-info.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef NautilusIconContainer TestIconContainer;
+typedef NautilusIconContainerClass TestIconContainerClass;
+
+G_DEFINE_TYPE (TestIconContainer, test_icon_container, NAUTILUS_TYPE_ICON_CONTAINER);
+
+/* The icon data is the name of the icon. */
+
+static NautilusIconInfo *
+test_icon_container_get_icon_images (NautilusIconContainer *container,
+				     NautilusIconData *data,
+				     int size,
+				     char **embedded_text,
+				     gboolean for_drag_accept,
+				     gboolean need_large_embedded_text,
+				     gboolean *embedded_text_needs_loading,
+				     gboolean *has_window_open)
+{
+	*embedded_text_needs_loading = FALSE;
+	*has_window_open = FALSE;
+
+	return nautilus_icon_info_lookup_from_name ("text-x-generic", size);
+}
+
+static void
+test_icon_container_get_icon_text (NautilusIconContainer *container,
+				   NautilusIconData *data,
+				   char **editable_text,
+				   char **additional_text,
+				   gboolean include_invisible)
+{
+	*editable_text = g_strdup ((char *) data);
+	*additional_text = g_strdup_printf ("%d bytes", (int) strlen ((char *) data));
+}
+
+static char *
+test_icon_container_get_icon_description (NautilusIconContainer *container,
+					  NautilusIconData *data)
+{
+	return NULL;
+}
+
+static int
+test_icon_container_compare_icons (NautilusIconContainer *container,
+				   NautilusIconData *icon_a,
+				   NautilusIconData *icon_b)
+{
+	return strcmp ((char *) icon_a, (char *) icon_b);
+}
+
+static char *
+test_icon_container_get_container_uri (NautilusIconContainer *container)
+{
+	return g_strdup ("file:///");
+}
+
+static void
+test_icon_container_class_init (TestIconContainerClass *class)
+{
+	class->get_icon_images = test_icon_container_get_icon_images;
+	class->get_icon_text = test_icon_container_get_icon_text;
+	class->get_icon_description = test_icon_container_get_icon_description;
+	class->compare_icons = test_icon_container_compare_icons;
+	class->compare_icons_by_name = test_icon_container_compare_icons;
+	class->get_container_uri = test_icon_container_get_container_uri;
+}
+
+static void
+test_icon_container_init (TestIconContainer *container)
+{
+}
+
+/* Measures the labels of all icons again and returns their text
+ * rectangles, for display and for layout, in canvas order. Unless
+ * shared is set, each icon measures its labels on its own.
+ */
+static GArray *
+measure_labels (NautilusIconContainer *container, gboolean shared)
+{
+	GArray *rectangles;
+	GList *l;
+	NautilusIconCanvasItem *item;
+	EelDRect rectangle;
+
+	rectangles = g_array_new (FALSE, FALSE, sizeof (EelDRect));
+	for (l = eel_canvas_root (EEL_CANVAS (container))->item_list; l != NULL; l = l->next) {
+		if (!NAUTILUS_IS_ICON_CANVAS_ITEM (l->data)) {
+			continue;
+		}
+		item = l->data;
+
+		if (!shared) {
+			nautilus_icon_canvas_item_clear_label_size_cache ();
+		}
+		nautilus_icon_canvas_item_invalidate_label_size (item);
+		rectangle = nautilus_icon_canvas_item_get_text_rectangle (item, FALSE);
+		g_array_append_val (rectangles, rectangle);
+		rectangle = nautilus_icon_canvas_item_get_text_rectangle (item, TRUE);
+		g_array_append_val (rectangles, rectangle);
+	}
+
+	return rectangles;
+}
+
+static void
+check_zoom_level (NautilusIconContainer *container,
+		  NautilusZoomLevel level,
+		  int n_icons)
+{
+	GArray *shared, *own;
+	EelDRect *a, *b;
+	guint hits, misses, previous_hits, previous_misses, i;
+
+	nautilus_icon_container_set_zoom_level (container, level);
+	nautilus_icon_container_layout_now (container);
+
+	/* Measuring again only finds shared sizes. */
+	g_array_free (measure_labels (container, TRUE), TRUE);
+	nautilus_icon_canvas_item_get_label_size_cache_statistics (&previous_hits, &previous_misses);
+	shared = measure_labels (container, TRUE);
+	nautilus_icon_canvas_item_get_label_size_cache_statistics (&hits, &misses);
+	if (misses != previous_misses || hits - previous_hits < (guint) n_icons) {
+		g_error ("zoom level %d: %u hits, %u misses for %d icons",
+			 level, hits - previous_hits, misses - previous_misses, n_icons);
+	}
+
+	own = measure_labels (container, FALSE);
+	if (shared->len != 2 * (guint) n_icons || own->len != shared->len) {
+		g_error ("zoom level %d: %u and %u rectangles for %d icons",
+			 level, shared->len, own->len, n_icons);
+	}
+
+	for (i = 0; i < shared->len; i++) {
+		a = &g_array_index (shared, EelDRect, i);
+		b = &g_array_index (own, EelDRect, i);
+		if (a->x0 != b->x0 || a->y0 != b->y0 ||
+		    a->x1 != b->x1 || a->y1 != b->y1) {
+			g_error ("zoom level %d, icon %u: shared label size %gx%g, measured %gx%g",
+				 level, i / 2,
+				 a->x1 - a->x0, a->y1 - a->y0,
+				 b->x1 - b->x0, b->y1 - b->y0);
+		}
+	}
+
+	g_array_free (shared, TRUE);
+	g_array_free (own, TRUE);
+}
+
+int
+main (int argc, char* argv[])
+{
+	GtkWidget *window, *scrolled_window, *container;
+	char **names;
+	int n_icons, level, i;
+
+	test_init (&argc, &argv);
+
+	n_icons = argc > 1 ? atoi (argv[1]) : 200;
+
+	window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size (GTK_WINDOW (window), 800, 600);
+	scrolled_window = gtk_scrolled_window_new (NULL, NULL);
+	gtk_container_add (GTK_CONTAINER (window), scrolled_window);
+	container = g_object_new (test_icon_container_get_type (), NULL);
+	gtk_container_add (GTK_CONTAINER (scrolled_window), container);
+	gtk_widget_show_all (window);
+
+	/* Short names, and long ones that wrap, every one ten times. */
+	names = g_new (char *, n_icons);
+	for (i = 0; i < n_icons; i++) {
+		if (i % 2 == 0) {
+			names[i] = g_strdup_printf ("file-%d", i % 20);
+		} else {
+			names[i] = g_strdup_printf ("Some document with a fairly long name that wraps-%d.txt", i % 20);
+		}
+		nautilus_icon_container_add (NAUTILUS_ICON_CONTAINER (container),
+					     NAUTILUS_ICON_CONTAINER_ICON_DATA (names[i]));
+	}
+
+	for (level = NAUTILUS_ZOOM_LEVEL_SMALLEST; level <= NAUTILUS_ZOOM_LEVEL_LARGEST; level++) {
+		check_zoom_level (NAUTILUS_ICON_CONTAINER (container), level, n_icons);
+	}
+
+	gtk_widget_destroy (window);
+	for (i = 0; i < n_icons; i++) {
+		g_free (names[i]);
+	}
+	g_free (names);
+
+	return test_quit (0);
+}
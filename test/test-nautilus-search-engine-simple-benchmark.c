@@ -0,0 +1,102 @@
+/* Times the simple search engine on a synthetic directory tree with
+ * different numbers of crawler threads. See
+ * test-nautilus-search-engine-simple for the check of the results.
+ *
+ * Usage: test-nautilus-search-engine-simple-benchmark [depth [fanout [files]]]
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-search-engine-simple.h>
+#include <stdlib.h>
+
+static GMainLoop *loop;
+static int n_hits;
+
+static void
+hits_added_cb (NautilusSearchEngine *engine, GList *hits)
+{
+	n_hits += g_list_length (hits);
+}
+
+static void
+finished_cb (NautilusSearchEngine *engine)
+{
+	g_main_loop_quit (loop);
+}
+
+static double
+run_search (const char *uri, guint n_threads)
+{
+	NautilusSearchEngine *engine;
+	NautilusQuery *query;
+	GTimer *timer;
+	double elapsed;
+
+	engine = nautilus_search_engine_simple_new ();
+	nautilus_search_engine_simple_set_n_threads (NAUTILUS_SEARCH_ENGINE_SIMPLE (engine),
+						     n_threads);
+	g_signal_connect (engine, "hits-added",
+			  G_CALLBACK (hits_added_cb), NULL);
+	g_signal_connect (engine, "finished",
+			  G_CALLBACK (finished_cb), NULL);
+
+	query = nautilus_query_new ();
+	nautilus_query_set_text (query, "file-1");
+	nautilus_query_set_location (query, uri);
+	nautilus_search_engine_set_query (engine, query);
+	g_object_unref (query);
+
+	n_hits = 0;
+	timer = g_timer_new ();
+	nautilus_search_engine_start (engine);
+	g_main_loop_run (loop);
+	elapsed = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	g_object_unref (engine);
+
+	return elapsed;
+}
+
+int 
+main (int argc, char* argv[])
+{
+	static const guint thread_counts[] = { 1, 2, 4, 8 };
+	char *root, *uri;
+	int depth, fanout, n_files;
+	double elapsed, base;
+	guint i;
+
+	test_init (&argc, &argv);
+
+	depth = argc > 1 ? atoi (argv[1]) : 4;
+	fanout = argc > 2 ? atoi (argv[2]) : 6;
+	n_files = argc > 3 ? atoi (argv[3]) : 20;
+
+	root = test_make_temp_directory ("nautilus-search-bench");
+	test_make_tree (root, depth, fanout, n_files);
+	uri = g_filename_to_uri (root, NULL, NULL);
+
+	loop = g_main_loop_new (NULL, FALSE);
+
+	/* Warm up the dentry cache so the first run isn't penalized. */
+	run_search (uri, 1);
+
+	base = 0;
+	for (i = 0; i < G_N_ELEMENTS (thread_counts); i++) {
+		elapsed = run_search (uri, thread_counts[i]);
+		if (i == 0) {
+			base = elapsed;
+		}
+		g_print ("%u thread(s): %.3f s, %d hits, speedup %.2fx\n",
+			 thread_counts[i], elapsed, n_hits, base / elapsed);
+	}
+
+	g_main_loop_unref (loop);
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (root);
+
+	return test_quit (0);
+}
@@ -0,0 +1,116 @@
+/* Checks that the simple search engine finds every match in a
+ * directory tree exactly once, whatever the number of crawler threads.
+ * The tree has a link back to its root, which must not be crawled
+ * again.
+ *
+ * Usage: test-nautilus-search-engine-simple [depth [fanout]]
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-search-engine-simple.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Matches file-1 and file-10 to file-19 in each directory. */
+#define N_FILES 20
+#define HITS_PER_DIRECTORY 11
+
+static GMainLoop *loop;
+static GHashTable *hits;
+
+static void
+hits_added_cb (NautilusSearchEngine *engine, GList *uris)
+{
+	GList *l;
+
+	for (l = uris; l != NULL; l = l->next) {
+		if (g_hash_table_lookup_extended (hits, l->data, NULL, NULL)) {
+			g_error ("%s found twice", (char *) l->data);
+		}
+		g_hash_table_insert (hits, g_strdup (l->data), NULL);
+	}
+}
+
+static void
+finished_cb (NautilusSearchEngine *engine)
+{
+	g_main_loop_quit (loop);
+}
+
+static void
+run_search (const char *uri, guint n_threads)
+{
+	NautilusSearchEngine *engine;
+	NautilusQuery *query;
+
+	engine = nautilus_search_engine_simple_new ();
+	nautilus_search_engine_simple_set_n_threads (NAUTILUS_SEARCH_ENGINE_SIMPLE (engine),
+						     n_threads);
+	g_signal_connect (engine, "hits-added",
+			  G_CALLBACK (hits_added_cb), NULL);
+	g_signal_connect (engine, "finished",
+			  G_CALLBACK (finished_cb), NULL);
+
+	query = nautilus_query_new ();
+	nautilus_query_set_text (query, "FILE-1");
+	nautilus_query_set_location (query, uri);
+	nautilus_search_engine_set_query (engine, query);
+	g_object_unref (query);
+
+	g_hash_table_remove_all (hits);
+	nautilus_search_engine_start (engine);
+	g_main_loop_run (loop);
+
+	g_object_unref (engine);
+}
+
+int
+main (int argc, char* argv[])
+{
+	static const guint thread_counts[] = { 1, 2, 4, 8 };
+	char *root, *link, *uri;
+	int depth, fanout, n_directories, level_size, i;
+	guint n;
+
+	test_init (&argc, &argv);
+
+	depth = argc > 1 ? atoi (argv[1]) : 2;
+	fanout = argc > 2 ? atoi (argv[2]) : 3;
+
+	root = test_make_temp_directory ("nautilus-search-test");
+	test_make_tree (root, depth, fanout, N_FILES);
+	link = g_build_filename (root, "dir-0", "loop", NULL);
+	if (symlink (root, link) != 0) {
+		g_error ("Could not create %s", link);
+	}
+	uri = g_filename_to_uri (root, NULL, NULL);
+
+	n_directories = 0;
+	level_size = 1;
+	for (i = 0; i <= depth; i++) {
+		n_directories += level_size;
+		level_size *= fanout;
+	}
+
+	loop = g_main_loop_new (NULL, FALSE);
+	hits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	for (n = 0; n < G_N_ELEMENTS (thread_counts); n++) {
+		run_search (uri, thread_counts[n]);
+		if (g_hash_table_size (hits) != (guint) (n_directories * HITS_PER_DIRECTORY)) {
+			g_error ("%u thread(s): %u hits, expected %d",
+				 thread_counts[n], g_hash_table_size (hits),
+				 n_directories * HITS_PER_DIRECTORY);
+		}
+	}
+
+	g_hash_table_destroy (hits);
+	g_main_loop_unref (loop);
+	test_remove_tree (root);
+	g_free (uri);
+	g_free (link);
+	g_free (root);
+
+	return test_quit (0);
+}
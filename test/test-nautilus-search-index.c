@@ -0,0 +1,291 @@
+/* Checks the results of file name index queries, as built, after it
+ * is told about added, removed and moved files, after files are added
+ * and removed without telling it, and after it is told that a
+ * directory changed. The index covers $HOME, which
+ * is pointed at a scratch tree along with the cache directory the
+ * index is written to.
+ *
+ * Usage: test-nautilus-search-index
+ */
+
+#include "test.h"
+
+#include <libnautilus-private/nautilus-directory-notify.h>
+#include <libnautilus-private/nautilus-search-index.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <utime.h>
+
+static char *home;
+static GList *hits;
+static gboolean finished;
+
+static GFile *
+get_location (const char *path)
+{
+	GFile *root, *location;
+
+	root = g_file_new_for_path (home);
+	location = g_file_resolve_relative_path (root, path);
+	g_object_unref (root);
+
+	return location;
+}
+
+static void
+hits_cb (GList *uris,
+	 gboolean query_finished,
+	 gpointer callback_data)
+{
+	GList *l;
+
+	for (l = uris; l != NULL; l = l->next) {
+		hits = g_list_prepend (hits, g_filename_from_uri (l->data, NULL, NULL));
+	}
+	finished = query_finished;
+}
+
+/* Checks that the query finds the files in expected, given as sorted
+ * paths relative to $HOME separated by spaces.
+ */
+static void
+check_query (const char *path,
+	     const char *word,
+	     const char *expected)
+{
+	GCancellable *cancellable;
+	GFile *location;
+	GString *found;
+	GList *l;
+	char *words[2];
+
+	location = get_location (path);
+	cancellable = g_cancellable_new ();
+	words[0] = (char *) word;
+	words[1] = NULL;
+
+	finished = FALSE;
+	nautilus_search_index_query_async (location, words, cancellable, hits_cb, NULL);
+	while (!finished) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	hits = g_list_sort (hits, (GCompareFunc) strcmp);
+	found = g_string_new (NULL);
+	for (l = hits; l != NULL; l = l->next) {
+		if (!g_str_has_prefix (l->data, home)) {
+			g_error ("%s is not in %s", (char *) l->data, home);
+		}
+		if (found->len > 0) {
+			g_string_append_c (found, ' ');
+		}
+		g_string_append (found, (char *) l->data + strlen (home) + 1);
+	}
+
+	if (strcmp (found->str, expected) != 0) {
+		g_error ("\"%s\" in \"%s\" found \"%s\", expected \"%s\"",
+			 word, path, found->str, expected);
+	}
+
+	g_string_free (found, TRUE);
+	g_list_free_full (hits, g_free);
+	hits = NULL;
+	g_object_unref (cancellable);
+	g_object_unref (location);
+}
+
+static char *
+get_path (const char *path)
+{
+	return g_build_filename (home, path, NULL);
+}
+
+static void
+make_file (const char *path)
+{
+	char *full_path;
+
+	full_path = get_path (path);
+	test_make_file (full_path);
+	g_free (full_path);
+}
+
+static void
+remove_file (const char *path)
+{
+	char *full_path;
+
+	full_path = get_path (path);
+	test_remove_tree (full_path);
+	g_free (full_path);
+}
+
+static void
+move_file (const char *from, const char *to)
+{
+	char *from_path, *to_path;
+
+	from_path = get_path (from);
+	to_path = get_path (to);
+	if (g_rename (from_path, to_path) != 0) {
+		g_error ("Could not move %s to %s", from_path, to_path);
+	}
+	g_free (to_path);
+	g_free (from_path);
+}
+
+static void
+set_mtime (const char *path, time_t mtime)
+{
+	struct utimbuf times;
+	char *full_path;
+
+	full_path = get_path (path);
+	times.actime = mtime;
+	times.modtime = mtime;
+	if (g_utime (full_path, &times) != 0) {
+		g_error ("Could not set the times of %s", full_path);
+	}
+	g_free (full_path);
+}
+
+static void
+notify_changed (const char *path)
+{
+	GFile *location;
+
+	location = get_location (path);
+	nautilus_search_index_notify_directory_changed (location);
+	g_object_unref (location);
+}
+
+static void
+notify_added (const char *path)
+{
+	GList *files;
+
+	make_file (path);
+	files = g_list_prepend (NULL, get_location (path));
+	nautilus_search_index_notify_files_added (files);
+	g_list_free_full (files, g_object_unref);
+}
+
+static void
+notify_removed (const char *path)
+{
+	GList *files;
+
+	remove_file (path);
+	files = g_list_prepend (NULL, get_location (path));
+	nautilus_search_index_notify_files_removed (files);
+	g_list_free_full (files, g_object_unref);
+}
+
+static void
+notify_moved (const char *from, const char *to)
+{
+	GFilePair pair;
+	GList *pairs;
+
+	move_file (from, to);
+	pair.from = get_location (from);
+	pair.to = get_location (to);
+	pairs = g_list_prepend (NULL, &pair);
+	nautilus_search_index_notify_files_moved (pairs);
+	g_list_free (pairs);
+	g_object_unref (pair.from);
+	g_object_unref (pair.to);
+}
+
+int
+main (int argc, char* argv[])
+{
+	char *root, *cache;
+	GFile *location;
+
+	root = test_make_temp_directory ("nautilus-index-test");
+	home = g_build_filename (root, "home", NULL);
+	cache = g_build_filename (root, "cache", NULL);
+	g_setenv ("HOME", home, TRUE);
+	g_setenv ("XDG_CACHE_HOME", cache, TRUE);
+
+	test_init (&argc, &argv);
+
+	make_file ("docs/report-a.txt");
+	make_file ("docs/old/report-b.txt");
+	make_file ("music/song.ogg");
+	make_file ("videos/clip-a.ogv");
+	make_file (".hidden/report-h.txt");
+
+	nautilus_search_index_ensure ();
+	location = get_location ("");
+	while (!nautilus_search_index_covers (location)) {
+		g_main_context_iteration (NULL, TRUE);
+	}
+	g_object_unref (location);
+
+	check_query ("", "report", "docs/old/report-b.txt docs/report-a.txt");
+	check_query ("docs/old", "report", "docs/old/report-b.txt");
+	/* Too short for the trigrams, every entry is looked at. */
+	check_query ("", "re", "docs/old/report-b.txt docs/report-a.txt");
+
+	notify_added ("docs/report-c.txt");
+	check_query ("", "report", "docs/old/report-b.txt docs/report-a.txt docs/report-c.txt");
+
+	notify_removed ("docs/report-a.txt");
+	check_query ("", "report", "docs/old/report-b.txt docs/report-c.txt");
+
+	notify_moved ("docs", "papers");
+	check_query ("", "report", "papers/old/report-b.txt papers/report-c.txt");
+	check_query ("papers/old", "report", "papers/old/report-b.txt");
+	check_query ("", "papers", "papers");
+	check_query ("", "docs", "");
+
+	notify_moved ("papers/report-c.txt", "music/report-c.txt");
+	check_query ("", "report", "music/report-c.txt papers/old/report-b.txt");
+
+	/* An entry of a moved directory moved again. */
+	notify_moved ("papers/old", "music/old");
+	check_query ("", "report", "music/old/report-b.txt music/report-c.txt");
+	check_query ("papers", "report", "");
+
+	notify_removed ("music");
+	check_query ("", "report", "");
+	check_query ("", "song", "");
+
+	/* Modification times only move on with the clock tick, make
+	 * sure the next changes show.
+	 */
+	g_usleep (G_USEC_PER_SEC / 10);
+
+	make_file ("papers/new/report-e.txt");
+	make_file ("videos/clip-b.ogv");
+	remove_file ("videos/clip-a.ogv");
+	check_query ("papers", "report", "papers/new/report-e.txt");
+	check_query ("", "clip", "videos/clip-b.ogv");
+	check_query ("", "new", "papers/new");
+
+	g_usleep (G_USEC_PER_SEC / 10);
+
+	remove_file ("papers/new");
+	check_query ("", "report", "");
+
+	/* A change the modification time doesn't show, as when a
+	 * monitor drops its events, is only seen when the index is
+	 * told.
+	 */
+	set_mtime ("videos", 1000000);
+	check_query ("", "clip", "videos/clip-b.ogv");
+	make_file ("videos/clip-c.ogv");
+	set_mtime ("videos", 1000000);
+	check_query ("", "clip", "videos/clip-b.ogv");
+	notify_changed ("videos");
+	check_query ("", "clip", "videos/clip-b.ogv videos/clip-c.ogv");
+
+	test_remove_tree (root);
+	g_free (cache);
+	g_free (home);
+	g_free (root);
+
+	return test_quit (0);
+}
@@ -1,4 +1,5 @@
 #include "test.h"
+#include <glib/gstdio.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -115,3 +116,90 @@ test_window_set_title_with_pid (GtkWindow *window,
 	g_free (tmp);
 }
 
+
+/* Returns a new, empty directory in the temporary directory. */
+char *
+test_make_temp_directory (const char *name)
+{
+	char *template, *path;
+
+	template = g_strdup_printf ("%s-XXXXXX", name);
+	path = g_build_filename (g_get_tmp_dir (), template, NULL);
+	g_free (template);
+
+	if (g_mkdtemp (path) == NULL) {
+		g_error ("Could not create %s", path);
+	}
+
+	return path;
+}
+
+/* Creates an empty file, and the directories leading to it. */
+void
+test_make_file (const char *path)
+{
+	char *dirname;
+
+	dirname = g_path_get_dirname (path);
+	g_mkdir_with_parents (dirname, 0755);
+	g_free (dirname);
+
+	if (!g_file_set_contents (path, "", 0, NULL)) {
+		g_error ("Could not create %s", path);
+	}
+}
+
+/* Creates n_files files named file-<n> in path and, down to depth,
+ * fanout directories named dir-<n> holding the same again.
+ */
+void
+test_make_tree (const char *path,
+		int depth,
+		int fanout,
+		int n_files)
+{
+	char *child;
+	int i;
+
+	g_mkdir_with_parents (path, 0755);
+
+	for (i = 0; i < n_files; i++) {
+		child = g_strdup_printf ("%s/file-%d", path, i);
+		test_make_file (child);
+		g_free (child);
+	}
+
+	if (depth == 0) {
+		return;
+	}
+
+	for (i = 0; i < fanout; i++) {
+		child = g_strdup_printf ("%s/dir-%d", path, i);
+		test_make_tree (child, depth - 1, fanout, n_files);
+		g_free (child);
+	}
+}
+
+void
+test_remove_tree (const char *path)
+{
+	GDir *dir;
+	const char *name;
+	char *child;
+
+	/* Don't follow links out of the tree. */
+	dir = NULL;
+	if (!g_file_test (path, G_FILE_TEST_IS_SYMLINK)) {
+		dir = g_dir_open (path, 0, NULL);
+	}
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			child = g_build_filename (path, name, NULL);
+			test_remove_tree (child);
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+
+	g_remove (path);
+}
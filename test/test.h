@@ -35,4 +35,13 @@ void       test_pixbuf_draw_rectangle_tiled     (GdkPixbuf                   *pi
 void       test_window_set_title_with_pid       (GtkWindow                   *window,
 						 const char                  *title);
 
+/* Scratch file trees for the tests that need real files. */
+char *     test_make_temp_directory             (const char                  *name);
+void       test_make_file                       (const char                  *path);
+void       test_make_tree                       (const char                  *path,
+						 int                          depth,
+						 int                          fanout,
+						 int                          n_files);
+void       test_remove_tree                     (const char                  *path);
+
 #endif /* TEST_H */